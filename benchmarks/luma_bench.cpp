@@ -0,0 +1,418 @@
+// Benchmark harness for the interpreter's hot paths (the `bench` target).
+//
+// Every benchmarks/*.lu script starts with a header of `// key: value`
+// comment lines:
+//
+//   // bench: loops          name (defaults to the file name)
+//   // ops: 1000000          operations one run performs
+//   // mode: fresh           optional, see below
+//   // setup: tcp_pair       optional, see below
+//
+// By default the script is executed once to set up its state, untimed, and
+// each timed run then calls its `run()` function. With `mode: fresh` the
+// whole script is the workload and every run uses a new interpreter, which
+// is what module loading needs. `setup: tcp_pair` connects two loopback TCP
+// sockets first and passes them in as CLIENT_FD and SERVER_FD.
+//
+// Results are ops/sec per run, reported as mean, standard deviation, min and
+// max. --json writes them in the format --baseline reads back, so two builds
+// can be compared:
+//
+//   luma_bench --json base.json            (on the old build)
+//   luma_bench --baseline base.json        (on the new one)
+
+#include "luma.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  std::string dir = "benchmarks";
+  int runs = 10;
+  int warmup = 1;
+  bool vm = false;
+  bool optimize = false;
+  std::string jsonPath;
+  std::string baselinePath;
+  std::vector<std::string> filters;
+  std::string executable;
+};
+
+struct Benchmark {
+  std::string name;
+  fs::path path;
+  double ops = 1;
+  bool fresh = false;
+  bool tcpPair = false;
+};
+
+struct Result {
+  std::string name;
+  double ops = 0;
+  double mean = 0; // ops/sec
+  double stddev = 0;
+  double min = 0;
+  double max = 0;
+};
+
+struct Baseline {
+  double mean = 0;
+  double stddev = 0;
+};
+
+void usage() {
+  std::cerr
+      << "Usage: luma_bench [options] [name...]\n"
+         "Options:\n"
+         "  --dir DIR        benchmark scripts (default: benchmarks)\n"
+         "  --runs N         timed runs per benchmark (default: 10)\n"
+         "  --warmup N       untimed runs before them (default: 1)\n"
+         "  --vm             run on the bytecode VM\n"
+         "  -O               enable the optimization pass\n"
+         "  --json FILE      write results as JSON (- for stdout)\n"
+         "  --baseline FILE  compare with the results of an earlier --json\n"
+         "Names select benchmarks by substring; all run by default.\n";
+}
+
+bool parseBenchmark(const fs::path &path, Benchmark &bench) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  bench.name = path.stem().string();
+  bench.path = path;
+  std::string line;
+  while (std::getline(in, line) && line.rfind("//", 0) == 0) {
+    const auto colon = line.find(':');
+    if (colon == std::string::npos)
+      continue;
+    std::string key = line.substr(2, colon - 2);
+    std::string value = line.substr(colon + 1);
+    key.erase(0, key.find_first_not_of(' '));
+    value.erase(0, value.find_first_not_of(' '));
+    if (key == "bench")
+      bench.name = value;
+    else if (key == "ops")
+      bench.ops = std::atof(value.c_str());
+    else if (key == "mode")
+      bench.fresh = value == "fresh";
+    else if (key == "setup")
+      bench.tcpPair = value == "tcp_pair";
+  }
+  return bench.ops > 0;
+}
+
+// A connected loopback TCP pair; false (and nothing left open) on failure.
+bool tcpPair(int &client, int &server) {
+  const int listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0)
+    return false;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  client = server = -1;
+  if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 &&
+      listen(listener, 1) == 0 &&
+      getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length) ==
+          0) {
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    if (client >= 0 &&
+        connect(client, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+            0)
+      server = accept(listener, nullptr, nullptr);
+  }
+  close(listener);
+  if (server < 0 && client >= 0)
+    close(client);
+  return server >= 0;
+}
+
+LumaInterpreter *newInterpreter(const Options &options, const Benchmark &b) {
+  LumaInterpreter *interp = luma_create();
+  luma_set_executable_path(interp, options.executable.c_str());
+  luma_set_entry_file(interp, b.path.c_str());
+  luma_set_engine(interp, options.vm ? LUMA_ENGINE_VM : LUMA_ENGINE_AST);
+  luma_set_optimize(interp, options.optimize);
+  return interp;
+}
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Seconds taken by each timed run, or empty if the script failed.
+std::vector<double> measure(const Options &options, const Benchmark &b) {
+  std::vector<double> times;
+  const int total = options.warmup + options.runs;
+
+  if (b.fresh) {
+    for (int i = 0; i < total; ++i) {
+      LumaInterpreter *interp = newInterpreter(options, b);
+      const auto start = Clock::now();
+      const int rc = luma_run_file(interp, b.path.c_str());
+      const double seconds = secondsSince(start);
+      luma_destroy(interp);
+      if (rc != 0)
+        return {};
+      if (i >= options.warmup)
+        times.push_back(seconds);
+    }
+    return times;
+  }
+
+  int client = -1, server = -1;
+  if (b.tcpPair && !tcpPair(client, server)) {
+    std::cerr << b.name << ": cannot connect a loopback TCP pair\n";
+    return {};
+  }
+  LumaInterpreter *interp = newInterpreter(options, b);
+  bool ok = true;
+  if (b.tcpPair) {
+    const std::string fds = "CLIENT_FD = " + std::to_string(client) +
+                            "\nSERVER_FD = " + std::to_string(server) + "\n";
+    ok = luma_run_string(interp, fds.c_str(), 0) == 0;
+  }
+  ok = ok && luma_run_file(interp, b.path.c_str()) == 0;
+  for (int i = 0; ok && i < total; ++i) {
+    const auto start = Clock::now();
+    ok = luma_run_string(interp, "run()", 0) == 0;
+    const double seconds = secondsSince(start);
+    if (i >= options.warmup)
+      times.push_back(seconds);
+  }
+  luma_destroy(interp);
+  if (b.tcpPair) {
+    close(client);
+    close(server);
+  }
+  if (!ok)
+    times.clear();
+  return times;
+}
+
+Result summarize(const Benchmark &b, const std::vector<double> &times) {
+  Result r;
+  r.name = b.name;
+  r.ops = b.ops;
+  std::vector<double> rates;
+  for (double t : times)
+    rates.push_back(b.ops / std::max(t, 1e-9));
+  r.min = *std::min_element(rates.begin(), rates.end());
+  r.max = *std::max_element(rates.begin(), rates.end());
+  for (double rate : rates)
+    r.mean += rate;
+  r.mean /= rates.size();
+  if (rates.size() > 1) {
+    double squares = 0;
+    for (double rate : rates)
+      squares += (rate - r.mean) * (rate - r.mean);
+    r.stddev = std::sqrt(squares / (rates.size() - 1));
+  }
+  return r;
+}
+
+std::string jsonString(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+// One benchmark per line, which is all readBaseline() relies on.
+void writeJson(std::ostream &out, const Options &options,
+               const std::vector<Result> &results) {
+  out << "{\n  \"engine\": \"" << (options.vm ? "vm" : "ast") << "\",\n"
+      << "  \"optimize\": " << (options.optimize ? "true" : "false") << ",\n"
+      << "  \"runs\": " << options.runs << ",\n  \"benchmarks\": [\n";
+  char number[64];
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    out << "    {\"name\": " << jsonString(r.name);
+    const std::pair<const char *, double> fields[] = {
+        {"ops", r.ops},     {"ops_per_sec", r.mean}, {"stddev", r.stddev},
+        {"min", r.min},     {"max", r.max}};
+    for (const auto &field : fields) {
+      std::snprintf(number, sizeof(number), "%.10g", field.second);
+      out << ", \"" << field.first << "\": " << number;
+    }
+    out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+double jsonNumber(const std::string &line, const char *key) {
+  const std::string tag = std::string("\"") + key + "\": ";
+  const auto at = line.find(tag);
+  return at == std::string::npos ? 0
+                                 : std::atof(line.c_str() + at + tag.size());
+}
+
+bool readBaseline(const std::string &path,
+                  std::map<std::string, Baseline> &baseline) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string line;
+  const std::string tag = "{\"name\": \"";
+  while (std::getline(in, line)) {
+    const auto at = line.find(tag);
+    if (at == std::string::npos)
+      continue;
+    const auto start = at + tag.size();
+    const auto end = line.find('"', start);
+    Baseline &entry = baseline[line.substr(start, end - start)];
+    entry.mean = jsonNumber(line, "ops_per_sec");
+    entry.stddev = jsonNumber(line, "stddev");
+  }
+  return true;
+}
+
+std::string formatRate(double rate) {
+  char text[32];
+  if (rate >= 1e6)
+    std::snprintf(text, sizeof(text), "%.2fM", rate / 1e6);
+  else if (rate >= 1e3)
+    std::snprintf(text, sizeof(text), "%.1fk", rate / 1e3);
+  else
+    std::snprintf(text, sizeof(text), "%.1f", rate);
+  return text;
+}
+
+// "+4.1%", flagged when the change exceeds twice the combined relative
+// standard deviation of the two measurements, i.e. is unlikely to be noise.
+std::string compare(const Result &r, const Baseline &base) {
+  if (base.mean <= 0)
+    return "";
+  const double delta = (r.mean - base.mean) / base.mean;
+  const double noise = 2 * std::hypot(r.stddev / r.mean,
+                                      base.stddev / base.mean);
+  char text[48];
+  std::snprintf(text, sizeof(text), "%+.1f%%%s", delta * 100,
+                std::fabs(delta) <= noise ? ""
+                : delta < 0               ? " slower"
+                                          : " faster");
+  return text;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  options.executable = fs::absolute(argv[0]).string();
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--dir" && hasValue) {
+      options.dir = argv[++i];
+    } else if (arg == "--runs" && hasValue) {
+      options.runs = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--warmup" && hasValue) {
+      options.warmup = std::max(0, std::atoi(argv[++i]));
+    } else if (arg == "--vm") {
+      options.vm = true;
+    } else if (arg == "-O") {
+      options.optimize = true;
+    } else if (arg == "--json" && hasValue) {
+      options.jsonPath = argv[++i];
+    } else if (arg == "--baseline" && hasValue) {
+      options.baselinePath = argv[++i];
+    } else if (arg == "--help" || arg[0] == '-') {
+      usage();
+      return arg == "--help" ? 0 : 1;
+    } else {
+      options.filters.push_back(arg);
+    }
+  }
+
+  std::vector<Benchmark> benchmarks;
+  std::error_code ec;
+  for (const auto &file : fs::directory_iterator(options.dir, ec)) {
+    Benchmark b;
+    if (file.path().extension() != ".lu" || !parseBenchmark(file.path(), b))
+      continue;
+    const bool selected =
+        options.filters.empty() ||
+        std::any_of(options.filters.begin(), options.filters.end(),
+                    [&](const std::string &f) {
+                      return b.name.find(f) != std::string::npos;
+                    });
+    if (selected)
+      benchmarks.push_back(b);
+  }
+  if (ec || benchmarks.empty()) {
+    std::cerr << "luma_bench: no benchmarks found in " << options.dir << "\n";
+    return 1;
+  }
+  std::sort(benchmarks.begin(), benchmarks.end(),
+            [](const Benchmark &a, const Benchmark &b) {
+              return a.name < b.name;
+            });
+
+  std::map<std::string, Baseline> baseline;
+  if (!options.baselinePath.empty() &&
+      !readBaseline(options.baselinePath, baseline)) {
+    std::cerr << "luma_bench: cannot read " << options.baselinePath << "\n";
+    return 1;
+  }
+
+  // With --json - the table goes to stderr so stdout stays valid JSON.
+  std::ostream &table = options.jsonPath == "-" ? std::cerr : std::cout;
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-18s %12s %8s %12s %12s  %s", "benchmark",
+                "ops/sec", "+/-", "min", "max",
+                baseline.empty() ? "" : "vs baseline");
+  table << line << "\n";
+
+  std::vector<Result> results;
+  int failures = 0;
+  for (const Benchmark &b : benchmarks) {
+    const std::vector<double> times = measure(options, b);
+    if (times.empty()) {
+      table << b.name << ": FAILED\n";
+      ++failures;
+      continue;
+    }
+    const Result r = summarize(b, times);
+    auto base = baseline.find(r.name);
+    std::snprintf(line, sizeof(line), "%-18s %12s %7.1f%% %12s %12s  %s",
+                  r.name.c_str(), formatRate(r.mean).c_str(),
+                  r.mean > 0 ? 100 * r.stddev / r.mean : 0.0,
+                  formatRate(r.min).c_str(), formatRate(r.max).c_str(),
+                  base == baseline.end() ? "" : compare(r, base->second).c_str());
+    table << line << std::endl;
+    results.push_back(r);
+  }
+
+  if (options.jsonPath == "-") {
+    writeJson(std::cout, options, results);
+  } else if (!options.jsonPath.empty()) {
+    std::ofstream out(options.jsonPath);
+    writeJson(out, options, results);
+    if (!out) {
+      std::cerr << "luma_bench: cannot write " << options.jsonPath << "\n";
+      return 1;
+    }
+  }
+  return failures ? 1 : 0;
+}
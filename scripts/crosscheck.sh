@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Runs every example with both execution engines, with and without -O, and
+# reports any difference in output or exit status. Usage: scripts/crosscheck.sh [path/to/luma]
+
+SOURCE_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+LUMA="${1:-$SOURCE_DIR/build/luma}"
+
+if [ ! -x "$LUMA" ]; then
+    echo "luma binary not found at $LUMA (pass its path as the first argument)"
+    exit 1
+fi
+
+failed=0
+for script in "$SOURCE_DIR"/examples/*.lu; do
+    ast_out=$("$LUMA" "$script" < /dev/null 2>&1)
+    ast_rc=$?
+    status="ok      "
+    # The VM and the optimizer (-O) must not change what a program does.
+    for flags in "--vm" "-O" "--vm -O"; do
+        out=$("$LUMA" $flags "$script" < /dev/null 2>&1)
+        rc=$?
+        if [ "$ast_out" != "$out" ] || [ "$ast_rc" != "$rc" ]; then
+            echo "MISMATCH $(basename "$script") with $flags (ast rc=$ast_rc, rc=$rc)"
+            diff <(echo "$ast_out") <(echo "$out") | head -20
+            status="MISMATCH"
+            failed=1
+        fi
+    done
+    if [ "$status" = "ok      " ]; then
+        echo "ok       $(basename "$script")"
+    fi
+done
+
+exit $failed
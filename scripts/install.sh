@@ -128,6 +128,14 @@ else
     log_warn "Failed to install standard library modules."
 fi
 
+# Pre-parse the modules so the first import at runtime skips parsing
+log_info "Precompiling modules..."
+if "$INSTALL_DIR/$BINARY_NAME" --compile "$MODULE_DIR"/*.lu; then
+    log_success "Precompiled modules into $MODULE_DIR/.luma_cache."
+else
+    log_warn "Some modules could not be precompiled; they will be parsed on first use."
+fi
+
 # Create symlink for luma
 if ln -sf "$INSTALL_DIR/$BINARY_NAME" "$INSTALL_DIR/$ALIAS_NAME"; then
     log_success "Created alias $ALIAS_NAME pointing to $BINARY_NAME"
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Runs every example under LeakSanitizer and reports any leak or memory
+# error. Needs a sanitizer build, for example:
+#   cmake -S . -B build-asan -DCMAKE_CXX_FLAGS="-fsanitize=address,undefined"
+#   cmake --build build-asan
+#   scripts/leakcheck.sh build-asan/luma
+# Worker isolates (@std.workers, @std.parallel) must free their own cycles
+# before their threads exit, so examples/parallel_test.lu covers them too.
+
+SOURCE_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+LUMA="${1:-$SOURCE_DIR/build-asan/luma}"
+
+if [ ! -x "$LUMA" ]; then
+    echo "luma binary not found at $LUMA (pass its path as the first argument)"
+    exit 1
+fi
+
+export ASAN_OPTIONS="detect_leaks=1:${ASAN_OPTIONS}"
+
+failed=0
+for script in "$SOURCE_DIR"/examples/*.lu; do
+    out=$("$LUMA" "$script" < /dev/null 2>&1)
+    if echo "$out" | grep -q "Sanitizer"; then
+        echo "LEAK     $(basename "$script")"
+        echo "$out" | grep -A12 -m1 "Sanitizer"
+        failed=1
+    else
+        echo "ok       $(basename "$script")"
+    fi
+done
+
+exit $failed
@@ -1,5 +1,9 @@
 #pragma once
+#include "ast_arena.hpp"
+#include "object.hpp"
+#include "source_buffer.hpp"
 #include "token.hpp"
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -7,41 +11,102 @@
 // Visibility for module exports
 enum class Visibility { Open, Closed };
 
+// ---------- Resolver annotations (see resolver.hpp) ----------
+
+// Lexical address of a variable: `depth` environments up from the current
+// one, at `index` in that environment's slot vector. A negative depth means
+// the name is looked up by name at runtime (globals, module scope and names
+// the resolver cannot pin down statically).
+struct Slot {
+  int depth = -1;
+  int index = -1;
+  bool resolved() const { return depth >= 0; }
+};
+
+// Slot layout of a block or function scope, filled in by the resolver.
+struct ScopeInfo {
+  std::vector<Symbol> names; // slot index -> variable name
+  bool receiver = false;          // method scope: slot 0 holds 'this'
+};
+
+// Per-site inline cache for property access on instances, keyed on the
+// receiver's shape id (see Shape in value.hpp). Remembers up to kSize
+// shapes, so monomorphic and lightly polymorphic sites skip the lookup.
+struct Function;
+struct Shape;
+
+struct PropertyCache {
+  struct Entry {
+    uint64_t shape = 0;               // 0 = unused
+    int slot = -1;                    // field slot, -1 for a method
+    const Function *method = nullptr; // class method (GetExpr)
+    Shape *next = nullptr;            // shape after adding the field (SetExpr)
+  };
+  static constexpr int kSize = 4;
+  Entry entries[kSize];
+  uint8_t victim = 0; // entry to replace once all are in use
+
+  const Entry *find(uint64_t shape) const {
+    for (const Entry &e : entries) {
+      if (e.shape == shape)
+        return &e;
+    }
+    return nullptr;
+  }
+
+  Entry &insert(uint64_t shape) {
+    for (Entry &e : entries) {
+      if (e.shape == 0) {
+        e.shape = shape;
+        return e;
+      }
+    }
+    Entry &e = entries[victim];
+    victim = static_cast<uint8_t>((victim + 1) % kSize);
+    e = Entry{};
+    e.shape = shape;
+    return e;
+  }
+};
+
+// Every node is allocated in the AstArena of the program it belongs to.
+template <class T> using NodePtr = AstArena::Ptr<T>;
+
 // ---------- Expressions ----------
 struct Expr {
   virtual ~Expr() = default;
 };
 
-using ExprPtr = std::unique_ptr<Expr>;
+using ExprPtr = NodePtr<Expr>;
 
 struct LiteralExpr : Expr {
   enum class Kind { Number, String, Bool, Nil };
 
   Kind kind;
   double numberValue = 0.0;
-  std::string stringValue;
+  Ref<StringObject> stringValue; // shared by every evaluation
   bool boolValue = false;
 
-  static ExprPtr number(double v) {
-    auto e = std::make_unique<LiteralExpr>();
+  static ExprPtr number(AstArena &arena, double v) {
+    auto e = arena.make<LiteralExpr>();
     e->kind = Kind::Number;
     e->numberValue = v;
     return e;
   }
-  static ExprPtr str(std::string v) {
-    auto e = std::make_unique<LiteralExpr>();
+  static ExprPtr str(AstArena &arena, std::string v) {
+    auto e = arena.make<LiteralExpr>();
     e->kind = Kind::String;
-    e->stringValue = std::move(v);
+    e->stringValue = makeRef<StringObject>(std::move(v));
     return e;
   }
-  static ExprPtr boolean(bool v) {
-    auto e = std::make_unique<LiteralExpr>();
+  static ExprPtr boolean(AstArena &arena, bool v) {
+    auto e = arena.make<LiteralExpr>();
     e->kind = Kind::Bool;
     e->boolValue = v;
     return e;
   }
-  static ExprPtr nil() {
-    auto e = std::make_unique<LiteralExpr>();
+  static ExprPtr nil(AstArena &arena) {
+    auto e = arena.make<LiteralExpr>();
     e->kind = Kind::Nil;
     return e;
   }
@@ -49,6 +114,7 @@ struct LiteralExpr : Expr {
 
 struct VariableExpr : Expr {
   Token name;
+  Slot slot;
   explicit VariableExpr(Token n) : name(std::move(n)) {}
 };
 
@@ -87,6 +153,7 @@ struct ListExpr : Expr {
 struct GetExpr : Expr {
   ExprPtr object;
   Token name;
+  mutable PropertyCache cache; // also serves calls of the form obj.m(...)
   explicit GetExpr(ExprPtr o, Token n)
       : object(std::move(o)), name(std::move(n)) {}
 };
@@ -113,12 +180,14 @@ struct SetExpr : Expr {
   ExprPtr object;
   Token name;
   ExprPtr value;
+  mutable PropertyCache cache;
   SetExpr(ExprPtr o, Token n, ExprPtr v)
       : object(std::move(o)), name(std::move(n)), value(std::move(v)) {}
 };
 
 struct ThisExpr : Expr {
   Token keyword;
+  Slot slot;
   explicit ThisExpr(Token k) : keyword(std::move(k)) {}
 };
 
@@ -134,7 +203,7 @@ struct Stmt {
   virtual ~Stmt() = default;
 };
 
-using StmtPtr = std::unique_ptr<Stmt>;
+using StmtPtr = NodePtr<Stmt>;
 
 struct ExprStmt : Stmt {
   ExprPtr expr;
@@ -149,35 +218,48 @@ struct PrintStmt : Stmt {
 struct VarAssignStmt : Stmt {
   Token name;
   ExprPtr value;
+  Slot slot;
+  // For `name = name + x` with both names bound to the same variable, the
+  // x (set by the resolver): a string only that variable holds can then
+  // grow in place instead of being copied.
+  const Expr *appended = nullptr;
   VarAssignStmt(Token n, ExprPtr v) : name(std::move(n)), value(std::move(v)) {}
 };
 
+struct Chunk; // bytecode.hpp
+
 struct BlockStmt : Stmt {
   std::vector<StmtPtr> statements;
+  // For a function body this is the function scope (receiver, parameters
+  // and locals); otherwise the block's own scope.
+  ScopeInfo scope;
+  // Bytecode for this block when it runs as a function body. Filled lazily by
+  // the VM so each body is compiled once, however many closures share it.
+  mutable std::shared_ptr<const Chunk> compiled;
   explicit BlockStmt(std::vector<StmtPtr> s) : statements(std::move(s)) {}
 };
 
 struct IfStmt : Stmt {
   ExprPtr condition;
-  std::unique_ptr<BlockStmt> thenBranch;
+  NodePtr<BlockStmt> thenBranch;
   StmtPtr
       elseBranch; // may be null, can be BlockStmt or another IfStmt (else if)
-  IfStmt(ExprPtr cond, std::unique_ptr<BlockStmt> t, StmtPtr e)
+  IfStmt(ExprPtr cond, NodePtr<BlockStmt> t, StmtPtr e)
       : condition(std::move(cond)), thenBranch(std::move(t)),
         elseBranch(std::move(e)) {}
 };
 
 struct WhileStmt : Stmt {
   ExprPtr condition;
-  std::unique_ptr<BlockStmt> body;
-  WhileStmt(ExprPtr cond, std::unique_ptr<BlockStmt> b)
+  NodePtr<BlockStmt> body;
+  WhileStmt(ExprPtr cond, NodePtr<BlockStmt> b)
       : condition(std::move(cond)), body(std::move(b)) {}
 };
 
 struct UntilStmt : Stmt {
   ExprPtr condition;
-  std::unique_ptr<BlockStmt> body;
-  UntilStmt(ExprPtr cond, std::unique_ptr<BlockStmt> b)
+  NodePtr<BlockStmt> body;
+  UntilStmt(ExprPtr cond, NodePtr<BlockStmt> b)
       : condition(std::move(cond)), body(std::move(b)) {}
 };
 
@@ -190,9 +272,10 @@ struct ReturnStmt : Stmt {
 struct FuncDefStmt : Stmt {
   Token name;
   std::vector<Token> params;
-  std::unique_ptr<BlockStmt> body;
+  NodePtr<BlockStmt> body;
   Visibility visibility = Visibility::Closed;
-  FuncDefStmt(Token n, std::vector<Token> p, std::unique_ptr<BlockStmt> b,
+  Slot slot; // where the function is bound
+  FuncDefStmt(Token n, std::vector<Token> p, NodePtr<BlockStmt> b,
               Visibility vis = Visibility::Closed)
       : name(std::move(n)), params(std::move(p)), body(std::move(b)),
         visibility(vis) {}
@@ -200,9 +283,10 @@ struct FuncDefStmt : Stmt {
 
 struct ClassStmt : Stmt {
   Token name;
-  std::vector<std::shared_ptr<FuncDefStmt>> methods;
+  std::vector<NodePtr<FuncDefStmt>> methods;
   Visibility visibility = Visibility::Closed;
-  ClassStmt(Token n, std::vector<std::shared_ptr<FuncDefStmt>> m,
+  Slot slot; // where the class is bound
+  ClassStmt(Token n, std::vector<NodePtr<FuncDefStmt>> m,
             Visibility vis = Visibility::Closed)
       : name(std::move(n)), methods(std::move(m)), visibility(vis) {}
 };
@@ -212,8 +296,8 @@ struct ClassStmt : Stmt {
 // echo N { ... } - repeat block N times
 struct EchoStmt : Stmt {
   ExprPtr count;
-  std::unique_ptr<BlockStmt> body;
-  EchoStmt(ExprPtr c, std::unique_ptr<BlockStmt> b)
+  NodePtr<BlockStmt> body;
+  EchoStmt(ExprPtr c, NodePtr<BlockStmt> b)
       : count(std::move(c)), body(std::move(b)) {}
 };
 
@@ -221,14 +305,16 @@ struct EchoStmt : Stmt {
 struct SwapStmt : Stmt {
   Token left;
   Token right;
+  Slot leftSlot;
+  Slot rightSlot;
   SwapStmt(Token l, Token r) : left(std::move(l)), right(std::move(r)) {}
 };
 
 // maybe { ... } otherwise { ... } - error handling
 struct MaybeStmt : Stmt {
-  std::unique_ptr<BlockStmt> tryBlock;
-  std::unique_ptr<BlockStmt> otherwiseBlock; // may be null
-  MaybeStmt(std::unique_ptr<BlockStmt> t, std::unique_ptr<BlockStmt> o)
+  NodePtr<BlockStmt> tryBlock;
+  NodePtr<BlockStmt> otherwiseBlock; // may be null
+  MaybeStmt(NodePtr<BlockStmt> t, NodePtr<BlockStmt> o)
       : tryBlock(std::move(t)), otherwiseBlock(std::move(o)) {}
 };
 
@@ -245,6 +331,25 @@ struct ModuleStmt : Stmt {
 struct UseStmt : Stmt {
   std::vector<Token> moduleIdParts;
   Token alias;
+  Slot slot; // where the alias is bound
   UseStmt(std::vector<Token> parts, Token a)
       : moduleIdParts(std::move(parts)), alias(std::move(a)) {}
 };
+
+// A parsed program together with the source its tokens view and the arena
+// its nodes live in. Members are destroyed in reverse order, so the
+// statements go before the memory they point into.
+struct Program {
+  SourceBuffer source;
+  AstArena arena;
+  std::vector<StmtPtr> statements;
+
+  Program() = default;
+  Program(Program &&) = default;
+  Program &operator=(Program &&other) noexcept {
+    statements = std::move(other.statements); // while their memory lives
+    arena = std::move(other.arena);
+    source = std::move(other.source);
+    return *this;
+  }
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bump allocator that owns one parsed program: its nodes and the text of
+// its non-identifier tokens live in a few large blocks, so a tree is laid
+// out roughly in parse order and is freed in one go with the arena.
+//
+// Nodes are still handed out as owning pointers (AstArena::Ptr), which run
+// the node's destructor but leave the memory to the arena. The arena must
+// therefore outlive every node made from it; see Program in ast.hpp.
+class AstArena {
+public:
+  struct Destroy {
+    template <class T> void operator()(T *node) const { node->~T(); }
+  };
+  template <class T> using Ptr = std::unique_ptr<T, Destroy>;
+
+  AstArena() = default;
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+  AstArena(AstArena &&other) noexcept { *this = std::move(other); }
+  AstArena &operator=(AstArena &&other) noexcept {
+    blocks_ = std::move(other.blocks_);
+    cursor_ = std::exchange(other.cursor_, nullptr);
+    remaining_ = std::exchange(other.remaining_, 0);
+    used_ = std::exchange(other.used_, 0);
+    return *this;
+  }
+
+  template <class T, class... Args> Ptr<T> make(Args &&...args) {
+    void *memory = allocate(sizeof(T), alignof(T));
+    return Ptr<T>(new (memory) T(std::forward<Args>(args)...));
+  }
+
+  // Copies `text` into the arena; the view stays valid as long as it does.
+  std::string_view copy(std::string_view text) {
+    if (text.empty())
+      return {};
+    char *memory = static_cast<char *>(allocate(text.size(), 1));
+    std::memcpy(memory, text.data(), text.size());
+    return {memory, text.size()};
+  }
+
+  size_t bytesUsed() const { return used_; }
+
+private:
+  static constexpr size_t kBlockSize = 16 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *cursor_ = nullptr;
+  size_t remaining_ = 0;
+  size_t used_ = 0;
+
+  void *allocate(size_t size, size_t align) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(cursor_);
+    size_t padding = (align - address % align) % align;
+    if (padding + size > remaining_) {
+      // Oversized requests get a block of their own; new[] returns memory
+      // aligned for any node type.
+      const size_t blockSize = size > kBlockSize ? size : kBlockSize;
+      blocks_.emplace_back(new char[blockSize]); // left uninitialised
+      cursor_ = blocks_.back().get();
+      remaining_ = blockSize;
+      padding = 0;
+    }
+    void *memory = cursor_ + padding;
+    cursor_ += padding + size;
+    remaining_ -= padding + size;
+    used_ += size;
+    return memory;
+  }
+};
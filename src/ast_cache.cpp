@@ -0,0 +1,781 @@
+#include "ast_cache.hpp"
+#include "crypto.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bump whenever the AST or the encoding below changes.
+constexpr uint32_t kFormatVersion = 2;
+constexpr char kImageMagic[4] = {'L', 'A', 'S', 'T'};
+constexpr char kFileMagic[4] = {'L', 'U', 'M', 'C'};
+
+enum class ExprTag : uint8_t {
+  None,
+  Literal,
+  Variable,
+  Grouping,
+  Unary,
+  Binary,
+  Call,
+  List,
+  Get,
+  Index,
+  IndexSet,
+  Set,
+  This,
+  Map,
+};
+
+enum class StmtTag : uint8_t {
+  None,
+  Expr,
+  Print,
+  VarAssign,
+  Block,
+  If,
+  While,
+  Until,
+  Return,
+  FuncDef,
+  Class,
+  Echo,
+  Swap,
+  Maybe,
+  Module,
+  Use,
+};
+
+struct Malformed {};
+
+uint64_t hashBytes(std::string_view data) { return fastHash(data); }
+
+// -------------------- encoding --------------------
+
+class Writer {
+public:
+  std::string finish(const std::vector<StmtPtr> &program) {
+    std::string body;
+    out_ = &body;
+    varint(program.size());
+    for (const auto &stmt : program)
+      statement(stmt.get());
+
+    // The string table goes first so the reader can build it up front.
+    std::string image(kImageMagic, sizeof(kImageMagic));
+    out_ = &image;
+    u32(kFormatVersion);
+    varint(strings_.size());
+    for (std::string_view s : strings_)
+      string(s);
+    image += body;
+    return image;
+  }
+
+private:
+  std::string *out_ = nullptr;
+  std::unordered_map<std::string_view, size_t> stringIds_;
+  std::vector<std::string_view> strings_;
+
+  void byte(uint8_t b) { out_->push_back(static_cast<char>(b)); }
+  void u32(uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      byte(static_cast<uint8_t>(v >> (8 * i)));
+  }
+  void varint(uint64_t v) {
+    while (v >= 0x80) {
+      byte(static_cast<uint8_t>(v | 0x80));
+      v >>= 7;
+    }
+    byte(static_cast<uint8_t>(v));
+  }
+  void svarint(int64_t v) {
+    varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+  }
+  void number(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    for (int i = 0; i < 8; ++i)
+      byte(static_cast<uint8_t>(bits >> (8 * i)));
+  }
+  void string(std::string_view s) {
+    varint(s.size());
+    out_->append(s);
+  }
+  // Identifiers repeat constantly, so tokens refer to a table entry.
+  void stringRef(std::string_view s) {
+    auto [it, inserted] = stringIds_.emplace(s, strings_.size());
+    if (inserted) {
+      strings_.push_back(s);
+    }
+    varint(it->second);
+  }
+
+  void token(const Token &t) {
+    varint(static_cast<uint64_t>(t.type));
+    stringRef(t.lexeme);
+    svarint(t.line);
+    byte(t.symbol != 0);
+  }
+  void tokens(const std::vector<Token> &ts) {
+    varint(ts.size());
+    for (const Token &t : ts)
+      token(t);
+  }
+  void exprs(const std::vector<ExprPtr> &es) {
+    varint(es.size());
+    for (const auto &e : es)
+      expression(e.get());
+  }
+  void block(const BlockStmt *b) {
+    if (!b) {
+      byte(0);
+      return;
+    }
+    byte(1);
+    varint(b->statements.size());
+    for (const auto &s : b->statements)
+      statement(s.get());
+  }
+  void function(const FuncDefStmt &f) {
+    token(f.name);
+    tokens(f.params);
+    block(f.body.get());
+    byte(f.visibility == Visibility::Open);
+  }
+  void tag(ExprTag t) { byte(static_cast<uint8_t>(t)); }
+  void tag(StmtTag t) { byte(static_cast<uint8_t>(t)); }
+
+  void expression(const Expr *expr) {
+    if (!expr) {
+      tag(ExprTag::None);
+    } else if (auto *e = dynamic_cast<const LiteralExpr *>(expr)) {
+      tag(ExprTag::Literal);
+      byte(static_cast<uint8_t>(e->kind));
+      switch (e->kind) {
+      case LiteralExpr::Kind::Number:
+        number(e->numberValue);
+        break;
+      case LiteralExpr::Kind::String:
+        string(e->stringValue->value);
+        break;
+      case LiteralExpr::Kind::Bool:
+        byte(e->boolValue);
+        break;
+      case LiteralExpr::Kind::Nil:
+        break;
+      }
+    } else if (auto *e = dynamic_cast<const VariableExpr *>(expr)) {
+      tag(ExprTag::Variable);
+      token(e->name);
+    } else if (auto *e = dynamic_cast<const GroupingExpr *>(expr)) {
+      tag(ExprTag::Grouping);
+      expression(e->expr.get());
+    } else if (auto *e = dynamic_cast<const UnaryExpr *>(expr)) {
+      tag(ExprTag::Unary);
+      token(e->op);
+      expression(e->right.get());
+    } else if (auto *e = dynamic_cast<const BinaryExpr *>(expr)) {
+      tag(ExprTag::Binary);
+      expression(e->left.get());
+      token(e->op);
+      expression(e->right.get());
+    } else if (auto *e = dynamic_cast<const CallExpr *>(expr)) {
+      tag(ExprTag::Call);
+      expression(e->callee.get());
+      token(e->paren);
+      exprs(e->args);
+    } else if (auto *e = dynamic_cast<const ListExpr *>(expr)) {
+      tag(ExprTag::List);
+      exprs(e->elements);
+    } else if (auto *e = dynamic_cast<const GetExpr *>(expr)) {
+      tag(ExprTag::Get);
+      expression(e->object.get());
+      token(e->name);
+    } else if (auto *e = dynamic_cast<const IndexSetExpr *>(expr)) {
+      tag(ExprTag::IndexSet);
+      expression(e->object.get());
+      token(e->bracket);
+      expression(e->index.get());
+      expression(e->value.get());
+    } else if (auto *e = dynamic_cast<const IndexExpr *>(expr)) {
+      tag(ExprTag::Index);
+      expression(e->object.get());
+      token(e->bracket);
+      expression(e->index.get());
+    } else if (auto *e = dynamic_cast<const SetExpr *>(expr)) {
+      tag(ExprTag::Set);
+      expression(e->object.get());
+      token(e->name);
+      expression(e->value.get());
+    } else if (auto *e = dynamic_cast<const ThisExpr *>(expr)) {
+      tag(ExprTag::This);
+      token(e->keyword);
+    } else if (auto *e = dynamic_cast<const MapExpr *>(expr)) {
+      tag(ExprTag::Map);
+      exprs(e->keys);
+      exprs(e->values);
+    } else {
+      throw std::logic_error("serializeProgram: unknown expression node");
+    }
+  }
+
+  void statement(const Stmt *stmt) {
+    if (!stmt) {
+      tag(StmtTag::None);
+    } else if (auto *s = dynamic_cast<const ExprStmt *>(stmt)) {
+      tag(StmtTag::Expr);
+      expression(s->expr.get());
+    } else if (auto *s = dynamic_cast<const PrintStmt *>(stmt)) {
+      tag(StmtTag::Print);
+      expression(s->expr.get());
+    } else if (auto *s = dynamic_cast<const VarAssignStmt *>(stmt)) {
+      tag(StmtTag::VarAssign);
+      token(s->name);
+      expression(s->value.get());
+    } else if (auto *s = dynamic_cast<const BlockStmt *>(stmt)) {
+      tag(StmtTag::Block);
+      block(s);
+    } else if (auto *s = dynamic_cast<const IfStmt *>(stmt)) {
+      tag(StmtTag::If);
+      expression(s->condition.get());
+      block(s->thenBranch.get());
+      statement(s->elseBranch.get());
+    } else if (auto *s = dynamic_cast<const WhileStmt *>(stmt)) {
+      tag(StmtTag::While);
+      expression(s->condition.get());
+      block(s->body.get());
+    } else if (auto *s = dynamic_cast<const UntilStmt *>(stmt)) {
+      tag(StmtTag::Until);
+      expression(s->condition.get());
+      block(s->body.get());
+    } else if (auto *s = dynamic_cast<const ReturnStmt *>(stmt)) {
+      tag(StmtTag::Return);
+      token(s->keyword);
+      expression(s->value.get());
+    } else if (auto *s = dynamic_cast<const FuncDefStmt *>(stmt)) {
+      tag(StmtTag::FuncDef);
+      function(*s);
+    } else if (auto *s = dynamic_cast<const ClassStmt *>(stmt)) {
+      tag(StmtTag::Class);
+      token(s->name);
+      varint(s->methods.size());
+      for (const auto &m : s->methods)
+        function(*m);
+      byte(s->visibility == Visibility::Open);
+    } else if (auto *s = dynamic_cast<const EchoStmt *>(stmt)) {
+      tag(StmtTag::Echo);
+      expression(s->count.get());
+      block(s->body.get());
+    } else if (auto *s = dynamic_cast<const SwapStmt *>(stmt)) {
+      tag(StmtTag::Swap);
+      token(s->left);
+      token(s->right);
+    } else if (auto *s = dynamic_cast<const MaybeStmt *>(stmt)) {
+      tag(StmtTag::Maybe);
+      block(s->tryBlock.get());
+      block(s->otherwiseBlock.get());
+    } else if (auto *s = dynamic_cast<const ModuleStmt *>(stmt)) {
+      tag(StmtTag::Module);
+      tokens(s->moduleIdParts);
+    } else if (auto *s = dynamic_cast<const UseStmt *>(stmt)) {
+      tag(StmtTag::Use);
+      tokens(s->moduleIdParts);
+      token(s->alias);
+    } else {
+      throw std::logic_error("serializeProgram: unknown statement node");
+    }
+  }
+};
+
+// -------------------- decoding --------------------
+
+class Reader {
+public:
+  Reader(std::string_view data, AstArena &arena)
+      : data_(data), arena_(arena) {}
+
+  void program(std::vector<StmtPtr> &out) {
+    if (data_.size() < sizeof(kImageMagic) ||
+        std::memcmp(data_.data(), kImageMagic, sizeof(kImageMagic)) != 0)
+      throw Malformed{};
+    pos_ = sizeof(kImageMagic);
+    if (u32() != kFormatVersion)
+      throw Malformed{};
+    strings_.resize(count());
+    for (Entry &e : strings_) {
+      const size_t n = count();
+      e.raw = data_.substr(pos_, n);
+      pos_ += n;
+    }
+
+    const size_t n = count();
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      out.push_back(statement());
+    if (pos_ != data_.size())
+      throw Malformed{};
+  }
+
+private:
+  // A string table entry, resolved to the lexeme tokens use on first use.
+  struct Entry {
+    std::string_view raw;      // in the cache image
+    std::string_view interned; // the symbol table's copy, once interned
+    std::string_view copied;   // the arena's copy, once copied
+    Symbol symbol = 0;
+    bool isCopied = false;
+  };
+
+  std::string_view data_;
+  AstArena &arena_;
+  size_t pos_ = 0;
+  std::vector<Entry> strings_;
+
+  uint8_t byte() {
+    if (pos_ >= data_.size())
+      throw Malformed{};
+    return static_cast<uint8_t>(data_[pos_++]);
+  }
+  uint32_t u32() {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+      v |= static_cast<uint32_t>(byte()) << (8 * i);
+    return v;
+  }
+  uint64_t varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      const uint8_t b = byte();
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    throw Malformed{};
+  }
+  int64_t svarint() {
+    const uint64_t v = varint();
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+  }
+  // A length or element count; never more than the bytes left.
+  size_t count() {
+    const uint64_t n = varint();
+    if (n > data_.size() - pos_)
+      throw Malformed{};
+    return static_cast<size_t>(n);
+  }
+  double number() {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i)
+      bits |= static_cast<uint64_t>(byte()) << (8 * i);
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+  std::string string() {
+    const size_t n = count();
+    std::string s(data_.substr(pos_, n));
+    pos_ += n;
+    return s;
+  }
+
+  Token token() {
+    Token t;
+    const uint64_t type = varint();
+    if (type > static_cast<uint64_t>(TokenType::Eof))
+      throw Malformed{};
+    t.type = static_cast<TokenType>(type);
+    const uint64_t id = varint();
+    if (id >= strings_.size())
+      throw Malformed{};
+    Entry &e = strings_[id];
+    t.line = static_cast<int>(svarint());
+    if (byte()) {
+      if (!e.symbol)
+        e.symbol = intern(e.raw, e.interned);
+      t.lexeme = e.interned;
+      t.symbol = e.symbol;
+    } else {
+      if (!e.isCopied) {
+        e.copied = arena_.copy(e.raw);
+        e.isCopied = true;
+      }
+      t.lexeme = e.copied;
+    }
+    return t;
+  }
+  std::vector<Token> tokens() {
+    std::vector<Token> ts(count());
+    for (Token &t : ts)
+      t = token();
+    return ts;
+  }
+  std::vector<ExprPtr> exprs() {
+    std::vector<ExprPtr> es(count());
+    for (ExprPtr &e : es)
+      e = expression();
+    return es;
+  }
+  NodePtr<BlockStmt> block() {
+    if (!byte())
+      return nullptr;
+    std::vector<StmtPtr> statements(count());
+    for (StmtPtr &s : statements)
+      s = statement();
+    return arena_.make<BlockStmt>(std::move(statements));
+  }
+  NodePtr<BlockStmt> requiredBlock() {
+    auto b = block();
+    if (!b)
+      throw Malformed{};
+    return b;
+  }
+  NodePtr<FuncDefStmt> function() {
+    Token name = token();
+    std::vector<Token> params = tokens();
+    auto body = requiredBlock();
+    const Visibility vis = byte() ? Visibility::Open : Visibility::Closed;
+    return arena_.make<FuncDefStmt>(std::move(name), std::move(params),
+                                         std::move(body), vis);
+  }
+  ExprPtr requiredExpression() {
+    ExprPtr e = expression();
+    if (!e)
+      throw Malformed{};
+    return e;
+  }
+
+  ExprPtr expression() {
+    switch (static_cast<ExprTag>(byte())) {
+    case ExprTag::None:
+      return nullptr;
+    case ExprTag::Literal:
+      switch (static_cast<LiteralExpr::Kind>(byte())) {
+      case LiteralExpr::Kind::Number:
+        return LiteralExpr::number(arena_, number());
+      case LiteralExpr::Kind::String:
+        return LiteralExpr::str(arena_, string());
+      case LiteralExpr::Kind::Bool:
+        return LiteralExpr::boolean(arena_, byte() != 0);
+      case LiteralExpr::Kind::Nil:
+        return LiteralExpr::nil(arena_);
+      }
+      throw Malformed{};
+    case ExprTag::Variable:
+      return arena_.make<VariableExpr>(token());
+    case ExprTag::Grouping:
+      return arena_.make<GroupingExpr>(requiredExpression());
+    case ExprTag::Unary: {
+      Token op = token();
+      return arena_.make<UnaryExpr>(std::move(op), requiredExpression());
+    }
+    case ExprTag::Binary: {
+      ExprPtr left = requiredExpression();
+      Token op = token();
+      return arena_.make<BinaryExpr>(std::move(left), std::move(op),
+                                          requiredExpression());
+    }
+    case ExprTag::Call: {
+      ExprPtr callee = requiredExpression();
+      Token paren = token();
+      return arena_.make<CallExpr>(std::move(callee), std::move(paren),
+                                        exprs());
+    }
+    case ExprTag::List:
+      return arena_.make<ListExpr>(exprs());
+    case ExprTag::Get: {
+      ExprPtr object = requiredExpression();
+      return arena_.make<GetExpr>(std::move(object), token());
+    }
+    case ExprTag::Index: {
+      ExprPtr object = requiredExpression();
+      Token bracket = token();
+      return arena_.make<IndexExpr>(std::move(object), std::move(bracket),
+                                         requiredExpression());
+    }
+    case ExprTag::IndexSet: {
+      ExprPtr object = requiredExpression();
+      Token bracket = token();
+      ExprPtr index = requiredExpression();
+      return arena_.make<IndexSetExpr>(std::move(object),
+                                            std::move(bracket),
+                                            std::move(index),
+                                            requiredExpression());
+    }
+    case ExprTag::Set: {
+      ExprPtr object = requiredExpression();
+      Token name = token();
+      return arena_.make<SetExpr>(std::move(object), std::move(name),
+                                       requiredExpression());
+    }
+    case ExprTag::This:
+      return arena_.make<ThisExpr>(token());
+    case ExprTag::Map: {
+      std::vector<ExprPtr> keys = exprs();
+      std::vector<ExprPtr> values = exprs();
+      if (keys.size() != values.size())
+        throw Malformed{};
+      return arena_.make<MapExpr>(std::move(keys), std::move(values));
+    }
+    }
+    throw Malformed{};
+  }
+
+  StmtPtr statement() {
+    switch (static_cast<StmtTag>(byte())) {
+    case StmtTag::None:
+      return nullptr;
+    case StmtTag::Expr:
+      return arena_.make<ExprStmt>(requiredExpression());
+    case StmtTag::Print:
+      return arena_.make<PrintStmt>(requiredExpression());
+    case StmtTag::VarAssign: {
+      Token name = token();
+      return arena_.make<VarAssignStmt>(std::move(name),
+                                             requiredExpression());
+    }
+    case StmtTag::Block:
+      return requiredBlock();
+    case StmtTag::If: {
+      ExprPtr condition = requiredExpression();
+      auto thenBranch = requiredBlock();
+      return arena_.make<IfStmt>(std::move(condition),
+                                      std::move(thenBranch), statement());
+    }
+    case StmtTag::While: {
+      ExprPtr condition = requiredExpression();
+      return arena_.make<WhileStmt>(std::move(condition), requiredBlock());
+    }
+    case StmtTag::Until: {
+      ExprPtr condition = requiredExpression();
+      return arena_.make<UntilStmt>(std::move(condition), requiredBlock());
+    }
+    case StmtTag::Return: {
+      Token keyword = token();
+      return arena_.make<ReturnStmt>(std::move(keyword), expression());
+    }
+    case StmtTag::FuncDef:
+      return function();
+    case StmtTag::Class: {
+      Token name = token();
+      std::vector<NodePtr<FuncDefStmt>> methods(count());
+      for (auto &m : methods)
+        m = function();
+      const Visibility vis = byte() ? Visibility::Open : Visibility::Closed;
+      return arena_.make<ClassStmt>(std::move(name), std::move(methods),
+                                         vis);
+    }
+    case StmtTag::Echo: {
+      ExprPtr count = requiredExpression();
+      return arena_.make<EchoStmt>(std::move(count), requiredBlock());
+    }
+    case StmtTag::Swap: {
+      Token left = token();
+      return arena_.make<SwapStmt>(std::move(left), token());
+    }
+    case StmtTag::Maybe: {
+      auto tryBlock = requiredBlock();
+      return arena_.make<MaybeStmt>(std::move(tryBlock), block());
+    }
+    case StmtTag::Module:
+      return arena_.make<ModuleStmt>(tokens());
+    case StmtTag::Use: {
+      std::vector<Token> parts = tokens();
+      return arena_.make<UseStmt>(std::move(parts), token());
+    }
+    }
+    throw Malformed{};
+  }
+};
+
+// -------------------- cache files --------------------
+
+// Layout: magic, version, mtime, size, content hash, source path, image.
+struct FileKey {
+  int64_t mtime = 0;
+  uint64_t size = 0;
+  uint64_t hash = 0;
+};
+
+bool cachingDisabled() { return std::getenv("LUMA_NO_CACHE") != nullptr; }
+
+bool statSource(const std::string &path, FileKey &key) {
+  std::error_code ec;
+  auto mtime = fs::last_write_time(path, ec);
+  if (ec)
+    return false;
+  auto size = fs::file_size(path, ec);
+  if (ec)
+    return false;
+  key.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+  key.size = size;
+  return true;
+}
+
+bool readFile(const std::string &path, std::string &out) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in)
+    return false;
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  out = ss.str();
+  return true;
+}
+
+void put64(std::string &out, uint64_t v) {
+  for (int i = 0; i < 8; ++i)
+    out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+uint64_t get64(std::string_view data, size_t pos) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i)
+    v |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+  return v;
+}
+
+} // namespace
+
+std::string serializeProgram(const std::vector<StmtPtr> &program) {
+  return Writer().finish(program);
+}
+
+bool deserializeProgram(std::string_view data, Program &program) {
+  Program decoded;
+  try {
+    Reader(data, decoded.arena).program(decoded.statements);
+  } catch (const Malformed &) {
+    return false;
+  }
+  program = std::move(decoded);
+  return true;
+}
+
+std::string cachePathFor(const std::string &sourcePath) {
+  fs::path source(sourcePath);
+  return (source.parent_path() / ".luma_cache" /
+          (source.filename().string() + "c"))
+      .string();
+}
+
+bool loadCachedProgram(const std::string &sourcePath, Program &program) {
+  if (cachingDisabled())
+    return false;
+  FileKey current;
+  std::string file;
+  if (!statSource(sourcePath, current) ||
+      !readFile(cachePathFor(sourcePath), file))
+    return false;
+
+  constexpr size_t kFixed = sizeof(kFileMagic) + 4 + 3 * 8;
+  if (file.size() < kFixed ||
+      std::memcmp(file.data(), kFileMagic, sizeof(kFileMagic)) != 0)
+    return false;
+  std::string_view view(file);
+  size_t pos = sizeof(kFileMagic);
+  uint32_t version = 0;
+  for (int i = 0; i < 4; ++i)
+    version |= static_cast<uint32_t>(static_cast<uint8_t>(view[pos + i]))
+               << (8 * i);
+  pos += 4;
+  if (version != kFormatVersion)
+    return false;
+  FileKey cached;
+  cached.mtime = static_cast<int64_t>(get64(view, pos));
+  cached.size = get64(view, pos + 8);
+  cached.hash = get64(view, pos + 16);
+  pos += 24;
+
+  // The path guards against a cache copied along with a different file.
+  const size_t pathEnd = file.find('\0', pos);
+  if (pathEnd == std::string::npos ||
+      view.substr(pos, pathEnd - pos) != fs::absolute(sourcePath).string())
+    return false;
+  pos = pathEnd + 1;
+
+  if (cached.mtime != current.mtime || cached.size != current.size) {
+    // Touched or rewritten: still usable if the contents are the same.
+    std::string source;
+    if (!readFile(sourcePath, source) || hashBytes(source) != cached.hash)
+      return false;
+  }
+  return deserializeProgram(view.substr(pos), program);
+}
+
+bool stampSource(const std::string &sourcePath, SourceStamp &stamp) {
+  FileKey key;
+  if (!statSource(sourcePath, key))
+    return false;
+  stamp.mtime = key.mtime;
+  stamp.size = key.size;
+  return true;
+}
+
+bool storeCachedProgram(const std::string &sourcePath,
+                        const SourceStamp &stamp, std::string_view source,
+                        const std::vector<StmtPtr> &program) {
+  if (cachingDisabled())
+    return false;
+  // A size mismatch means the file changed after it was stamped.
+  if (stamp.size != source.size())
+    return false;
+  FileKey key;
+  key.mtime = stamp.mtime;
+  key.size = stamp.size;
+  key.hash = hashBytes(source);
+
+  std::string file(kFileMagic, sizeof(kFileMagic));
+  for (int i = 0; i < 4; ++i)
+    file.push_back(static_cast<char>(kFormatVersion >> (8 * i)));
+  put64(file, static_cast<uint64_t>(key.mtime));
+  put64(file, key.size);
+  put64(file, key.hash);
+  file += fs::absolute(sourcePath).string();
+  file.push_back('\0');
+  file += serializeProgram(program);
+
+  const fs::path target(cachePathFor(sourcePath));
+  std::error_code ec;
+  fs::create_directories(target.parent_path(), ec);
+  if (ec)
+    return false;
+  // Write then rename, so concurrent loaders (@std.workers) never see a
+  // half-written file.
+  const fs::path temp =
+      target.string() + ".tmp" + std::to_string(getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    out.write(file.data(), static_cast<std::streamsize>(file.size()));
+    if (!out) {
+      out.close();
+      fs::remove(temp, ec);
+      return false;
+    }
+  }
+  fs::rename(temp, target, ec);
+  if (ec) {
+    fs::remove(temp, ec);
+    return false;
+  }
+  FileKey now;
+  if (!statSource(sourcePath, now) || now.mtime != key.mtime ||
+      now.size != key.size) {
+    fs::remove(target, ec);
+    return false;
+  }
+  return true;
+}
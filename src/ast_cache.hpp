@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+
+// Pre-parsed modules on disk, so later runs skip lexing and parsing.
+//
+// A cache file holds the parse tree exactly as the parser produced it
+// (before the resolver annotates it), so both engines can use it. It lives
+// in a `.luma_cache` directory next to the source and is keyed by the
+// source path, its mtime and size, and a hash of its contents: a file with
+// unchanged mtime and size is trusted as is, otherwise the source is hashed
+// and the cache is used only if the contents still match.
+//
+// Set LUMA_NO_CACHE in the environment to neither read nor write caches.
+
+// Compact binary form of a program; deserializeProgram() returns false for
+// data that is truncated, corrupt or from another format version.
+std::string serializeProgram(const std::vector<StmtPtr> &program);
+bool deserializeProgram(std::string_view data, Program &program);
+
+// Path of the cache file for `sourcePath`.
+std::string cachePathFor(const std::string &sourcePath);
+
+// Fills `program` and returns true if an up-to-date cache exists.
+bool loadCachedProgram(const std::string &sourcePath, Program &program);
+
+// The source file's mtime and size, as a cache entry records them.
+struct SourceStamp {
+  int64_t mtime = 0;
+  uint64_t size = 0;
+};
+bool stampSource(const std::string &sourcePath, SourceStamp &stamp);
+
+// Writes the cache for `source`, read from `sourcePath` after `stamp` was
+// taken. Stamping first means an edit made while the source is read and
+// parsed leaves an entry with the old mtime, which the next load rehashes,
+// instead of the old parse tree under the new mtime; an entry whose file
+// changed size or mtime by the time it is written is dropped. Best effort:
+// a read-only directory just means no cache. Returns whether it was
+// written.
+bool storeCachedProgram(const std::string &sourcePath,
+                        const SourceStamp &stamp, std::string_view source,
+                        const std::vector<StmtPtr> &program);
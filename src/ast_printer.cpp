@@ -160,7 +160,7 @@ std::string AstPrinter::exprToString(const Expr &e) {
       out << l->numberValue;
       break;
     case LiteralExpr::Kind::String:
-      out << "\"" << l->stringValue << "\"";
+      out << "\"" << l->stringValue->value << "\"";
       break;
     case LiteralExpr::Kind::Bool:
       out << (l->boolValue ? "true" : "false");
@@ -173,7 +173,7 @@ std::string AstPrinter::exprToString(const Expr &e) {
   }
 
   if (auto *v = dynamic_cast<const VariableExpr *>(&e)) {
-    return v->name.lexeme;
+    return std::string(v->name.lexeme);
   }
 
   if (auto *g = dynamic_cast<const GroupingExpr *>(&e)) {
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "ast.hpp"
+#include "token.hpp"
+#include "value.hpp"
+
+// Instruction set of the stack VM (see vm.hpp). Operands `a` and `b` index
+// into the owning Chunk's tables or hold jump targets / counts.
+enum class OpCode : uint8_t {
+  // Values
+  Constant, // push constants[a]
+  Nil,
+  True,
+  False,
+  Pop,
+
+  // Variables resolved to a slot (a = depth, b = index)
+  GetLocal,
+  SetLocal, // pops value
+
+  // Variables looked up by name (a = token index of the name)
+  GetVar,
+  SetVar, // pops value, assign-or-define like VarAssignStmt
+  Swap,   // a = statement index of the SwapStmt
+  // `name = name + x` (a = statement index of the VarAssignStmt); pops the
+  // variable's value and x, and appends in place when it can
+  Append,
+
+  // Operators (a = token index of the operator, used for slow paths)
+  Negate,
+  Not,
+  Add,
+  Subtract,
+  Multiply,
+  Divide,
+  BitAnd,
+  BitOr,
+  ShiftLeft,
+  ShiftRight,
+  Greater,
+  GreaterEqual,
+  Less,
+  LessEqual,
+  Equal,
+  NotEqual,
+
+  // Control flow (a = target instruction)
+  Jump,
+  JumpIfFalse,     // pops condition
+  JumpIfTrue,      // pops condition
+  JumpIfFalseKeep, // leaves condition on the stack ('and')
+  JumpIfTrueKeep,  // leaves condition on the stack ('or')
+
+  // Calls and aggregates
+  Call,        // a = argc, b = token index of the call site
+  GetMethod,   // a = expr index of the GetExpr; object -> callee, receiver
+  Invoke,      // a = argc, b = token index; stack: callee, receiver, args
+  BuildList,   // a = element count
+  BuildMap,    // a = entry count (key, value pairs on the stack)
+  GetProperty, // a = expr index of the GetExpr
+  SetProperty, // a = expr index of the SetExpr; stack: object, value
+  GetIndex,    // stack: object, index
+  SetIndex,    // stack: object, index, value
+
+  // Statements
+  Print,
+  PushScope, // a = scope index
+  PopScope,
+  EchoInit, // validates the count and leaves it on the stack as a counter
+  EchoNext, // a = exit target; decrements the counter or pops it and exits
+  MaybeBegin, // a = handler target
+  MaybeEnd,
+  Exec,   // a = statement index, run by the tree walker (declarations)
+  Export, // a = token index of an open top-level def/class
+  Return, // pops the return value
+  ReturnOutside, // 'return' at script or module level
+};
+
+struct Instruction {
+  OpCode op;
+  uint32_t a = 0;
+  uint32_t b = 0;
+};
+
+// Compiled form of a script, module body or function body.
+struct Chunk {
+  std::vector<Instruction> code;
+  std::vector<Value> constants;
+  std::vector<Token> tokens;       // names, operators and call sites
+  std::vector<const Stmt *> stmts; // statements delegated to the tree walker
+  std::vector<const ScopeInfo *> scopes; // slot layouts for PushScope
+  std::vector<const Expr *> exprs; // property sites, for their inline caches
+};
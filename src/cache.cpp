@@ -0,0 +1,255 @@
+#include "cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+// -------------------- LRU --------------------
+
+void LruCache::unlink(Node *n) {
+  (n->prev ? n->prev->next : head_) = n->next;
+  (n->next ? n->next->prev : tail_) = n->prev;
+  n->prev = n->next = nullptr;
+}
+
+void LruCache::append(Node *n) {
+  n->prev = tail_;
+  n->next = nullptr;
+  (tail_ ? tail_->next : head_) = n;
+  tail_ = n;
+}
+
+const Value *LruCache::get(const std::string &key) {
+  auto it = nodes_.find(key);
+  if (it == nodes_.end())
+    return nullptr;
+  Node *n = &it->second;
+  if (n != tail_) {
+    unlink(n);
+    append(n);
+  }
+  return &n->value;
+}
+
+void LruCache::set(const std::string &key, Value value) {
+  auto it = nodes_.find(key);
+  if (it != nodes_.end()) {
+    Node *n = &it->second;
+    n->value = std::move(value);
+    unlink(n);
+    append(n);
+    return;
+  }
+  if (nodes_.size() >= maxSize_ && head_)
+    erase(*head_->key);
+  // unordered_map nodes never move, so the links and key pointer stay valid.
+  auto [pos, inserted] = nodes_.emplace(key, Node());
+  Node *n = &pos->second;
+  n->value = std::move(value);
+  n->key = &pos->first;
+  append(n);
+}
+
+bool LruCache::erase(const std::string &key) {
+  auto it = nodes_.find(key);
+  if (it == nodes_.end())
+    return false;
+  unlink(&it->second);
+  nodes_.erase(it);
+  return true;
+}
+
+void LruCache::clear() {
+  nodes_.clear();
+  head_ = tail_ = nullptr;
+}
+
+// -------------------- LFU --------------------
+
+LfuCache::Bucket *LfuCache::insertBucket(uint64_t frequency, Bucket *after) {
+  auto *b = new Bucket();
+  b->frequency = frequency;
+  b->prev = after;
+  b->next = after ? after->next : buckets_;
+  if (b->next)
+    b->next->prev = b;
+  (after ? after->next : buckets_) = b;
+  return b;
+}
+
+void LfuCache::attach(Node *n, Bucket *b) {
+  n->bucket = b;
+  n->prev = b->tail;
+  n->next = nullptr;
+  (b->tail ? b->tail->next : b->head) = n;
+  b->tail = n;
+}
+
+void LfuCache::detach(Node *n) {
+  Bucket *b = n->bucket;
+  (n->prev ? n->prev->next : b->head) = n->next;
+  (n->next ? n->next->prev : b->tail) = n->prev;
+  n->prev = n->next = nullptr;
+  n->bucket = nullptr;
+  if (!b->head) {
+    (b->prev ? b->prev->next : buckets_) = b->next;
+    if (b->next)
+      b->next->prev = b->prev;
+    delete b;
+  }
+}
+
+void LfuCache::touch(Node *n) {
+  Bucket *b = n->bucket;
+  const uint64_t frequency = b->frequency + 1;
+  Bucket *target = b->next;
+  if (!target || target->frequency != frequency)
+    target = insertBucket(frequency, b);
+  detach(n); // may free b, which target no longer points through
+  attach(n, target);
+}
+
+const Value *LfuCache::get(const std::string &key) {
+  auto it = nodes_.find(key);
+  if (it == nodes_.end())
+    return nullptr;
+  touch(&it->second);
+  return &it->second.value;
+}
+
+void LfuCache::set(const std::string &key, Value value) {
+  auto it = nodes_.find(key);
+  if (it != nodes_.end()) {
+    it->second.value = std::move(value);
+    touch(&it->second);
+    return;
+  }
+  if (nodes_.size() >= maxSize_ && buckets_)
+    erase(*buckets_->head->key);
+  auto [pos, inserted] = nodes_.emplace(key, Node());
+  Node *n = &pos->second;
+  n->value = std::move(value);
+  n->key = &pos->first;
+  Bucket *first = buckets_;
+  if (!first || first->frequency != 1)
+    first = insertBucket(1, nullptr);
+  attach(n, first);
+}
+
+bool LfuCache::erase(const std::string &key) {
+  auto it = nodes_.find(key);
+  if (it == nodes_.end())
+    return false;
+  detach(&it->second);
+  nodes_.erase(it);
+  return true;
+}
+
+void LfuCache::clear() {
+  nodes_.clear();
+  while (buckets_) {
+    Bucket *next = buckets_->next;
+    delete buckets_;
+    buckets_ = next;
+  }
+}
+
+uint64_t LfuCache::frequency(const std::string &key) const {
+  auto it = nodes_.find(key);
+  return it == nodes_.end() ? 0 : it->second.bucket->frequency;
+}
+
+// -------------------- TTL --------------------
+
+double TtlCache::clock() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+void TtlCache::schedule(const std::string &key, Entry &entry, double ttl) {
+  entry.expiresAt = clock() + ttl;
+  entry.generation = nextGeneration_++;
+  heap_.push_back({entry.expiresAt, entry.generation, key});
+  std::push_heap(heap_.begin(), heap_.end(), std::greater<Deadline>());
+  // Stale items only leave the heap when they reach the top; keep a run of
+  // reassignments from growing it without bound.
+  if (heap_.size() > 2 * entries_.size() + 16)
+    compactHeap();
+}
+
+void TtlCache::compactHeap() {
+  heap_.erase(std::remove_if(heap_.begin(), heap_.end(),
+                             [&](const Deadline &d) {
+                               auto it = entries_.find(d.key);
+                               return it == entries_.end() ||
+                                      it->second.generation != d.generation;
+                             }),
+              heap_.end());
+  std::make_heap(heap_.begin(), heap_.end(), std::greater<Deadline>());
+}
+
+void TtlCache::evictExpired() {
+  const double now = clock();
+  while (!heap_.empty() && heap_.front().expiresAt <= now) {
+    std::pop_heap(heap_.begin(), heap_.end(), std::greater<Deadline>());
+    Deadline d = std::move(heap_.back());
+    heap_.pop_back();
+    auto it = entries_.find(d.key);
+    if (it != entries_.end() && it->second.generation == d.generation)
+      entries_.erase(d.key);
+  }
+}
+
+const Value *TtlCache::get(const std::string &key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return nullptr;
+  if (it->second.expiresAt <= clock()) {
+    entries_.erase(key);
+    return nullptr;
+  }
+  return &it->second.value;
+}
+
+bool TtlCache::set(const std::string &key, Value value, double ttl) {
+  auto it = entries_.find(key);
+  if (it == entries_.end() && entries_.size() >= maxSize_) {
+    evictExpired();
+    if (entries_.size() >= maxSize_)
+      return false;
+  }
+  Entry &entry = entries_[key];
+  entry.value = std::move(value);
+  schedule(key, entry, ttl);
+  return true;
+}
+
+bool TtlCache::has(const std::string &key) const {
+  auto it = entries_.find(key);
+  return it != entries_.end() && it->second.expiresAt > clock();
+}
+
+bool TtlCache::erase(const std::string &key) {
+  return entries_.erase(key) != 0;
+}
+
+void TtlCache::clear() {
+  entries_.clear();
+  heap_.clear();
+}
+
+double TtlCache::ttl(const std::string &key) const {
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return -2;
+  const double remaining = it->second.expiresAt - clock();
+  return remaining > 0 ? remaining : -1;
+}
+
+bool TtlCache::expire(const std::string &key, double ttl) {
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  schedule(key, it->second, ttl);
+  return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ordered_map.hpp"
+#include "value.hpp"
+
+// Native storage behind @std.cache. Every operation the Luma classes expose
+// is O(1) (amortised O(log n) for TTL expiry) instead of scanning a list.
+// Keys are strings, as they are for maps.
+
+// Least recently used. The recency list is threaded through the hash nodes
+// themselves, so an entry is one allocation and touching it is a relink.
+class LruCache {
+public:
+  explicit LruCache(size_t maxSize) : maxSize_(maxSize) {}
+
+  const Value *get(const std::string &key); // marks the key as used
+  void set(const std::string &key, Value value);
+  bool has(const std::string &key) const { return nodes_.count(key) != 0; }
+  bool erase(const std::string &key);
+  void clear();
+
+  size_t size() const { return nodes_.size(); }
+  size_t maxSize() const { return maxSize_; }
+  const std::string *lruKey() const { return head_ ? head_->key : nullptr; }
+  const std::string *mruKey() const { return tail_ ? tail_->key : nullptr; }
+
+  // Least recently used first.
+  template <class F> void forEach(F &&fn) const {
+    for (const Node *n = head_; n; n = n->next)
+      fn(*n->key, n->value);
+  }
+
+private:
+  struct Node {
+    Value value;
+    const std::string *key = nullptr; // the owning map key
+    Node *prev = nullptr;
+    Node *next = nullptr;
+  };
+
+  size_t maxSize_;
+  std::unordered_map<std::string, Node> nodes_;
+  Node *head_ = nullptr; // least recently used
+  Node *tail_ = nullptr; // most recently used
+
+  void unlink(Node *n);
+  void append(Node *n);
+};
+
+// Least frequently used, ties broken by age. Keys sit in per-frequency
+// buckets kept in ascending order, so the victim is always the oldest key
+// of the first bucket.
+class LfuCache {
+public:
+  explicit LfuCache(size_t maxSize) : maxSize_(maxSize) {}
+  ~LfuCache() { clear(); }
+  LfuCache(const LfuCache &) = delete;
+  LfuCache &operator=(const LfuCache &) = delete;
+
+  const Value *get(const std::string &key); // counts as a use
+  void set(const std::string &key, Value value);
+  bool has(const std::string &key) const { return nodes_.count(key) != 0; }
+  bool erase(const std::string &key);
+  void clear();
+
+  size_t size() const { return nodes_.size(); }
+  size_t maxSize() const { return maxSize_; }
+  uint64_t frequency(const std::string &key) const;
+
+  // Least frequently used first.
+  template <class F> void forEach(F &&fn) const {
+    for (const Bucket *b = buckets_; b; b = b->next) {
+      for (const Node *n = b->head; n; n = n->next)
+        fn(*n->key, n->value);
+    }
+  }
+
+private:
+  struct Bucket;
+  struct Node {
+    Value value;
+    const std::string *key = nullptr;
+    Bucket *bucket = nullptr;
+    Node *prev = nullptr;
+    Node *next = nullptr;
+  };
+  struct Bucket {
+    uint64_t frequency;
+    Node *head = nullptr; // oldest
+    Node *tail = nullptr;
+    Bucket *prev = nullptr;
+    Bucket *next = nullptr;
+  };
+
+  size_t maxSize_;
+  std::unordered_map<std::string, Node> nodes_;
+  Bucket *buckets_ = nullptr; // lowest frequency first
+
+  void touch(Node *n);
+  void detach(Node *n); // drops the bucket if it empties
+  void attach(Node *n, Bucket *b);
+  Bucket *insertBucket(uint64_t frequency, Bucket *after);
+};
+
+// Entries with a time to live, in seconds. Expiry times sit in a min-heap;
+// reassigning a key leaves its old heap item behind, recognised as stale by
+// its generation and dropped when it surfaces. Keys iterate in insertion
+// order.
+class TtlCache {
+public:
+  TtlCache(size_t maxSize, double defaultTtl)
+      : maxSize_(maxSize), defaultTtl_(defaultTtl) {}
+
+  const Value *get(const std::string &key);
+  // False when the cache is full even after dropping expired entries.
+  bool set(const std::string &key, Value value, double ttl);
+  bool has(const std::string &key) const;
+  bool erase(const std::string &key);
+  void clear();
+  // Seconds left; -1 once expired, -2 for an unknown key.
+  double ttl(const std::string &key) const;
+  bool expire(const std::string &key, double ttl);
+  void evictExpired();
+
+  size_t size() const { return entries_.size(); }
+  size_t maxSize() const { return maxSize_; }
+  double defaultTtl() const { return defaultTtl_; }
+
+  // Live (unexpired) entries in insertion order.
+  template <class F> void forEach(F &&fn) const {
+    const double now = clock();
+    for (const auto &[key, entry] : entries_) {
+      if (entry.expiresAt > now)
+        fn(key, entry.value);
+    }
+  }
+
+  static double clock(); // monotonic seconds
+
+private:
+  struct Entry {
+    Value value;
+    double expiresAt = 0;
+    uint64_t generation = 0;
+  };
+  struct Deadline {
+    double expiresAt;
+    uint64_t generation;
+    std::string key;
+    bool operator>(const Deadline &o) const { return expiresAt > o.expiresAt; }
+  };
+
+  size_t maxSize_;
+  double defaultTtl_;
+  OrderedMap<Entry> entries_;
+  std::vector<Deadline> heap_; // min-heap on expiresAt
+  uint64_t nextGeneration_ = 1;
+
+  void schedule(const std::string &key, Entry &entry, double ttl);
+  void compactHeap();
+};
@@ -0,0 +1,391 @@
+#include "compiler.hpp"
+#include <stdexcept>
+
+std::unique_ptr<Chunk>
+Compiler::compileScript(const std::vector<StmtPtr> &program) {
+  beginChunk(false);
+  for (const auto &stmt : program)
+    statement(*stmt);
+  emit(OpCode::Nil);
+  emit(OpCode::Return);
+  return std::move(chunk_);
+}
+
+std::unique_ptr<Chunk>
+Compiler::compileModule(const std::vector<StmtPtr> &program) {
+  beginChunk(false);
+  for (const auto &stmt : program) {
+    statement(*stmt);
+
+    // Mirror Interpreter::loadModule: open top-level defs and classes are
+    // exported right after they are defined.
+    if (auto *f = dynamic_cast<const FuncDefStmt *>(stmt.get())) {
+      if (f->visibility == Visibility::Open)
+        emit(OpCode::Export, addToken(f->name));
+    }
+    if (auto *c = dynamic_cast<const ClassStmt *>(stmt.get())) {
+      if (c->visibility == Visibility::Open)
+        emit(OpCode::Export, addToken(c->name));
+    }
+  }
+  emit(OpCode::Nil);
+  emit(OpCode::Return);
+  return std::move(chunk_);
+}
+
+std::unique_ptr<Chunk> Compiler::compileFunction(const BlockStmt &body) {
+  beginChunk(true);
+  // The body runs directly in the call environment that holds the
+  // parameters, so it does not open a scope of its own.
+  for (const auto &stmt : body.statements)
+    statement(*stmt);
+  emit(OpCode::Nil);
+  emit(OpCode::Return);
+  return std::move(chunk_);
+}
+
+void Compiler::beginChunk(bool inFunction) {
+  chunk_ = std::make_unique<Chunk>();
+  inFunction_ = inFunction;
+}
+
+// -------------------- statements --------------------
+
+void Compiler::scopedBlock(const BlockStmt &block) {
+  emit(OpCode::PushScope, addScope(block.scope));
+  for (const auto &stmt : block.statements)
+    statement(*stmt);
+  emit(OpCode::PopScope);
+}
+
+void Compiler::statement(const Stmt &stmt) {
+  if (auto *x = dynamic_cast<const ExprStmt *>(&stmt)) {
+    expression(*x->expr);
+    emit(OpCode::Pop);
+    return;
+  }
+
+  if (auto *p = dynamic_cast<const PrintStmt *>(&stmt)) {
+    expression(*p->expr);
+    emit(OpCode::Print);
+    return;
+  }
+
+  if (auto *a = dynamic_cast<const VarAssignStmt *>(&stmt)) {
+    if (a->appended) {
+      expression(*static_cast<const BinaryExpr &>(*a->value).left);
+      expression(*a->appended);
+      emit(OpCode::Append, addStmt(*a));
+      return;
+    }
+    expression(*a->value);
+    if (a->slot.resolved())
+      emit(OpCode::SetLocal, a->slot.depth, a->slot.index);
+    else
+      emit(OpCode::SetVar, addToken(a->name));
+    return;
+  }
+
+  if (auto *b = dynamic_cast<const BlockStmt *>(&stmt)) {
+    scopedBlock(*b);
+    return;
+  }
+
+  if (auto *i = dynamic_cast<const IfStmt *>(&stmt)) {
+    expression(*i->condition);
+    uint32_t toElse = emitJump(OpCode::JumpIfFalse);
+    scopedBlock(*i->thenBranch);
+    if (!i->elseBranch) {
+      patchJump(toElse);
+      return;
+    }
+    uint32_t toEnd = emitJump(OpCode::Jump);
+    patchJump(toElse);
+    if (auto *elseBlock = dynamic_cast<const BlockStmt *>(i->elseBranch.get()))
+      scopedBlock(*elseBlock);
+    else
+      statement(*i->elseBranch); // else if
+    patchJump(toEnd);
+    return;
+  }
+
+  if (auto *w = dynamic_cast<const WhileStmt *>(&stmt)) {
+    uint32_t loopStart = here();
+    expression(*w->condition);
+    uint32_t exit = emitJump(OpCode::JumpIfFalse);
+    scopedBlock(*w->body);
+    emit(OpCode::Jump, loopStart);
+    patchJump(exit);
+    return;
+  }
+
+  if (auto *u = dynamic_cast<const UntilStmt *>(&stmt)) {
+    uint32_t loopStart = here();
+    expression(*u->condition);
+    uint32_t exit = emitJump(OpCode::JumpIfTrue);
+    scopedBlock(*u->body);
+    emit(OpCode::Jump, loopStart);
+    patchJump(exit);
+    return;
+  }
+
+  if (auto *r = dynamic_cast<const ReturnStmt *>(&stmt)) {
+    if (r->value)
+      expression(*r->value);
+    else
+      emit(OpCode::Nil);
+    emit(inFunction_ ? OpCode::Return : OpCode::ReturnOutside);
+    return;
+  }
+
+  if (auto *e = dynamic_cast<const EchoStmt *>(&stmt)) {
+    expression(*e->count);
+    emit(OpCode::EchoInit);
+    uint32_t loopStart = here();
+    uint32_t exit = emitJump(OpCode::EchoNext);
+    scopedBlock(*e->body);
+    emit(OpCode::Jump, loopStart);
+    patchJump(exit);
+    return;
+  }
+
+  if (auto *s = dynamic_cast<const SwapStmt *>(&stmt)) {
+    emit(OpCode::Swap, addStmt(*s));
+    return;
+  }
+
+  if (auto *m = dynamic_cast<const MaybeStmt *>(&stmt)) {
+    uint32_t handler = emitJump(OpCode::MaybeBegin);
+    scopedBlock(*m->tryBlock);
+    emit(OpCode::MaybeEnd);
+    uint32_t toEnd = emitJump(OpCode::Jump);
+    patchJump(handler);
+    if (m->otherwiseBlock)
+      scopedBlock(*m->otherwiseBlock);
+    patchJump(toEnd);
+    return;
+  }
+
+  // Declarations (def, class, module, use) run once per definition and are
+  // delegated to the tree walker.
+  if (dynamic_cast<const FuncDefStmt *>(&stmt) ||
+      dynamic_cast<const ClassStmt *>(&stmt) ||
+      dynamic_cast<const ModuleStmt *>(&stmt) ||
+      dynamic_cast<const UseStmt *>(&stmt)) {
+    emit(OpCode::Exec, addStmt(stmt));
+    return;
+  }
+
+  throw std::runtime_error("Unknown statement at compile time.");
+}
+
+// -------------------- expressions --------------------
+
+static OpCode binaryOpCode(TokenType type) {
+  switch (type) {
+  case TokenType::Plus:
+    return OpCode::Add;
+  case TokenType::Minus:
+    return OpCode::Subtract;
+  case TokenType::Star:
+    return OpCode::Multiply;
+  case TokenType::Slash:
+    return OpCode::Divide;
+  case TokenType::Ampersand:
+    return OpCode::BitAnd;
+  case TokenType::Pipe:
+    return OpCode::BitOr;
+  case TokenType::ShiftLeft:
+    return OpCode::ShiftLeft;
+  case TokenType::ShiftRight:
+    return OpCode::ShiftRight;
+  case TokenType::Greater:
+    return OpCode::Greater;
+  case TokenType::GreaterEqual:
+    return OpCode::GreaterEqual;
+  case TokenType::Less:
+    return OpCode::Less;
+  case TokenType::LessEqual:
+    return OpCode::LessEqual;
+  case TokenType::EqualEqual:
+    return OpCode::Equal;
+  case TokenType::BangEqual:
+    return OpCode::NotEqual;
+  default:
+    throw std::runtime_error("Unknown binary operator '" +
+                             std::string(tokenTypeName(type)) + "'");
+  }
+}
+
+void Compiler::expression(const Expr &expr) {
+  if (auto *l = dynamic_cast<const LiteralExpr *>(&expr)) {
+    switch (l->kind) {
+    case LiteralExpr::Kind::Number:
+      emit(OpCode::Constant, addConstant(l->numberValue));
+      return;
+    case LiteralExpr::Kind::String:
+      emit(OpCode::Constant, addConstant(l->stringValue));
+      return;
+    case LiteralExpr::Kind::Bool:
+      emit(l->boolValue ? OpCode::True : OpCode::False);
+      return;
+    case LiteralExpr::Kind::Nil:
+      emit(OpCode::Nil);
+      return;
+    }
+  }
+
+  if (auto *v = dynamic_cast<const VariableExpr *>(&expr)) {
+    getVariable(v->name, v->slot);
+    return;
+  }
+
+  if (auto *th = dynamic_cast<const ThisExpr *>(&expr)) {
+    getVariable(th->keyword, th->slot);
+    return;
+  }
+
+  if (auto *g = dynamic_cast<const GroupingExpr *>(&expr)) {
+    expression(*g->expr);
+    return;
+  }
+
+  if (auto *u = dynamic_cast<const UnaryExpr *>(&expr)) {
+    expression(*u->right);
+    if (u->op.type == TokenType::Minus)
+      emit(OpCode::Negate, addToken(u->op));
+    else
+      emit(OpCode::Not, addToken(u->op));
+    return;
+  }
+
+  if (auto *b = dynamic_cast<const BinaryExpr *>(&expr)) {
+    if (b->op.type == TokenType::Or || b->op.type == TokenType::And) {
+      // Short-circuit: keep the left operand as the result when it decides
+      // the outcome, otherwise discard it and evaluate the right operand.
+      expression(*b->left);
+      uint32_t toEnd = emitJump(b->op.type == TokenType::Or
+                                    ? OpCode::JumpIfTrueKeep
+                                    : OpCode::JumpIfFalseKeep);
+      emit(OpCode::Pop);
+      expression(*b->right);
+      patchJump(toEnd);
+      return;
+    }
+    expression(*b->left);
+    expression(*b->right);
+    emit(binaryOpCode(b->op.type), addToken(b->op));
+    return;
+  }
+
+  if (auto *c = dynamic_cast<const CallExpr *>(&expr)) {
+    if (auto *get = dynamic_cast<const GetExpr *>(c->callee.get())) {
+      expression(*get->object);
+      emit(OpCode::GetMethod, addExpr(*get));
+      for (const auto &a : c->args)
+        expression(*a);
+      emit(OpCode::Invoke, static_cast<uint32_t>(c->args.size()),
+           addToken(c->paren));
+      return;
+    }
+    expression(*c->callee);
+    for (const auto &a : c->args)
+      expression(*a);
+    emit(OpCode::Call, static_cast<uint32_t>(c->args.size()),
+         addToken(c->paren));
+    return;
+  }
+
+  if (auto *ix = dynamic_cast<const IndexExpr *>(&expr)) {
+    expression(*ix->object);
+    expression(*ix->index);
+    emit(OpCode::GetIndex);
+    return;
+  }
+
+  if (auto *is = dynamic_cast<const IndexSetExpr *>(&expr)) {
+    expression(*is->object);
+    expression(*is->index);
+    expression(*is->value);
+    emit(OpCode::SetIndex);
+    return;
+  }
+
+  if (auto *list = dynamic_cast<const ListExpr *>(&expr)) {
+    for (const auto &e : list->elements)
+      expression(*e);
+    emit(OpCode::BuildList, static_cast<uint32_t>(list->elements.size()));
+    return;
+  }
+
+  if (auto *get = dynamic_cast<const GetExpr *>(&expr)) {
+    expression(*get->object);
+    emit(OpCode::GetProperty, addExpr(*get));
+    return;
+  }
+
+  if (auto *set = dynamic_cast<const SetExpr *>(&expr)) {
+    expression(*set->object);
+    expression(*set->value);
+    emit(OpCode::SetProperty, addExpr(*set));
+    return;
+  }
+
+  if (auto *mp = dynamic_cast<const MapExpr *>(&expr)) {
+    for (size_t i = 0; i < mp->keys.size(); ++i) {
+      expression(*mp->keys[i]);
+      expression(*mp->values[i]);
+    }
+    emit(OpCode::BuildMap, static_cast<uint32_t>(mp->keys.size()));
+    return;
+  }
+
+  throw std::runtime_error("Unknown expression type at compile time.");
+}
+
+// -------------------- helpers --------------------
+
+void Compiler::getVariable(const Token &name, const Slot &slot) {
+  if (slot.resolved())
+    emit(OpCode::GetLocal, slot.depth, slot.index);
+  else
+    emit(OpCode::GetVar, addToken(name));
+}
+
+uint32_t Compiler::emit(OpCode op, uint32_t a, uint32_t b) {
+  chunk_->code.push_back({op, a, b});
+  return static_cast<uint32_t>(chunk_->code.size() - 1);
+}
+
+uint32_t Compiler::emitJump(OpCode op) { return emit(op, 0); }
+
+void Compiler::patchJump(uint32_t at) { chunk_->code[at].a = here(); }
+
+uint32_t Compiler::here() const {
+  return static_cast<uint32_t>(chunk_->code.size());
+}
+
+uint32_t Compiler::addToken(const Token &token) {
+  chunk_->tokens.push_back(token);
+  return static_cast<uint32_t>(chunk_->tokens.size() - 1);
+}
+
+uint32_t Compiler::addConstant(Value value) {
+  chunk_->constants.push_back(std::move(value));
+  return static_cast<uint32_t>(chunk_->constants.size() - 1);
+}
+
+uint32_t Compiler::addStmt(const Stmt &stmt) {
+  chunk_->stmts.push_back(&stmt);
+  return static_cast<uint32_t>(chunk_->stmts.size() - 1);
+}
+
+uint32_t Compiler::addScope(const ScopeInfo &scope) {
+  chunk_->scopes.push_back(&scope);
+  return static_cast<uint32_t>(chunk_->scopes.size() - 1);
+}
+
+uint32_t Compiler::addExpr(const Expr &expr) {
+  chunk_->exprs.push_back(&expr);
+  return static_cast<uint32_t>(chunk_->exprs.size() - 1);
+}
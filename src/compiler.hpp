@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+
+// Lowers the parsed AST to bytecode for the VM. The chunk refers back to
+// declaration statements (def, class, module, use), so the AST must outlive
+// every chunk compiled from it.
+class Compiler {
+public:
+  std::unique_ptr<Chunk> compileScript(const std::vector<StmtPtr> &program);
+  std::unique_ptr<Chunk> compileModule(const std::vector<StmtPtr> &program);
+  std::unique_ptr<Chunk> compileFunction(const BlockStmt &body);
+
+private:
+  std::unique_ptr<Chunk> chunk_;
+  bool inFunction_ = false;
+
+  void beginChunk(bool inFunction);
+
+  void statement(const Stmt &stmt);
+  void scopedBlock(const BlockStmt &block);
+  void expression(const Expr &expr);
+
+  uint32_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0);
+  uint32_t emitJump(OpCode op);
+  void patchJump(uint32_t at);
+  uint32_t here() const;
+
+  uint32_t addToken(const Token &token);
+  uint32_t addConstant(Value value);
+  uint32_t addStmt(const Stmt &stmt);
+  uint32_t addScope(const ScopeInfo &scope);
+  uint32_t addExpr(const Expr &expr);
+
+  void getVariable(const Token &name, const Slot &slot);
+};
@@ -0,0 +1,558 @@
+#include "crypto.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#else
+#include <stdlib.h> // arc4random_buf
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LUMA_SHA_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+#define LUMA_SHA_ARM 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+uint32_t load32be(const uint8_t *p) {
+  return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 |
+         uint32_t(p[3]);
+}
+
+uint64_t load64le(const uint8_t *p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; --i)
+    v = v << 8 | p[i];
+  return v;
+}
+
+uint32_t load32le(const uint8_t *p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+         uint32_t(p[3]) << 24;
+}
+
+uint32_t rotl32(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+uint64_t rotl64(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+uint64_t rotr64(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+// -------------------- SHA-1 --------------------
+
+void sha1Portable(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  for (; blocks--; data += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+      w[i] = load32be(data + 4 * i);
+    for (int i = 16; i < 80; ++i)
+      w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      const uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl32(b, 30);
+      b = a;
+      a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+// -------------------- SHA-256 --------------------
+
+alignas(16) const uint32_t kSha256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+void sha256Portable(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  for (; blocks--; data += 64) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+      w[i] = load32be(data + 4 * i);
+    for (int i = 16; i < 64; ++i) {
+      const uint32_t s0 =
+          rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const uint32_t s1 =
+          rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+      const uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+      const uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + kSha256[i] + w[i];
+      const uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+      const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#ifdef LUMA_SHA_X86
+
+// The SHA extensions work four message words at a time. The state lives in
+// two registers in the order the round instructions want: ABEF and CDGH
+// for SHA-256, ABCD plus E in the top lane for SHA-1.
+
+__attribute__((target("sha,sse4.1"))) void
+sha1Ni(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  const __m128i swap = _mm_set_epi64x(0x0001020304050607ULL,
+                                      0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0x1b);
+  __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+  for (; blocks--; data += 64) {
+    const __m128i abcdSave = abcd, eSave = e0;
+    __m128i w[4];
+    for (int i = 0; i < 4; ++i)
+      w[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)),
+          swap);
+    __m128i previous = abcd;
+    for (int g = 0; g < 20; ++g) { // four rounds each
+      if (g >= 4)
+        w[g % 4] = _mm_sha1msg2_epu32(
+            _mm_xor_si128(_mm_sha1msg1_epu32(w[g % 4], w[(g + 1) % 4]),
+                          w[(g + 2) % 4]),
+            w[(g + 3) % 4]);
+      const __m128i e = g == 0 ? _mm_add_epi32(e0, w[0])
+                               : _mm_sha1nexte_epu32(previous, w[g % 4]);
+      previous = abcd;
+      switch (g / 5) {
+      case 0: abcd = _mm_sha1rnds4_epu32(abcd, e, 0); break;
+      case 1: abcd = _mm_sha1rnds4_epu32(abcd, e, 1); break;
+      case 2: abcd = _mm_sha1rnds4_epu32(abcd, e, 2); break;
+      default: abcd = _mm_sha1rnds4_epu32(abcd, e, 3); break;
+      }
+    }
+    e0 = _mm_sha1nexte_epu32(previous, eSave);
+    abcd = _mm_add_epi32(abcd, abcdSave);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state),
+                   _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+__attribute__((target("sha,sse4.1"))) void
+sha256Ni(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                      0x0405060700010203ULL);
+  __m128i tmp = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xb1);
+  __m128i cdgh = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1b);
+  __m128i abef = _mm_alignr_epi8(tmp, cdgh, 8);
+  cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+  for (; blocks--; data += 64) {
+    const __m128i abefSave = abef, cdghSave = cdgh;
+    __m128i w[4];
+    for (int i = 0; i < 4; ++i)
+      w[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)),
+          swap);
+    for (int g = 0; g < 16; ++g) { // four rounds each
+      if (g >= 4)
+        w[g % 4] = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(w[g % 4], w[(g + 1) % 4]),
+                          _mm_alignr_epi8(w[(g + 3) % 4], w[(g + 2) % 4], 4)),
+            w[(g + 3) % 4]);
+      __m128i msg = _mm_add_epi32(
+          w[g % 4], _mm_load_si128(reinterpret_cast<const __m128i *>(
+                        kSha256 + 4 * g)));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+      msg = _mm_shuffle_epi32(msg, 0x0e);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, msg);
+    }
+    abef = _mm_add_epi32(abef, abefSave);
+    cdgh = _mm_add_epi32(cdgh, cdghSave);
+  }
+  tmp = _mm_shuffle_epi32(abef, 0x1b);
+  cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state),
+                   _mm_blend_epi16(tmp, cdgh, 0xf0));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4),
+                   _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+bool cpuHasShaNi() {
+  unsigned a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    return false;
+  const bool ssse3 = c & (1u << 9), sse41 = c & (1u << 19);
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+    return false;
+  return ssse3 && sse41 && (b & (1u << 29));
+}
+
+#endif
+
+#ifdef LUMA_SHA_ARM
+
+void sha256Arm(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  uint32x4_t abcd = vld1q_u32(state);
+  uint32x4_t efgh = vld1q_u32(state + 4);
+  for (; blocks--; data += 64) {
+    const uint32x4_t abcdSave = abcd, efghSave = efgh;
+    uint32x4_t w[4];
+    for (int i = 0; i < 4; ++i)
+      w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    for (int g = 0; g < 16; ++g) { // four rounds each
+      if (g >= 4)
+        w[g % 4] = vsha256su1q_u32(vsha256su0q_u32(w[g % 4], w[(g + 1) % 4]),
+                                   w[(g + 2) % 4], w[(g + 3) % 4]);
+      const uint32x4_t msg = vaddq_u32(w[g % 4], vld1q_u32(kSha256 + 4 * g));
+      const uint32x4_t before = abcd;
+      abcd = vsha256hq_u32(abcd, efgh, msg);
+      efgh = vsha256h2q_u32(efgh, before, msg);
+    }
+    abcd = vaddq_u32(abcd, abcdSave);
+    efgh = vaddq_u32(efgh, efghSave);
+  }
+  vst1q_u32(state, abcd);
+  vst1q_u32(state + 4, efgh);
+}
+
+#endif
+
+using Compress = void (*)(uint32_t state[8], const uint8_t *data,
+                          size_t blocks);
+
+struct ShaKernels {
+  Compress sha1 = sha1Portable;
+  Compress sha256 = sha256Portable;
+
+  ShaKernels() {
+#ifdef LUMA_SHA_X86
+    if (cpuHasShaNi()) {
+      sha1 = sha1Ni;
+      sha256 = sha256Ni;
+    }
+#endif
+#ifdef LUMA_SHA_ARM
+    sha256 = sha256Arm;
+#endif
+  }
+};
+
+const ShaKernels &shaKernels() {
+  static const ShaKernels kernels;
+  return kernels;
+}
+
+// -------------------- BLAKE2b --------------------
+
+const uint64_t kBlake2bIv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+const uint8_t kBlake2bSigma[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+void blake2bCompress(uint64_t h[8], const uint8_t *block, uint64_t counter,
+                     bool last) {
+  uint64_t m[16], v[16];
+  for (int i = 0; i < 16; ++i)
+    m[i] = load64le(block + 8 * i);
+  for (int i = 0; i < 8; ++i) {
+    v[i] = h[i];
+    v[i + 8] = kBlake2bIv[i];
+  }
+  v[12] ^= counter;
+  if (last)
+    v[14] = ~v[14];
+  auto mix = [&](int a, int b, int c, int d, uint64_t x, uint64_t y) {
+    v[a] = v[a] + v[b] + x;
+    v[d] = rotr64(v[d] ^ v[a], 32);
+    v[c] = v[c] + v[d];
+    v[b] = rotr64(v[b] ^ v[c], 24);
+    v[a] = v[a] + v[b] + y;
+    v[d] = rotr64(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = rotr64(v[b] ^ v[c], 63);
+  };
+  for (const auto &s : kBlake2bSigma) {
+    mix(0, 4, 8, 12, m[s[0]], m[s[1]]);
+    mix(1, 5, 9, 13, m[s[2]], m[s[3]]);
+    mix(2, 6, 10, 14, m[s[4]], m[s[5]]);
+    mix(3, 7, 11, 15, m[s[6]], m[s[7]]);
+    mix(0, 5, 10, 15, m[s[8]], m[s[9]]);
+    mix(1, 6, 11, 12, m[s[10]], m[s[11]]);
+    mix(2, 7, 8, 13, m[s[12]], m[s[13]]);
+    mix(3, 4, 9, 14, m[s[14]], m[s[15]]);
+  }
+  for (int i = 0; i < 8; ++i)
+    h[i] ^= v[i] ^ v[i + 8];
+}
+
+} // namespace
+
+bool hashAlgorithmFromName(std::string_view name, HashAlgorithm &algorithm) {
+  if (name == "sha1")
+    algorithm = HashAlgorithm::Sha1;
+  else if (name == "sha256")
+    algorithm = HashAlgorithm::Sha256;
+  else if (name == "blake2b")
+    algorithm = HashAlgorithm::Blake2b;
+  else
+    return false;
+  return true;
+}
+
+Hasher::Hasher(HashAlgorithm algorithm) : algorithm_(algorithm) {
+  static const uint32_t sha1Init[8] = {0x67452301, 0xefcdab89, 0x98badcfe,
+                                       0x10325476, 0xc3d2e1f0};
+  static const uint32_t sha256Init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                         0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                         0x1f83d9ab, 0x5be0cd19};
+  switch (algorithm) {
+  case HashAlgorithm::Sha1:
+    std::memcpy(sha_, sha1Init, sizeof sha_);
+    break;
+  case HashAlgorithm::Sha256:
+    std::memcpy(sha_, sha256Init, sizeof sha_);
+    break;
+  case HashAlgorithm::Blake2b:
+    std::memcpy(blake_, kBlake2bIv, sizeof blake_);
+    blake_[0] ^= 0x01010000 ^ 64; // no key, 64-byte digest
+    break;
+  }
+}
+
+size_t Hasher::blockSize() const {
+  return algorithm_ == HashAlgorithm::Blake2b ? 128 : 64;
+}
+
+size_t Hasher::digestSize() const {
+  switch (algorithm_) {
+  case HashAlgorithm::Sha1: return 20;
+  case HashAlgorithm::Sha256: return 32;
+  case HashAlgorithm::Blake2b: return 64;
+  }
+  return 0;
+}
+
+void Hasher::compress(const uint8_t *blocks, size_t count) {
+  switch (algorithm_) {
+  case HashAlgorithm::Sha1:
+    shaKernels().sha1(sha_, blocks, count);
+    break;
+  case HashAlgorithm::Sha256:
+    shaKernels().sha256(sha_, blocks, count);
+    break;
+  case HashAlgorithm::Blake2b:
+    for (size_t i = 0; i < count; ++i, blocks += 128)
+      blake2bCompress(blake_, blocks, length_ - blockUsed_ + 128 * (i + 1),
+                      false);
+    break;
+  }
+}
+
+void Hasher::update(const void *data, size_t size) {
+  auto p = static_cast<const uint8_t *>(data);
+  const size_t block = blockSize();
+  // BLAKE2b flags the final block, so a full block stays buffered until
+  // more data shows it was not the last.
+  const bool holdLast = algorithm_ == HashAlgorithm::Blake2b;
+  while (size > 0) {
+    if (blockUsed_ == block) {
+      compress(block_, 1);
+      blockUsed_ = 0;
+    }
+    if (blockUsed_ == 0 && size > block) {
+      size_t whole = size / block;
+      if (holdLast && size % block == 0)
+        --whole;
+      if (whole > 0) {
+        compress(p, whole);
+        length_ += whole * block;
+        p += whole * block;
+        size -= whole * block;
+        continue;
+      }
+    }
+    const size_t take = std::min(block - blockUsed_, size);
+    std::memcpy(block_ + blockUsed_, p, take);
+    blockUsed_ += take;
+    length_ += take;
+    p += take;
+    size -= take;
+    if (!holdLast && blockUsed_ == block) {
+      compress(block_, 1);
+      blockUsed_ = 0;
+    }
+  }
+}
+
+void Hasher::finish(uint8_t *out) {
+  if (algorithm_ == HashAlgorithm::Blake2b) {
+    std::memset(block_ + blockUsed_, 0, 128 - blockUsed_);
+    blake2bCompress(blake_, block_, length_, true);
+    for (int i = 0; i < 64; ++i)
+      out[i] = static_cast<uint8_t>(blake_[i / 8] >> (8 * (i % 8)));
+    return;
+  }
+  const uint64_t bits = length_ * 8;
+  block_[blockUsed_++] = 0x80;
+  if (blockUsed_ > 56) {
+    std::memset(block_ + blockUsed_, 0, 64 - blockUsed_);
+    compress(block_, 1);
+    blockUsed_ = 0;
+  }
+  std::memset(block_ + blockUsed_, 0, 56 - blockUsed_);
+  for (int i = 0; i < 8; ++i)
+    block_[56 + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+  compress(block_, 1);
+  const size_t words = digestSize() / 4;
+  for (size_t i = 0; i < words; ++i)
+    for (int j = 0; j < 4; ++j)
+      out[4 * i + j] = static_cast<uint8_t>(sha_[i] >> (24 - 8 * j));
+}
+
+std::string Hasher::digest() const {
+  Hasher copy = *this;
+  uint8_t out[64];
+  copy.finish(out);
+  return std::string(reinterpret_cast<const char *>(out), digestSize());
+}
+
+std::string hashDigest(HashAlgorithm algorithm, std::string_view data) {
+  Hasher hasher(algorithm);
+  hasher.update(data);
+  return hasher.digest();
+}
+
+uint64_t fastHash(std::string_view data, uint64_t seed) {
+  constexpr uint64_t p1 = 0x9e3779b185ebca87ULL, p2 = 0xc2b2ae3d27d4eb4fULL,
+                     p3 = 0x165667b19e3779f9ULL, p4 = 0x85ebca77c2b2ae63ULL,
+                     p5 = 0x27d4eb2f165667c5ULL;
+  auto round = [](uint64_t acc, uint64_t lane) {
+    return rotl64(acc + lane * p2, 31) * p1;
+  };
+  auto p = reinterpret_cast<const uint8_t *>(data.data());
+  const uint8_t *const end = p + data.size();
+  uint64_t h;
+  if (data.size() >= 32) {
+    uint64_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+    for (; end - p >= 32; p += 32) {
+      v1 = round(v1, load64le(p));
+      v2 = round(v2, load64le(p + 8));
+      v3 = round(v3, load64le(p + 16));
+      v4 = round(v4, load64le(p + 24));
+    }
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    for (uint64_t v : {v1, v2, v3, v4})
+      h = (h ^ round(0, v)) * p1 + p4;
+  } else {
+    h = seed + p5;
+  }
+  h += data.size();
+  for (; end - p >= 8; p += 8)
+    h = rotl64(h ^ round(0, load64le(p)), 27) * p1 + p4;
+  if (end - p >= 4) {
+    h = rotl64(h ^ (load32le(p) * p1), 23) * p2 + p3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+    h = rotl64(h ^ (*p * p5), 11) * p1;
+  h ^= h >> 33;
+  h *= p2;
+  h ^= h >> 29;
+  h *= p3;
+  h ^= h >> 32;
+  return h;
+}
+
+void secureRandomBytes(void *out, size_t size) {
+#if defined(__linux__)
+  auto p = static_cast<uint8_t *>(out);
+  while (size > 0) {
+    const ssize_t n = getrandom(p, size, 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("getrandom failed: ") +
+                               std::strerror(errno));
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+#else
+  arc4random_buf(out, size);
+#endif
+}
+
+std::string hexEncode(std::string_view bytes) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(bytes.size() * 2, '\0');
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    const auto b = static_cast<unsigned char>(bytes[i]);
+    hex[2 * i] = digits[b >> 4];
+    hex[2 * i + 1] = digits[b & 15];
+  }
+  return hex;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Hashing and randomness behind @std.crypto.
+//
+// SHA-1, SHA-256 and BLAKE2b-512 follow their specifications (FIPS 180-4,
+// RFC 7693). SHA-1 and SHA-256 use the x86 SHA extensions when the CPU
+// reports them at run time, and SHA-256 the ARMv8 crypto extensions when the
+// target is built with them; otherwise portable code runs.
+
+enum class HashAlgorithm { Sha1, Sha256, Blake2b };
+
+// "sha1", "sha256" or "blake2b"; false for anything else.
+bool hashAlgorithmFromName(std::string_view name, HashAlgorithm &algorithm);
+
+// An incremental hash: update() any number of times, then digest().
+class Hasher {
+public:
+  explicit Hasher(HashAlgorithm algorithm);
+
+  void update(const void *data, size_t size);
+  void update(std::string_view data) { update(data.data(), data.size()); }
+
+  // The raw digest of everything so far. The hasher itself is not finished,
+  // so more data can follow.
+  std::string digest() const;
+
+  HashAlgorithm algorithm() const { return algorithm_; }
+  size_t digestSize() const; // 20, 32 or 64 bytes
+
+private:
+  HashAlgorithm algorithm_;
+  uint32_t sha_[8];  // SHA-1 uses the first five words
+  uint64_t blake_[8];
+  uint8_t block_[128]; // SHA uses 64 bytes
+  size_t blockUsed_ = 0;
+  uint64_t length_ = 0; // bytes hashed
+
+  size_t blockSize() const;
+  void compress(const uint8_t *blocks, size_t count);
+  void finish(uint8_t *out);
+};
+
+std::string hashDigest(HashAlgorithm algorithm, std::string_view data);
+
+// XXH64: a fast non-cryptographic 64-bit hash for table and cache keys.
+uint64_t fastHash(std::string_view data, uint64_t seed = 0);
+
+// Fills `out` from the operating system's CSPRNG; throws std::runtime_error
+// if it cannot.
+void secureRandomBytes(void *out, size_t size);
+
+std::string hexEncode(std::string_view bytes);
@@ -1,2 +1,21 @@
 #include "environment.hpp"
-// (intentionally empty — methods are inline in the header)
+
+// Function's members that need Environment complete (see value.hpp).
+
+Function::Function(const Function &other)
+    : GcObject(other), name(other.name), params(other.params),
+      body(other.body), closure(other.closure), receiver(other.receiver) {}
+
+Function::~Function() = default;
+
+void Function::traceRefs(GcVisitor visit, void *context) const {
+  if (closure)
+    visit(closure.get(), context);
+  if (receiver)
+    visit(receiver.get(), context);
+}
+
+void Function::clearRefs() {
+  Ref<Environment> dropped = std::move(closure);
+  InstancePtr receiverDropped = std::move(receiver);
+}
@@ -4,54 +4,182 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "token.hpp"
 #include "value.hpp"
 
-class Environment : public std::enable_shared_from_this<Environment> {
+// A runtime scope. Variables the resolver pinned down live in a flat slot
+// vector laid out by the scope's ScopeInfo and are reached by (depth, index);
+// everything else (globals, module scope, late-bound names) lives in the
+// name-keyed map. Name-based lookups also see defined slots, so dynamic code
+// and resolved code observe the same variables. Names are interned Symbols.
+class Environment : public GcObject {
 public:
-  explicit Environment(std::shared_ptr<Environment> enclosing = nullptr)
-      : enclosing_(std::move(enclosing)) {}
+  explicit Environment(Ref<Environment> enclosing = nullptr,
+                       const ScopeInfo *scope = nullptr)
+      : enclosing_(std::move(enclosing)), scope_(scope) {
+    if (scope_)
+      slots_.resize(scope_->names.size());
+  }
+
+  // Empties the environment and rebinds it, keeping its allocations.
+  void reset(Ref<Environment> enclosing, const ScopeInfo *scope) {
+    values_.clear();
+    slots_.clear();
+    if (scope)
+      slots_.resize(scope->names.size());
+    enclosing_ = std::move(enclosing);
+    scope_ = scope;
+    defined_ = 0;
+  }
+
+  // ---- Resolved access ----
+
+  Environment *ancestor(int depth) {
+    Environment *env = this;
+    while (depth-- > 0)
+      env = env->enclosing_.get();
+    return env;
+  }
 
+  const Value &slot(int index) const { return slots_[index]; }
+  Value &slot(int index) { return slots_[index]; }
+
+  void setSlot(int index, Value value) {
+    slots_[index] = std::move(value);
+    // Slots are first written in declaration order, so everything below
+    // defined_ has been assigned.
+    if (index >= defined_)
+      defined_ = index + 1;
+  }
+
+  // ---- Name-based access ----
+
+  void define(Symbol name, Value value) { values_[name] = std::move(value); }
   void define(const std::string &name, Value value) {
-    values_[name] = std::move(value);
+    define(intern(name), std::move(value));
   }
 
-  bool has(const std::string &name) const {
-    if (values_.find(name) != values_.end())
-      return true;
-    if (enclosing_)
-      return enclosing_->has(name);
+  bool has(Symbol name) const {
+    for (const Environment *env = this; env; env = env->enclosing_.get()) {
+      if (env->findLocal(name))
+        return true;
+    }
     return false;
   }
 
   Value get(const Token &name) const {
-    auto it = values_.find(name.lexeme);
-    if (it != values_.end())
-      return it->second;
-    if (enclosing_)
-      return enclosing_->get(name);
-    throw std::runtime_error("Undefined variable '" + name.lexeme +
+    for (const Environment *env = this; env; env = env->enclosing_.get()) {
+      if (const Value *v = env->findLocal(name.symbol))
+        return *v;
+    }
+    throw std::runtime_error("Undefined variable '" + std::string(name.lexeme) +
                              "' at line " + std::to_string(name.line));
   }
 
-  void assign(const Token &name, Value value) {
-    auto it = values_.find(name.lexeme);
-    if (it != values_.end()) {
-      it->second = std::move(value);
-      return;
+  // The variable's storage, or null when no enclosing scope defines it.
+  Value *find(Symbol name) {
+    for (Environment *env = this; env; env = env->enclosing_.get()) {
+      if (Value *v = env->findLocal(name))
+        return v;
     }
-    if (enclosing_) {
-      enclosing_->assign(name, std::move(value));
-      return;
+    return nullptr;
+  }
+
+  void assign(const Token &name, Value value) {
+    for (Environment *env = this; env; env = env->enclosing_.get()) {
+      if (Value *v = env->findLocal(name.symbol)) {
+        *v = std::move(value);
+        return;
+      }
     }
-    throw std::runtime_error("Undefined variable '" + name.lexeme +
+    throw std::runtime_error("Undefined variable '" + std::string(name.lexeme) +
                              "' at line " + std::to_string(name.line));
   }
 
-  std::shared_ptr<Environment> enclosing() const { return enclosing_; }
+  // Adds every name visible from this environment to `out`.
+  void collectNames(std::unordered_set<Symbol> &out) const {
+    for (const Environment *env = this; env; env = env->enclosing_.get()) {
+      for (const auto &entry : env->values_)
+        out.insert(entry.first);
+      for (int i = 0; i < env->defined_; ++i)
+        out.insert(env->scope_->names[i]);
+    }
+  }
+
+  Ref<Environment> enclosing() const { return enclosing_; }
+
+  void traceRefs(GcVisitor visit, void *context) const override {
+    for (const auto &entry : values_)
+      gcTrace(entry.second, visit, context);
+    for (const Value &value : slots_)
+      gcTrace(value, visit, context);
+    if (enclosing_)
+      visit(enclosing_.get(), context);
+  }
+
+  void clearRefs() override {
+    auto values = std::move(values_);
+    auto slots = std::move(slots_);
+    auto enclosing = std::move(enclosing_);
+    reset(nullptr, nullptr);
+  }
+
+private:
+  std::unordered_map<Symbol, Value> values_;
+  std::vector<Value> slots_;
+  Ref<Environment> enclosing_;
+  const ScopeInfo *scope_ = nullptr;
+  int defined_ = 0;
+
+  const Value *findLocal(Symbol name) const {
+    return const_cast<Environment *>(this)->findLocal(name);
+  }
+
+  Value *findLocal(Symbol name) {
+    if (!values_.empty()) {
+      auto it = values_.find(name);
+      if (it != values_.end())
+        return &it->second;
+    }
+    for (int i = defined_; i-- > 0;) {
+      if (scope_->names[i] == name)
+        return &slots_[i];
+    }
+    return nullptr;
+  }
+};
+
+// Recycles block and call environments. A scope that nothing captured (no
+// closure, bound class or pending handler holds a reference) is reset and
+// handed out again, so hot loops and calls reuse a handful of environments
+// instead of allocating one per iteration.
+class EnvironmentPool {
+public:
+  Ref<Environment> acquire(Ref<Environment> enclosing,
+                                       const ScopeInfo *scope) {
+    if (free_.empty())
+      return makeRef<Environment>(std::move(enclosing), scope);
+    Ref<Environment> env = std::move(free_.back());
+    free_.pop_back();
+    env->reset(std::move(enclosing), scope);
+    return env;
+  }
+
+  // Gives up the caller's reference to `env`, recycling it when that was the
+  // last one. The reference count is the escape check: a captured scope is
+  // left to its other owners.
+  void release(Ref<Environment> &env) {
+    if (env.use_count() == 1 && free_.size() < kMaxFree) {
+      env->reset(nullptr, nullptr); // drop held values right away
+      free_.push_back(std::move(env));
+    }
+    env.reset();
+  }
 
 private:
-  std::unordered_map<std::string, Value> values_;
-  std::shared_ptr<Environment> enclosing_;
+  static constexpr size_t kMaxFree = 256;
+  std::vector<Ref<Environment>> free_;
 };
@@ -0,0 +1,200 @@
+#include "file_io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void ioError(const char *operation) {
+  throw std::runtime_error(std::string("File ") + operation +
+                           " failed: " + std::strerror(errno) + ".");
+}
+
+} // namespace
+
+bool FileHandle::parseMode(std::string_view text, Mode &mode) {
+  if (text == "r")
+    mode = Mode::Read;
+  else if (text == "w")
+    mode = Mode::Write;
+  else if (text == "a")
+    mode = Mode::Append;
+  else
+    return false;
+  return true;
+}
+
+std::unique_ptr<FileHandle> FileHandle::open(const std::string &path,
+                                             Mode mode) {
+  int flags = O_CLOEXEC;
+  switch (mode) {
+  case Mode::Read:
+    flags |= O_RDONLY;
+    break;
+  case Mode::Write:
+    flags |= O_WRONLY | O_CREAT | O_TRUNC;
+    break;
+  case Mode::Append:
+    flags |= O_WRONLY | O_CREAT | O_APPEND;
+    break;
+  }
+  const int fd = ::open(path.c_str(), flags, 0644);
+  if (fd < 0)
+    return nullptr;
+  return std::unique_ptr<FileHandle>(new FileHandle(fd, mode));
+}
+
+FileHandle::FileHandle(int fd, Mode mode)
+    : fd_(fd), mode_(mode), buffer_(new char[kBufferSize]) {}
+
+FileHandle::~FileHandle() {
+  try {
+    close();
+  } catch (const std::exception &) {
+  }
+}
+
+void FileHandle::requireMode(Mode mode, const char *operation) const {
+  if (closed())
+    throw std::runtime_error(std::string("Cannot ") + operation +
+                             " a closed file.");
+  const bool reading = mode_ == Mode::Read;
+  if (reading != (mode == Mode::Read))
+    throw std::runtime_error(std::string("Cannot ") + operation +
+                             (reading ? " a file opened for reading."
+                                      : " a file opened for writing."));
+}
+
+bool FileHandle::fill() {
+  if (begin_ < end_)
+    return true;
+  begin_ = end_ = 0;
+  while (!eof_) {
+    const ssize_t n = ::read(fd_, buffer_.get(), kBufferSize);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ioError("read");
+    }
+    if (n == 0)
+      eof_ = true;
+    end_ = static_cast<size_t>(n);
+    return n > 0;
+  }
+  return false;
+}
+
+bool FileHandle::readLine(std::string &line) {
+  requireMode(Mode::Read, "read");
+  line.clear();
+  bool any = false;
+  while (fill()) {
+    any = true;
+    const char *start = buffer_.get() + begin_;
+    const char *newline =
+        static_cast<const char *>(std::memchr(start, '\n', end_ - begin_));
+    if (!newline) {
+      line.append(start, end_ - begin_);
+      begin_ = end_;
+      continue;
+    }
+    line.append(start, newline);
+    begin_ += static_cast<size_t>(newline - start) + 1;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    return true;
+  }
+  return any;
+}
+
+bool FileHandle::readChunk(size_t max, std::string &out) {
+  requireMode(Mode::Read, "read");
+  out.clear();
+  if (max == 0)
+    return !atEnd();
+  // Serve what is buffered, then read large requests straight into `out`.
+  if (begin_ < end_) {
+    const size_t take = std::min(max, end_ - begin_);
+    out.assign(buffer_.get() + begin_, take);
+    begin_ += take;
+  }
+  if (out.size() < max && max - out.size() >= kBufferSize) {
+    size_t have = out.size();
+    out.resize(max);
+    while (have < max && !eof_) {
+      const ssize_t n = ::read(fd_, &out[have], max - have);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        ioError("read");
+      }
+      if (n == 0)
+        eof_ = true;
+      have += static_cast<size_t>(n);
+    }
+    out.resize(have);
+  } else if (out.empty() && fill()) {
+    const size_t take = std::min(max, end_ - begin_);
+    out.assign(buffer_.get() + begin_, take);
+    begin_ += take;
+  }
+  return !out.empty();
+}
+
+bool FileHandle::atEnd() {
+  requireMode(Mode::Read, "read");
+  return !fill();
+}
+
+void FileHandle::writeAll(const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = ::write(fd_, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ioError("write");
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+void FileHandle::write(std::string_view data) {
+  requireMode(Mode::Write, "write to");
+  if (end_ + data.size() > kBufferSize)
+    flush();
+  if (data.size() >= kBufferSize) {
+    writeAll(data.data(), data.size());
+    return;
+  }
+  std::memcpy(buffer_.get() + end_, data.data(), data.size());
+  end_ += data.size();
+}
+
+void FileHandle::flush() {
+  if (closed() || mode_ == Mode::Read || end_ == 0)
+    return;
+  const size_t pending = end_;
+  end_ = 0; // a failed write is not retried by close()
+  writeAll(buffer_.get(), pending);
+}
+
+void FileHandle::close() {
+  if (closed())
+    return;
+  const int fd = fd_;
+  try {
+    flush();
+  } catch (...) {
+    ::close(fd);
+    fd_ = -1;
+    throw;
+  }
+  fd_ = -1;
+  if (::close(fd) != 0 && mode_ != Mode::Read)
+    ioError("close");
+}
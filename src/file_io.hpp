@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Buffered file handles behind fs.open_file and fs.lines.
+//
+// A handle owns one descriptor and a fixed 64 KiB buffer, so reading a file
+// line by line or chunk by chunk uses the same memory however large the
+// file is. Writes collect in the buffer and go out when it fills, on
+// flush() and on close(); a write larger than the buffer goes straight to
+// the descriptor. I/O errors throw std::runtime_error.
+class FileHandle {
+public:
+  enum class Mode { Read, Write, Append };
+
+  // Mode "r", "w" (create or truncate) or "a" (create, append).
+  static bool parseMode(std::string_view text, Mode &mode);
+
+  // Returns null if the file cannot be opened.
+  static std::unique_ptr<FileHandle> open(const std::string &path, Mode mode);
+
+  ~FileHandle(); // flushes and closes, ignoring errors
+  FileHandle(const FileHandle &) = delete;
+  FileHandle &operator=(const FileHandle &) = delete;
+
+  // The next line without its "\n" (or "\r\n"); false at end of file. A
+  // last line without a newline still counts.
+  bool readLine(std::string &line);
+  // Up to `max` bytes; false at end of file.
+  bool readChunk(size_t max, std::string &out);
+  bool atEnd(); // may read ahead to find out
+
+  void write(std::string_view data);
+  void flush();
+  void close();
+
+  bool closed() const { return fd_ < 0; }
+  Mode mode() const { return mode_; }
+
+private:
+  static constexpr size_t kBufferSize = 64 * 1024;
+
+  FileHandle(int fd, Mode mode);
+
+  int fd_;
+  Mode mode_;
+  std::unique_ptr<char[]> buffer_;
+  size_t begin_ = 0; // reading: unread bytes are [begin_, end_)
+  size_t end_ = 0;   // writing: pending bytes are [0, end_)
+  bool eof_ = false;
+
+  void requireMode(Mode mode, const char *operation) const;
+  bool fill(); // reading: false once nothing is left
+  void writeAll(const char *data, size_t size);
+};
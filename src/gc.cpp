@@ -0,0 +1,65 @@
+#include "gc.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+void subtractInternal(GcObject *child, void *) { --child->gcRefs; }
+
+void markReachable(GcObject *child, void *context) {
+  if (child->gcReachable)
+    return;
+  child->gcReachable = true;
+  static_cast<std::vector<GcObject *> *>(context)->push_back(child);
+}
+
+} // namespace
+
+size_t gcCollect() {
+  GcHeap &heap = gcHeap;
+  if (heap.collecting)
+    return 0;
+  heap.collecting = true;
+
+  for (GcObject *o = heap.head; o; o = o->gcNext) {
+    o->gcRefs = static_cast<int32_t>(o->refCount);
+    o->gcReachable = false;
+  }
+  for (GcObject *o = heap.head; o; o = o->gcNext)
+    o->traceRefs(subtractInternal, nullptr);
+
+  // An object nobody owns yet (refCount 0, e.g. one under construction or
+  // on the C++ stack) is treated as externally referenced too.
+  std::vector<GcObject *> pending;
+  for (GcObject *o = heap.head; o; o = o->gcNext) {
+    if (o->gcRefs > 0 || o->refCount == 0) {
+      o->gcReachable = true;
+      pending.push_back(o);
+    }
+  }
+  while (!pending.empty()) {
+    GcObject *o = pending.back();
+    pending.pop_back();
+    o->traceRefs(markReachable, &pending);
+  }
+
+  // Holding a reference to every garbage object keeps them all alive while
+  // their references are cleared; dropping these frees them.
+  std::vector<Ref<GcObject>> garbage;
+  for (GcObject *o = heap.head; o; o = o->gcNext) {
+    if (!o->gcReachable)
+      garbage.emplace_back(o);
+  }
+  for (const Ref<GcObject> &o : garbage)
+    o->clearRefs();
+  const size_t freed = garbage.size();
+  garbage.clear();
+
+  heap.allocated = 0;
+  heap.threshold = std::max(GcHeap::kMinThreshold, heap.live);
+  ++heap.collections;
+  heap.freed += freed;
+  heap.collecting = false;
+  return freed;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+#include "object.hpp"
+
+// Cycle collector for the GcObjects of the calling thread.
+//
+// Reference counts already free acyclic garbage the moment it is dropped,
+// so the collector only has to find cycles, and it needs no root set: it
+// subtracts the references GcObjects hold to each other from their counts.
+// An object left with a positive count is referenced from outside the
+// tracked heap (a local, the interpreter's environments, a native's
+// captures, a pending callback) and stays alive with everything it
+// reaches. Whatever remains can only be reached from other garbage; its
+// references are cleared, and reference counting frees it.
+//
+// A collection walks every tracked object, so it runs after as many new
+// objects as were live at the end of the previous one (at least
+// GcHeap::kMinThreshold), which keeps its cost proportional to allocation.
+// The interpreter polls gcMaybeCollect() where no C++ frame can hold the
+// only reference to an object: between top-level statements, on loop
+// back-edges and between event-loop callbacks.
+
+// Collects now and returns how many objects were freed.
+size_t gcCollect();
+
+inline void gcMaybeCollect() {
+  if (gcHeap.allocated >= gcHeap.threshold)
+    gcCollect();
+}
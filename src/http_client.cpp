@@ -0,0 +1,666 @@
+#include "http_client.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <strings.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "reactor.hpp"
+
+namespace {
+
+constexpr size_t kMaxHeadBytes = 64 * 1024;
+constexpr size_t kReadChunk = 64 * 1024;
+
+std::string lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return s;
+}
+
+bool equalsIgnoreCase(const std::string &a, const char *b) {
+  return strcasecmp(a.c_str(), b) == 0;
+}
+
+std::string trim(const std::string &s) {
+  const size_t begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+    return "";
+  return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+// Idle keep-alive connections, per thread so that @std.workers threads never
+// share a socket.
+class ConnectionPool {
+public:
+  static ConnectionPool &local() {
+    thread_local ConnectionPool pool;
+    return pool;
+  }
+
+  ~ConnectionPool() {
+    for (auto &[key, fds] : idle_)
+      for (int fd : fds)
+        ::close(fd);
+  }
+
+  // An idle connection to `key`, or -1. Connections the server has closed
+  // (or sent unexpected bytes on) in the meantime are dropped.
+  int take(const std::string &key) {
+    auto it = idle_.find(key);
+    if (it == idle_.end())
+      return -1;
+    auto &fds = it->second;
+    while (!fds.empty()) {
+      const int fd = fds.back();
+      fds.pop_back();
+      pollfd p{fd, POLLIN, 0};
+      if (::poll(&p, 1, 0) == 0)
+        return fd;
+      ::close(fd);
+    }
+    return -1;
+  }
+
+  void give(const std::string &key, int fd) {
+    auto &fds = idle_[key];
+    if (fds.size() >= kMaxIdlePerHost) {
+      ::close(fds.front());
+      fds.erase(fds.begin());
+    }
+    fds.push_back(fd);
+  }
+
+private:
+  static constexpr size_t kMaxIdlePerHost = 8;
+  std::unordered_map<std::string, std::vector<int>> idle_;
+};
+
+bool idempotent(const std::string &method) {
+  return method == "GET" || method == "HEAD" || method == "PUT" ||
+         method == "DELETE" || method == "OPTIONS";
+}
+
+} // namespace
+
+HttpExchange::HttpExchange(HttpRequest request)
+    : request_(std::move(request)), redirectsLeft_(request_.maxRedirects) {
+  parseUrl(request_.url);
+}
+
+HttpExchange::~HttpExchange() { closeConnection(); }
+
+short HttpExchange::events() const {
+  switch (state_) {
+  case State::Connecting:
+  case State::Sending:
+    return POLLOUT;
+  case State::Head:
+  case State::Body:
+    return POLLIN;
+  default:
+    return 0;
+  }
+}
+
+// http://host[:port][/path][?query][#fragment]; host may be [v6].
+bool HttpExchange::parseUrl(const std::string &url) {
+  const std::string scheme = "http://";
+  if (url.size() <= scheme.size() ||
+      lower(url.substr(0, scheme.size())) != scheme)
+    return false;
+  const size_t authorityEnd = url.find_first_of("/?#", scheme.size());
+  std::string authority = url.substr(scheme.size(), authorityEnd - scheme.size());
+  if (authority.find('@') != std::string::npos)
+    return false; // credentials in URLs are not supported
+  port_ = "80";
+  if (!authority.empty() && authority[0] == '[') {
+    const size_t close = authority.find(']');
+    if (close == std::string::npos)
+      return false;
+    host_ = authority.substr(1, close - 1);
+    if (close + 1 < authority.size()) {
+      if (authority[close + 1] != ':')
+        return false;
+      port_ = authority.substr(close + 2);
+    }
+  } else {
+    const size_t colon = authority.rfind(':');
+    host_ = authority.substr(0, colon);
+    if (colon != std::string::npos)
+      port_ = authority.substr(colon + 1);
+  }
+  if (host_.empty() || port_.empty() ||
+      port_.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+
+  target_ = authorityEnd == std::string::npos ? "/" : url.substr(authorityEnd);
+  target_ = target_.substr(0, target_.find('#'));
+  if (target_.empty() || target_[0] != '/')
+    target_ = "/" + target_; // "http://host?q"
+  hostKey_ = host_ + ":" + port_;
+  return true;
+}
+
+void HttpExchange::start() {
+  deadline_ = Reactor::now() + request_.timeoutMs;
+  begin();
+}
+
+// Starts (or, after a redirect, restarts) the exchange for request_.url.
+void HttpExchange::begin() {
+  response_ = HttpResponse();
+  response_.url = request_.url;
+  if (!parseUrl(request_.url)) {
+    fail(request_.url.rfind("https://", 0) == 0
+             ? "https:// is not supported by the native HTTP client"
+             : "Invalid URL: " + request_.url);
+    return;
+  }
+
+  // Defaults first; a header the caller sets replaces its default.
+  auto given = [&](const char *name) {
+    for (const auto &[n, v] : request_.headers)
+      if (equalsIgnoreCase(n, name))
+        return true;
+    return false;
+  };
+  out_ = request_.method + " " + target_ + " HTTP/1.1\r\n";
+  if (!given("host"))
+    out_ += "Host: " + (host_.find(':') != std::string::npos
+                            ? "[" + host_ + "]"
+                            : host_) +
+            (port_ == "80" ? "" : ":" + port_) + "\r\n";
+  if (!given("user-agent"))
+    out_ += "User-Agent: luma\r\n";
+  if (!given("accept"))
+    out_ += "Accept: */*\r\n";
+  for (const auto &[name, value] : request_.headers) {
+    if (!equalsIgnoreCase(name, "content-length"))
+      out_ += name + ": " + value + "\r\n";
+  }
+  if (!request_.body.empty() || request_.method == "POST" ||
+      request_.method == "PUT" || request_.method == "PATCH")
+    out_ += "Content-Length: " + std::to_string(request_.body.size()) + "\r\n";
+  out_ += "\r\n";
+  out_ += request_.body;
+  sent_ = 0;
+
+  fd_ = ConnectionPool::local().take(hostKey_);
+  if (fd_ >= 0) {
+    reused_ = true;
+    state_ = State::Sending;
+    send();
+    return;
+  }
+  reused_ = false;
+  std::string error;
+  if (!resolve(error)) {
+    fail(error);
+    return;
+  }
+  connectNext("no addresses");
+}
+
+bool HttpExchange::resolve(std::string &error) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *found = nullptr;
+  const int rc = getaddrinfo(host_.c_str(), port_.c_str(), &hints, &found);
+  if (rc != 0) {
+    error = "Cannot resolve " + host_ + ": " + gai_strerror(rc);
+    return false;
+  }
+  addresses_.clear();
+  for (addrinfo *a = found; a; a = a->ai_next) {
+    sockaddr_storage address{};
+    std::memcpy(&address, a->ai_addr, a->ai_addrlen);
+    addresses_.emplace_back(address, a->ai_addrlen);
+  }
+  freeaddrinfo(found);
+  nextAddress_ = 0;
+  return true;
+}
+
+// Tries the remaining addresses in turn; `why` is the last failure.
+void HttpExchange::connectNext(const std::string &why) {
+  closeConnection();
+  while (nextAddress_ < addresses_.size()) {
+    const auto &[address, length] = addresses_[nextAddress_++];
+    fd_ = ::socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                   0);
+    if (fd_ < 0)
+      continue;
+    if (::connect(fd_, reinterpret_cast<const sockaddr *>(&address),
+                  length) == 0) {
+      state_ = State::Sending;
+      send();
+      return;
+    }
+    if (errno == EINPROGRESS) {
+      state_ = State::Connecting;
+      return;
+    }
+    closeConnection();
+  }
+  fail("Cannot connect to " + hostKey_ + ": " + why);
+}
+
+// A pooled connection the server had already dropped fails on first use;
+// the request is sent again on a new connection when that is safe.
+void HttpExchange::retryOrFail(const std::string &message) {
+  std::string error;
+  if (reused_ && received_ == 0 && idempotent(request_.method) &&
+      resolve(error)) {
+    reused_ = false;
+    sent_ = 0;
+    in_.clear();
+    inPos_ = 0;
+    connectNext(message);
+    return;
+  }
+  fail(message);
+}
+
+void HttpExchange::advance(short revents) {
+  (void)revents; // the calls below report errors and hang-ups themselves
+  if (state_ == State::Connecting) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+      error = errno;
+    if (error != 0) {
+      connectNext(std::strerror(error));
+      return;
+    }
+    state_ = State::Sending;
+  }
+  if (state_ == State::Sending) {
+    send();
+    return;
+  }
+  if (state_ == State::Head || state_ == State::Body)
+    receive();
+}
+
+void HttpExchange::expire() {
+  if (!done())
+    fail("HTTP request to " + request_.url + " timed out");
+}
+
+void HttpExchange::send() {
+  while (sent_ < out_.size()) {
+    const ssize_t n = ::send(fd_, out_.data() + sent_, out_.size() - sent_,
+                             MSG_NOSIGNAL);
+    if (n > 0) {
+      sent_ += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    retryOrFail(std::string("Send failed: ") + std::strerror(errno));
+    return;
+  }
+  out_.clear();
+  state_ = State::Head;
+  in_.clear();
+  inPos_ = 0;
+  received_ = 0;
+  receive(); // usually nothing yet, but saves a poll when it is
+}
+
+void HttpExchange::receive() {
+  char chunk[16 * 1024];
+  while (state_ == State::Head || state_ == State::Body) {
+    ssize_t n;
+    if (state_ == State::Body && bodyMode_ == BodyMode::Length &&
+        inPos_ == in_.size()) {
+      // Straight into the body: no staging copy for the bulk of it.
+      const size_t want = std::min(remaining_, kReadChunk);
+      char *dest = extendBody(want);
+      n = ::recv(fd_, dest, want, 0);
+      shrinkBody(want - static_cast<size_t>(std::max<ssize_t>(n, 0)));
+      if (n > 0) {
+        received_ += static_cast<size_t>(n);
+        remaining_ -= static_cast<size_t>(n);
+        if (remaining_ == 0)
+          complete();
+        continue;
+      }
+    } else {
+      n = ::recv(fd_, chunk, sizeof(chunk), 0);
+      if (n > 0) {
+        received_ += static_cast<size_t>(n);
+        if (inPos_ == in_.size()) {
+          in_.clear();
+          inPos_ = 0;
+        }
+        in_.append(chunk, static_cast<size_t>(n));
+        parse();
+        continue;
+      }
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (n < 0) {
+      retryOrFail(std::string("Receive failed: ") + std::strerror(errno));
+      return;
+    }
+    // The server closed the connection.
+    keepAlive_ = false;
+    if (state_ == State::Body && bodyMode_ == BodyMode::UntilClose)
+      complete();
+    else if (received_ == 0)
+      retryOrFail("Connection closed before any response");
+    else
+      fail("Connection closed before the response was complete");
+    return;
+  }
+}
+
+void HttpExchange::parse() {
+  while (state_ == State::Head || state_ == State::Body) {
+    const size_t available = in_.size() - inPos_;
+    if (state_ == State::Head) {
+      const size_t end = in_.find("\r\n\r\n", inPos_);
+      if (end == std::string::npos) {
+        if (available > kMaxHeadBytes)
+          fail("Response head too large");
+        return;
+      }
+      if (!parseHead(end))
+        return;
+      continue;
+    }
+
+    if (bodyMode_ == BodyMode::UntilClose) {
+      appendBody(in_.data() + inPos_, available);
+      inPos_ = in_.size();
+      return;
+    }
+    if (bodyMode_ == BodyMode::Length) {
+      const size_t take = std::min(remaining_, available);
+      appendBody(in_.data() + inPos_, take);
+      inPos_ += take;
+      remaining_ -= take;
+      if (remaining_ == 0)
+        complete();
+      return;
+    }
+
+    // Chunked: "<hex size>[;ext]\r\n<data>\r\n" ... "0\r\n<trailers>\r\n"
+    if (chunkState_ == ChunkState::Data) {
+      const size_t take = std::min(remaining_, available);
+      appendBody(in_.data() + inPos_, take);
+      inPos_ += take;
+      remaining_ -= take;
+      if (remaining_ > 0)
+        return;
+      chunkState_ = ChunkState::DataEnd;
+      continue;
+    }
+    if (chunkState_ == ChunkState::DataEnd) {
+      if (available < 2)
+        return;
+      if (in_.compare(inPos_, 2, "\r\n") != 0) {
+        fail("Malformed chunked body");
+        return;
+      }
+      inPos_ += 2;
+      chunkState_ = ChunkState::Size;
+      continue;
+    }
+    const size_t lineEnd = in_.find("\r\n", inPos_);
+    if (lineEnd == std::string::npos) {
+      if (available > kMaxHeadBytes)
+        fail("Malformed chunked body");
+      return;
+    }
+    const std::string line = in_.substr(inPos_, lineEnd - inPos_);
+    inPos_ = lineEnd + 2;
+    if (chunkState_ == ChunkState::Trailers) {
+      if (line.empty())
+        complete();
+      continue;
+    }
+    char *end = nullptr;
+    const unsigned long long size = std::strtoull(line.c_str(), &end, 16);
+    if (end == line.c_str()) {
+      fail("Malformed chunk size");
+      return;
+    }
+    if (size == 0) {
+      chunkState_ = ChunkState::Trailers;
+    } else {
+      remaining_ = static_cast<size_t>(size);
+      chunkState_ = ChunkState::Data;
+    }
+  }
+}
+
+// The head spans [inPos_, end); false if the exchange failed.
+bool HttpExchange::parseHead(size_t end) {
+  const std::string head = in_.substr(inPos_, end - inPos_);
+  inPos_ = end + 4;
+
+  size_t lineEnd = head.find("\r\n");
+  const std::string statusLine = head.substr(0, lineEnd);
+  // "HTTP/1.1 200 OK"
+  if (statusLine.rfind("HTTP/1.", 0) != 0 || statusLine.size() < 12) {
+    fail("Malformed response status line");
+    return false;
+  }
+  const bool http10 = statusLine.compare(5, 3, "1.0") == 0;
+  const int status = std::atoi(statusLine.c_str() + 9);
+  if (status < 100 || status > 999) {
+    fail("Malformed response status line");
+    return false;
+  }
+  if (status >= 100 && status < 200)
+    return true; // 100 Continue and friends: the real head follows
+
+  response_.status = status;
+  response_.reason = statusLine.size() > 13 ? statusLine.substr(13) : "";
+  response_.headers.clear();
+  bool chunked = false;
+  bool haveLength = false;
+  size_t length = 0;
+  keepAlive_ = !http10;
+  while (lineEnd != std::string::npos) {
+    const size_t start = lineEnd + 2;
+    lineEnd = head.find("\r\n", start);
+    const std::string line = head.substr(start, lineEnd - start);
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos)
+      continue;
+    std::string name = lower(trim(line.substr(0, colon)));
+    std::string value = trim(line.substr(colon + 1));
+    if (name == "transfer-encoding") {
+      chunked = lower(value).find("chunked") != std::string::npos;
+    } else if (name == "content-length") {
+      haveLength = true;
+      length = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+    } else if (name == "connection") {
+      const std::string v = lower(value);
+      if (v.find("close") != std::string::npos)
+        keepAlive_ = false;
+      else if (v.find("keep-alive") != std::string::npos)
+        keepAlive_ = true;
+    }
+    response_.headers.emplace_back(std::move(name), std::move(value));
+  }
+
+  if (request_.bodyAsBuffer)
+    response_.buffer = makeRef<ByteBuffer>();
+  state_ = State::Body;
+  chunkState_ = ChunkState::Size;
+  if (request_.method == "HEAD" || status == 204 || status == 304) {
+    complete();
+  } else if (chunked) {
+    bodyMode_ = BodyMode::Chunked;
+  } else if (haveLength) {
+    bodyMode_ = BodyMode::Length;
+    remaining_ = length;
+    // Reserve what the server announced, within reason.
+    if (request_.bodyAsBuffer)
+      response_.buffer->bytes.reserve(std::min<size_t>(length, 64 << 20));
+    else
+      response_.body.reserve(std::min<size_t>(length, 64 << 20));
+    if (length == 0)
+      complete();
+  } else {
+    bodyMode_ = BodyMode::UntilClose;
+    keepAlive_ = false;
+  }
+  return true;
+}
+
+void HttpExchange::appendBody(const char *data, size_t size) {
+  if (size == 0)
+    return;
+  std::memcpy(extendBody(size), data, size);
+}
+
+// Room for `size` more body bytes, to be filled in place.
+char *HttpExchange::extendBody(size_t size) {
+  if (response_.buffer) {
+    auto &bytes = response_.buffer->bytes;
+    bytes.resize(bytes.size() + size);
+    return reinterpret_cast<char *>(bytes.data() + bytes.size() - size);
+  }
+  response_.body.resize(response_.body.size() + size);
+  return &response_.body[response_.body.size() - size];
+}
+
+// Gives back the unused tail of the last extendBody().
+void HttpExchange::shrinkBody(size_t size) {
+  if (response_.buffer)
+    response_.buffer->bytes.resize(response_.buffer->bytes.size() - size);
+  else
+    response_.body.resize(response_.body.size() - size);
+}
+
+void HttpExchange::complete() {
+  // Reusable only if nothing beyond this response was received.
+  if (keepAlive_ && inPos_ == in_.size() && fd_ >= 0) {
+    ConnectionPool::local().give(hostKey_, fd_);
+    fd_ = -1;
+  } else {
+    closeConnection();
+  }
+  in_.clear();
+  inPos_ = 0;
+
+  const int status = response_.status;
+  const bool redirect = status == 301 || status == 302 || status == 303 ||
+                        status == 307 || status == 308;
+  std::string location;
+  for (const auto &[name, value] : response_.headers)
+    if (name == "location")
+      location = value;
+  if (redirect && !location.empty() && redirectsLeft_ > 0) {
+    --redirectsLeft_;
+    if (location[0] == '/')
+      location = "http://" + hostKey_ + location;
+    request_.url = location;
+    // 303, and 301/302 after a POST, continue as a GET without the body.
+    if (status == 303 ||
+        ((status == 301 || status == 302) && request_.method == "POST")) {
+      request_.method = "GET";
+      request_.body.clear();
+    }
+    begin();
+    return;
+  }
+  state_ = State::Done;
+}
+
+void HttpExchange::closeConnection() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void HttpExchange::fail(const std::string &message) {
+  closeConnection();
+  const std::string url = response_.url;
+  response_ = HttpResponse();
+  response_.url = url.empty() ? request_.url : url;
+  response_.error = message;
+  state_ = State::Done;
+}
+
+void HttpExchange::runAll(const std::vector<HttpExchange *> &exchanges,
+                          size_t perHost) {
+  // Host keys are kept from the start: a redirect may change an exchange's.
+  std::unordered_map<std::string, size_t> open;
+  std::vector<std::pair<HttpExchange *, std::string>> active;
+  std::vector<HttpExchange *> waiting(exchanges.rbegin(), exchanges.rend());
+  std::vector<pollfd> fds;
+
+  while (true) {
+    // Start whatever the per-host limit allows, in order.
+    std::vector<HttpExchange *> blocked;
+    while (!waiting.empty()) {
+      HttpExchange *ex = waiting.back();
+      waiting.pop_back();
+      if (open[ex->hostKey()] >= perHost) {
+        blocked.push_back(ex);
+        continue;
+      }
+      ex->start();
+      if (!ex->done()) {
+        ++open[ex->hostKey()];
+        active.emplace_back(ex, ex->hostKey());
+      }
+    }
+    waiting.assign(blocked.rbegin(), blocked.rend());
+    if (active.empty())
+      break;
+
+    fds.clear();
+    double soonest = active.front().first->deadline();
+    for (const auto &[ex, key] : active) {
+      fds.push_back({ex->fd(), ex->events(), 0});
+      soonest = std::min(soonest, ex->deadline());
+    }
+    const double wait = std::clamp(soonest - Reactor::now(), 0.0, 60000.0);
+    const int rc = ::poll(fds.data(), fds.size(), static_cast<int>(wait) + 1);
+    if (rc < 0 && errno != EINTR) {
+      const std::string error = std::string("poll failed: ") + std::strerror(errno);
+      for (HttpExchange *ex : exchanges)
+        if (!ex->done())
+          ex->fail(error);
+      return;
+    }
+
+    const double now = Reactor::now();
+    for (size_t i = 0; i < active.size(); ++i) {
+      HttpExchange *ex = active[i].first;
+      if (rc > 0 && fds[i].revents)
+        ex->advance(fds[i].revents);
+      else if (now >= ex->deadline())
+        ex->expire();
+    }
+    for (auto it = active.begin(); it != active.end();) {
+      if (it->first->done()) {
+        --open[it->second];
+        it = active.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+#include "value.hpp"
+
+// Native HTTP/1.1 client behind @std.http.
+//
+// Each request is an HttpExchange: a non-blocking state machine over one
+// TCP connection that connects, sends the request and reads the response
+// head, then the body by Content-Length, by chunks or until the server
+// closes. The same exchange is driven in three ways: alone with poll()
+// (http.request), several at once in one poll() loop (http.request_all), or
+// by the interpreter's reactor (http.request_async).
+//
+// A connection that finishes a response cleanly and was not asked to close
+// goes back to a per-thread pool keyed by host and port, so the next
+// request to that host skips the TCP handshake. Only plain http:// is
+// spoken; there is no TLS here.
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+struct HttpRequest {
+  std::string method = "GET";
+  std::string url;
+  HttpHeaders headers; // sent as given, after the defaults they replace
+  std::string body;
+  double timeoutMs = 10000; // for the whole exchange, redirects included
+  int maxRedirects = 5;
+  bool bodyAsBuffer = false; // read the body into a ByteBuffer
+};
+
+struct HttpResponse {
+  int status = 0;
+  std::string reason;
+  HttpHeaders headers; // names lower-cased, in the order received
+  std::string body;    // unless the request asked for a buffer
+  BufferPtr buffer;
+  std::string url;   // after redirects
+  std::string error; // set instead of the fields above on failure
+};
+
+class HttpExchange {
+public:
+  explicit HttpExchange(HttpRequest request);
+  ~HttpExchange(); // closes a connection still in use
+  HttpExchange(const HttpExchange &) = delete;
+  HttpExchange &operator=(const HttpExchange &) = delete;
+
+  // Resolves the host and connects, or takes a pooled connection. May
+  // finish at once, e.g. with an error for a malformed URL.
+  void start();
+
+  // The socket to wait on and the poll() events it needs; -1 once done.
+  int fd() const { return fd_; }
+  short events() const;
+  bool done() const { return state_ == State::Done; }
+  double deadline() const { return deadline_; } // Reactor::now() clock
+
+  // Makes progress after poll() reported `revents` on fd().
+  void advance(short revents);
+  void expire(); // the deadline passed
+
+  const std::string &hostKey() const { return hostKey_; } // "host:port"
+  HttpResponse &response() { return response_; }
+
+  // Runs the exchanges to completion together, with at most
+  // `perHost` connections open to any one host at a time.
+  static void runAll(const std::vector<HttpExchange *> &exchanges,
+                     size_t perHost = 6);
+
+private:
+  enum class State { Idle, Connecting, Sending, Head, Body, Done };
+  enum class BodyMode { Length, Chunked, UntilClose };
+  enum class ChunkState { Size, Data, DataEnd, Trailers };
+
+  HttpRequest request_;
+  HttpResponse response_;
+  State state_ = State::Idle;
+  double deadline_ = 0;
+  int redirectsLeft_;
+
+  std::string host_;
+  std::string port_;
+  std::string target_; // path and query
+  std::string hostKey_;
+
+  int fd_ = -1;
+  bool reused_ = false; // fd_ came from the pool
+  std::vector<std::pair<sockaddr_storage, socklen_t>> addresses_;
+  size_t nextAddress_ = 0;
+
+  std::string out_; // request bytes
+  size_t sent_ = 0;
+
+  std::string in_; // received bytes not yet consumed
+  size_t inPos_ = 0;
+  size_t received_ = 0; // bytes received on this connection
+  BodyMode bodyMode_ = BodyMode::Length;
+  ChunkState chunkState_ = ChunkState::Size;
+  size_t remaining_ = 0; // body or chunk bytes still expected
+  bool keepAlive_ = true;
+
+  bool parseUrl(const std::string &url);
+  void begin();
+  bool resolve(std::string &error);
+  void connectNext(const std::string &why);
+  void retryOrFail(const std::string &message);
+  void send();
+  void receive();
+  void parse();
+  bool parseHead(size_t end);
+  void appendBody(const char *data, size_t size);
+  char *extendBody(size_t size);
+  void shrinkBody(size_t size);
+  void complete();
+  void closeConnection();
+  void fail(const std::string &message);
+};
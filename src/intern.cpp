@@ -0,0 +1,44 @@
+#include "intern.hpp"
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+struct SymbolTable {
+  std::mutex mutex;
+  std::deque<std::string> names; // index = symbol - 1; deque keeps views valid
+  std::unordered_map<std::string_view, Symbol> ids;
+};
+
+static SymbolTable &table() {
+  static SymbolTable instance;
+  return instance;
+}
+
+Symbol intern(std::string_view name, std::string_view &stored) {
+  SymbolTable &t = table();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  auto it = t.ids.find(name);
+  if (it != t.ids.end()) {
+    stored = it->first;
+    return it->second;
+  }
+  t.names.emplace_back(name);
+  Symbol symbol = static_cast<Symbol>(t.names.size());
+  stored = t.names.back();
+  t.ids.emplace(stored, symbol);
+  return symbol;
+}
+
+Symbol intern(std::string_view name) {
+  std::string_view stored;
+  return intern(name, stored);
+}
+
+const std::string &symbolName(Symbol symbol) {
+  SymbolTable &t = table();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  if (symbol == 0 || symbol > t.names.size())
+    throw std::out_of_range("Unknown symbol " + std::to_string(symbol));
+  return t.names[symbol - 1];
+}
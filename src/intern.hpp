@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Interned identifier. Equal names always map to the same Symbol, so the
+// runtime can key variables, fields and methods on integers. Symbols are
+// dense, start at 1 (0 means "none") and stay valid for the whole process.
+using Symbol = uint32_t;
+
+// All of these are thread-safe; the table is shared by every interpreter.
+Symbol intern(std::string_view name);
+// As intern(), also setting `stored` to the table's own copy of the name.
+Symbol intern(std::string_view name, std::string_view &stored);
+const std::string &symbolName(Symbol symbol);
@@ -1,6 +1,23 @@
 #include "interpreter.hpp"
+#include "ast_cache.hpp"
+#include "cache.hpp"
+#include "compiler.hpp"
+#include "crypto.hpp"
+#include "file_io.hpp"
+#include "gc.hpp"
+#include "http_client.hpp"
+#include "json.hpp"
 #include "lexer.hpp"
+#include "optimizer.hpp"
+#include "parallel.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
+#include "reactor.hpp"
+#include "resolver.hpp"
+#include "source_buffer.hpp"
+#include "string_ops.hpp"
+#include "vm.hpp"
+#include "worker_pool.hpp"
 #include <algorithm>
 #include <array>
 #include <cctype>
@@ -10,12 +27,14 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <list>
 #include <random>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <chrono>
 #include <thread>
+#include <utility>
 #include <unistd.h>
 #include <limits.h>
 #include <sys/socket.h>
@@ -25,6 +44,14 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <cstring>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -94,6 +121,8 @@ static Value nativeSysEnviron(const std::vector<Value> &args);
 static Value nativeSysExit(const std::vector<Value> &args);
 static Value nativeSysArgv(const std::vector<Value> &args);
 static Value nativeSysProgname(const std::vector<Value> &args);
+static Value nativeSysGc(const std::vector<Value> &args);
+static Value nativeSysGcStats(const std::vector<Value> &args);
 
 // UUID module natives
 static Value nativeUuidV4(const std::vector<Value> &args);
@@ -134,14 +163,26 @@ static Value nativeSocketRecvFrom(const std::vector<Value> &args);
 static Value nativeSocketClose(const std::vector<Value> &args);
 static Value nativeSocketSetOption(const std::vector<Value> &args);
 static Value nativeSocketGetOption(const std::vector<Value> &args);
-
-
-Interpreter::Interpreter() {
-  globals_ = std::make_shared<Environment>();
+static Value nativeSocketRecvBuffer(const std::vector<Value> &args);
+static Value nativeSocketRecvInto(const std::vector<Value> &args);
+static Value nativeSocketSetNonblocking(const std::vector<Value> &args);
+static Value nativeSocketListenTcp(const std::vector<Value> &args);
+static Value nativeSocketRecvMmsg(const std::vector<Value> &args);
+static Value nativeSocketSendMmsg(const std::vector<Value> &args);
+static Value nativeSocketWritev(const std::vector<Value> &args);
+static Value nativeSocketSendfile(const std::vector<Value> &args);
+
+// Buffer value methods, keyed by name
+static void defineBufferMethods(
+    std::unordered_map<Symbol, NativeFunctionPtr> &methods);
+
+
+Interpreter::Interpreter() : vm_(std::make_unique<VM>(*this)) {
+  globals_ = makeRef<Environment>();
   env_ = globals_;
 
   auto defineGlobal = [&](const std::string &name, std::function<Value(const std::vector<Value> &)> func, size_t arity) {
-    auto native = std::make_shared<NativeFunctionObject>();
+    auto native = makeRef<NativeFunctionObject>();
     native->name = name;
     native->func = func;
     native->arity = arity;
@@ -153,8 +194,29 @@ Interpreter::Interpreter() {
   defineGlobal("pop", nativePop, 1);
   defineGlobal("keys", nativeKeys, 1);
   defineGlobal("remove", nativeRemove, 2);
+
+  defineBufferMethods(bufferMethods_);
+  defineListMethods();
 }
 
+Interpreter::~Interpreter() {
+  // Reference counting alone would leave cycles among this interpreter's
+  // objects (a module's functions and its environment, say) on the
+  // thread's heap until the next poll, or for good once the thread exits.
+  // Drop every root first, so one collection frees them.
+  reactor_.reset(); // pending callbacks
+  vm_.reset();
+  moduleCache_.clear();
+  hostNatives_.clear();
+  currentExports_.reset();
+  returnValue_ = Value();
+  env_.reset();
+  globals_.reset();
+  gcCollect();
+}
+
+void Interpreter::setEngine(Engine engine) { engine_ = engine; }
+
 void Interpreter::setExecutablePath(const std::string &path) {
   executablePath_ = fs::absolute(path).string();
 }
@@ -204,184 +266,379 @@ void Interpreter::initializeRoots() {
   }
 }
 
-void Interpreter::run(const std::vector<StmtPtr> &program) {
-  try {
+void Interpreter::run(std::vector<StmtPtr> &program) {
+  resolve(program);
+  runResolved(program);
+}
+
+void Interpreter::run(Program program) {
+  scripts_.push_back(std::move(program));
+  Program &script = scripts_.back();
+  if (optimize_)
+    Optimizer(script.arena).optimize(script.statements);
+  run(script.statements);
+}
+
+Interpreter::Script &Interpreter::compile(Program program) {
+  compiled_.push_back(std::make_unique<Script>());
+  Script &script = *compiled_.back();
+  script.program = std::move(program);
+  if (optimize_)
+    Optimizer(script.program.arena).optimize(script.program.statements);
+  resolve(script.program.statements);
+  return script;
+}
+
+void Interpreter::run(Script &script) {
+  runResolved(script.program.statements, &script.chunk);
+}
+
+void Interpreter::runResolved(const std::vector<StmtPtr> &program,
+                              std::shared_ptr<const Chunk> *chunk) {
+  if (engine_ == Engine::Bytecode) {
+    std::shared_ptr<const Chunk> compiled;
+    if (chunk && *chunk)
+      compiled = *chunk;
+    else
+      compiled = Compiler().compileScript(program);
+    if (chunk)
+      *chunk = compiled;
+    (void)vm_->run(*compiled, env_);
+  } else {
     for (const auto &s : program) {
-      execute(*s);
+      if (execute(*s) == Completion::Return) {
+        returnValue_ = std::monostate{};
+        throw std::runtime_error("Return used outside of a function.");
+      }
+      gcMaybeCollect();
     }
-  } catch (const ReturnSignal &) {
-    throw std::runtime_error("Return used outside of a function.");
   }
+  // Like a browser or Node, a script that started timers or watches keeps
+  // running until its event loop has nothing left to do.
+  if (reactor_)
+    runReactor(-1, true);
+}
+
+Profiler &Interpreter::startProfiler() {
+  if (!profiler_)
+    profiler_ = std::make_unique<Profiler>();
+  profiler_->start();
+  return *profiler_;
+}
+
+Reactor &Interpreter::reactor() {
+  if (!reactor_)
+    reactor_ = std::make_unique<Reactor>();
+  return *reactor_;
+}
+
+Value Interpreter::call(const Value &callee, const std::vector<Value> &args) {
+  static const Token paren{TokenType::RightParen, ")", 0};
+  return callFunction(callee, args, paren);
+}
+
+Value *Interpreter::findGlobal(std::string_view name) {
+  return globals_->find(intern(name));
+}
+
+void Interpreter::defineHostNative(const std::string &moduleId,
+                                   NativeFunctionPtr native) {
+  if (moduleId.empty()) {
+    globals_->define(intern(native->name), native);
+    return;
+  }
+  if (moduleId.size() < 2 || moduleId[0] != '@')
+    throw std::runtime_error("Invalid module ID: " + moduleId);
+  // Already imported: add it now; otherwise loadModule adds it.
+  auto loaded = moduleCache_.find(moduleId);
+  if (loaded != moduleCache_.end())
+    loaded->second->values[native->name] = native;
+  hostNatives_[moduleId].push_back(std::move(native));
+}
+
+bool Interpreter::runReactor(double timeoutMs, bool untilIdle) {
+  auto dispatch = [this](const Value &callback,
+                         const std::vector<Value> &args) {
+    (void)call(callback, args);
+    gcMaybeCollect();
+  };
+  if (untilIdle) {
+    reactor().run(dispatch);
+    return reactor_->pending();
+  }
+  return reactor().runOnce(timeoutMs, dispatch);
+}
+
+void Interpreter::resolve(std::vector<StmtPtr> &program) {
+  std::unordered_set<Symbol> known;
+  env_->collectNames(known);
+  Resolver(std::move(known)).resolve(program);
 }
 
 void Interpreter::assignOrDefine(const Token &name, Value value) {
-  if (env_->has(name.lexeme)) {
+  if (env_->has(name.symbol)) {
     env_->assign(name, std::move(value));
   } else {
-    env_->define(name.lexeme, std::move(value));
+    env_->define(name.symbol, std::move(value));
+  }
+}
+
+Value Interpreter::lookUpVariable(const Token &name, const Slot &slot) const {
+  if (slot.resolved())
+    return env_->ancestor(slot.depth)->slot(slot.index);
+  return env_->get(name);
+}
+
+void Interpreter::assignVariable(const Token &name, const Slot &slot,
+                                 Value value) {
+  if (slot.resolved())
+    env_->ancestor(slot.depth)->setSlot(slot.index, std::move(value));
+  else
+    assignOrDefine(name, std::move(value));
+}
+
+// def, class and use always bind in the current scope, shadowing outer names.
+void Interpreter::defineVariable(const Token &name, const Slot &slot,
+                                 Value value) {
+  if (slot.resolved())
+    env_->setSlot(slot.index, std::move(value));
+  else
+    env_->define(name.symbol, std::move(value));
+}
+
+void Interpreter::appendAssign(const Token &name, const Slot &slot,
+                               Value left, const Value &right) {
+  static const Token plus{TokenType::Plus, "+", 0};
+  const Ref<StringObject> *str = left.stringObject();
+  if (str && holds_alternative<std::string>(right) &&
+      str->use_count() == 2) {
+    // Evaluating x may have reassigned the variable, so check that it still
+    // holds this string before growing it.
+    Value *target = slot.resolved()
+                        ? &env_->ancestor(slot.depth)->slot(slot.index)
+                        : env_->find(name.symbol);
+    const Ref<StringObject> *held = target ? target->stringObject() : nullptr;
+    if (held && *held == *str) {
+      (*held)->value += get<std::string>(right);
+      return;
+    }
+  }
+  assignVariable(name, slot, binaryOp(plus, left, right));
+}
+
+void Interpreter::executeSwap(const SwapStmt &stmt) {
+  auto read = [&](const Token &name, const Slot &slot) {
+    return slot.resolved() ? env_->ancestor(slot.depth)->slot(slot.index)
+                           : env_->get(name);
+  };
+  auto write = [&](const Token &name, const Slot &slot, Value value) {
+    if (slot.resolved())
+      env_->ancestor(slot.depth)->setSlot(slot.index, std::move(value));
+    else
+      env_->assign(name, std::move(value));
+  };
+  Value leftVal = read(stmt.left, stmt.leftSlot);
+  Value rightVal = read(stmt.right, stmt.rightSlot);
+  write(stmt.left, stmt.leftSlot, std::move(rightVal));
+  write(stmt.right, stmt.rightSlot, std::move(leftVal));
+}
+
+Ref<Environment>
+Interpreter::callEnvironment(const Function &function, const InstancePtr &self,
+                             const std::vector<Value> &args) {
+  if (args.size() != function.arity()) {
+    throw std::runtime_error("Expected " + std::to_string(function.arity()) +
+                             " arguments but got " +
+                             std::to_string(args.size()) + ".");
   }
+  const ScopeInfo &scope = function.body->scope;
+  auto environment = envPool_.acquire(function.closure, &scope);
+  int base = 0;
+  if (scope.receiver) {
+    environment->setSlot(0, self ? Value(self) : Value(std::monostate{}));
+    base = 1;
+  }
+  for (size_t i = 0; i < args.size(); ++i) {
+    environment->setSlot(base + static_cast<int>(i), args[i]);
+  }
+  return environment;
 }
 
-void Interpreter::executeBlock(const BlockStmt &block,
-                               std::shared_ptr<Environment> newEnv) {
-  std::shared_ptr<Environment> previous = env_;
+Interpreter::Completion
+Interpreter::executeBlock(const BlockStmt &block,
+                          Ref<Environment> newEnv) {
+  Ref<Environment> previous = env_;
+  Completion completion = Completion::Normal;
   try {
     env_ = newEnv;
     for (const auto &stmt : block.statements) {
-      execute(*stmt);
+      completion = execute(*stmt);
+      if (completion == Completion::Return)
+        break;
     }
   } catch (...) {
     env_ = previous;
     throw;
   }
   env_ = previous;
+  return completion;
+}
+
+Interpreter::Completion Interpreter::executeScoped(const BlockStmt &block) {
+  Ref<Environment> previous = env_;
+  env_ = envPool_.acquire(previous, &block.scope);
+  Completion completion = Completion::Normal;
+  try {
+    for (const auto &stmt : block.statements) {
+      completion = execute(*stmt);
+      if (completion == Completion::Return)
+        break;
+    }
+  } catch (...) {
+    envPool_.release(env_);
+    env_ = std::move(previous);
+    throw;
+  }
+  envPool_.release(env_);
+  env_ = std::move(previous);
+  return completion;
 }
 
 void Interpreter::visitClassStmt(const ClassStmt &stmt) {
-  env_->define(stmt.name.lexeme, std::monostate{});
+  defineVariable(stmt.name, stmt.slot, std::monostate{});
 
-  std::map<std::string, FunctionPtr> methods;
+  std::unordered_map<Symbol, FunctionPtr> methods;
   for (const auto &method : stmt.methods) {
-    auto func = std::make_shared<Function>();
+    auto func = makeRef<Function>();
     func->name = method->name;
     func->params = method->params;
     func->body = method->body.get();
     func->closure = env_; // Closure captures defining scope
-    methods[method->name.lexeme] = func;
+    methods[method->name.symbol] = func;
   }
 
-  auto klass = std::make_shared<LumaClass>();
+  auto klass = makeRef<LumaClass>();
   klass->name = stmt.name.lexeme;
   klass->methods = std::move(methods);
 
-  env_->assign(stmt.name, klass);
+  defineVariable(stmt.name, stmt.slot, klass);
 }
 
-void Interpreter::execute(const Stmt &stmt) {
+Interpreter::Completion Interpreter::execute(const Stmt &stmt) {
   if (auto *x = dynamic_cast<const ExprStmt *>(&stmt)) {
     (void)evaluate(*x->expr);
-    return;
+    return Completion::Normal;
   }
 
   if (auto *p = dynamic_cast<const PrintStmt *>(&stmt)) {
     Value v = evaluate(*p->expr);
     std::cout << valueToString(v) << "\n";
-    return;
+    return Completion::Normal;
   }
 
   if (auto *a = dynamic_cast<const VarAssignStmt *>(&stmt)) {
+    if (a->appended) {
+      Value left = lookUpVariable(a->name, a->slot);
+      appendAssign(a->name, a->slot, std::move(left), evaluate(*a->appended));
+      return Completion::Normal;
+    }
     Value v = evaluate(*a->value);
-    assignOrDefine(a->name, std::move(v));
-    return;
+    assignVariable(a->name, a->slot, std::move(v));
+    return Completion::Normal;
   }
 
   if (auto *b = dynamic_cast<const BlockStmt *>(&stmt)) {
-    auto newEnv = std::make_shared<Environment>(env_);
-    executeBlock(*b, std::move(newEnv));
-    return;
+    return executeScoped(*b);
   }
 
   if (auto *i = dynamic_cast<const IfStmt *>(&stmt)) {
     Value cond = evaluate(*i->condition);
     if (isTruthy(cond)) {
-      auto newEnv = std::make_shared<Environment>(env_);
-      executeBlock(*i->thenBranch, std::move(newEnv));
+      return executeScoped(*i->thenBranch);
     } else if (i->elseBranch) {
       // elseBranch can be a BlockStmt or another IfStmt (else if)
       if (auto *elseBlock =
               dynamic_cast<const BlockStmt *>(i->elseBranch.get())) {
-        auto newEnv = std::make_shared<Environment>(env_);
-        executeBlock(*elseBlock, std::move(newEnv));
+        return executeScoped(*elseBlock);
       } else {
         // It's another IfStmt (else if chain)
-        execute(*i->elseBranch);
+        return execute(*i->elseBranch);
       }
     }
-    return;
+    return Completion::Normal;
   }
 
   if (auto *w = dynamic_cast<const WhileStmt *>(&stmt)) {
     while (isTruthy(evaluate(*w->condition))) {
-      auto newEnv = std::make_shared<Environment>(env_);
-      executeBlock(*w->body, std::move(newEnv));
+      if (executeScoped(*w->body) == Completion::Return)
+        return Completion::Return;
+      gcMaybeCollect();
     }
-    return;
+    return Completion::Normal;
   }
 
   if (auto *u = dynamic_cast<const UntilStmt *>(&stmt)) {
     // Until = while (!condition)
     while (!isTruthy(evaluate(*u->condition))) {
-      auto newEnv = std::make_shared<Environment>(env_);
-      executeBlock(*u->body, std::move(newEnv));
+      if (executeScoped(*u->body) == Completion::Return)
+        return Completion::Return;
+      gcMaybeCollect();
     }
-    return;
+    return Completion::Normal;
   }
 
   if (auto *r = dynamic_cast<const ReturnStmt *>(&stmt)) {
-    Value v = std::monostate{};
-    if (r->value)
-      v = evaluate(*r->value);
-    throw ReturnSignal{std::move(v)};
+    returnValue_ = r->value ? evaluate(*r->value) : Value(std::monostate{});
+    return Completion::Return;
   }
 
   if (auto *f = dynamic_cast<const FuncDefStmt *>(&stmt)) {
-    auto fn = std::make_shared<Function>();
+    auto fn = makeRef<Function>();
     fn->name = f->name;
     fn->params = f->params;
     fn->body = f->body.get();
     fn->closure = env_; // capture defining environment
-    env_->define(f->name.lexeme, fn);
-    return;
+    defineVariable(f->name, f->slot, fn);
+    return Completion::Normal;
   }
 
   if (auto *c = dynamic_cast<const ClassStmt *>(&stmt)) {
     visitClassStmt(*c);
-    return;
+    return Completion::Normal;
   }
 
   // ========== Luma Unique Statements ==========
 
   // echo N { ... } - repeat block N times
   if (auto *e = dynamic_cast<const EchoStmt *>(&stmt)) {
-    Value countVal = evaluate(*e->count);
-    if (!std::holds_alternative<double>(countVal)) {
-      throw std::runtime_error("Echo count must be a number.");
-    }
-    int count = static_cast<int>(std::get<double>(countVal));
-    if (count < 0) {
-      throw std::runtime_error("Echo count cannot be negative.");
-    }
+    int count = echoCount(evaluate(*e->count));
     for (int i = 0; i < count; i++) {
-      auto newEnv = std::make_shared<Environment>(env_);
-      executeBlock(*e->body, std::move(newEnv));
+      if (executeScoped(*e->body) == Completion::Return)
+        return Completion::Return;
+      gcMaybeCollect();
     }
-    return;
+    return Completion::Normal;
   }
 
   // a <-> b - swap two variables
   if (auto *s = dynamic_cast<const SwapStmt *>(&stmt)) {
-    Value leftVal = env_->get(s->left);
-    Value rightVal = env_->get(s->right);
-    env_->assign(s->left, std::move(rightVal));
-    env_->assign(s->right, std::move(leftVal));
-    return;
+    executeSwap(*s);
+    return Completion::Normal;
   }
 
   // maybe { ... } otherwise { ... } - error handling
   if (auto *m = dynamic_cast<const MaybeStmt *>(&stmt)) {
     try {
-      auto newEnv = std::make_shared<Environment>(env_);
-      executeBlock(*m->tryBlock, std::move(newEnv));
+      return executeScoped(*m->tryBlock);
     } catch (const std::runtime_error &) {
       // If an error occurred and we have an otherwise block, execute it
       if (m->otherwiseBlock) {
-        auto newEnv = std::make_shared<Environment>(env_);
-        executeBlock(*m->otherwiseBlock, std::move(newEnv));
+        return executeScoped(*m->otherwiseBlock);
       }
       // If no otherwise block, silently continue (that's the "maybe"
       // philosophy)
     }
-    return;
+    return Completion::Normal;
   }
 
   // ========== Module System Statements ==========
@@ -396,97 +653,99 @@ void Interpreter::execute(const Stmt &stmt) {
       fs::path stdPath(stdlibRoot_);
       // For now, allow it (stdlib files need to declare their identity)
     }
-    return;
+    return Completion::Normal;
   }
 
   // use @std.io as io - load module and bind to alias
   if (auto *use = dynamic_cast<const UseStmt *>(&stmt)) {
     std::string moduleId = moduleIdToString(use->moduleIdParts);
     MapPtr exports = loadModule(moduleId);
-    env_->define(use->alias.lexeme, exports);
-    return;
+    defineVariable(use->alias, use->slot, exports);
+    return Completion::Normal;
   }
 
   throw std::runtime_error("Unknown statement at runtime.");
 }
 
 static void requireNumber(const Value &v, const std::string &where) {
-  if (!std::holds_alternative<double>(v)) {
+  if (!holds_alternative<double>(v)) {
     throw std::runtime_error("Type error: expected number in " + where +
                              ", got " + valueToString(v));
   }
 }
 
+// Profiler::Scope describers: display name and definition line of a callee.
+static auto describeFunction(const Function &function,
+                             const InstancePtr &self) {
+  return [&function, &self](std::string &name, int &line) {
+    name = std::string(function.name.lexeme);
+    if (self)
+      name = self->klass->name + "." + name;
+    line = function.name.line;
+  };
+}
+
+static auto describeNative(const NativeFunctionObject &native,
+                           const char *prefix = "") {
+  return [&native, prefix](std::string &name, int &) {
+    name = prefix + native.name;
+  };
+}
+
 Value Interpreter::callFunction(const Value &callee,
                                 const std::vector<Value> &args,
                                 const Token &callSiteParen) {
-  if (auto fn = std::get_if<FunctionPtr>(&callee)) {
+  if (auto fn = get_if<FunctionPtr>(&callee)) {
     FunctionPtr function = *fn;
-    if (args.size() != function->arity()) {
-      throw std::runtime_error("Expected " + std::to_string(function->arity()) +
-                               " arguments but got " +
-                               std::to_string(args.size()) + ".");
-    }
-
-    auto environment = std::make_shared<Environment>(function->closure);
-    for (size_t i = 0; i < function->params.size(); ++i) {
-      environment->define(function->params[i].lexeme, args[i]);
-    }
-
-    try {
-      executeBlock(*function->body, environment);
-    } catch (const ReturnSignal &returnValue) {
-      return returnValue.value;
-    }
-    return std::monostate{};
+    Profiler::Scope frame(profiler_.get(), function->body, callSiteParen.line,
+                          describeFunction(*function, function->receiver));
+    return invokeFunction(*function, function->receiver, args);
   }
 
-  if (auto nf = std::get_if<NativeFunctionPtr>(&callee)) {
+  if (auto nf = get_if<NativeFunctionPtr>(&callee)) {
       NativeFunctionPtr native = *nf;
       if (!native->variadic && args.size() != native->arity) {
           throw std::runtime_error("Expected " + std::to_string(native->arity) +
               " arguments but got " +
               std::to_string(args.size()) + ".");
       }
+      Profiler::Scope frame(profiler_.get(), native.get(), callSiteParen.line,
+                            describeNative(*native));
       return native->func(args);
   }
 
-  if (auto klass = std::get_if<ClassPtr>(&callee)) {
+  if (auto klass = get_if<ClassPtr>(&callee)) {
     // Create instance
-    auto instance = std::make_shared<LumaInstance>(*klass);
+    auto instance = makeRef<LumaInstance>(*klass);
 
     // Look for definition of "init"
-    FunctionPtr init = (*klass)->findMethod("init");
+    static const Symbol kInit = intern("init");
+    FunctionPtr init = (*klass)->findMethod(kInit);
+    Profiler::Scope frame(profiler_.get(), klass->get(), callSiteParen.line,
+                          [&](std::string &name, int &line) {
+                            name = (*klass)->name + (init ? ".init" : "()");
+                            line = init ? init->name.line : 0;
+                          });
     if (init) {
-      // Bind 'this' to init
-      // We need to bind 'this' to the method call.
-      // Current implementation of Function doesn't support 'this' binding
-      // implicitly? We need a way to bind 'this'. Standard Lox way:
-      // Function.bind(instance) -> new Function with environment containing
-      // "this".
-
-      auto environment = std::make_shared<Environment>(init->closure);
-      environment->define("this", instance); // Bind 'this'
-
-      // Handle args
-      if (args.size() != init->arity()) {
-        throw std::runtime_error("Expected " + std::to_string(init->arity()) +
-                                 " arguments but got " +
-                                 std::to_string(args.size()) + ".");
-      }
-      for (size_t i = 0; i < init->params.size(); ++i) {
-        environment->define(init->params[i].lexeme, args[i]);
+      // 'this' is slot 0 of the method scope
+      auto environment = callEnvironment(*init, instance, args);
+
+      if (engine_ == Engine::Bytecode) {
+        // Lox semantics: the value of an explicit return in init is ignored.
+        (void)vm_->run(vm_->chunkFor(*init->body), environment);
+        envPool_.release(environment);
+        return instance;
       }
 
-      try {
-        executeBlock(*init->body, environment);
-      } catch (const ReturnSignal &returnValue) {
+      if (executeBlock(*init->body, environment) == Completion::Return) {
         // initializer usually returns 'this', but if user returns something
         // else? Lox: always return this. Luma: let's return this implicitly
         // unless explicit return? For now, ignore return value of init and
         // return instance? Or allow explicit return? Lox ignores explicit
         // return in init. Let's mimic Lox: init returns 'this'.
+        returnValue_ = std::monostate{};
       }
+      envPool_.release(environment);
     } else {
       if (!args.empty()) {
         throw std::runtime_error("Expected 0 arguments but got " +
@@ -499,6 +758,392 @@ Value Interpreter::callFunction(const Value &callee,
 
   throw std::runtime_error("Can only call functions and classes.");
 }
+
+Value Interpreter::invokeFunction(const Function &function,
+                                  const InstancePtr &self,
+                                  const std::vector<Value> &args) {
+  auto environment = callEnvironment(function, self, args);
+
+  Value result = std::monostate{};
+  if (engine_ == Engine::Bytecode) {
+    result = vm_->run(vm_->chunkFor(*function.body), environment);
+  } else {
+    if (executeBlock(*function.body, environment) == Completion::Return)
+      result = std::exchange(returnValue_, std::monostate{});
+  }
+  envPool_.release(environment);
+  return result;
+}
+
+Value Interpreter::invoke(const Value &callee, const Value &receiver,
+                          const std::vector<Value> &args,
+                          const Token &callSiteParen) {
+  if (auto self = get_if<InstancePtr>(&receiver)) {
+    const Function &method = *get<FunctionPtr>(callee);
+    Profiler::Scope frame(profiler_.get(), method.body, callSiteParen.line,
+                          describeFunction(method, *self));
+    return invokeFunction(method, *self, args);
+  }
+  if (holds_alternative<BufferPtr>(receiver) ||
+      holds_alternative<ListPtr>(receiver)) {
+    const NativeFunctionObject &method = *get<NativeFunctionPtr>(callee);
+    Profiler::Scope frame(
+        profiler_.get(), &method, callSiteParen.line,
+        describeNative(method, holds_alternative<ListPtr>(receiver)
+                                   ? "list."
+                                   : "buffer."));
+    return callNativeMethod(method, receiver, args);
+  }
+  if (holds_alternative<FunctionPtr>(callee) ||
+      holds_alternative<ClassPtr>(callee) ||
+      holds_alternative<NativeFunctionPtr>(callee)) {
+    return callFunction(callee, args, callSiteParen);
+  }
+  throw std::runtime_error("Can only call functions and classes.");
+}
+
+// ---------- Operator and access semantics ----------
+// Shared by the tree walker (evaluate) and the bytecode VM so both engines
+// agree on results and error messages.
+
+Value Interpreter::unaryOp(const Token &op, const Value &right) {
+  if (op.type == TokenType::Minus) {
+    requireNumber(right, "unary '-'");
+    return -get<double>(right);
+  }
+  if (op.type == TokenType::Bang || op.type == TokenType::Not) {
+    return !isTruthy(right);
+  }
+  throw std::runtime_error("Unknown unary operator '" +
+                           std::string(op.lexeme) + "'");
+}
+
+Value Interpreter::binaryOp(const Token &op, const Value &left,
+                            const Value &right) {
+  switch (op.type) {
+  case TokenType::Plus:
+    if (holds_alternative<double>(left) &&
+        holds_alternative<double>(right)) {
+      return get<double>(left) + get<double>(right);
+    }
+    if (holds_alternative<std::string>(left) &&
+        holds_alternative<std::string>(right)) {
+      return get<std::string>(left) + get<std::string>(right);
+    }
+    throw std::runtime_error(
+        "Type error: '+' needs (number,number) or (string,string).");
+  case TokenType::Minus:
+    requireNumber(left, "binary '-'");
+    requireNumber(right, "binary '-'");
+    return get<double>(left) - get<double>(right);
+  case TokenType::Star:
+    requireNumber(left, "binary '*'");
+    requireNumber(right, "binary '*'");
+    return get<double>(left) * get<double>(right);
+  case TokenType::Slash:
+    requireNumber(left, "binary '/'");
+    requireNumber(right, "binary '/'");
+    if (get<double>(right) == 0.0)
+      throw std::runtime_error("Runtime error: division by zero.");
+    return get<double>(left) / get<double>(right);
+  case TokenType::Ampersand:
+    requireNumber(left, "bitwise '&'");
+    requireNumber(right, "bitwise '&'");
+    return static_cast<double>(static_cast<int64_t>(get<double>(left)) & static_cast<int64_t>(get<double>(right)));
+  case TokenType::Pipe:
+    requireNumber(left, "bitwise '|'");
+    requireNumber(right, "bitwise '|'");
+    return static_cast<double>(static_cast<int64_t>(get<double>(left)) | static_cast<int64_t>(get<double>(right)));
+  case TokenType::ShiftLeft:
+    requireNumber(left, "bitwise '<<'");
+    requireNumber(right, "bitwise '<<'");
+    return static_cast<double>(static_cast<int64_t>(get<double>(left)) << static_cast<int64_t>(get<double>(right)));
+  case TokenType::ShiftRight:
+    requireNumber(left, "bitwise '>>'");
+    requireNumber(right, "bitwise '>>'");
+    return static_cast<double>(static_cast<int64_t>(get<double>(left)) >> static_cast<int64_t>(get<double>(right)));
+  case TokenType::Greater:
+    requireNumber(left, "comparison");
+    requireNumber(right, "comparison");
+    return get<double>(left) > get<double>(right);
+  case TokenType::GreaterEqual:
+    requireNumber(left, "comparison");
+    requireNumber(right, "comparison");
+    return get<double>(left) >= get<double>(right);
+  case TokenType::Less:
+    requireNumber(left, "comparison");
+    requireNumber(right, "comparison");
+    return get<double>(left) < get<double>(right);
+  case TokenType::LessEqual:
+    requireNumber(left, "comparison");
+    requireNumber(right, "comparison");
+    return get<double>(left) <= get<double>(right);
+  case TokenType::EqualEqual:
+    return valuesEqual(left, right);
+  case TokenType::BangEqual:
+    return !valuesEqual(left, right);
+  default:
+    throw std::runtime_error("Unknown binary operator '" +
+                             std::string(op.lexeme) + "'");
+  }
+}
+
+// Field or method `name` of an instance, through the site's inline cache
+// when there is one. Returns the field, or null with `method` set.
+static const Value *findMember(const LumaInstance &instance, const Token &name,
+                               PropertyCache *cache, const Function *&method) {
+  const uint64_t shape = instance.shape->id;
+  if (cache) {
+    if (const PropertyCache::Entry *e = cache->find(shape)) {
+      if (e->slot >= 0)
+        return &instance.fields[e->slot];
+      method = e->method;
+      return nullptr;
+    }
+  }
+  // Fields shadow methods; both are fixed for a given shape.
+  int slot = instance.shape->slotOf(name.symbol);
+  if (slot >= 0) {
+    if (cache)
+      cache->insert(shape).slot = slot;
+    return &instance.fields[slot];
+  }
+  FunctionPtr found = instance.klass->findMethod(name.symbol);
+  if (found) {
+    method = found.get();
+    if (cache)
+      cache->insert(shape).method = method;
+  }
+  return nullptr;
+}
+
+// Arguments for a buffer or list method: the receiver, then the call's
+// arguments.
+static std::vector<Value> withReceiver(const Value &self,
+                                       const std::vector<Value> &args) {
+  std::vector<Value> full;
+  full.reserve(args.size() + 1);
+  full.push_back(self);
+  full.insert(full.end(), args.begin(), args.end());
+  return full;
+}
+
+Value Interpreter::getProperty(const Value &object, const Token &name,
+                               PropertyCache *cache) {
+  // Module namespace access (MapPtr)
+  if (auto mapPtr = get_if<MapPtr>(&object)) {
+    const auto &values = (*mapPtr)->values;
+    auto it = values.find(name.lexeme);
+    if (it != values.end()) {
+      return it->second;
+    }
+    throw std::runtime_error("Module has no exported member '" +
+                             std::string(name.lexeme) + "'.");
+  }
+  // Instance property access
+  if (auto inst = get_if<InstancePtr>(&object)) {
+    const Function *method = nullptr;
+    if (const Value *field = findMember(**inst, name, cache, method)) {
+      return *field;
+    }
+    if (method) {
+      auto boundMethod = makeRef<Function>(*method);
+      boundMethod->receiver = *inst;
+      return boundMethod;
+    }
+    throw std::runtime_error("Undefined property '" +
+                             std::string(name.lexeme) + "'.");
+  }
+  if (NativeFunctionPtr method = nativeMethod(object, name)) {
+    // A method read without a call binds the buffer or list.
+    auto bound = makeRef<NativeFunctionObject>();
+    bound->name = method->name;
+    bound->arity = method->arity;
+    bound->variadic = method->variadic;
+    bound->func = [method, self = object](const std::vector<Value> &args) {
+      return method->func(withReceiver(self, args));
+    };
+    return bound;
+  }
+  throw std::runtime_error("Only instances and modules have properties.");
+}
+
+NativeFunctionPtr Interpreter::nativeMethod(const Value &object,
+                                            const Token &name) const {
+  const char *kind;
+  const std::unordered_map<Symbol, NativeFunctionPtr> *methods;
+  if (holds_alternative<BufferPtr>(object)) {
+    kind = "Buffer";
+    methods = &bufferMethods_;
+  } else if (holds_alternative<ListPtr>(object)) {
+    kind = "List";
+    methods = &listMethods_;
+  } else {
+    return nullptr;
+  }
+  auto it = methods->find(name.symbol);
+  if (it == methods->end())
+    throw std::runtime_error(std::string(kind) + " has no method '" +
+                             std::string(name.lexeme) + "'.");
+  return it->second;
+}
+
+Value Interpreter::callNativeMethod(const NativeFunctionObject &method,
+                                    const Value &self,
+                                    const std::vector<Value> &args) {
+  if (!method.variadic && args.size() != method.arity) {
+    throw std::runtime_error("Expected " + std::to_string(method.arity) +
+                             " arguments but got " +
+                             std::to_string(args.size()) + ".");
+  }
+  return method.func(withReceiver(self, args));
+}
+
+Value Interpreter::getMethod(const Value &object, const Token &name,
+                             PropertyCache *cache, Value &receiver) {
+  if (auto inst = get_if<InstancePtr>(&object)) {
+    const Function *method = nullptr;
+    if (const Value *field = findMember(**inst, name, cache, method)) {
+      return *field;
+    }
+    if (method) {
+      receiver = *inst;
+      return FunctionPtr(const_cast<Function *>(method));
+    }
+    throw std::runtime_error("Undefined property '" +
+                             std::string(name.lexeme) + "'.");
+  }
+  if (NativeFunctionPtr method = nativeMethod(object, name)) {
+    receiver = object;
+    return method;
+  }
+  return getProperty(object, name, cache);
+}
+
+Value Interpreter::setProperty(const Value &object, const Token &name,
+                               Value value, PropertyCache *cache) {
+  if (auto inst = get_if<InstancePtr>(&object)) {
+    LumaInstance &instance = **inst;
+    if (cache) {
+      if (const PropertyCache::Entry *e = cache->find(instance.shape->id)) {
+        if (e->next) {
+          instance.shape = e->next;
+          instance.fields.push_back(value);
+        } else {
+          instance.fields[e->slot] = value;
+        }
+        return value;
+      }
+    }
+    int slot = instance.shape->slotOf(name.symbol);
+    if (slot >= 0) {
+      if (cache)
+        cache->insert(instance.shape->id).slot = slot;
+      instance.fields[slot] = value;
+    } else {
+      Shape *next = instance.shape->withField(name.symbol);
+      if (cache) {
+        PropertyCache::Entry &e = cache->insert(instance.shape->id);
+        e.slot = static_cast<int>(instance.fields.size());
+        e.next = next;
+      }
+      instance.shape = next;
+      instance.fields.push_back(value);
+    }
+    return value;
+  }
+  throw std::runtime_error("Only instances have properties.");
+}
+
+Value Interpreter::getIndex(const Value &object, const Value &index) {
+  if (auto listPtr = get_if<ListPtr>(&object)) {
+    if (!holds_alternative<double>(index)) {
+      throw std::runtime_error("List index must be a number.");
+    }
+    int idx = static_cast<int>(get<double>(index));
+    auto &elements = (*listPtr)->elements;
+    if (idx < 0 || idx >= static_cast<int>(elements.size())) {
+      throw std::runtime_error("List index out of bounds.");
+    }
+    return elements[idx];
+  }
+
+  if (auto mapPtr = get_if<MapPtr>(&object)) {
+    if (auto s = get_if<std::string>(&index)) {
+      auto &values = (*mapPtr)->values;
+      if (values.count(*s)) {
+        return values.at(*s);
+      }
+      throw std::runtime_error("Undefined key '" + *s + "'.");
+    }
+    throw std::runtime_error("Map key must be a string.");
+  }
+
+  if (auto bufferPtr = get_if<BufferPtr>(&object)) {
+    if (!holds_alternative<double>(index)) {
+      throw std::runtime_error("Buffer index must be a number.");
+    }
+    double idx = get<double>(index);
+    const auto &bytes = (*bufferPtr)->bytes;
+    if (idx < 0 || idx >= bytes.size()) {
+      throw std::runtime_error("Buffer index out of bounds.");
+    }
+    return static_cast<double>(bytes[static_cast<size_t>(idx)]);
+  }
+  throw std::runtime_error("Only lists, maps and buffers support subscription.");
+}
+
+Value Interpreter::setIndex(const Value &object, const Value &index,
+                            Value value) {
+  if (auto listPtr = get_if<ListPtr>(&object)) {
+    if (!holds_alternative<double>(index)) {
+      throw std::runtime_error("List index must be a number.");
+    }
+    int idx = static_cast<int>(get<double>(index));
+    auto &elements = (*listPtr)->elements;
+    if (idx < 0 || idx >= static_cast<int>(elements.size())) {
+      throw std::runtime_error("List index out of bounds.");
+    }
+    elements[idx] = value;
+    return value;
+  }
+
+  if (auto mapPtr = get_if<MapPtr>(&object)) {
+    if (auto s = get_if<std::string>(&index)) {
+      (*mapPtr)->values[*s] = value;
+      return value;
+    }
+    throw std::runtime_error("Map key must be a string.");
+  }
+
+  if (auto bufferPtr = get_if<BufferPtr>(&object)) {
+    if (!holds_alternative<double>(index) || !holds_alternative<double>(value)) {
+      throw std::runtime_error("Buffer index and value must be numbers.");
+    }
+    double idx = get<double>(index);
+    auto &bytes = (*bufferPtr)->bytes;
+    if (idx < 0 || idx >= bytes.size()) {
+      throw std::runtime_error("Buffer index out of bounds.");
+    }
+    double byte = get<double>(value);
+    bytes[static_cast<size_t>(idx)] =
+        byte > 0 ? (byte >= 255 ? 255 : static_cast<uint8_t>(byte)) : 0;
+    return value;
+  }
+  throw std::runtime_error("Only lists, maps and buffers support assignment.");
+}
+
+int Interpreter::echoCount(const Value &countVal) {
+  if (!holds_alternative<double>(countVal)) {
+    throw std::runtime_error("Echo count must be a number.");
+  }
+  int count = static_cast<int>(get<double>(countVal));
+  if (count < 0) {
+    throw std::runtime_error("Echo count cannot be negative.");
+  }
+  return count;
+}
+
 Value Interpreter::evaluate(const Expr &expr) {
   if (auto *l = dynamic_cast<const LiteralExpr *>(&expr)) {
     switch (l->kind) {
@@ -514,7 +1159,7 @@ Value Interpreter::evaluate(const Expr &expr) {
   }
 
   if (auto *v = dynamic_cast<const VariableExpr *>(&expr)) {
-    return env_->get(v->name);
+    return lookUpVariable(v->name, v->slot);
   }
 
   if (auto *g = dynamic_cast<const GroupingExpr *>(&expr)) {
@@ -523,14 +1168,7 @@ Value Interpreter::evaluate(const Expr &expr) {
 
   if (auto *u = dynamic_cast<const UnaryExpr *>(&expr)) {
     Value right = evaluate(*u->right);
-    if (u->op.type == TokenType::Minus) {
-      requireNumber(right, "unary '-'");
-      return -std::get<double>(right);
-    }
-    if (u->op.type == TokenType::Bang || u->op.type == TokenType::Not) {
-      return !isTruthy(right);
-    }
-    throw std::runtime_error("Unknown unary operator '" + u->op.lexeme + "'");
+    return unaryOp(u->op, right);
   }
 
   if (auto *b = dynamic_cast<const BinaryExpr *>(&expr)) {
@@ -549,149 +1187,43 @@ Value Interpreter::evaluate(const Expr &expr) {
     // Eager evaluation for other binary operators
     Value left = evaluate(*b->left);
     Value right = evaluate(*b->right);
-
-    switch (b->op.type) {
-    case TokenType::Plus:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) + std::get<double>(right);
-      }
-      if (std::holds_alternative<std::string>(left) &&
-          std::holds_alternative<std::string>(right)) {
-        return std::get<std::string>(left) + std::get<std::string>(right);
-      }
-      throw std::runtime_error(
-          "Type error: '+' needs (number,number) or (string,string).");
-    case TokenType::Minus:
-      requireNumber(left, "binary '-'");
-      requireNumber(right, "binary '-'");
-      return std::get<double>(left) - std::get<double>(right);
-    case TokenType::Star:
-      requireNumber(left, "binary '*'");
-      requireNumber(right, "binary '*'");
-      return std::get<double>(left) * std::get<double>(right);
-    case TokenType::Slash:
-      requireNumber(left, "binary '/'");
-      requireNumber(right, "binary '/'");
-      if (std::get<double>(right) == 0.0)
-        throw std::runtime_error("Runtime error: division by zero.");
-      return std::get<double>(left) / std::get<double>(right);
-    case TokenType::Ampersand:
-      requireNumber(left, "bitwise '&'");
-      requireNumber(right, "bitwise '&'");
-      return static_cast<double>(static_cast<int64_t>(std::get<double>(left)) & static_cast<int64_t>(std::get<double>(right)));
-    case TokenType::Pipe:
-      requireNumber(left, "bitwise '|'");
-      requireNumber(right, "bitwise '|'");
-      return static_cast<double>(static_cast<int64_t>(std::get<double>(left)) | static_cast<int64_t>(std::get<double>(right)));
-    case TokenType::ShiftLeft:
-      requireNumber(left, "bitwise '<<'");
-      requireNumber(right, "bitwise '<<'");
-      return static_cast<double>(static_cast<int64_t>(std::get<double>(left)) << static_cast<int64_t>(std::get<double>(right)));
-    case TokenType::ShiftRight:
-      requireNumber(left, "bitwise '>>'");
-      requireNumber(right, "bitwise '>>'");
-      return static_cast<double>(static_cast<int64_t>(std::get<double>(left)) >> static_cast<int64_t>(std::get<double>(right)));
-    case TokenType::Greater:
-      requireNumber(left, "comparison");
-      requireNumber(right, "comparison");
-      return std::get<double>(left) > std::get<double>(right);
-    case TokenType::GreaterEqual:
-      requireNumber(left, "comparison");
-      requireNumber(right, "comparison");
-      return std::get<double>(left) >= std::get<double>(right);
-    case TokenType::Less:
-      requireNumber(left, "comparison");
-      requireNumber(right, "comparison");
-      return std::get<double>(left) < std::get<double>(right);
-    case TokenType::LessEqual:
-      requireNumber(left, "comparison");
-      requireNumber(right, "comparison");
-      return std::get<double>(left) <= std::get<double>(right);
-    case TokenType::EqualEqual:
-      return valuesEqual(left, right);
-    case TokenType::BangEqual:
-      return !valuesEqual(left, right);
-    default:
-      throw std::runtime_error("Unknown binary operator '" + b->op.lexeme +
-                               "'");
-    }
+    return binaryOp(b->op, left, right);
   }
 
   if (auto *c = dynamic_cast<const CallExpr *>(&expr)) {
-    Value callee = evaluate(*c->callee);
+    Value callee;
+    Value receiver;
+    if (auto *get = dynamic_cast<const GetExpr *>(c->callee.get())) {
+      // obj.method(...) calls the method directly instead of binding it.
+      callee = getMethod(evaluate(*get->object), get->name, &get->cache,
+                         receiver);
+    } else {
+      callee = evaluate(*c->callee);
+    }
     std::vector<Value> args;
     args.reserve(c->args.size());
     for (const auto &a : c->args)
       args.push_back(evaluate(*a));
 
-    if (std::holds_alternative<FunctionPtr>(callee) ||
-        std::holds_alternative<ClassPtr>(callee) ||
-        std::holds_alternative<NativeFunctionPtr>(callee)) {
-      return callFunction(callee, args, c->paren);
-    }
-    throw std::runtime_error("Can only call functions and classes.");
+    return invoke(callee, receiver, args, c->paren);
   }
 
   if (auto *indexExpr = dynamic_cast<const IndexExpr *>(&expr)) {
     Value object = evaluate(*indexExpr->object);
     Value index = evaluate(*indexExpr->index);
-
-    if (auto listPtr = std::get_if<ListPtr>(&object)) {
-      if (!std::holds_alternative<double>(index)) {
-        throw std::runtime_error("List index must be a number.");
-      }
-      int idx = static_cast<int>(std::get<double>(index));
-      auto &elements = (*listPtr)->elements;
-      if (idx < 0 || idx >= static_cast<int>(elements.size())) {
-        throw std::runtime_error("List index out of bounds.");
-      }
-      return elements[idx];
-    }
-
-    if (auto mapPtr = std::get_if<MapPtr>(&object)) {
-      if (auto s = std::get_if<std::string>(&index)) {
-        auto &values = (*mapPtr)->values;
-        if (values.count(*s)) {
-          return values.at(*s);
-        }
-        throw std::runtime_error("Undefined key '" + *s + "'.");
-      }
-      throw std::runtime_error("Map key must be a string.");
-    }
-    throw std::runtime_error("Only lists and maps support subscription.");
+    return getIndex(object, index);
   }
 
   if (auto *indexSetExpr = dynamic_cast<const IndexSetExpr *>(&expr)) {
     Value object = evaluate(*indexSetExpr->object);
     Value index = evaluate(*indexSetExpr->index);
     Value value = evaluate(*indexSetExpr->value);
-
-    if (auto listPtr = std::get_if<ListPtr>(&object)) {
-      if (!std::holds_alternative<double>(index)) {
-        throw std::runtime_error("List index must be a number.");
-      }
-      int idx = static_cast<int>(std::get<double>(index));
-      auto &elements = (*listPtr)->elements;
-      if (idx < 0 || idx >= static_cast<int>(elements.size())) {
-        throw std::runtime_error("List index out of bounds.");
-      }
-      elements[idx] = value;
-      return value;
-    }
-
-    if (auto mapPtr = std::get_if<MapPtr>(&object)) {
-      if (auto s = std::get_if<std::string>(&index)) {
-        (*mapPtr)->values[*s] = value;
-        return value;
-      }
-      throw std::runtime_error("Map key must be a string.");
-    }
-    throw std::runtime_error("Only lists and maps support assignment.");
+    return setIndex(object, index, std::move(value));
   }
 
   if (auto *listExpr = dynamic_cast<const ListExpr *>(&expr)) {
-    auto list = std::make_shared<List>();
+    auto list = makeRef<List>();
+    list->elements.reserve(listExpr->elements.size());
     for (const auto &e : listExpr->elements) {
       list->elements.push_back(evaluate(*e));
     }
@@ -700,56 +1232,28 @@ Value Interpreter::evaluate(const Expr &expr) {
 
   if (auto get = dynamic_cast<const GetExpr *>(&expr)) {
     Value object = evaluate(*get->object);
-    // Module namespace access (MapPtr)
-    if (auto mapPtr = std::get_if<MapPtr>(&object)) {
-      const auto &values = (*mapPtr)->values;
-      auto it = values.find(get->name.lexeme);
-      if (it != values.end()) {
-        return it->second;
-      }
-      throw std::runtime_error("Module has no exported member '" +
-                               get->name.lexeme + "'.");
-    }
-    // Instance property access
-    if (auto inst = std::get_if<InstancePtr>(&object)) {
-      LumaInstance *instance = inst->get();
-      if (instance->fields.count(get->name.lexeme)) {
-        return instance->fields.at(get->name.lexeme);
-      }
-      FunctionPtr method = instance->klass->findMethod(get->name.lexeme);
-      if (method) {
-        auto newEnv = std::make_shared<Environment>(method->closure);
-        newEnv->define("this", *inst);
-        auto boundMethod = std::make_shared<Function>(*method);
-        boundMethod->closure = newEnv;
-        return boundMethod;
-      }
-      throw std::runtime_error("Undefined property '" + get->name.lexeme +
-                               "'.");
-    }
-    throw std::runtime_error("Only instances and modules have properties.");
+    return getProperty(object, get->name, &get->cache);
   }
 
   if (auto set = dynamic_cast<const SetExpr *>(&expr)) {
     Value object = evaluate(*set->object);
-    if (auto inst = std::get_if<InstancePtr>(&object)) {
-      Value value = evaluate(*set->value);
-      (*inst)->fields[set->name.lexeme] = value;
-      return value;
+    if (!holds_alternative<InstancePtr>(object)) {
+      throw std::runtime_error("Only instances have properties.");
     }
-    throw std::runtime_error("Only instances have properties.");
+    Value value = evaluate(*set->value);
+    return setProperty(object, set->name, std::move(value), &set->cache);
   }
 
   if (auto th = dynamic_cast<const ThisExpr *>(&expr)) {
-    return env_->get(th->keyword);
+    return lookUpVariable(th->keyword, th->slot);
   }
 
   if (auto mp = dynamic_cast<const MapExpr *>(&expr)) {
-    auto map = std::make_shared<LumaMap>();
+    auto map = makeRef<LumaMap>(mp->keys.size());
     for (size_t i = 0; i < mp->keys.size(); ++i) {
       Value k = evaluate(*mp->keys[i]);
       Value v = evaluate(*mp->values[i]);
-      if (auto s = std::get_if<std::string>(&k)) {
+      if (auto s = get_if<std::string>(&k)) {
         map->values[*s] = v;
       } else {
         throw std::runtime_error("Map keys must be strings.");
@@ -833,30 +1337,60 @@ MapPtr Interpreter::loadModule(const std::string &moduleId) {
     return cacheIt->second;
   }
 
+  // A module only the host provides (see defineHostNative).
+  auto host = hostNatives_.find(moduleId);
+  if (host != hostNatives_.end()) {
+    bool hasFile = true;
+    try {
+      (void)resolveModulePath(moduleId);
+    } catch (const std::runtime_error &) {
+      hasFile = false;
+    }
+    if (!hasFile) {
+      MapPtr exports = makeRef<LumaMap>();
+      for (const auto &native : host->second)
+        exports->values[native->name] = native;
+      moduleCache_[moduleId] = exports;
+      return exports;
+    }
+  }
+
   // Check for cyclic imports
   if (modulesLoading_.count(moduleId)) {
     throw std::runtime_error("Cyclic import detected: " + moduleId);
   }
   modulesLoading_.insert(moduleId);
+  // Keyed on the interned ID, whose storage is stable for the process.
+  Profiler::Scope frame(profiler_.get(),
+                        profiler_ ? &symbolName(intern(moduleId)) : nullptr, 0,
+                        [&](std::string &name, int &) {
+                          name = "use " + moduleId;
+                        });
 
   // Resolve path
   std::string modulePath = resolveModulePath(moduleId);
 
-  // Read file
-  std::ifstream in(modulePath, std::ios::in | std::ios::binary);
-  if (!in) {
-    modulesLoading_.erase(moduleId);
-    throw std::runtime_error("Could not open module file: " + modulePath);
+  // Pre-parsed copy from an earlier run (see ast_cache.hpp), else parse
+  // the source and leave a copy for next time.
+  Program parsed;
+  if (!loadCachedProgram(modulePath, parsed)) {
+    // Stamped before reading; see storeCachedProgram.
+    SourceStamp stamp;
+    const bool stamped = stampSource(modulePath, stamp);
+    if (!parsed.source.openFile(modulePath)) {
+      modulesLoading_.erase(moduleId);
+      throw std::runtime_error("Could not open module file: " + modulePath);
+    }
+    Lexer lexer(parsed.source.text());
+    Parser parser(lexer, parsed.arena);
+    parsed.statements = parser.parse();
+    if (stamped)
+      storeCachedProgram(modulePath, stamp, parsed.source.text(),
+                         parsed.statements);
   }
-  std::ostringstream ss;
-  ss << in.rdbuf();
-  std::string source = ss.str();
-
-  // Lex and parse
-  Lexer lexer(source);
-  auto tokens = lexer.scanTokens();
-  Parser parser(tokens);
-  auto program = parser.parse();
+  if (optimize_)
+    Optimizer(parsed.arena).optimize(parsed.statements);
+  std::vector<StmtPtr> &program = parsed.statements;
 
   // Save current state
   auto savedEnv = env_;
@@ -865,28 +1399,40 @@ MapPtr Interpreter::loadModule(const std::string &moduleId) {
   bool savedInModuleLoad = inModuleLoad_;
 
   // Set up module execution context
-  env_ = std::make_shared<Environment>(globals_);
-  currentExports_ = std::make_shared<LumaMap>();
+  env_ = makeRef<Environment>(globals_);
+  currentExports_ = makeRef<LumaMap>();
   currentModuleId_ = "";
   inModuleLoad_ = true;
+  resolve(program);
 
   try {
-    // Execute the module
-    for (const auto &stmt : program) {
-      execute(*stmt);
-
-      // After executing a top-level def or class with Open visibility,
-      // add it to exports
-      if (auto *f = dynamic_cast<const FuncDefStmt *>(stmt.get())) {
-        if (f->visibility == Visibility::Open) {
-          Value val = env_->get(f->name);
-          currentExports_->values[f->name.lexeme] = val;
+    if (engine_ == Engine::Bytecode) {
+      // The compiler emits Export instructions after each open def/class, so
+      // exports are captured at the same point as in the loop below.
+      auto chunk = Compiler().compileModule(program);
+      (void)vm_->run(*chunk, env_);
+    } else {
+      // Execute the module
+      for (const auto &stmt : program) {
+        if (execute(*stmt) == Completion::Return) {
+          // Same error the VM raises for ReturnOutside.
+          returnValue_ = std::monostate{};
+          throw std::logic_error("Return used outside of a function.");
         }
-      }
-      if (auto *c = dynamic_cast<const ClassStmt *>(stmt.get())) {
-        if (c->visibility == Visibility::Open) {
-          Value val = env_->get(c->name);
-          currentExports_->values[c->name.lexeme] = val;
+
+        // After executing a top-level def or class with Open visibility,
+        // add it to exports
+        if (auto *f = dynamic_cast<const FuncDefStmt *>(stmt.get())) {
+          if (f->visibility == Visibility::Open) {
+            Value val = env_->get(f->name);
+            currentExports_->values[f->name.lexeme] = val;
+          }
+        }
+        if (auto *c = dynamic_cast<const ClassStmt *>(stmt.get())) {
+          if (c->visibility == Visibility::Open) {
+            Value val = env_->get(c->name);
+            currentExports_->values[c->name.lexeme] = val;
+          }
         }
       }
     }
@@ -903,7 +1449,7 @@ MapPtr Interpreter::loadModule(const std::string &moduleId) {
   // Get exports and cache
   MapPtr exports = currentExports_;
   moduleCache_[moduleId] = exports;
-  moduleAstCache_[moduleId] = std::move(program); // Keep AST alive!
+  moduleAstCache_[moduleId] = std::move(parsed); // Keep AST alive!
 
   // Restore state
   env_ = savedEnv;
@@ -913,6 +1459,11 @@ MapPtr Interpreter::loadModule(const std::string &moduleId) {
   modulesLoading_.erase(moduleId);
 
   injectNativeNatives(moduleId, exports);
+  host = hostNatives_.find(moduleId);
+  if (host != hostNatives_.end()) {
+    for (const auto &native : host->second)
+      exports->values[native->name] = native;
+  }
 
   return exports;
 }
@@ -934,7 +1485,7 @@ static Value nativeTimeNow(const std::vector<Value> &args) {
 }
 
 static Value nativeTimeSleep(const std::vector<Value> &args) {
-    if (auto ms = std::get_if<double>(&args[0])) {
+    if (auto ms = get_if<double>(&args[0])) {
         std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long long>(*ms)));
     }
     return std::monostate{};
@@ -942,7 +1493,7 @@ static Value nativeTimeSleep(const std::vector<Value> &args) {
 
 // Async module natives
 static Value nativeAsyncSleep(const std::vector<Value> &args) {
-    if (auto ms = std::get_if<double>(&args[0])) {
+    if (auto ms = get_if<double>(&args[0])) {
         std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long long>(*ms)));
     }
     return std::monostate{};
@@ -950,7 +1501,7 @@ static Value nativeAsyncSleep(const std::vector<Value> &args) {
 
 // Net module natives
 static Value nativeNetIsIpv4(const std::vector<Value> &args) {
-    if (auto ip = std::get_if<std::string>(&args[0])) {
+    if (auto ip = get_if<std::string>(&args[0])) {
         // Simple IPv4 validation
         std::regex ipv4_pattern(R"(^(\d{1,3})\.(\d{1,3})\.(\d{1,3})\.(\d{1,3})$)");
         std::smatch matches;
@@ -968,7 +1519,7 @@ static Value nativeNetIsIpv4(const std::vector<Value> &args) {
 }
 
 static Value nativeNetIsIpv6(const std::vector<Value> &args) {
-    if (auto ip = std::get_if<std::string>(&args[0])) {
+    if (auto ip = get_if<std::string>(&args[0])) {
         // Basic IPv6 validation
         std::regex ipv6_pattern(R"(^([0-9a-fA-F]{1,4}:){7}[0-9a-fA-F]{1,4}$|^::([0-9a-fA-F]{1,4}:)*[0-9a-fA-F]{1,4}$|^([0-9a-fA-F]{1,4}:)*::([0-9a-fA-F]{1,4}:)*[0-9a-fA-F]{1,4}$)");
         return std::regex_match(*ip, ipv6_pattern);
@@ -977,7 +1528,7 @@ static Value nativeNetIsIpv6(const std::vector<Value> &args) {
 }
 
 static Value nativeNetIpv4ToInt(const std::vector<Value> &args) {
-    if (auto ip = std::get_if<std::string>(&args[0])) {
+    if (auto ip = get_if<std::string>(&args[0])) {
         std::istringstream iss(*ip);
         std::string octet;
         unsigned long result = 0;
@@ -997,7 +1548,7 @@ static Value nativeNetIpv4ToInt(const std::vector<Value> &args) {
 }
 
 static Value nativeNetIntToIpv4(const std::vector<Value> &args) {
-    if (auto num = std::get_if<double>(&args[0])) {
+    if (auto num = get_if<double>(&args[0])) {
         unsigned long ip = static_cast<unsigned long>(*num);
         std::ostringstream oss;
         oss << ((ip >> 24) & 255) << "."
@@ -1011,10 +1562,10 @@ static Value nativeNetIntToIpv4(const std::vector<Value> &args) {
 
 static Value nativeNetDnsLookup(const std::vector<Value> &args) {
     // Placeholder - DNS lookup would require network libraries
-    if (auto hostname = std::get_if<std::string>(&args[0])) {
+    if (auto hostname = get_if<std::string>(&args[0])) {
         // For now, return a mock result
-        auto result = std::make_shared<LumaMap>();
-        auto addresses = std::make_shared<List>();
+        auto result = makeRef<LumaMap>();
+        auto addresses = makeRef<List>();
         addresses->elements.push_back(std::string("127.0.0.1"));
         result->values["addresses"] = addresses;
         result->values["type"] = 1.0; // A record
@@ -1033,8 +1584,8 @@ static Value nativeNetGetHostname(const std::vector<Value> &args) {
 }
 
 static Value nativeNetParseUrl(const std::vector<Value> &args) {
-    if (auto url = std::get_if<std::string>(&args[0])) {
-        auto result = std::make_shared<LumaMap>();
+    if (auto url = get_if<std::string>(&args[0])) {
+        auto result = makeRef<LumaMap>();
 
         // Simple URL parsing
         size_t colon_pos = url->find(':');
@@ -1086,8 +1637,8 @@ static Value nativeNetParseUrl(const std::vector<Value> &args) {
 static Value nativeSocketCreate(const std::vector<Value> &args) {
     if (args.size() < 2) return std::monostate{};
 
-    auto family = std::get_if<double>(&args[0]);
-    auto type = std::get_if<double>(&args[1]);
+    auto family = get_if<double>(&args[0]);
+    auto type = get_if<double>(&args[1]);
 
     if (!family || !type) return std::monostate{};
 
@@ -1105,9 +1656,9 @@ static Value nativeSocketCreate(const std::vector<Value> &args) {
 static Value nativeSocketBind(const std::vector<Value> &args) {
     if (args.size() < 3) return false;
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto addr_val = std::get_if<std::string>(&args[1]);
-    auto port_val = std::get_if<double>(&args[2]);
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto addr_val = get_if<std::string>(&args[1]);
+    auto port_val = get_if<double>(&args[2]);
 
     if (!sockfd_val || !addr_val || !port_val) return false;
 
@@ -1129,8 +1680,8 @@ static Value nativeSocketBind(const std::vector<Value> &args) {
 static Value nativeSocketListen(const std::vector<Value> &args) {
     if (args.size() < 2) return false;
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto backlog_val = std::get_if<double>(&args[1]);
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto backlog_val = get_if<double>(&args[1]);
 
     if (!sockfd_val || !backlog_val) return false;
 
@@ -1147,7 +1698,7 @@ static Value nativeSocketListen(const std::vector<Value> &args) {
 static Value nativeSocketAccept(const std::vector<Value> &args) {
     if (args.size() < 1) return std::monostate{};
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
+    auto sockfd_val = get_if<double>(&args[0]);
     if (!sockfd_val) return std::monostate{};
 
     int sockfd = static_cast<int>(*sockfd_val);
@@ -1159,7 +1710,7 @@ static Value nativeSocketAccept(const std::vector<Value> &args) {
         return std::monostate{};
     }
 
-    auto result = std::make_shared<LumaMap>();
+    auto result = makeRef<LumaMap>();
     result->values["fd"] = static_cast<double>(client_fd);
     result->values["address"] = std::string(inet_ntoa(client_addr.sin_addr));
     result->values["port"] = static_cast<double>(ntohs(client_addr.sin_port));
@@ -1170,9 +1721,9 @@ static Value nativeSocketAccept(const std::vector<Value> &args) {
 static Value nativeSocketConnect(const std::vector<Value> &args) {
     if (args.size() < 3) return false;
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto addr_val = std::get_if<std::string>(&args[1]);
-    auto port_val = std::get_if<double>(&args[2]);
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto addr_val = get_if<std::string>(&args[1]);
+    auto port_val = get_if<double>(&args[2]);
 
     if (!sockfd_val || !addr_val || !port_val) return false;
 
@@ -1194,16 +1745,72 @@ static Value nativeSocketConnect(const std::vector<Value> &args) {
     return true;
 }
 
+// Receive space for recv-style natives. Only the bytes actually received
+// are copied out, so requests up to kCachedBytes share one buffer per
+// thread instead of allocating max_bytes on every call. Larger requests
+// (a big recvmmsg batch) get a buffer of their own for the call, so one of
+// them does not pin its size for the life of the thread.
+class RecvScratch {
+public:
+    explicit RecvScratch(size_t size) : size_(size) {
+        if (size <= kCachedBytes) {
+            thread_local std::vector<char> shared;
+            if (shared.size() < size)
+                shared.resize(size);
+            data_ = shared.data();
+        } else {
+            owned_.reset(new char[size]);
+            data_ = owned_.get();
+        }
+    }
+
+    char *data() { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    static constexpr size_t kCachedBytes = 256 * 1024;
+    std::unique_ptr<char[]> owned_;
+    char *data_ = nullptr;
+    size_t size_;
+};
+
+// { "data", "address", "port" } as returned by recvfrom and recvmmsg.
+static Value datagramValue(const char *data, size_t length,
+                           const sockaddr_in &from) {
+    char address[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+    auto result = makeRef<LumaMap>(3);
+    result->values["data"] = std::string(data, length);
+    result->values["address"] = std::string(address);
+    result->values["port"] = static_cast<double>(ntohs(from.sin_port));
+    return result;
+}
+
+// Bytes to send from a string or buffer argument.
+static bool socketPayload(const Value &v, const char *&data, size_t &length) {
+    if (auto s = get_if<std::string>(&v)) {
+        data = s->data();
+        length = s->size();
+        return true;
+    }
+    if (auto b = get_if<BufferPtr>(&v)) {
+        data = reinterpret_cast<const char *>((*b)->bytes.data());
+        length = (*b)->bytes.size();
+        return true;
+    }
+    return false;
+}
+
 static Value nativeSocketSend(const std::vector<Value> &args) {
     if (args.size() < 2) return std::monostate{};
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto data_val = std::get_if<std::string>(&args[1]);
-
-    if (!sockfd_val || !data_val) return std::monostate{};
+    auto sockfd_val = get_if<double>(&args[0]);
+    const char *data = nullptr;
+    size_t length = 0;
+    if (!sockfd_val || !socketPayload(args[1], data, length)) return std::monostate{};
 
     int sockfd = static_cast<int>(*sockfd_val);
-    ssize_t sent = send(sockfd, data_val->c_str(), data_val->length(), 0);
+    ssize_t sent = send(sockfd, data, length, 0);
 
     if (sent < 0) {
         return std::monostate{};
@@ -1215,15 +1822,15 @@ static Value nativeSocketSend(const std::vector<Value> &args) {
 static Value nativeSocketRecv(const std::vector<Value> &args) {
     if (args.size() < 2) return std::monostate{};
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto max_bytes_val = std::get_if<double>(&args[1]);
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto max_bytes_val = get_if<double>(&args[1]);
 
     if (!sockfd_val || !max_bytes_val) return std::monostate{};
 
     int sockfd = static_cast<int>(*sockfd_val);
     size_t max_bytes = static_cast<size_t>(*max_bytes_val);
 
-    std::vector<char> buffer(max_bytes);
+    RecvScratch buffer(max_bytes);
     ssize_t received = recv(sockfd, buffer.data(), max_bytes, 0);
 
     if (received < 0) {
@@ -1233,15 +1840,59 @@ static Value nativeSocketRecv(const std::vector<Value> &args) {
     return std::string(buffer.data(), received);
 }
 
+// Like recv, but the payload comes back as a buffer.
+static Value nativeSocketRecvBuffer(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto max_bytes_val = get_if<double>(&args[1]);
+
+    if (!sockfd_val || !max_bytes_val) return std::monostate{};
+
+    auto buffer = makeRef<ByteBuffer>();
+    buffer->bytes.resize(static_cast<size_t>(*max_bytes_val));
+    ssize_t received = recv(static_cast<int>(*sockfd_val), buffer->bytes.data(),
+                            buffer->bytes.size(), 0);
+
+    if (received < 0) {
+        return std::monostate{};
+    }
+
+    buffer->bytes.resize(static_cast<size_t>(received));
+    return buffer;
+}
+
+// recv_into(fd, buffer, max_bytes): appends to an existing buffer so a
+// connection can reuse one allocation. Returns the byte count.
+static Value nativeSocketRecvInto(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto buffer_val = get_if<BufferPtr>(&args[1]);
+    auto max_bytes_val = get_if<double>(&args[2]);
+
+    if (!sockfd_val || !buffer_val || !max_bytes_val) return std::monostate{};
+
+    auto &bytes = (*buffer_val)->bytes;
+    const size_t used = bytes.size();
+    bytes.resize(used + static_cast<size_t>(*max_bytes_val));
+    ssize_t received = recv(static_cast<int>(*sockfd_val), bytes.data() + used,
+                            bytes.size() - used, 0);
+    bytes.resize(used + (received > 0 ? static_cast<size_t>(received) : 0));
+
+    if (received < 0) {
+        return std::monostate{};
+    }
+
+    return static_cast<double>(received);
+}
+
 static Value nativeSocketSendTo(const std::vector<Value> &args) {
     if (args.size() < 4) return std::monostate{};
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto data_val = std::get_if<std::string>(&args[1]);
-    auto addr_val = std::get_if<std::string>(&args[2]);
-    auto port_val = std::get_if<double>(&args[3]);
+    auto sockfd_val = get_if<double>(&args[0]);
+    const char *data = nullptr;
+    size_t length = 0;
+    auto addr_val = get_if<std::string>(&args[2]);
+    auto port_val = get_if<double>(&args[3]);
 
-    if (!sockfd_val || !data_val || !addr_val || !port_val) return std::monostate{};
+    if (!sockfd_val || !socketPayload(args[1], data, length) || !addr_val || !port_val) return std::monostate{};
 
     int sockfd = static_cast<int>(*sockfd_val);
     struct sockaddr_in dest_addr;
@@ -1254,7 +1905,7 @@ static Value nativeSocketSendTo(const std::vector<Value> &args) {
         return std::monostate{};
     }
 
-    ssize_t sent = sendto(sockfd, data_val->c_str(), data_val->length(), 0,
+    ssize_t sent = sendto(sockfd, data, length, 0,
                          (struct sockaddr*)&dest_addr, sizeof(dest_addr));
 
     if (sent < 0) {
@@ -1267,15 +1918,15 @@ static Value nativeSocketSendTo(const std::vector<Value> &args) {
 static Value nativeSocketRecvFrom(const std::vector<Value> &args) {
     if (args.size() < 2) return std::monostate{};
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    auto max_bytes_val = std::get_if<double>(&args[1]);
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto max_bytes_val = get_if<double>(&args[1]);
 
     if (!sockfd_val || !max_bytes_val) return std::monostate{};
 
     int sockfd = static_cast<int>(*sockfd_val);
     size_t max_bytes = static_cast<size_t>(*max_bytes_val);
 
-    std::vector<char> buffer(max_bytes);
+    RecvScratch buffer(max_bytes);
     struct sockaddr_in src_addr;
     socklen_t src_len = sizeof(src_addr);
 
@@ -1286,25 +1937,291 @@ static Value nativeSocketRecvFrom(const std::vector<Value> &args) {
         return std::monostate{};
     }
 
-    auto result = std::make_shared<LumaMap>();
-    result->values["data"] = std::string(buffer.data(), received);
-    result->values["address"] = std::string(inet_ntoa(src_addr.sin_addr));
-    result->values["port"] = static_cast<double>(ntohs(src_addr.sin_port));
-
-    return result;
+    return datagramValue(buffer.data(), static_cast<size_t>(received), src_addr);
 }
 
-static Value nativeSocketClose(const std::vector<Value> &args) {
-    if (args.size() < 1) return false;
+// recvmmsg(fd, count, max_bytes): up to `count` datagrams in one call, as a
+// list of recvfrom results. Waits for the first datagram only (unless the
+// socket is non-blocking), then takes whatever else is already queued.
+static Value nativeSocketRecvMmsg(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto count_val = get_if<double>(&args[1]);
+    auto max_bytes_val = get_if<double>(&args[2]);
 
-    auto sockfd_val = std::get_if<double>(&args[0]);
-    if (!sockfd_val) return false;
+    if (!sockfd_val || !count_val || !max_bytes_val || *count_val < 1)
+        return std::monostate{};
+
+    constexpr size_t kMaxBatch = 1024;
+    int sockfd = static_cast<int>(*sockfd_val);
+    size_t count = std::min(static_cast<size_t>(*count_val), kMaxBatch);
+    size_t max_bytes = static_cast<size_t>(*max_bytes_val);
+
+    RecvScratch buffer(count * max_bytes);
+    std::vector<sockaddr_in> from(count);
+    auto list = makeRef<List>();
+#if defined(__linux__)
+    std::vector<iovec> iov(count);
+    std::vector<mmsghdr> msgs(count);
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = buffer.data() + i * max_bytes;
+        iov[i].iov_len = max_bytes;
+        msgs[i].msg_hdr = msghdr();
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+    int received = recvmmsg(sockfd, msgs.data(), static_cast<unsigned>(count),
+                            MSG_WAITFORONE, nullptr);
+    if (received < 0) {
+        return std::monostate{};
+    }
+    list->elements.reserve(static_cast<size_t>(received));
+    for (int i = 0; i < received; ++i) {
+        list->elements.push_back(datagramValue(buffer.data() + i * max_bytes,
+                                               msgs[i].msg_len, from[i]));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        socklen_t from_len = sizeof(from[i]);
+        char *slot = buffer.data() + i * max_bytes;
+        ssize_t received = recvfrom(sockfd, slot, max_bytes, i ? MSG_DONTWAIT : 0,
+                                    (struct sockaddr*)&from[i], &from_len);
+        if (received < 0) {
+            if (i == 0) return std::monostate{};
+            break;
+        }
+        list->elements.push_back(
+            datagramValue(slot, static_cast<size_t>(received), from[i]));
+    }
+#endif
+    return list;
+}
+
+// sendmmsg(fd, packets): sends a list of datagrams in as few calls as the
+// platform allows. Each packet is a { "data", "address", "port" } map, or a
+// bare string/buffer on a connected socket. Returns the number sent.
+static Value nativeSocketSendMmsg(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto packets_val = get_if<ListPtr>(&args[1]);
+
+    if (!sockfd_val || !packets_val) return std::monostate{};
+
+    int sockfd = static_cast<int>(*sockfd_val);
+    const auto &packets = (*packets_val)->elements;
+    const size_t count = packets.size();
+    std::vector<iovec> iov(count);
+    std::vector<sockaddr_in> to(count);
+    std::vector<bool> addressed(count, false);
+
+    for (size_t i = 0; i < count; ++i) {
+        const char *data = nullptr;
+        size_t length = 0;
+        const Value *payload = &packets[i];
+        if (auto packet = get_if<MapPtr>(&packets[i])) {
+            auto &fields = (*packet)->values;
+            auto data_it = fields.find("data");
+            auto addr_it = fields.find("address");
+            auto port_it = fields.find("port");
+            if (data_it == fields.end()) return std::monostate{};
+            payload = &data_it->second;
+            if (addr_it != fields.end() && port_it != fields.end()) {
+                auto address = get_if<std::string>(&addr_it->second);
+                auto port = get_if<double>(&port_it->second);
+                if (!address || !port) return std::monostate{};
+                memset(&to[i], 0, sizeof(to[i]));
+                to[i].sin_family = AF_INET;
+                to[i].sin_port = htons(static_cast<uint16_t>(*port));
+                if (inet_pton(AF_INET, address->c_str(), &to[i].sin_addr) <= 0)
+                    return std::monostate{};
+                addressed[i] = true;
+            }
+        }
+        if (!socketPayload(*payload, data, length)) return std::monostate{};
+        iov[i].iov_base = const_cast<char *>(data);
+        iov[i].iov_len = length;
+    }
+
+    size_t sent = 0;
+#if defined(__linux__)
+    std::vector<mmsghdr> msgs(count);
+    for (size_t i = 0; i < count; ++i) {
+        msgs[i].msg_hdr = msghdr();
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (addressed[i]) {
+            msgs[i].msg_hdr.msg_name = &to[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(to[i]);
+        }
+    }
+    while (sent < count) {
+        int n = sendmmsg(sockfd, msgs.data() + sent,
+                         static_cast<unsigned>(count - sent), 0);
+        if (n <= 0) break;
+        sent += static_cast<size_t>(n);
+    }
+#else
+    for (; sent < count; ++sent) {
+        ssize_t n = addressed[sent]
+            ? sendto(sockfd, iov[sent].iov_base, iov[sent].iov_len, 0,
+                     (struct sockaddr*)&to[sent], sizeof(to[sent]))
+            : send(sockfd, iov[sent].iov_base, iov[sent].iov_len, 0);
+        if (n < 0) break;
+    }
+#endif
+    if (sent == 0 && count > 0) {
+        return std::monostate{};
+    }
+    return static_cast<double>(sent);
+}
+
+// writev(fd, parts): gathers a list of strings/buffers into as few
+// syscalls as possible. Keeps writing until everything is sent or the
+// socket would block; returns the bytes written.
+static Value nativeSocketWritev(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto parts_val = get_if<ListPtr>(&args[1]);
+
+    if (!sockfd_val || !parts_val) return std::monostate{};
+
+    int sockfd = static_cast<int>(*sockfd_val);
+    std::vector<iovec> iov;
+    iov.reserve((*parts_val)->elements.size());
+    for (const Value &part : (*parts_val)->elements) {
+        const char *data = nullptr;
+        size_t length = 0;
+        if (!socketPayload(part, data, length)) return std::monostate{};
+        if (length > 0)
+            iov.push_back({const_cast<char *>(data), length});
+    }
+
+#ifndef IOV_MAX
+    constexpr int IOV_MAX = 1024;
+#endif
+    size_t total = 0;
+    size_t next = 0;
+    while (next < iov.size()) {
+        int batch = static_cast<int>(std::min<size_t>(iov.size() - next, IOV_MAX));
+        ssize_t written = writev(sockfd, iov.data() + next, batch);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (total == 0) return std::monostate{};
+            break;
+        }
+        total += static_cast<size_t>(written);
+        // Skip the parts fully written; trim the one cut short.
+        size_t left = static_cast<size_t>(written);
+        while (next < iov.size() && left >= iov[next].iov_len) {
+            left -= iov[next].iov_len;
+            ++next;
+        }
+        if (left > 0) {
+            iov[next].iov_base = static_cast<char *>(iov[next].iov_base) + left;
+            iov[next].iov_len -= left;
+        }
+    }
+    return static_cast<double>(total);
+}
+
+// sendfile(fd, path, offset, count): streams a file to a socket without
+// copying it through Luma. offset and count may be nil (whole file).
+// Returns the bytes sent, or nil if the file cannot be opened.
+static Value nativeSocketSendfile(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    auto path_val = get_if<std::string>(&args[1]);
+
+    if (!sockfd_val || !path_val) return std::monostate{};
+
+    int sockfd = static_cast<int>(*sockfd_val);
+    int filefd = open(path_val->c_str(), O_RDONLY);
+    if (filefd < 0) return std::monostate{};
+    struct stat info;
+    if (fstat(filefd, &info) < 0) {
+        close(filefd);
+        return std::monostate{};
+    }
+
+    off_t offset = 0;
+    if (auto v = get_if<double>(&args[2])) offset = static_cast<off_t>(*v);
+    off_t end = info.st_size;
+    if (auto v = get_if<double>(&args[3]))
+        end = std::min<off_t>(end, offset + static_cast<off_t>(*v));
+
+    size_t total = 0;
+    while (offset < end) {
+        size_t want = static_cast<size_t>(end - offset);
+#if defined(__linux__)
+        ssize_t sent = sendfile(sockfd, filefd, &offset, want);
+#elif defined(__APPLE__)
+        off_t length = static_cast<off_t>(want);
+        int rc = sendfile(filefd, sockfd, offset, &length, nullptr, 0);
+        ssize_t sent = length > 0 ? static_cast<ssize_t>(length) : rc;
+        offset += length;
+#else
+        RecvScratch chunk(std::min<size_t>(want, 1 << 16));
+        ssize_t sent = pread(filefd, chunk.data(), std::min(want, chunk.size()), offset);
+        if (sent > 0) sent = send(sockfd, chunk.data(), static_cast<size_t>(sent), 0);
+        if (sent > 0) offset += sent;
+#endif
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) break; // error, would block, or the file shrank
+        total += static_cast<size_t>(sent);
+    }
+    close(filefd);
+    return static_cast<double>(total);
+}
+
+static Value nativeSocketClose(const std::vector<Value> &args) {
+    if (args.size() < 1) return false;
+
+    auto sockfd_val = get_if<double>(&args[0]);
+    if (!sockfd_val) return false;
 
     int sockfd = static_cast<int>(*sockfd_val);
     close(sockfd);
     return true;
 }
 
+// set_nonblocking(fd, flag): for sockets driven by @std.reactor. A
+// non-blocking accept/recv/send that would wait returns nil instead.
+static Value nativeSocketSetNonblocking(const std::vector<Value> &args) {
+    auto sockfd_val = get_if<double>(&args[0]);
+    if (!sockfd_val) return false;
+
+    int sockfd = static_cast<int>(*sockfd_val);
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags < 0) return false;
+    flags = isTruthy(args[1]) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(sockfd, F_SETFL, flags) == 0;
+}
+
+// listen_tcp(host, port, backlog): a bound, listening IPv4 TCP socket with
+// SO_REUSEADDR set, or nil on failure.
+static Value nativeSocketListenTcp(const std::vector<Value> &args) {
+    auto addr_val = get_if<std::string>(&args[0]);
+    auto port_val = get_if<double>(&args[1]);
+    auto backlog_val = get_if<double>(&args[2]);
+    if (!addr_val || !port_val) return std::monostate{};
+
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) return std::monostate{};
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(static_cast<uint16_t>(*port_val));
+    server_addr.sin_addr.s_addr = inet_addr(addr_val->c_str());
+    int backlog = backlog_val ? static_cast<int>(*backlog_val) : SOMAXCONN;
+    if (bind(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 ||
+        listen(sockfd, backlog) < 0) {
+        close(sockfd);
+        return std::monostate{};
+    }
+    return static_cast<double>(sockfd);
+}
+
 static Value nativeSocketSetOption(const std::vector<Value> &args) {
     // Placeholder implementation
     return true;
@@ -1332,7 +2249,7 @@ static Value nativeOsCwd(const std::vector<Value> &args) {
 }
 
 static Value nativeOsEnv(const std::vector<Value> &args) {
-    if (auto key = std::get_if<std::string>(&args[0])) {
+    if (auto key = get_if<std::string>(&args[0])) {
         const char* val = std::getenv(key->c_str());
         if (val) return std::string(val);
     }
@@ -1342,7 +2259,7 @@ static Value nativeOsEnv(const std::vector<Value> &args) {
 static Value nativeOsExit(const std::vector<Value> &args) {
     int code = 0;
     if (!args.empty()) {
-        if (auto c = std::get_if<double>(&args[0])) {
+        if (auto c = get_if<double>(&args[0])) {
             code = static_cast<int>(*c);
         }
     }
@@ -1351,7 +2268,7 @@ static Value nativeOsExit(const std::vector<Value> &args) {
 }
 
 static Value nativeIoAsk(const std::vector<Value> &args) {
-    if (auto prompt = std::get_if<std::string>(&args[0])) {
+    if (auto prompt = get_if<std::string>(&args[0])) {
         std::cout << *prompt;
         // Ensure prompt is displayed immediately
         std::cout.flush();
@@ -1371,319 +2288,116 @@ static Value nativeIoInput(const std::vector<Value> &args) {
     return std::monostate{};
 }
 
-// --- JSON Helpers ---
+// --- JSON ---
 
-static std::string jsonStringify(const Value &v);
-
-static std::string jsonStringifyList(const ListPtr &list) {
-  std::string s = "[";
-  const auto &elems = list->elements;
-  for (size_t i = 0; i < elems.size(); ++i) {
-    if (i > 0)
-      s += ","; // JSON standard: no space required, but usually compact
-    s += jsonStringify(elems[i]);
-  }
-  s += "]";
-  return s;
+static std::string_view jsonText(const Value &v, const char *fn) {
+  if (auto s = get_if<std::string>(&v))
+    return *s;
+  if (auto b = get_if<BufferPtr>(&v))
+    return {reinterpret_cast<const char *>((*b)->bytes.data()),
+            (*b)->bytes.size()};
+  throw std::runtime_error(std::string(fn) + " expects a string or buffer.");
 }
 
-static std::string jsonStringifyMap(const MapPtr &map) {
-  std::string s = "{";
-  const auto &values = map->values;
-  size_t i = 0;
-  for (const auto &[key, val] : values) {
-    if (i > 0)
-      s += ",";
-    s += "\"" + key + "\":" + jsonStringify(val);
-    i++;
-  }
-  s += "}";
-  return s;
+static Value nativeJsonStringify(const std::vector<Value> &args) {
+  return jsonStringify(args[0]);
 }
 
-static std::string jsonEscape(const std::string &str) {
-  std::string result = "\"";
-  for (char c : str) {
-    switch (c) {
-    case '\"': result += "\\\""; break;
-    case '\\': result += "\\\\"; break;
-    case '\b': result += "\\b"; break;
-    case '\f': result += "\\f"; break;
-    case '\n': result += "\\n"; break;
-    case '\r': result += "\\r"; break;
-    case '\t': result += "\\t"; break;
-    default:
-      if (static_cast<unsigned char>(c) < 32) {
-        // control chars
-        char buf[8];
-        snprintf(buf, sizeof(buf), "\\u%04x", c);
-        result += buf;
-      } else {
-        result += c;
-      }
-    }
-  }
-  result += "\"";
-  return result;
+static Value nativeJsonParse(const std::vector<Value> &args) {
+  return jsonParse(jsonText(args[0], "json.parse"));
 }
 
-static std::string jsonStringify(const Value &v) {
-  if (std::holds_alternative<std::monostate>(v))
-    return "null";
-  if (auto d = std::get_if<double>(&v)) {
-    // Check if integer
-    double ip;
-    if (std::modf(*d, &ip) == 0.0) {
-      return std::to_string(static_cast<long long>(*d));
-    }
-    return std::to_string(*d);
-  }
-  if (auto s = std::get_if<std::string>(&v))
-    return jsonEscape(*s);
-  if (auto b = std::get_if<bool>(&v))
-    return *b ? "true" : "false";
-  if (auto l = std::get_if<ListPtr>(&v))
-    return jsonStringifyList(*l);
-  if (auto m = std::get_if<MapPtr>(&v))
-    return jsonStringifyMap(*m);
-  
-  return "\"<unsupported>\"";
+// A map of { next(), done() } bound to a JsonReader, which keeps the source
+// alive, read like a module namespace (as cache objects are).
+static Value jsonReaderObject(const Value &source, JsonReader::Mode mode) {
+  auto reader = std::make_shared<JsonReader>(source, mode);
+  auto object = makeRef<LumaMap>(2);
+  auto method = [&](const std::string &name,
+                    std::function<Value(const std::vector<Value> &)> func) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->func = std::move(func);
+    native->arity = 0;
+    object->values[name] = native;
+  };
+  method("next", [reader](const std::vector<Value> &) {
+    return reader->next();
+  });
+  method("done", [reader](const std::vector<Value> &) {
+    return Value(reader->done());
+  });
+  return object;
 }
 
-static Value nativeJsonStringify(const std::vector<Value> &args) {
-  return jsonStringify(args[0]);
+static Value nativeJsonParseStream(const std::vector<Value> &args) {
+  jsonText(args[0], "json.parse_stream");
+  return jsonReaderObject(args[0], JsonReader::Mode::Documents);
 }
 
-// Helper for parsing
-struct JsonParser {
-  std::string src;
-  size_t current = 0;
-
-  JsonParser(std::string s) : src(std::move(s)) {}
-
-  Value parse() {
-    skipWhitespace();
-    if (isAtEnd()) return std::monostate{};
-    char c = peek();
-    
-    if (c == '{') return parseObject();
-    if (c == '[') return parseArray();
-    if (c == '"') return parseString();
-    if (c == '-' || isdigit(c)) return parseNumber();
-    if (c == 't') return parseTrue();
-    if (c == 'f') return parseFalse();
-    if (c == 'n') return parseNull();
-
-    throw std::runtime_error("Invalid JSON at position " + std::to_string(current));
-  }
-
-  Value parseObject() {
-    consume('{');
-    auto map = std::make_shared<LumaMap>();
-    skipWhitespace();
-    if (peek() == '}') {
-        advance();
-        return map;
-    }
-
-    while (true) {
-        skipWhitespace();
-        if (peek() != '"') throw std::runtime_error("Expected string key in JSON object");
-        std::string key = parseStringVal();
-        skipWhitespace();
-        consume(':');
-        Value val = parse();
-        map->values[key] = val;
-        
-        skipWhitespace();
-        if (peek() == '}') {
-            advance();
-            break;
-        }
-        consume(',');
-    }
-    return map;
-  }
-
-  Value parseArray() {
-    consume('[');
-    auto list = std::make_shared<List>();
-    skipWhitespace();
-    if (peek() == ']') {
-        advance();
-        return list;
-    }
-
-    while (true) {
-        list->elements.push_back(parse());
-        skipWhitespace();
-        if (peek() == ']') {
-            advance();
-            break;
-        }
-        consume(',');
-    }
-    return list;
-  }
-
-  std::string parseStringVal() {
-      consume('"');
-      std::string res;
-      while (!isAtEnd() && peek() != '"') {
-          char c = advance();
-          if (c == '\\') {
-              if (isAtEnd()) throw std::runtime_error("Unterminated string escape");
-              char next = advance();
-              switch (next) {
-                  case '"': res += '"'; break;
-                  case '\\': res += '\\'; break;
-                  case '/': res += '/'; break;
-                  case 'b': res += '\b'; break;
-                  case 'f': res += '\f'; break;
-                  case 'n': res += '\n'; break;
-                  case 'r': res += '\r'; break;
-                  case 't': res += '\t'; break;
-                  case 'u': 
-                      // skip unicode implementation for brevity
-                      advance(); advance(); advance(); advance(); 
-                      res += '?'; 
-                      break; 
-                  default: res += next; break;
-              }
-          } else {
-              res += c;
-          }
-      }
-      consume('"');
-      return res;
-  }
-  
-  Value parseString() {
-      return parseStringVal();
-  }
-
-  Value parseNumber() {
-    size_t start = current;
-    if (peek() == '-') advance();
-    while (isdigit(peek())) advance();
-    if (peek() == '.') {
-        advance();
-        while (isdigit(peek())) advance();
-    }
-    // scientific notation not supported for simplicity
-    std::string numStr = src.substr(start, current - start);
-    return std::stod(numStr);
-  }
-
-  Value parseTrue() {
-    consume('t'); consume('r'); consume('u'); consume('e');
-    return true;
-  }
-  Value parseFalse() {
-    consume('f'); consume('a'); consume('l'); consume('s'); consume('e');
-    return false;
-  }
-  Value parseNull() {
-    consume('n'); consume('u'); consume('l'); consume('l');
-    return std::monostate{};
-  }
-
-  void consume(char c) {
-    if (peek() == c) {
-        advance();
-    } else {
-        throw std::runtime_error("Expected '" + std::string(1, c) + "'");
-    }
-  }
-
-  void skipWhitespace() {
-    while (!isAtEnd() && isspace(peek())) advance();
-  }
-
-  char peek() {
-    if (isAtEnd()) return '\0';
-    return src[current];
-  }
-
-  char advance() {
-    if (isAtEnd()) return '\0';
-    return src[current++];
-  }
-
-  bool isAtEnd() { return current >= src.size(); }
-};
-
-static Value nativeJsonParse(const std::vector<Value> &args) {
-  if (auto s = std::get_if<std::string>(&args[0])) {
-    try {
-        JsonParser parser(*s);
-        return parser.parse();
-    } catch (const std::exception& e) {
-        return std::monostate{}; // return nil on error
-    }
-  }
-  return std::monostate{};
+static Value nativeJsonIterArray(const std::vector<Value> &args) {
+  jsonText(args[0], "json.iter_array");
+  return jsonReaderObject(args[0], JsonReader::Mode::ArrayElements);
 }
 
 // ========== Math Natives ==========
 static Value nativeMathSqrt(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::sqrt(*x);
+    if (auto x = get_if<double>(&args[0])) return std::sqrt(*x);
     return std::monostate{};
 }
 static Value nativeMathSin(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::sin(*x);
+    if (auto x = get_if<double>(&args[0])) return std::sin(*x);
     return std::monostate{};
 }
 static Value nativeMathCos(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::cos(*x);
+    if (auto x = get_if<double>(&args[0])) return std::cos(*x);
     return std::monostate{};
 }
 static Value nativeMathTan(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::tan(*x);
+    if (auto x = get_if<double>(&args[0])) return std::tan(*x);
     return std::monostate{};
 }
 static Value nativeMathAbs(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::abs(*x);
+    if (auto x = get_if<double>(&args[0])) return std::abs(*x);
     return std::monostate{};
 }
 static Value nativeMathCeil(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::ceil(*x);
+    if (auto x = get_if<double>(&args[0])) return std::ceil(*x);
     return std::monostate{};
 }
 static Value nativeMathFloor(const std::vector<Value> &args) {
-    if (auto x = std::get_if<double>(&args[0])) return std::floor(*x);
+    if (auto x = get_if<double>(&args[0])) return std::floor(*x);
     return std::monostate{};
 }
 static Value nativeMathPi(const std::vector<Value> &args) {
     return 3.141592653589793;
 }
 
-static std::string trimString(const std::string &input) {
-  size_t start = 0;
-  while (start < input.size() && std::isspace(static_cast<unsigned char>(input[start]))) {
-    start++;
-  }
-  if (start == input.size()) return "";
-
-  size_t end = input.size();
-  while (end > start && std::isspace(static_cast<unsigned char>(input[end - 1]))) {
-    end--;
-  }
-
-  return input.substr(start, end - start);
-}
-
 static double requireNumberValue(const Value &v, const std::string &where) {
-  if (auto n = std::get_if<double>(&v)) return *n;
+  if (auto n = get_if<double>(&v)) return *n;
   throw std::runtime_error("Expected number in " + where + ".");
 }
 
 static std::string requireStringValue(const Value &v, const std::string &where) {
-  if (auto s = std::get_if<std::string>(&v)) return *s;
+  if (auto s = get_if<std::string>(&v)) return *s;
   throw std::runtime_error("Expected string in " + where + ".");
 }
 
-static std::mt19937 &globalRng();
+static std::string_view fsData(const Value &v, const char *where) {
+  if (auto s = get_if<std::string>(&v))
+    return *s;
+  if (auto b = get_if<BufferPtr>(&v))
+    return {reinterpret_cast<const char *>((*b)->bytes.data()),
+            (*b)->bytes.size()};
+  throw std::runtime_error(std::string("Expected string or buffer in ") +
+                           where + ".");
+}
+
+static size_t requireSizeValue(const Value &v, const std::string &where) {
+  const double n = requireNumberValue(v, where);
+  if (n < 0 || n != std::floor(n))
+    throw std::runtime_error(where + " must be a non-negative integer.");
+  return static_cast<size_t>(n);
+}
 
 static Value nativeFsExists(const std::vector<Value> &args) {
   std::string path = requireStringValue(args[0], "fs.exists path");
@@ -1697,26 +2411,33 @@ static Value nativeFsIsDir(const std::vector<Value> &args) {
 
 static Value nativeFsReadFile(const std::vector<Value> &args) {
   std::string path = requireStringValue(args[0], "fs.read_file path");
-  std::ifstream file(path, std::ios::binary);
-  if (!file.is_open()) return std::monostate{};
-
-  std::ostringstream contents;
-  contents << file.rdbuf();
-  return contents.str();
+  auto file = FileHandle::open(path, FileHandle::Mode::Read);
+  if (!file) return std::monostate{};
+  std::string contents, chunk;
+  try {
+    while (file->readChunk(1 << 20, chunk)) contents += chunk;
+  } catch (const std::runtime_error &) {
+    return std::monostate{};
+  }
+  return contents;
 }
 
 static Value nativeFsWriteFile(const std::vector<Value> &args) {
   std::string path = requireStringValue(args[0], "fs.write_file path");
-  std::string data = requireStringValue(args[1], "fs.write_file data");
-  std::ofstream file(path, std::ios::binary);
-  if (!file.is_open()) return false;
-  file << data;
-  return file.good();
+  auto file = FileHandle::open(path, FileHandle::Mode::Write);
+  if (!file) return false;
+  try {
+    file->write(fsData(args[1], "fs.write_file data"));
+    file->close();
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+  return true;
 }
 
 static Value nativeFsListDir(const std::vector<Value> &args) {
   std::string path = requireStringValue(args[0], "fs.list_dir path");
-  auto list = std::make_shared<List>();
+  auto list = makeRef<List>();
   try {
     for (const auto &entry : fs::directory_iterator(path)) {
       list->elements.push_back(entry.path().filename().string());
@@ -1727,6 +2448,140 @@ static Value nativeFsListDir(const std::vector<Value> &args) {
   return list;
 }
 
+// Native objects below are maps of bound natives, read like a module
+// namespace (as cache objects are).
+using NativeMethod = std::function<Value(const std::vector<Value> &)>;
+
+static void bindFsMethod(const MapPtr &object, const std::string &name,
+                         size_t arity, NativeMethod func) {
+  auto native = makeRef<NativeFunctionObject>();
+  native->name = name;
+  native->func = std::move(func);
+  native->arity = arity;
+  object->values[name] = native;
+}
+
+// fs.open_file: { read_line(), read_chunk(size), done(), write(data), flush(),
+// close(), path, mode }.
+static Value nativeFsOpen(const std::vector<Value> &args) {
+  std::string path = requireStringValue(args[0], "fs.open_file path");
+  FileHandle::Mode mode;
+  if (!FileHandle::parseMode(
+          requireStringValue(args[1], "fs.open_file mode"), mode))
+    throw std::runtime_error("fs.open_file mode must be \"r\", \"w\" or \"a\".");
+  std::shared_ptr<FileHandle> file = FileHandle::open(path, mode);
+  if (!file) return std::monostate{};
+
+  auto object = makeRef<LumaMap>(8);
+  object->values["path"] = args[0];
+  object->values["mode"] = args[1];
+  bindFsMethod(object, "read_line", 0, [file](const std::vector<Value> &) {
+    std::string line;
+    if (!file->readLine(line)) return Value();
+    return Value(std::move(line));
+  });
+  bindFsMethod(object, "read_chunk", 1, [file](const std::vector<Value> &args) {
+    std::string chunk;
+    if (!file->readChunk(requireSizeValue(args[0], "read_chunk size"), chunk))
+      return Value();
+    return Value(std::move(chunk));
+  });
+  bindFsMethod(object, "done", 0, [file](const std::vector<Value> &) {
+    return Value(file->atEnd());
+  });
+  bindFsMethod(object, "write", 1, [file](const std::vector<Value> &args) {
+    file->write(fsData(args[0], "write data"));
+    return Value();
+  });
+  bindFsMethod(object, "flush", 0, [file](const std::vector<Value> &) {
+    file->flush();
+    return Value();
+  });
+  bindFsMethod(object, "close", 0, [file](const std::vector<Value> &) {
+    file->close();
+    return Value();
+  });
+  return object;
+}
+
+// fs.lines: { next(), done() } over the lines of a file, as the JSON
+// readers are; the file closes once the last line has been read.
+static Value nativeFsLines(const std::vector<Value> &args) {
+  std::string path = requireStringValue(args[0], "fs.lines path");
+  std::shared_ptr<FileHandle> file =
+      FileHandle::open(path, FileHandle::Mode::Read);
+  if (!file) return std::monostate{};
+
+  auto object = makeRef<LumaMap>(2);
+  bindFsMethod(object, "next", 0, [file](const std::vector<Value> &) {
+    std::string line;
+    if (file->closed() || !file->readLine(line)) {
+      file->close();
+      return Value();
+    }
+    return Value(std::move(line));
+  });
+  bindFsMethod(object, "done", 0, [file](const std::vector<Value> &) {
+    if (file->closed()) return Value(true);
+    if (!file->atEnd()) return Value(false);
+    file->close();
+    return Value(true);
+  });
+  return object;
+}
+
+// fs.mmap: a read-only view of a file mapped into memory, so only the pages
+// touched are read and nothing is copied until a range is asked for:
+// { size, slice(offset, length), bytes(offset, length), find(text, from),
+// lines() }.
+static Value nativeFsMmap(const std::vector<Value> &args) {
+  std::string path = requireStringValue(args[0], "fs.mmap path");
+  auto file = std::make_shared<SourceBuffer>();
+  if (!file->openFile(path)) return std::monostate{};
+
+  auto range = [file](const Value &offset, const Value &length,
+                      const char *fn) {
+    const std::string_view text = file->text();
+    const size_t start = std::min(
+        requireSizeValue(offset, std::string(fn) + " offset"), text.size());
+    return text.substr(
+        start, requireSizeValue(length, std::string(fn) + " length"));
+  };
+  auto object = makeRef<LumaMap>(6);
+  object->values["size"] = static_cast<double>(file->text().size());
+  bindFsMethod(object, "slice", 2, [range](const std::vector<Value> &args) {
+    return Value(std::string(range(args[0], args[1], "slice")));
+  });
+  bindFsMethod(object, "bytes", 2, [range](const std::vector<Value> &args) {
+    const std::string_view bytes = range(args[0], args[1], "bytes");
+    return Value(makeRef<ByteBuffer>(bytes.data(), bytes.size()));
+  });
+  bindFsMethod(object, "find", 2, [file](const std::vector<Value> &args) {
+    const size_t at = file->text().find(
+        fsData(args[0], "find text"), requireSizeValue(args[1], "find from"));
+    return Value(at == std::string_view::npos ? -1.0 : static_cast<double>(at));
+  });
+  bindFsMethod(object, "lines", 0, [file](const std::vector<Value> &) {
+    auto pos = std::make_shared<size_t>(0);
+    auto reader = makeRef<LumaMap>(2);
+    bindFsMethod(reader, "next", 0, [file, pos](const std::vector<Value> &) {
+      const std::string_view text = file->text();
+      if (*pos >= text.size()) return Value();
+      size_t end = text.find('\n', *pos);
+      if (end == std::string_view::npos) end = text.size();
+      std::string_view line = text.substr(*pos, end - *pos);
+      *pos = end + 1;
+      if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+      return Value(std::string(line));
+    });
+    bindFsMethod(reader, "done", 0, [file, pos](const std::vector<Value> &) {
+      return Value(*pos >= file->text().size());
+    });
+    return Value(reader);
+  });
+  return object;
+}
+
 static std::string shellQuote(const std::string &arg) {
   std::string quoted = "'";
   for (char c : arg) {
@@ -1754,43 +2609,285 @@ static Value runShellCapture(const std::string &command) {
   return output;
 }
 
+// --- HTTP ---
+
+// The request for http.request(method, url, options) and friends. Options
+// (map or nil): headers (map), body (string or buffer), timeout (ms),
+// max_redirects, as_buffer.
+static HttpRequest httpRequest(const Value &method, const Value &url,
+                               const Value &options, const char *where) {
+  HttpRequest request;
+  request.method = requireStringValue(method, std::string(where) + " method");
+  std::transform(request.method.begin(), request.method.end(),
+                 request.method.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  request.url = requireStringValue(url, std::string(where) + " url");
+  if (isNil(options))
+    return request;
+  auto map = get_if<MapPtr>(&options);
+  if (!map)
+    throw std::runtime_error(std::string("Expected map of options in ") +
+                             where + ".");
+  const auto &values = (*map)->values;
+  if (auto it = values.find("headers"); it != values.end() && !isNil(it->second)) {
+    auto headers = get_if<MapPtr>(&it->second);
+    if (!headers)
+      throw std::runtime_error(std::string("Expected map of headers in ") +
+                               where + ".");
+    for (const auto &[name, value] : (*headers)->values)
+      request.headers.emplace_back(name, valueToString(value));
+  }
+  if (auto it = values.find("body"); it != values.end() && !isNil(it->second)) {
+    if (auto b = get_if<BufferPtr>(&it->second))
+      request.body.assign((*b)->bytes.begin(), (*b)->bytes.end());
+    else
+      request.body = requireStringValue(it->second, std::string(where) + " body");
+  }
+  if (auto it = values.find("timeout"); it != values.end() && !isNil(it->second))
+    request.timeoutMs =
+        requireNumberValue(it->second, std::string(where) + " timeout");
+  if (auto it = values.find("max_redirects");
+      it != values.end() && !isNil(it->second))
+    request.maxRedirects = static_cast<int>(
+        requireNumberValue(it->second, std::string(where) + " max_redirects"));
+  if (auto it = values.find("as_buffer"); it != values.end())
+    request.bodyAsBuffer = isTruthy(it->second);
+  return request;
+}
+
+// { status, reason, headers, body, url, error }: error is nil unless no
+// response arrived, in which case status is 0 and body nil.
+static Value httpResponseValue(HttpResponse &response) {
+  auto result = makeRef<LumaMap>(6);
+  auto &values = result->values;
+  values["status"] = static_cast<double>(response.status);
+  values["reason"] = std::move(response.reason);
+  auto headers = makeRef<LumaMap>(response.headers.size());
+  for (auto &[name, value] : response.headers) {
+    Value &slot = headers->values[name];
+    if (auto earlier = get_if<std::string>(&slot)) // e.g. set-cookie
+      slot = *earlier + ", " + value;
+    else
+      slot = std::move(value);
+  }
+  values["headers"] = headers;
+  if (!response.error.empty())
+    values["body"] = std::monostate{};
+  else if (response.buffer)
+    values["body"] = response.buffer;
+  else
+    values["body"] = std::move(response.body);
+  values["url"] = std::move(response.url);
+  if (response.error.empty())
+    values["error"] = std::monostate{};
+  else
+    values["error"] = std::move(response.error);
+  return result;
+}
+
+static Value runShellCapture(const std::string &command);
+
+// get/post keep their old contract: the body, or nil on any failure
+// (including status >= 400). Only https:// still goes through curl.
+static Value httpSimple(HttpRequest request, const std::string &curlArgs) {
+  if (request.url.rfind("https://", 0) == 0)
+    return runShellCapture("curl -fsSL --max-time 10 " + curlArgs + " 2>/dev/null");
+  HttpExchange exchange(std::move(request));
+  HttpExchange::runAll({&exchange});
+  const HttpResponse &response = exchange.response();
+  if (!response.error.empty() || response.status >= 400)
+    return std::monostate{};
+  return response.body;
+}
+
 static Value nativeHttpGet(const std::vector<Value> &args) {
-  std::string url = requireStringValue(args[0], "http.get url");
-  std::string command = "curl -fsSL --max-time 10 " + shellQuote(url) + " 2>/dev/null";
-  return runShellCapture(command);
+  HttpRequest request;
+  request.url = requireStringValue(args[0], "http.get url");
+  const std::string curlArgs = shellQuote(request.url);
+  return httpSimple(std::move(request), curlArgs);
 }
 
 static Value nativeHttpPost(const std::vector<Value> &args) {
-  std::string url = requireStringValue(args[0], "http.post url");
-  std::string body = requireStringValue(args[1], "http.post body");
-  std::string command = "curl -fsSL --max-time 10 -X POST --data-binary " + shellQuote(body) + " " + shellQuote(url) + " 2>/dev/null";
-  return runShellCapture(command);
-}
+  HttpRequest request;
+  request.method = "POST";
+  request.url = requireStringValue(args[0], "http.post url");
+  request.body = requireStringValue(args[1], "http.post body");
+  const std::string curlArgs = "-X POST --data-binary " +
+                               shellQuote(request.body) + " " +
+                               shellQuote(request.url);
+  return httpSimple(std::move(request), curlArgs);
+}
+
+static Value nativeHttpRequest(const std::vector<Value> &args) {
+  HttpExchange exchange(httpRequest(args[0], args[1], args[2], "http.request"));
+  HttpExchange::runAll({&exchange});
+  if (!exchange.response().error.empty())
+    throw std::runtime_error(exchange.response().error + ".");
+  return httpResponseValue(exchange.response());
+}
+
+// requests: URL strings (GET) or maps of { method, url } plus any of the
+// request options. Responses come back in the same order; a failed one has
+// its error set rather than raising.
+static Value nativeHttpRequestAll(const std::vector<Value> &args) {
+  auto list = get_if<ListPtr>(&args[0]);
+  if (!list)
+    throw std::runtime_error("Expected list in http.request_all.");
+  std::vector<std::unique_ptr<HttpExchange>> exchanges;
+  for (const Value &entry : (*list)->elements) {
+    if (get_if<std::string>(&entry)) {
+      exchanges.push_back(std::make_unique<HttpExchange>(
+          httpRequest(Value("GET"), entry, Value(), "http.request_all")));
+      continue;
+    }
+    auto map = get_if<MapPtr>(&entry);
+    if (!map)
+      throw std::runtime_error(
+          "Expected URL or request map in http.request_all.");
+    auto method = (*map)->values.find("method");
+    auto url = (*map)->values.find("url");
+    exchanges.push_back(std::make_unique<HttpExchange>(httpRequest(
+        method == (*map)->values.end() ? Value("GET") : method->second,
+        url == (*map)->values.end() ? Value() : url->second, entry,
+        "http.request_all")));
+  }
+  std::vector<HttpExchange *> running;
+  for (auto &exchange : exchanges)
+    running.push_back(exchange.get());
+  HttpExchange::runAll(running);
+  auto responses = makeRef<List>();
+  responses->elements.reserve(exchanges.size());
+  for (auto &exchange : exchanges)
+    responses->elements.push_back(httpResponseValue(exchange->response()));
+  return responses;
+}
+
+// The exchange advances from reactor callbacks: one watch on its current
+// socket for the event it needs, re-armed after every step (the socket can
+// change across redirects and retries), and a timer for its deadline. The
+// callback gets the response on a later turn, never from inside this call.
+void Interpreter::httpAsync(std::shared_ptr<HttpExchange> exchange,
+                            Value callback) {
+  struct Pending {
+    std::shared_ptr<HttpExchange> exchange;
+    Value callback;
+    int watched = -1;
+    uint64_t timer = 0;
+    Value onReadable, onWritable, onTimeout;
+  };
+  auto pending = std::make_shared<Pending>();
+  pending->exchange = std::move(exchange);
+  pending->callback = std::move(callback);
+
+  // Natives built here hold `pending` until the exchange finishes.
+  auto step = [this, pending](short events) {
+    if (pending->watched >= 0)
+      reactor().unwatch(pending->watched);
+    pending->watched = -1;
+    HttpExchange &ex = *pending->exchange;
+    if (events > 0)
+      ex.advance(events);
+    else if (events == 0 && !ex.done())
+      ex.expire();
+    if (!ex.done()) {
+      pending->watched = ex.fd();
+      reactor().watch(ex.fd(),
+                      ex.events() & POLLIN ? Reactor::Readable
+                                           : Reactor::Writable,
+                      ex.events() & POLLIN ? pending->onReadable
+                                           : pending->onWritable);
+      return;
+    }
+    reactor().cancelTimer(pending->timer);
+    reactor().defer(pending->callback, {httpResponseValue(ex.response())});
+    // Break the cycle through the natives' captures.
+    pending->onReadable = pending->onWritable = pending->onTimeout = Value();
+  };
+  auto native = [&](const char *name, short events) {
+    auto fn = makeRef<NativeFunctionObject>();
+    fn->name = name;
+    fn->arity = events ? 1 : 0;
+    fn->func = [step, events](const std::vector<Value> &) {
+      step(events);
+      return Value();
+    };
+    return Value(fn);
+  };
+  pending->onReadable = native("http readable", POLLIN);
+  pending->onWritable = native("http writable", POLLOUT);
+  pending->onTimeout = native("http timeout", 0);
 
-static std::string hexFromUint64(uint64_t value) {
-  std::ostringstream oss;
-  oss << std::hex << std::setfill('0') << std::setw(16) << value;
-  return oss.str();
+  pending->exchange->start();
+  if (!pending->exchange->done())
+    pending->timer = reactor().addTimer(
+        std::max(0.0, pending->exchange->deadline() - Reactor::now()),
+        pending->onTimeout);
+  // Arms the first watch, or delivers an immediate failure on the next turn.
+  step(-1);
 }
 
-static std::string pseudoSha256(const std::string &data) {
-  static const std::array<uint64_t, 4> salts = {
-      0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
-      0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL};
+// --- Crypto ---
 
-  std::hash<std::string> hasher;
-  std::string digest;
-  digest.reserve(64);
+static std::string_view cryptoData(const Value &v, const char *fn) {
+  if (auto s = get_if<std::string>(&v))
+    return *s;
+  if (auto b = get_if<BufferPtr>(&v))
+    return {reinterpret_cast<const char *>((*b)->bytes.data()),
+            (*b)->bytes.size()};
+  throw std::runtime_error(std::string(fn) + " expects a string or buffer.");
+}
 
-  for (auto salt : salts) {
-    digest += hexFromUint64(hasher(data + std::to_string(salt)) ^ salt);
-  }
-  return digest;
+static HashAlgorithm cryptoAlgorithm(const Value &v, const char *fn) {
+  HashAlgorithm algorithm;
+  auto name = get_if<std::string>(&v);
+  if (!name || !hashAlgorithmFromName(*name, algorithm))
+    throw std::runtime_error(std::string(fn) +
+                             " algorithm must be \"sha1\", \"sha256\" or "
+                             "\"blake2b\".");
+  return algorithm;
 }
 
 static Value nativeCryptoHash(const std::vector<Value> &args) {
-  std::string data = requireStringValue(args[0], "crypto.hash data");
-  return pseudoSha256(data);
+  return hexEncode(
+      hashDigest(HashAlgorithm::Sha256, cryptoData(args[0], "crypto.hash")));
+}
+
+static Value nativeCryptoDigest(const std::vector<Value> &args) {
+  return hexEncode(hashDigest(cryptoAlgorithm(args[0], "crypto.digest"),
+                              cryptoData(args[1], "crypto.digest")));
+}
+
+// A map of { update(chunk), digest(), algorithm } bound to one Hasher, read
+// like a module namespace (as cache objects are).
+static Value nativeCryptoHasher(const std::vector<Value> &args) {
+  auto hasher = std::make_shared<Hasher>(
+      cryptoAlgorithm(args[0], "crypto.hasher"));
+  auto object = makeRef<LumaMap>(3);
+  object->values["algorithm"] = args[0];
+  auto method = [&](const std::string &name, size_t arity,
+                    std::function<Value(const std::vector<Value> &)> func) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->func = std::move(func);
+    native->arity = arity;
+    object->values[name] = native;
+  };
+  method("update", 1, [hasher](const std::vector<Value> &args) {
+    hasher->update(cryptoData(args[0], "update"));
+    return Value();
+  });
+  method("digest", 0, [hasher](const std::vector<Value> &) {
+    return Value(hexEncode(hasher->digest()));
+  });
+  return object;
+}
+
+static Value nativeCryptoFastHash(const std::vector<Value> &args) {
+  const uint64_t h = fastHash(cryptoData(args[0], "crypto.fast_hash"));
+  char bytes[8];
+  for (int i = 0; i < 8; ++i)
+    bytes[i] = static_cast<char>(h >> (56 - 8 * i));
+  return hexEncode(std::string_view(bytes, 8));
 }
 
 static Value nativeCryptoRandomBytes(const std::vector<Value> &args) {
@@ -1799,140 +2896,318 @@ static Value nativeCryptoRandomBytes(const std::vector<Value> &args) {
     throw std::runtime_error("crypto.random_bytes length cannot be negative.");
   }
 
-  size_t length = static_cast<size_t>(requested);
-  std::uniform_int_distribution<int> dist(0, 255);
-  std::ostringstream oss;
-  oss << std::hex << std::setfill('0');
-  for (size_t i = 0; i < length; ++i) {
-    int byte = dist(globalRng());
-    oss << std::setw(2) << byte;
-  }
-  return oss.str();
+  std::string bytes(static_cast<size_t>(requested), '\0');
+  secureRandomBytes(bytes.data(), bytes.size());
+  return hexEncode(bytes);
 }
 
-static Value nativeRegexMatch(const std::vector<Value> &args) {
-  std::string pattern = requireStringValue(args[0], "regex.match pattern");
-  std::string text = requireStringValue(args[1], "regex.match text");
+// --- Regex ---
+
+using RegexPtr = std::shared_ptr<const std::regex>;
+
+// Compiling a std::regex costs far more than running it, and scripts reuse
+// a handful of patterns, so string patterns are compiled once and kept in a
+// small LRU cache. Per thread: @std.workers run natives concurrently.
+static RegexPtr compileRegex(const std::string &pattern) {
+  constexpr size_t kCapacity = 64;
+  struct Cache {
+    std::list<std::pair<std::string, RegexPtr>> order; // least recent first
+    std::unordered_map<std::string_view,
+                       std::list<std::pair<std::string, RegexPtr>>::iterator>
+        index; // keys view the strings in `order`
+  };
+  thread_local Cache cache;
+
+  auto it = cache.index.find(pattern);
+  if (it != cache.index.end()) {
+    cache.order.splice(cache.order.end(), cache.order, it->second);
+    return it->second->second;
+  }
+  RegexPtr re;
   try {
-    std::regex re(pattern);
-    return std::regex_match(text, re);
+    re = std::make_shared<const std::regex>(
+        pattern, std::regex::ECMAScript | std::regex::optimize);
   } catch (const std::regex_error &e) {
     throw std::runtime_error(std::string("Invalid regex: ") + e.what());
   }
+  if (cache.order.size() >= kCapacity) {
+    cache.index.erase(cache.order.front().first);
+    cache.order.pop_front();
+  }
+  cache.order.emplace_back(pattern, re);
+  cache.index.emplace(cache.order.back().first, std::prev(cache.order.end()));
+  return re;
 }
 
-static Value nativeRegexSearch(const std::vector<Value> &args) {
-  std::string pattern = requireStringValue(args[0], "regex.search pattern");
-  std::string text = requireStringValue(args[1], "regex.search text");
-  try {
-    std::regex re(pattern);
-    return std::regex_search(text, re);
-  } catch (const std::regex_error &e) {
-    throw std::runtime_error(std::string("Invalid regex: ") + e.what());
-  }
+static const std::string &regexText(const Value &v, const char *where) {
+  if (auto s = get_if<std::string>(&v))
+    return *s;
+  throw std::runtime_error(std::string("Expected string in ") + where + ".");
 }
 
-static Value nativeRegexReplace(const std::vector<Value> &args) {
-  std::string pattern = requireStringValue(args[0], "regex.replace pattern");
-  std::string text = requireStringValue(args[1], "regex.replace text");
-  std::string replacement = requireStringValue(args[2], "regex.replace replacement");
-  try {
-    std::regex re(pattern);
-    return std::regex_replace(text, re, replacement);
-  } catch (const std::regex_error &e) {
-    throw std::runtime_error(std::string("Invalid regex: ") + e.what());
-  }
+static Value regexSplit(const std::regex &re, const std::string &text) {
+  auto list = makeRef<List>();
+  std::sregex_token_iterator it(text.begin(), text.end(), re, -1);
+  for (std::sregex_token_iterator end; it != end; ++it)
+    list->elements.push_back(it->str());
+  return list;
 }
 
-static Value nativeRegexSplit(const std::vector<Value> &args) {
-  std::string pattern = requireStringValue(args[0], "regex.split pattern");
-  std::string text = requireStringValue(args[1], "regex.split text");
-  auto list = std::make_shared<List>();
-  try {
-    std::regex re(pattern);
-    std::sregex_token_iterator it(text.begin(), text.end(), re, -1);
-    std::sregex_token_iterator end;
-    for (; it != end; ++it) {
-      list->elements.push_back(it->str());
+// Every match in one call: the matched text for a pattern without groups,
+// else a list of its groups (nil for a group that did not take part).
+static Value regexFindAll(const std::regex &re, const std::string &text) {
+  auto list = makeRef<List>();
+  const size_t groups = re.mark_count();
+  std::sregex_iterator it(text.begin(), text.end(), re);
+  for (std::sregex_iterator end; it != end; ++it) {
+    const std::smatch &m = *it;
+    if (groups == 0) {
+      list->elements.push_back(m.str());
+      continue;
     }
-  } catch (const std::regex_error &e) {
-    throw std::runtime_error(std::string("Invalid regex: ") + e.what());
+    auto captured = makeRef<List>();
+    captured->elements.reserve(groups);
+    for (size_t i = 1; i <= groups; ++i)
+      captured->elements.push_back(m[i].matched ? Value(m[i].str())
+                                                : Value(std::monostate{}));
+    list->elements.push_back(captured);
   }
   return list;
 }
 
+static Value nativeRegexMatch(const std::vector<Value> &args) {
+  RegexPtr re = compileRegex(regexText(args[0], "regex.match pattern"));
+  return std::regex_match(regexText(args[1], "regex.match text"), *re);
+}
+
+static Value nativeRegexSearch(const std::vector<Value> &args) {
+  RegexPtr re = compileRegex(regexText(args[0], "regex.search pattern"));
+  return std::regex_search(regexText(args[1], "regex.search text"), *re);
+}
+
+static Value nativeRegexReplace(const std::vector<Value> &args) {
+  RegexPtr re = compileRegex(regexText(args[0], "regex.replace pattern"));
+  return std::regex_replace(
+      regexText(args[1], "regex.replace text"), *re,
+      regexText(args[2], "regex.replace replacement"));
+}
+
+static Value nativeRegexSplit(const std::vector<Value> &args) {
+  RegexPtr re = compileRegex(regexText(args[0], "regex.split pattern"));
+  return regexSplit(*re, regexText(args[1], "regex.split text"));
+}
+
+static Value nativeRegexFindAll(const std::vector<Value> &args) {
+  RegexPtr re = compileRegex(regexText(args[0], "regex.find_all pattern"));
+  return regexFindAll(*re, regexText(args[1], "regex.find_all text"));
+}
+
+// A compiled pattern: a map of methods bound to one std::regex, read like a
+// module namespace (as cache objects are), plus its `pattern` string.
+static Value nativeRegexCompile(const std::vector<Value> &args) {
+  const std::string &pattern = regexText(args[0], "regex.compile pattern");
+  RegexPtr re = compileRegex(pattern);
+  auto object = makeRef<LumaMap>(6);
+  object->values["pattern"] = args[0];
+  auto method = [&](const std::string &name, size_t arity,
+                    std::function<Value(const std::vector<Value> &)> func) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->func = std::move(func);
+    native->arity = arity;
+    object->values[name] = native;
+  };
+  method("match", 1, [re](const std::vector<Value> &args) {
+    return Value(std::regex_match(regexText(args[0], "match text"), *re));
+  });
+  method("search", 1, [re](const std::vector<Value> &args) {
+    return Value(std::regex_search(regexText(args[0], "search text"), *re));
+  });
+  method("replace", 2, [re](const std::vector<Value> &args) {
+    return Value(std::regex_replace(regexText(args[0], "replace text"), *re,
+                                    regexText(args[1], "replace replacement")));
+  });
+  method("split", 1, [re](const std::vector<Value> &args) {
+    return regexSplit(*re, regexText(args[0], "split text"));
+  });
+  method("find_all", 1, [re](const std::vector<Value> &args) {
+    return regexFindAll(*re, regexText(args[0], "find_all text"));
+  });
+  return object;
+}
+
+// The string argument itself, without a copy.
+static std::string_view requireStringView(const Value &v,
+                                          const std::string &where) {
+  if (auto s = get_if<std::string>(&v))
+    return *s;
+  throw std::runtime_error("Expected string in " + where + ".");
+}
+
 static Value nativeStringUpper(const std::vector<Value> &args) {
   std::string value = requireStringValue(args[0], "string.upper");
-  std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::toupper(c); });
+  asciiUpper(value);
   return value;
 }
 
 static Value nativeStringLower(const std::vector<Value> &args) {
   std::string value = requireStringValue(args[0], "string.lower");
-  std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+  asciiLower(value);
   return value;
 }
 
 static Value nativeStringTrim(const std::vector<Value> &args) {
-  std::string value = requireStringValue(args[0], "string.trim");
-  return trimString(value);
+  std::string_view value = requireStringView(args[0], "string.trim");
+  std::string_view trimmed = trimWhitespace(value);
+  if (trimmed.size() == value.size())
+    return args[0]; // strings are immutable, so share it
+  return std::string(trimmed);
 }
 
 static Value nativeStringStartsWith(const std::vector<Value> &args) {
-  std::string value = requireStringValue(args[0], "string.starts_with value");
-  std::string prefix = requireStringValue(args[1], "string.starts_with prefix");
-  if (prefix.size() > value.size()) return false;
-  return value.compare(0, prefix.size(), prefix) == 0;
+  std::string_view value = requireStringView(args[0], "string.starts_with value");
+  std::string_view prefix = requireStringView(args[1], "string.starts_with prefix");
+  return value.substr(0, prefix.size()) == prefix;
 }
 
 static Value nativeStringEndsWith(const std::vector<Value> &args) {
-  std::string value = requireStringValue(args[0], "string.ends_with value");
-  std::string suffix = requireStringValue(args[1], "string.ends_with suffix");
+  std::string_view value = requireStringView(args[0], "string.ends_with value");
+  std::string_view suffix = requireStringView(args[1], "string.ends_with suffix");
   if (suffix.size() > value.size()) return false;
-  return value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+  return value.substr(value.size() - suffix.size()) == suffix;
 }
 
 static Value nativeStringSplit(const std::vector<Value> &args) {
-  std::string value = requireStringValue(args[0], "string.split value");
-  std::string delim = requireStringValue(args[1], "string.split delimiter");
+  std::string_view value = requireStringView(args[0], "string.split value");
+  std::string_view delim = requireStringView(args[1], "string.split delimiter");
   if (delim.empty()) {
     throw std::runtime_error("Delimiter cannot be empty in string.split.");
   }
 
-  auto list = std::make_shared<List>();
+  auto list = makeRef<List>();
   size_t start = 0;
-  while (true) {
-    size_t pos = value.find(delim, start);
-    if (pos == std::string::npos) {
-      list->elements.push_back(value.substr(start));
-      break;
-    }
-    list->elements.push_back(value.substr(start, pos - start));
+  for (size_t pos = findSubstring(value, delim); pos != std::string_view::npos;
+       pos = findSubstring(value, delim, start)) {
+    list->elements.emplace_back(std::string(value.substr(start, pos - start)));
     start = pos + delim.size();
   }
+  list->elements.emplace_back(std::string(value.substr(start)));
   return list;
 }
 
 static Value nativeStringJoin(const std::vector<Value> &args) {
   const Value &listVal = args[0];
-  std::string delim = requireStringValue(args[1], "string.join delimiter");
+  std::string_view delim = requireStringView(args[1], "string.join delimiter");
 
-  auto listPtr = std::get_if<ListPtr>(&listVal);
+  auto listPtr = get_if<ListPtr>(&listVal);
   if (!listPtr) {
     throw std::runtime_error("Expected list in string.join.");
   }
 
-  std::ostringstream out;
   const auto &elements = (*listPtr)->elements;
+  size_t total = elements.empty() ? 0 : delim.size() * (elements.size() - 1);
+  for (const Value &v : elements)
+    total += requireStringView(v, "string.join elements").size();
+  std::string out;
+  out.reserve(total);
   for (size_t i = 0; i < elements.size(); ++i) {
-    if (i > 0) out << delim;
-    out << requireStringValue(elements[i], "string.join elements");
+    if (i > 0) out += delim;
+    out += get<std::string>(elements[i]);
+  }
+  return out;
+}
+
+// find(str, sub): the byte offset of the first sub, or -1.
+static Value nativeStringFind(const std::vector<Value> &args) {
+  size_t at = findSubstring(requireStringView(args[0], "string.find value"),
+                            requireStringView(args[1], "string.find substring"));
+  return at == std::string_view::npos ? -1.0 : static_cast<double>(at);
+}
+
+static Value nativeStringContains(const std::vector<Value> &args) {
+  return findSubstring(
+             requireStringView(args[0], "string.contains value"),
+             requireStringView(args[1], "string.contains substring")) !=
+         std::string_view::npos;
+}
+
+static Value nativeStringCount(const std::vector<Value> &args) {
+  std::string_view value = requireStringView(args[0], "string.count value");
+  std::string_view sub = requireStringView(args[1], "string.count substring");
+  if (sub.empty()) {
+    throw std::runtime_error("Substring cannot be empty in string.count.");
+  }
+  return static_cast<double>(countSubstring(value, sub));
+}
+
+static Value nativeStringReplace(const std::vector<Value> &args) {
+  std::string_view value = requireStringView(args[0], "string.replace value");
+  std::string_view from = requireStringView(args[1], "string.replace old");
+  std::string_view to = requireStringView(args[2], "string.replace new");
+  if (from.empty()) {
+    throw std::runtime_error("Search string cannot be empty in string.replace.");
   }
-  return out.str();
+  if (findSubstring(value, from) == std::string_view::npos)
+    return args[0];
+  return replaceAll(value, from, to);
+}
+
+// Appends a value as print shows it; strings are copied as they are.
+static void appendText(std::string &out, const Value &v) {
+  if (auto str = get_if<std::string>(&v))
+    out += *str;
+  else
+    out += valueToString(v);
+}
+
+// string.builder: { append(value), append_many(list), reserve(capacity),
+// length(), clear(), to_string() } over one growing buffer, so building a
+// string piece by piece costs O(n) instead of a copy per `+`.
+static Value nativeStringBuilder(const std::vector<Value> &args) {
+  auto text = std::make_shared<std::string>();
+  if (!isNil(args[0]))
+    text->reserve(requireSizeValue(args[0], "string.builder capacity"));
+
+  auto object = makeRef<LumaMap>(6);
+  auto bind = [&](const std::string &name, size_t arity, NativeMethod func) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->func = std::move(func);
+    native->arity = arity;
+    object->values[name] = native;
+  };
+  bind("append", 1, [text](const std::vector<Value> &args) {
+    appendText(*text, args[0]);
+    return Value();
+  });
+  bind("append_many", 1, [text](const std::vector<Value> &args) {
+    auto list = get_if<ListPtr>(&args[0]);
+    if (!list)
+      throw std::runtime_error("Expected list in append_many.");
+    for (const Value &v : (*list)->elements)
+      appendText(*text, v);
+    return Value();
+  });
+  bind("reserve", 1, [text](const std::vector<Value> &args) {
+    text->reserve(requireSizeValue(args[0], "reserve capacity"));
+    return Value();
+  });
+  bind("length", 0, [text](const std::vector<Value> &) {
+    return Value(static_cast<double>(text->size()));
+  });
+  bind("clear", 0, [text](const std::vector<Value> &) {
+    text->clear();
+    return Value();
+  });
+  bind("to_string", 0, [text](const std::vector<Value> &) {
+    return Value(*text);
+  });
+  return object;
 }
 
 static std::mt19937 &globalRng() {
-  static std::mt19937 engine(std::random_device{}());
+  // Per thread: @std.workers runs interpreters side by side.
+  thread_local std::mt19937 engine(std::random_device{}());
   return engine;
 }
 
@@ -2009,7 +3284,7 @@ static Value nativePathStem(const std::vector<Value> &args) {
   if (last_dot == std::string::npos || (last_sep != std::string::npos && last_dot < last_sep)) {
     return nativePathBasename(args);
   }
-  std::string basename = std::get<std::string>(nativePathBasename(args));
+  std::string basename = get<std::string>(nativePathBasename(args));
   return basename.substr(0, last_dot - (path.length() - basename.length()));
 }
 
@@ -2243,7 +3518,7 @@ static Value nativeSysArch(const std::vector<Value> &args) {
 }
 
 static Value nativeSysPlatformInfo(const std::vector<Value> &args) {
-  auto info = std::make_shared<LumaMap>();
+  auto info = makeRef<LumaMap>();
   info->values["os"] = nativeSysPlatform(args);
   info->values["arch"] = nativeSysArch(args);
   info->values["version"] = "unknown";
@@ -2255,7 +3530,7 @@ static Value nativeSysCpuCount(const std::vector<Value> &args) {
 }
 
 static Value nativeSysCpuInfo(const std::vector<Value> &args) {
-  auto info = std::make_shared<LumaMap>();
+  auto info = makeRef<LumaMap>();
   info->values["count"] = nativeSysCpuCount(args);
   info->values["model"] = "unknown";
   return info;
@@ -2272,9 +3547,9 @@ static Value nativeSysAvailableMemory(const std::vector<Value> &args) {
 }
 
 static Value nativeSysMemoryInfo(const std::vector<Value> &args) {
-  auto info = std::make_shared<LumaMap>();
-  double total = std::get<double>(nativeSysTotalMemory(args));
-  double available = std::get<double>(nativeSysAvailableMemory(args));
+  auto info = makeRef<LumaMap>();
+  double total = get<double>(nativeSysTotalMemory(args));
+  double available = get<double>(nativeSysAvailableMemory(args));
   info->values["total"] = total;
   info->values["available"] = available;
   info->values["used"] = total - available;
@@ -2290,7 +3565,7 @@ static Value nativeSysPpid(const std::vector<Value> &args) {
 }
 
 static Value nativeSysProcessInfo(const std::vector<Value> &args) {
-  auto info = std::make_shared<LumaMap>();
+  auto info = makeRef<LumaMap>();
   info->values["pid"] = nativeSysPid(args);
   info->values["ppid"] = nativeSysPpid(args);
   info->values["command"] = "unknown";
@@ -2298,7 +3573,7 @@ static Value nativeSysProcessInfo(const std::vector<Value> &args) {
 }
 
 static Value nativeSysLoadAverage(const std::vector<Value> &args) {
-  auto list = std::make_shared<List>();
+  auto list = makeRef<List>();
   list->elements = {static_cast<double>(0), static_cast<double>(0), static_cast<double>(0)};
   return list;
 }
@@ -2316,7 +3591,7 @@ static Value nativeSysHostname(const std::vector<Value> &args) {
 }
 
 static Value nativeSysNetworkInterfaces(const std::vector<Value> &args) {
-  auto list = std::make_shared<List>();
+  auto list = makeRef<List>();
   // Network interface detection would go here
   return list;
 }
@@ -2335,7 +3610,7 @@ static Value nativeSysCwd(const std::vector<Value> &args) {
 }
 
 static Value nativeSysEnviron(const std::vector<Value> &args) {
-  auto env = std::make_shared<LumaMap>();
+  auto env = makeRef<LumaMap>();
   extern char **environ;
   for (char **envp = environ; *envp != nullptr; ++envp) {
     std::string env_var = *envp;
@@ -2357,7 +3632,7 @@ static Value nativeSysExit(const std::vector<Value> &args) {
 
 static Value nativeSysArgv(const std::vector<Value> &args) {
   // Would need to store argv from main
-  auto list = std::make_shared<List>();
+  auto list = makeRef<List>();
   return list;
 }
 
@@ -2365,6 +3640,19 @@ static Value nativeSysProgname(const std::vector<Value> &args) {
   return "luma";
 }
 
+static Value nativeSysGc(const std::vector<Value> &args) {
+  return static_cast<double>(gcCollect());
+}
+
+static Value nativeSysGcStats(const std::vector<Value> &args) {
+  auto stats = makeRef<LumaMap>(4);
+  stats->values["live"] = static_cast<double>(gcHeap.live);
+  stats->values["collections"] = static_cast<double>(gcHeap.collections);
+  stats->values["freed"] = static_cast<double>(gcHeap.freed);
+  stats->values["threshold"] = static_cast<double>(gcHeap.threshold);
+  return stats;
+}
+
 // ========== UUID Module Natives ==========
 
 static Value nativeUuidV4(const std::vector<Value> &args) {
@@ -2409,11 +3697,11 @@ static Value nativeUuidIsValid(const std::vector<Value> &args) {
 
 static Value nativeUuidParse(const std::vector<Value> &args) {
   std::string uuid = requireStringValue(args[0], "uuid.parse uuid");
-  if (!std::get<bool>(nativeUuidIsValid(args))) {
+  if (!get<bool>(nativeUuidIsValid(args))) {
     return std::monostate{};
   }
 
-  auto parsed = std::make_shared<LumaMap>();
+  auto parsed = makeRef<LumaMap>();
   parsed->values["string"] = uuid;
   parsed->values["version"] = static_cast<double>(4); // Assume v4
   parsed->values["variant"] = static_cast<double>(1); // RFC 4122
@@ -2421,11 +3709,11 @@ static Value nativeUuidParse(const std::vector<Value> &args) {
 }
 
 static Value nativeUuidStringify(const std::vector<Value> &args) {
-  if (std::holds_alternative<std::monostate>(args[0])) {
+  if (holds_alternative<std::monostate>(args[0])) {
     return nativeUuidNil(args);
   }
-  auto uuid_obj = std::get<MapPtr>(args[0]);
-  return std::get<std::string>(uuid_obj->values["string"]);
+  auto uuid_obj = get<MapPtr>(args[0]);
+  return get<std::string>(uuid_obj->values["string"]);
 }
 
 // ========== URL Module Natives ==========
@@ -2433,7 +3721,7 @@ static Value nativeUuidStringify(const std::vector<Value> &args) {
 static Value nativeUrlParse(const std::vector<Value> &args) {
   std::string url_str = requireStringValue(args[0], "url.parse url");
 
-  auto parsed = std::make_shared<LumaMap>();
+  auto parsed = makeRef<LumaMap>();
   parsed->values["href"] = url_str;
   parsed->values["protocol"] = "";
   parsed->values["hostname"] = "";
@@ -2484,37 +3772,37 @@ static Value nativeUrlParse(const std::vector<Value> &args) {
 }
 
 static Value nativeUrlFormat(const std::vector<Value> &args) {
-  auto url_obj = std::get<MapPtr>(args[0]);
+  auto url_obj = get<MapPtr>(args[0]);
   std::string result;
 
-  std::string protocol = std::get<std::string>(url_obj->values["protocol"]);
+  std::string protocol = get<std::string>(url_obj->values["protocol"]);
   if (!protocol.empty()) {
     result += protocol;
     if (protocol.back() != ':') result += ":";
     if (result.back() != '/') result += "//";
   }
 
-  std::string hostname = std::get<std::string>(url_obj->values["hostname"]);
+  std::string hostname = get<std::string>(url_obj->values["hostname"]);
   if (!hostname.empty()) {
     result += hostname;
   }
 
-  std::string port = std::get<std::string>(url_obj->values["port"]);
+  std::string port = get<std::string>(url_obj->values["port"]);
   if (!port.empty()) {
     result += ":" + port;
   }
 
-  std::string pathname = std::get<std::string>(url_obj->values["pathname"]);
+  std::string pathname = get<std::string>(url_obj->values["pathname"]);
   if (!pathname.empty()) {
     result += pathname;
   }
 
-  std::string search = std::get<std::string>(url_obj->values["search"]);
+  std::string search = get<std::string>(url_obj->values["search"]);
   if (!search.empty()) {
     result += search;
   }
 
-  std::string hash = std::get<std::string>(url_obj->values["hash"]);
+  std::string hash = get<std::string>(url_obj->values["hash"]);
   if (!hash.empty()) {
     result += hash;
   }
@@ -2525,7 +3813,7 @@ static Value nativeUrlFormat(const std::vector<Value> &args) {
 static Value nativeUrlParseQuery(const std::vector<Value> &args) {
   std::string query_str = requireStringValue(args[0], "url.parse_query query");
 
-  auto params = std::make_shared<LumaMap>();
+  auto params = makeRef<LumaMap>();
 
   if (query_str.empty()) {
     return params;
@@ -2565,7 +3853,7 @@ static Value nativeUrlParseQuery(const std::vector<Value> &args) {
 }
 
 static Value nativeUrlBuildQuery(const std::vector<Value> &args) {
-  auto params = std::get<MapPtr>(args[0]);
+  auto params = get<MapPtr>(args[0]);
   std::string result;
 
   bool first = true;
@@ -2595,9 +3883,883 @@ static Value nativeUrlResolve(const std::vector<Value> &args) {
 }
 
 
+// ========== Buffer Module Natives ==========
+// Buffer methods are natives that receive the buffer itself as args[0]
+// (see Interpreter::invoke); the rest are @std.buffer module functions.
+
+static ByteBuffer &requireBuffer(const Value &v, const std::string &where) {
+  if (auto b = get_if<BufferPtr>(&v))
+    return **b;
+  throw std::runtime_error("Expected buffer in " + where + ".");
+}
+
+// Out-of-range byte values clamp, as the Luma Buffer's _to_byte did.
+static uint8_t toByte(const Value &v, const std::string &where) {
+  double d = requireNumberValue(v, where);
+  if (!(d > 0))
+    return 0;
+  return d >= 255 ? 255 : static_cast<uint8_t>(d);
+}
+
+static const Value &optionalArg(const std::vector<Value> &args, size_t i) {
+  static const Value nil;
+  return i < args.size() ? args[i] : nil;
+}
+
+static void requireArgCount(const std::vector<Value> &args, size_t min,
+                            size_t max) {
+  if (args.size() < min || args.size() > max)
+    throw std::runtime_error("Expected " + std::to_string(min - 1) + " to " +
+                             std::to_string(max - 1) + " arguments but got " +
+                             std::to_string(args.size() - 1) + ".");
+}
+
+// nil means `fallback`; anything else is clamped into [0, size].
+static size_t bufferPosition(const Value &v, size_t size, size_t fallback,
+                             const std::string &where) {
+  if (isNil(v))
+    return fallback;
+  double d = requireNumberValue(v, where);
+  if (!(d > 0))
+    return 0;
+  return d >= static_cast<double>(size) ? size : static_cast<size_t>(d);
+}
+
+// Appends the bytes of a string, buffer or list of byte values.
+static void appendBytes(std::vector<uint8_t> &out, const Value &v,
+                        const std::string &where) {
+  if (auto s = get_if<std::string>(&v)) {
+    out.insert(out.end(), s->begin(), s->end());
+  } else if (auto b = get_if<BufferPtr>(&v)) {
+    const auto &bytes = (*b)->bytes;
+    out.insert(out.end(), bytes.begin(), bytes.end()); // safe for self-append
+  } else if (auto l = get_if<ListPtr>(&v)) {
+    out.reserve(out.size() + (*l)->elements.size());
+    for (const Value &e : (*l)->elements)
+      out.push_back(toByte(e, where));
+  } else {
+    throw std::runtime_error("Expected string, buffer or list in " + where +
+                             ".");
+  }
+}
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+static std::string hexEncode(const uint8_t *data, size_t size) {
+  std::string out(size * 2, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    out[2 * i] = kHexDigits[data[i] >> 4];
+    out[2 * i + 1] = kHexDigits[data[i] & 0xf];
+  }
+  return out;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static std::vector<uint8_t> hexDecode(const std::string &hex) {
+  if (hex.size() % 2 != 0)
+    throw std::runtime_error("Hex string must have an even length.");
+  std::vector<uint8_t> out(hex.size() / 2);
+  for (size_t i = 0; i < out.size(); ++i) {
+    int hi = hexValue(hex[2 * i]);
+    int lo = hexValue(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0)
+      throw std::runtime_error("Invalid hex digit in '" + hex + "'.");
+    out[i] = static_cast<uint8_t>(hi << 4 | lo);
+  }
+  return out;
+}
+
+static const char kBase64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string base64Encode(const uint8_t *data, size_t size) {
+  std::string out;
+  out.reserve((size + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < size; i += 3) {
+    uint32_t n = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+    out += kBase64Alphabet[n >> 18];
+    out += kBase64Alphabet[(n >> 12) & 63];
+    out += kBase64Alphabet[(n >> 6) & 63];
+    out += kBase64Alphabet[n & 63];
+  }
+  if (i < size) {
+    uint32_t n = data[i] << 16 | (i + 1 < size ? data[i + 1] << 8 : 0);
+    out += kBase64Alphabet[n >> 18];
+    out += kBase64Alphabet[(n >> 12) & 63];
+    out += i + 1 < size ? kBase64Alphabet[(n >> 6) & 63] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+static std::vector<uint8_t> base64Decode(const std::string &text) {
+  std::vector<uint8_t> out;
+  out.reserve(text.size() / 4 * 3);
+  uint32_t acc = 0;
+  int bits = 0;
+  for (char c : text) {
+    if (c == '=')
+      break;
+    if (std::isspace(static_cast<unsigned char>(c)))
+      continue;
+    const char *p = std::strchr(kBase64Alphabet, c);
+    if (!p || c == '\0')
+      throw std::runtime_error("Invalid base64 character in input.");
+    acc = acc << 6 | static_cast<uint32_t>(p - kBase64Alphabet);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<uint8_t>(acc >> bits));
+    }
+  }
+  return out;
+}
+
+// Reads an unsigned `width`-byte integer; nil when it does not fit.
+static Value readUint(const std::vector<Value> &args, size_t width,
+                      bool bigEndian) {
+  const auto &bytes = requireBuffer(args[0], "buffer read").bytes;
+  double offset = requireNumberValue(args[1], "buffer read offset");
+  if (offset < 0 || offset + width > bytes.size())
+    return std::monostate{};
+  const uint8_t *p = bytes.data() + static_cast<size_t>(offset);
+  uint32_t n = 0;
+  for (size_t i = 0; i < width; ++i)
+    n |= static_cast<uint32_t>(p[bigEndian ? i : width - 1 - i])
+         << (8 * (width - 1 - i));
+  return static_cast<double>(n);
+}
+
+static Value writeUint(const std::vector<Value> &args, size_t width,
+                       bool bigEndian) {
+  auto &bytes = requireBuffer(args[0], "buffer write").bytes;
+  double offset = requireNumberValue(args[1], "buffer write offset");
+  double value = requireNumberValue(args[2], "buffer write value");
+  if (offset < 0 || offset + width > bytes.size())
+    return false;
+  uint8_t *p = bytes.data() + static_cast<size_t>(offset);
+  // A single byte clamps like set(); wider values keep their low bits.
+  const auto n = width == 1 ? toByte(args[2], "buffer write value")
+                            : static_cast<uint32_t>(static_cast<int64_t>(value));
+  for (size_t i = 0; i < width; ++i)
+    p[bigEndian ? i : width - 1 - i] =
+        static_cast<uint8_t>(n >> (8 * (width - 1 - i)));
+  return true;
+}
+
+static int compareBuffers(const ByteBuffer &a, const ByteBuffer &b) {
+  const size_t common = std::min(a.bytes.size(), b.bytes.size());
+  int c = common ? std::memcmp(a.bytes.data(), b.bytes.data(), common) : 0;
+  if (c == 0 && a.bytes.size() != b.bytes.size())
+    c = a.bytes.size() < b.bytes.size() ? -1 : 1;
+  return c < 0 ? -1 : (c > 0 ? 1 : 0);
+}
+
+// ---- methods ----
+
+static Value nativeBufferLength(const std::vector<Value> &args) {
+  return static_cast<double>(requireBuffer(args[0], "length").bytes.size());
+}
+
+static Value nativeBufferCap(const std::vector<Value> &args) {
+  return static_cast<double>(requireBuffer(args[0], "cap").bytes.capacity());
+}
+
+static Value nativeBufferIsEmpty(const std::vector<Value> &args) {
+  return requireBuffer(args[0], "is_empty").bytes.empty();
+}
+
+static Value nativeBufferClear(const std::vector<Value> &args) {
+  requireBuffer(args[0], "clear").bytes.clear();
+  return std::monostate{};
+}
+
+static Value nativeBufferGet(const std::vector<Value> &args) {
+  const auto &bytes = requireBuffer(args[0], "get").bytes;
+  double index = requireNumberValue(args[1], "buffer.get index");
+  if (index < 0 || index >= bytes.size())
+    return std::monostate{};
+  return static_cast<double>(bytes[static_cast<size_t>(index)]);
+}
+
+static Value nativeBufferSet(const std::vector<Value> &args) {
+  auto &bytes = requireBuffer(args[0], "set").bytes;
+  double index = requireNumberValue(args[1], "buffer.set index");
+  if (index < 0 || index >= bytes.size())
+    return false;
+  bytes[static_cast<size_t>(index)] = toByte(args[2], "buffer.set value");
+  return true;
+}
+
+static Value nativeBufferAppendByte(const std::vector<Value> &args) {
+  requireBuffer(args[0], "append_byte")
+      .bytes.push_back(toByte(args[1], "buffer.append_byte"));
+  return std::monostate{};
+}
+
+static Value nativeBufferAppendBytes(const std::vector<Value> &args) {
+  appendBytes(requireBuffer(args[0], "append_bytes").bytes, args[1],
+              "buffer.append_bytes");
+  return std::monostate{};
+}
+
+static Value nativeBufferInsert(const std::vector<Value> &args) {
+  auto &bytes = requireBuffer(args[0], "insert").bytes;
+  size_t index = bufferPosition(args[1], bytes.size(), 0, "buffer.insert");
+  bytes.insert(bytes.begin() + index, toByte(args[2], "buffer.insert"));
+  return std::monostate{};
+}
+
+static Value nativeBufferRemove(const std::vector<Value> &args) {
+  auto &bytes = requireBuffer(args[0], "remove").bytes;
+  double index = requireNumberValue(args[1], "buffer.remove index");
+  if (index < 0 || index >= bytes.size())
+    return std::monostate{};
+  auto it = bytes.begin() + static_cast<size_t>(index);
+  double removed = *it;
+  bytes.erase(it);
+  return removed;
+}
+
+// slice([start[, end]])
+static Value nativeBufferSlice(const std::vector<Value> &args) {
+  requireArgCount(args, 1, 3);
+  const auto &bytes = requireBuffer(args[0], "slice").bytes;
+  size_t start = bufferPosition(optionalArg(args, 1), bytes.size(), 0,
+                                "buffer.slice start");
+  size_t end = bufferPosition(optionalArg(args, 2), bytes.size(),
+                              bytes.size(), "buffer.slice end");
+  if (start >= end)
+    return makeRef<ByteBuffer>();
+  return makeRef<ByteBuffer>(
+      std::vector<uint8_t>(bytes.begin() + start, bytes.begin() + end));
+}
+
+// copy_from(other[, offset[, length]]): replaces the contents.
+static Value nativeBufferCopyFrom(const std::vector<Value> &args) {
+  requireArgCount(args, 2, 4);
+  auto &bytes = requireBuffer(args[0], "copy_from").bytes;
+  const auto &src = requireBuffer(args[1], "buffer.copy_from").bytes;
+  size_t offset = bufferPosition(optionalArg(args, 2), src.size(), 0,
+                                 "buffer.copy_from offset");
+  size_t length = bufferPosition(optionalArg(args, 3), src.size() - offset,
+                                 src.size() - offset,
+                                 "buffer.copy_from length");
+  std::vector<uint8_t> copy(src.begin() + offset,
+                            src.begin() + offset + length);
+  bytes = std::move(copy);
+  return std::monostate{};
+}
+
+// fill(value[, start[, end]])
+static Value nativeBufferFill(const std::vector<Value> &args) {
+  requireArgCount(args, 2, 4);
+  auto &bytes = requireBuffer(args[0], "fill").bytes;
+  uint8_t value = toByte(args[1], "buffer.fill value");
+  size_t start = bufferPosition(optionalArg(args, 2), bytes.size(), 0,
+                                "buffer.fill start");
+  size_t end = bufferPosition(optionalArg(args, 3), bytes.size(),
+                              bytes.size(), "buffer.fill end");
+  if (start < end)
+    std::fill(bytes.begin() + start, bytes.begin() + end, value);
+  return std::monostate{};
+}
+
+static Value nativeBufferToString(const std::vector<Value> &args) {
+  const auto &bytes = requireBuffer(args[0], "to_string").bytes;
+  return std::string(bytes.begin(), bytes.end());
+}
+
+static Value nativeBufferToHex(const std::vector<Value> &args) {
+  const auto &bytes = requireBuffer(args[0], "to_hex").bytes;
+  return hexEncode(bytes.data(), bytes.size());
+}
+
+static Value nativeBufferToBase64(const std::vector<Value> &args) {
+  const auto &bytes = requireBuffer(args[0], "to_base64").bytes;
+  return base64Encode(bytes.data(), bytes.size());
+}
+
+static Value nativeBufferEqualsMethod(const std::vector<Value> &args) {
+  return compareBuffers(requireBuffer(args[0], "equals"),
+                        requireBuffer(args[1], "buffer.equals")) == 0;
+}
+
+static Value nativeBufferCompareMethod(const std::vector<Value> &args) {
+  return static_cast<double>(compareBuffers(
+      requireBuffer(args[0], "compare"),
+      requireBuffer(args[1], "buffer.compare")));
+}
+
+// ---- module functions ----
+
+// Buffer(size_or_data): nil, a zero-filled size, or the bytes of a string,
+// list or other buffer (copied).
+static Value nativeBufferNew(const std::vector<Value> &args) {
+  auto buffer = makeRef<ByteBuffer>();
+  const Value &init = args[0];
+  if (auto n = get_if<double>(&init)) {
+    buffer->bytes.resize(*n > 0 ? static_cast<size_t>(*n) : 0);
+  } else if (!isNil(init)) {
+    appendBytes(buffer->bytes, init, "Buffer");
+  }
+  return buffer;
+}
+
+static Value nativeBufferFromHex(const std::vector<Value> &args) {
+  return makeRef<ByteBuffer>(
+      hexDecode(requireStringValue(args[0], "buffer.from_hex")));
+}
+
+static Value nativeBufferFromBase64(const std::vector<Value> &args) {
+  return makeRef<ByteBuffer>(
+      base64Decode(requireStringValue(args[0], "buffer.from_base64")));
+}
+
+static Value nativeBufferConcat(const std::vector<Value> &args) {
+  auto list = get_if<ListPtr>(&args[0]);
+  if (!list)
+    throw std::runtime_error("Expected list in buffer.concat.");
+  size_t total = 0;
+  for (const Value &v : (*list)->elements)
+    total += requireBuffer(v, "buffer.concat").bytes.size();
+  auto result = makeRef<ByteBuffer>();
+  result->bytes.reserve(total);
+  for (const Value &v : (*list)->elements) {
+    const auto &bytes = get<BufferPtr>(v)->bytes;
+    result->bytes.insert(result->bytes.end(), bytes.begin(), bytes.end());
+  }
+  return result;
+}
+
+static Value nativeBufferCompare(const std::vector<Value> &args) {
+  return static_cast<double>(
+      compareBuffers(requireBuffer(args[0], "buffer.compare"),
+                     requireBuffer(args[1], "buffer.compare")));
+}
+
+static Value nativeBufferEquals(const std::vector<Value> &args) {
+  return compareBuffers(requireBuffer(args[0], "buffer.equals"),
+                        requireBuffer(args[1], "buffer.equals")) == 0;
+}
+
+static void defineBufferMethods(
+    std::unordered_map<Symbol, NativeFunctionPtr> &methods) {
+  // Arity excludes the buffer itself.
+  auto method = [&](const std::string &name,
+                    std::function<Value(const std::vector<Value> &)> func,
+                    size_t arity, bool variadic = false) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->func = std::move(func);
+    native->arity = arity;
+    native->variadic = variadic;
+    methods[intern(name)] = native;
+  };
+  auto reader = [](size_t width, bool bigEndian) {
+    return [=](const std::vector<Value> &args) {
+      return readUint(args, width, bigEndian);
+    };
+  };
+  auto writer = [](size_t width, bool bigEndian) {
+    return [=](const std::vector<Value> &args) {
+      return writeUint(args, width, bigEndian);
+    };
+  };
+
+  method("length", nativeBufferLength, 0);
+  method("cap", nativeBufferCap, 0);
+  method("is_empty", nativeBufferIsEmpty, 0);
+  method("clear", nativeBufferClear, 0);
+  method("get", nativeBufferGet, 1);
+  method("set", nativeBufferSet, 2);
+  method("append_byte", nativeBufferAppendByte, 1);
+  method("append_bytes", nativeBufferAppendBytes, 1);
+  method("append_buffer", nativeBufferAppendBytes, 1);
+  method("insert", nativeBufferInsert, 2);
+  method("remove", nativeBufferRemove, 1);
+  method("slice", nativeBufferSlice, 2, true);
+  method("copy_from", nativeBufferCopyFrom, 3, true);
+  method("fill", nativeBufferFill, 3, true);
+  method("to_string", nativeBufferToString, 0);
+  method("to_hex", nativeBufferToHex, 0);
+  method("to_base64", nativeBufferToBase64, 0);
+  method("equals", nativeBufferEqualsMethod, 1);
+  method("compare", nativeBufferCompareMethod, 1);
+  method("read_uint8", reader(1, true), 1);
+  method("read_uint16_be", reader(2, true), 1);
+  method("read_uint16_le", reader(2, false), 1);
+  method("read_uint32_be", reader(4, true), 1);
+  method("read_uint32_le", reader(4, false), 1);
+  method("write_uint8", writer(1, true), 2);
+  method("write_uint16_be", writer(2, true), 2);
+  method("write_uint16_le", writer(2, false), 2);
+  method("write_uint32_be", writer(4, true), 2);
+  method("write_uint32_le", writer(4, false), 2);
+}
+
+// ========== List Methods ==========
+// Methods of list values. Like buffer methods, each native gets the list as
+// args[0]; the ones that call back into Luma are bound to the interpreter
+// in defineListMethods().
+
+static List &requireList(const Value &v, const std::string &where) {
+  if (auto l = get_if<ListPtr>(&v))
+    return **l;
+  throw std::runtime_error("Expected list in " + where + ".");
+}
+
+// A position in [0, size]: nil means `fallback`, and negative numbers count
+// from the end, as in Python.
+static size_t listPosition(const Value &v, size_t size, size_t fallback,
+                           const std::string &where) {
+  if (isNil(v))
+    return fallback;
+  double d = requireNumberValue(v, where);
+  if (d < 0)
+    d += static_cast<double>(size);
+  if (!(d > 0))
+    return 0;
+  return d >= static_cast<double>(size) ? size : static_cast<size_t>(d);
+}
+
+static Value nativeListLength(const std::vector<Value> &args) {
+  return static_cast<double>(requireList(args[0], "length").elements.size());
+}
+
+static Value nativeListPush(const std::vector<Value> &args) {
+  requireList(args[0], "push").elements.push_back(args[1]);
+  return args[1];
+}
+
+static Value nativeListPop(const std::vector<Value> &args) {
+  auto &elements = requireList(args[0], "pop").elements;
+  if (elements.empty())
+    return std::monostate{};
+  Value v = std::move(elements.back());
+  elements.pop_back();
+  return v;
+}
+
+// slice([start[, end]]): a new list with the elements in [start, end).
+static Value nativeListSlice(const std::vector<Value> &args) {
+  requireArgCount(args, 1, 3);
+  const auto &elements = requireList(args[0], "slice").elements;
+  size_t start = listPosition(optionalArg(args, 1), elements.size(), 0,
+                              "list.slice start");
+  size_t end = listPosition(optionalArg(args, 2), elements.size(),
+                            elements.size(), "list.slice end");
+  auto result = makeRef<List>();
+  if (start < end)
+    result->elements.assign(elements.begin() + start, elements.begin() + end);
+  return result;
+}
+
+static Value nativeListConcat(const std::vector<Value> &args) {
+  const auto &elements = requireList(args[0], "concat").elements;
+  const auto &other = requireList(args[1], "list.concat").elements;
+  auto result = makeRef<List>();
+  result->elements.reserve(elements.size() + other.size());
+  result->elements.insert(result->elements.end(), elements.begin(),
+                          elements.end());
+  result->elements.insert(result->elements.end(), other.begin(), other.end());
+  return result;
+}
+
+// extend(other): appends other's elements in place and returns the list.
+static Value nativeListExtend(const std::vector<Value> &args) {
+  auto &elements = requireList(args[0], "extend").elements;
+  // Copied first: `other` may be this list.
+  std::vector<Value> other = requireList(args[1], "list.extend").elements;
+  elements.insert(elements.end(), std::make_move_iterator(other.begin()),
+                  std::make_move_iterator(other.end()));
+  return args[0];
+}
+
+static Value nativeListInsert(const std::vector<Value> &args) {
+  auto &elements = requireList(args[0], "insert").elements;
+  size_t index = listPosition(args[1], elements.size(), elements.size(),
+                              "list.insert index");
+  elements.insert(elements.begin() + index, args[2]);
+  return args[2];
+}
+
+// remove_at(index): removes and returns the element at index.
+static Value nativeListRemoveAt(const std::vector<Value> &args) {
+  auto &elements = requireList(args[0], "remove_at").elements;
+  double index = requireNumberValue(args[1], "list.remove_at index");
+  if (index < 0)
+    index += static_cast<double>(elements.size());
+  if (!(index >= 0) || index >= static_cast<double>(elements.size()))
+    throw std::runtime_error("List index out of bounds.");
+  auto it = elements.begin() + static_cast<size_t>(index);
+  Value v = std::move(*it);
+  elements.erase(it);
+  return v;
+}
+
+static Value nativeListIndexOf(const std::vector<Value> &args) {
+  const auto &elements = requireList(args[0], "index_of").elements;
+  for (size_t i = 0; i < elements.size(); ++i) {
+    if (valuesEqual(elements[i], args[1]))
+      return static_cast<double>(i);
+  }
+  return -1.0;
+}
+
+static Value nativeListContains(const std::vector<Value> &args) {
+  const auto &elements = requireList(args[0], "contains").elements;
+  for (const Value &v : elements) {
+    if (valuesEqual(v, args[1]))
+      return true;
+  }
+  return false;
+}
+
+static Value nativeListReverse(const std::vector<Value> &args) {
+  auto &elements = requireList(args[0], "reverse").elements;
+  std::reverse(elements.begin(), elements.end());
+  return args[0];
+}
+
+static Value nativeListClear(const std::vector<Value> &args) {
+  requireList(args[0], "clear").elements.clear();
+  return std::monostate{};
+}
+
+// Stable bottom-up merge sort. Every index is bounds-checked and every
+// element is written exactly once per pass, so an inconsistent comparator
+// (a random one, or numbers with NaN) still leaves a permutation of the
+// input; std::stable_sort would be undefined behaviour.
+template <class Less>
+static void mergeSort(std::vector<Value> &elements, Less less) {
+  const size_t n = elements.size();
+  std::vector<Value> merged(n);
+  for (size_t width = 1; width < n; width *= 2) {
+    for (size_t lo = 0; lo < n; lo += 2 * width) {
+      const size_t mid = std::min(lo + width, n);
+      const size_t hi = std::min(lo + 2 * width, n);
+      size_t i = lo, j = mid, k = lo;
+      // Right before left only when strictly less, which keeps it stable.
+      while (i < mid && j < hi)
+        merged[k++] = less(elements[j], elements[i]) ? std::move(elements[j++])
+                                                     : std::move(elements[i++]);
+      while (i < mid)
+        merged[k++] = std::move(elements[i++]);
+      while (j < hi)
+        merged[k++] = std::move(elements[j++]);
+    }
+    elements.swap(merged);
+  }
+}
+
+// sort([compare]): sorts in place, stably, and returns the list. Without a
+// comparator the list must hold only numbers or only strings, which are
+// compared natively; compare(a, b) returns a negative number when a goes
+// before b.
+static Value listSort(Interpreter &interp, const std::vector<Value> &args) {
+  requireArgCount(args, 1, 2);
+  List &list = requireList(args[0], "sort");
+  // Sorted as a copy: the comparator may change the list.
+  std::vector<Value> elements = list.elements;
+  const Value &compare = optionalArg(args, 1);
+  if (!isNil(compare)) {
+    std::vector<Value> pair(2);
+    mergeSort(elements, [&](const Value &a, const Value &b) {
+      pair[0] = a;
+      pair[1] = b;
+      return requireNumberValue(interp.call(compare, pair),
+                                "list.sort comparator") < 0;
+    });
+  } else if (std::all_of(elements.begin(), elements.end(),
+                         [](const Value &v) {
+                           return holds_alternative<double>(v);
+                         })) {
+    mergeSort(elements, [](const Value &a, const Value &b) {
+      return get<double>(a) < get<double>(b);
+    });
+  } else if (std::all_of(elements.begin(), elements.end(),
+                         [](const Value &v) {
+                           return holds_alternative<std::string>(v);
+                         })) {
+    mergeSort(elements, [](const Value &a, const Value &b) {
+      return get<std::string>(a) < get<std::string>(b);
+    });
+  } else {
+    throw std::runtime_error(
+        "list.sort needs a comparator unless all elements are numbers or "
+        "all are strings.");
+  }
+  list.elements = std::move(elements);
+  return args[0];
+}
+
+// map, filter and reduce index the list on every step, so a callback that
+// changes the list cannot leave them reading freed elements. One argument
+// vector is reused for every call.
+static Value listMap(Interpreter &interp, const std::vector<Value> &args) {
+  const List &list = requireList(args[0], "map");
+  auto result = makeRef<List>();
+  result->elements.reserve(list.elements.size());
+  std::vector<Value> callArgs(1);
+  for (size_t i = 0; i < list.elements.size(); ++i) {
+    callArgs[0] = list.elements[i];
+    result->elements.push_back(interp.call(args[1], callArgs));
+  }
+  return result;
+}
+
+static Value listFilter(Interpreter &interp, const std::vector<Value> &args) {
+  const List &list = requireList(args[0], "filter");
+  auto result = makeRef<List>();
+  std::vector<Value> callArgs(1);
+  for (size_t i = 0; i < list.elements.size(); ++i) {
+    callArgs[0] = list.elements[i];
+    if (isTruthy(interp.call(args[1], callArgs)))
+      result->elements.push_back(std::move(callArgs[0]));
+  }
+  return result;
+}
+
+// reduce(fn[, initial]): without `initial` the first element starts the
+// accumulator, and an empty list gives nil.
+static Value listReduce(Interpreter &interp, const std::vector<Value> &args) {
+  requireArgCount(args, 2, 3);
+  const List &list = requireList(args[0], "reduce");
+  size_t i = 0;
+  Value acc;
+  if (args.size() == 3)
+    acc = args[2];
+  else if (!list.elements.empty())
+    acc = list.elements[i++];
+  std::vector<Value> callArgs(2);
+  for (; i < list.elements.size(); ++i) {
+    callArgs[0] = std::move(acc);
+    callArgs[1] = list.elements[i];
+    acc = interp.call(args[1], callArgs);
+  }
+  return acc;
+}
+
+void Interpreter::defineListMethods() {
+  // Arity excludes the list itself.
+  auto method = [&](const std::string &name,
+                    std::function<Value(const std::vector<Value> &)> func,
+                    size_t arity, bool variadic = false) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->func = std::move(func);
+    native->arity = arity;
+    native->variadic = variadic;
+    listMethods_[intern(name)] = native;
+  };
+  auto withInterpreter = [this](Value (*func)(Interpreter &,
+                                              const std::vector<Value> &)) {
+    return [this, func](const std::vector<Value> &args) {
+      return func(*this, args);
+    };
+  };
+
+  method("length", nativeListLength, 0);
+  method("push", nativeListPush, 1);
+  method("pop", nativeListPop, 0);
+  method("slice", nativeListSlice, 2, true);
+  method("concat", nativeListConcat, 1);
+  method("extend", nativeListExtend, 1);
+  method("insert", nativeListInsert, 2);
+  method("remove_at", nativeListRemoveAt, 1);
+  method("index_of", nativeListIndexOf, 1);
+  method("contains", nativeListContains, 1);
+  method("reverse", nativeListReverse, 0);
+  method("clear", nativeListClear, 0);
+  method("sort", withInterpreter(listSort), 1, true);
+  method("map", withInterpreter(listMap), 1);
+  method("filter", withInterpreter(listFilter), 1);
+  method("reduce", withInterpreter(listReduce), 2, true);
+}
+
+// ========== Cache Module Natives ==========
+
+// A cache object is a map of native methods bound to one shared store, read
+// like a module namespace, so `c.get(key)` looks the same as it did on the
+// Luma classes these replace.
+using CacheMethod = std::function<Value(const std::vector<Value> &)>;
+
+static void bindCacheMethod(LumaMap &object, const std::string &name,
+                            size_t arity, CacheMethod func,
+                            bool variadic = false) {
+  auto native = makeRef<NativeFunctionObject>();
+  native->name = name;
+  native->func = std::move(func);
+  native->arity = arity;
+  native->variadic = variadic;
+  object.values[name] = native;
+}
+
+static const std::string &cacheKey(const Value &v) {
+  if (auto s = get_if<std::string>(&v))
+    return *s;
+  throw std::runtime_error("Cache keys must be strings.");
+}
+
+static size_t cacheMaxSize(const Value &v) {
+  if (holds_alternative<std::monostate>(v))
+    return 100;
+  double n = requireNumberValue(v, "cache max_size");
+  return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+static Value cacheResult(const Value *v) {
+  return v ? *v : Value(std::monostate{});
+}
+
+// Methods every cache shares. `forEach` order is the cache's own: recency
+// for LRU, frequency for LFU, insertion for TTL.
+template <class C>
+static void bindCacheCommon(LumaMap &object, const std::shared_ptr<C> &cache) {
+  object.values["max_size"] = static_cast<double>(cache->maxSize());
+  bindCacheMethod(object, "get", 1, [cache](const std::vector<Value> &args) {
+    return cacheResult(cache->get(cacheKey(args[0])));
+  });
+  bindCacheMethod(object, "has", 1, [cache](const std::vector<Value> &args) {
+    return Value(cache->has(cacheKey(args[0])));
+  });
+  bindCacheMethod(object, "delete", 1,
+                  [cache](const std::vector<Value> &args) {
+                    return Value(cache->erase(cacheKey(args[0])));
+                  });
+  bindCacheMethod(object, "clear", 0, [cache](const std::vector<Value> &) {
+    cache->clear();
+    return Value(std::monostate{});
+  });
+  bindCacheMethod(object, "keys", 0, [cache](const std::vector<Value> &) {
+    auto list = makeRef<List>();
+    cache->forEach([&](const std::string &key, const Value &) {
+      list->elements.push_back(key);
+    });
+    return Value(list);
+  });
+  bindCacheMethod(object, "values", 0, [cache](const std::vector<Value> &) {
+    auto list = makeRef<List>();
+    cache->forEach([&](const std::string &, const Value &value) {
+      list->elements.push_back(value);
+    });
+    return Value(list);
+  });
+  bindCacheMethod(object, "entries", 0, [cache](const std::vector<Value> &) {
+    auto list = makeRef<List>();
+    cache->forEach([&](const std::string &key, const Value &value) {
+      auto pair = makeRef<List>();
+      pair->elements.push_back(key);
+      pair->elements.push_back(value);
+      list->elements.push_back(pair);
+    });
+    return Value(list);
+  });
+  bindCacheMethod(object, "length", 0, [cache](const std::vector<Value> &) {
+    return Value(static_cast<double>(cache->size()));
+  });
+  bindCacheMethod(object, "is_empty", 0, [cache](const std::vector<Value> &) {
+    return Value(cache->size() == 0);
+  });
+  bindCacheMethod(object, "is_full", 0, [cache](const std::vector<Value> &) {
+    return Value(cache->size() >= cache->maxSize());
+  });
+}
+
+template <class C>
+static void bindCacheSet(LumaMap &object, const std::shared_ptr<C> &cache) {
+  bindCacheMethod(object, "set", 2, [cache](const std::vector<Value> &args) {
+    cache->set(cacheKey(args[0]), args[1]);
+    return Value(true);
+  });
+}
+
+static Value nativeCacheLru(const std::vector<Value> &args) {
+  auto cache = std::make_shared<LruCache>(cacheMaxSize(args[0]));
+  auto object = makeRef<LumaMap>();
+  bindCacheCommon(*object, cache);
+  bindCacheSet(*object, cache);
+  bindCacheMethod(*object, "lru_key", 0, [cache](const std::vector<Value> &) {
+    const std::string *key = cache->lruKey();
+    return key ? Value(*key) : Value(std::monostate{});
+  });
+  bindCacheMethod(*object, "mru_key", 0, [cache](const std::vector<Value> &) {
+    const std::string *key = cache->mruKey();
+    return key ? Value(*key) : Value(std::monostate{});
+  });
+  return object;
+}
+
+static Value nativeCacheLfu(const std::vector<Value> &args) {
+  auto cache = std::make_shared<LfuCache>(cacheMaxSize(args[0]));
+  auto object = makeRef<LumaMap>();
+  bindCacheCommon(*object, cache);
+  bindCacheSet(*object, cache);
+  bindCacheMethod(*object, "frequency", 1,
+                  [cache](const std::vector<Value> &args) {
+                    return Value(static_cast<double>(
+                        cache->frequency(cacheKey(args[0]))));
+                  });
+  return object;
+}
+
+static Value nativeCacheTtl(const std::vector<Value> &args) {
+  double defaultTtl = 3600; // one hour
+  if (!holds_alternative<std::monostate>(args[1]))
+    defaultTtl = requireNumberValue(args[1], "cache default_ttl");
+  auto cache = std::make_shared<TtlCache>(cacheMaxSize(args[0]), defaultTtl);
+  auto object = makeRef<LumaMap>();
+  bindCacheCommon(*object, cache);
+  object->values["default_ttl"] = defaultTtl;
+
+  // set(key, value[, ttl])
+  bindCacheMethod(
+      *object, "set", 2,
+      [cache](const std::vector<Value> &args) {
+        if (args.size() != 2 && args.size() != 3)
+          throw std::runtime_error("Expected 2 or 3 arguments but got " +
+                                   std::to_string(args.size()) + ".");
+        double ttl = cache->defaultTtl();
+        if (args.size() == 3 && !holds_alternative<std::monostate>(args[2]))
+          ttl = requireNumberValue(args[2], "cache ttl");
+        return Value(cache->set(cacheKey(args[0]), args[1], ttl));
+      },
+      true);
+  // Expired entries still hold a slot until they are evicted.
+  bindCacheMethod(*object, "length", 0, [cache](const std::vector<Value> &) {
+    cache->evictExpired();
+    return Value(static_cast<double>(cache->size()));
+  });
+  bindCacheMethod(*object, "is_empty", 0, [cache](const std::vector<Value> &) {
+    cache->evictExpired();
+    return Value(cache->size() == 0);
+  });
+  bindCacheMethod(*object, "cleanup", 0, [cache](const std::vector<Value> &) {
+    cache->evictExpired();
+    return Value(std::monostate{});
+  });
+  bindCacheMethod(*object, "ttl", 1, [cache](const std::vector<Value> &args) {
+    return Value(cache->ttl(cacheKey(args[0])));
+  });
+  bindCacheMethod(*object, "expire", 2,
+                  [cache](const std::vector<Value> &args) {
+                    double ttl = requireNumberValue(args[1], "cache ttl");
+                    return Value(cache->expire(cacheKey(args[0]), ttl));
+                  });
+  return object;
+}
+
 void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr exports) {
   auto defineNative = [&](const std::string &name, std::function<Value(const std::vector<Value>&)> func, size_t arity) {
-      auto native = std::make_shared<NativeFunctionObject>();
+      auto native = makeRef<NativeFunctionObject>();
       native->name = name;
       native->func = func;
       native->arity = arity;
@@ -2616,6 +4778,8 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
   } else if (moduleId == "@std.json") {
       defineNative("stringify", nativeJsonStringify, 1);
       defineNative("parse", nativeJsonParse, 1);
+      defineNative("parse_stream", nativeJsonParseStream, 1);
+      defineNative("iter_array", nativeJsonIterArray, 1);
   } else if (moduleId == "@std.io") {
       defineNative("input", nativeIoInput, 0);
       defineNative("ask", nativeIoAsk, 1);
@@ -2636,6 +4800,11 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
       defineNative("ends_with", nativeStringEndsWith, 2);
       defineNative("split", nativeStringSplit, 2);
       defineNative("join", nativeStringJoin, 2);
+      defineNative("find", nativeStringFind, 2);
+      defineNative("contains", nativeStringContains, 2);
+      defineNative("count", nativeStringCount, 2);
+      defineNative("replace", nativeStringReplace, 3);
+      defineNative("builder", nativeStringBuilder, 1);
   } else if (moduleId == "@std.random") {
       defineNative("number", nativeRandomNumber, 0);
       defineNative("between", nativeRandomBetween, 2);
@@ -2646,17 +4815,36 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
       defineNative("read_file", nativeFsReadFile, 1);
       defineNative("write_file", nativeFsWriteFile, 2);
       defineNative("list_dir", nativeFsListDir, 1);
+      defineNative("open_file", nativeFsOpen, 2);
+      defineNative("lines", nativeFsLines, 1);
+      defineNative("mmap", nativeFsMmap, 1);
   } else if (moduleId == "@std.http") {
       defineNative("get", nativeHttpGet, 1);
       defineNative("post", nativeHttpPost, 2);
+      defineNative("request", nativeHttpRequest, 3);
+      defineNative("request_all", nativeHttpRequestAll, 1);
+      defineNative("request_async", [this](const std::vector<Value> &args) {
+        if (!holds_alternative<FunctionPtr>(args[3]) &&
+            !holds_alternative<NativeFunctionPtr>(args[3]))
+          throw std::runtime_error("Expected function in http.request_async.");
+        httpAsync(std::make_shared<HttpExchange>(httpRequest(
+                      args[0], args[1], args[2], "http.request_async")),
+                  args[3]);
+        return Value();
+      }, 4);
   } else if (moduleId == "@std.crypto") {
       defineNative("hash", nativeCryptoHash, 1);
+      defineNative("digest", nativeCryptoDigest, 2);
+      defineNative("hasher", nativeCryptoHasher, 1);
+      defineNative("fast_hash", nativeCryptoFastHash, 1);
       defineNative("random_bytes", nativeCryptoRandomBytes, 1);
   } else if (moduleId == "@std.regex") {
       defineNative("match", nativeRegexMatch, 2);
       defineNative("search", nativeRegexSearch, 2);
       defineNative("replace", nativeRegexReplace, 3);
       defineNative("split", nativeRegexSplit, 2);
+      defineNative("find_all", nativeRegexFindAll, 2);
+      defineNative("compile", nativeRegexCompile, 1);
   } else if (moduleId == "@std.path") {
       defineNative("join", nativePathJoin, 1); // variadic
       defineNative("dirname", nativePathDirname, 1);
@@ -2713,6 +4901,8 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
       defineNative("exit", nativeSysExit, 1);
       defineNative("argv", nativeSysArgv, 0);
       defineNative("progname", nativeSysProgname, 0);
+      defineNative("gc", nativeSysGc, 0);
+      defineNative("gc_stats", nativeSysGcStats, 0);
   } else if (moduleId == "@std.uuid") {
       defineNative("v4", nativeUuidV4, 0);
       defineNative("nil", nativeUuidNil, 0);
@@ -2735,6 +4925,203 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
       defineNative("dns_lookup", nativeNetDnsLookup, 1);
       defineNative("get_hostname", nativeNetGetHostname, 0);
       defineNative("parse_url", nativeNetParseUrl, 1);
+  } else if (moduleId == "@std.reactor") {
+      auto callbackArg = [](const Value &v, const char *where) {
+        if (!isNil(v) && !holds_alternative<FunctionPtr>(v) &&
+            !holds_alternative<NativeFunctionPtr>(v) &&
+            !holds_alternative<ClassPtr>(v))
+          throw std::runtime_error(std::string("Expected function in reactor.") +
+                                   where + ".");
+        return v;
+      };
+      auto fdArg = [](const Value &v, const char *where) {
+        return static_cast<int>(
+            requireNumberValue(v, std::string("reactor.") + where + " fd"));
+      };
+      defineNative("watch_read", [this, callbackArg, fdArg](const std::vector<Value> &args) {
+        reactor().watch(fdArg(args[0], "watch_read"), Reactor::Readable,
+                        callbackArg(args[1], "watch_read"));
+        return Value();
+      }, 2);
+      defineNative("watch_write", [this, callbackArg, fdArg](const std::vector<Value> &args) {
+        reactor().watch(fdArg(args[0], "watch_write"), Reactor::Writable,
+                        callbackArg(args[1], "watch_write"));
+        return Value();
+      }, 2);
+      defineNative("unwatch", [this, fdArg](const std::vector<Value> &args) {
+        reactor().unwatch(fdArg(args[0], "unwatch"));
+        return Value();
+      }, 1);
+      defineNative("set_timeout", [this, callbackArg](const std::vector<Value> &args) {
+        double ms = requireNumberValue(args[1], "reactor.set_timeout ms");
+        return Value(static_cast<double>(
+            reactor().addTimer(ms, callbackArg(args[0], "set_timeout"))));
+      }, 2);
+      defineNative("set_interval", [this, callbackArg](const std::vector<Value> &args) {
+        double ms = requireNumberValue(args[1], "reactor.set_interval ms");
+        return Value(static_cast<double>(
+            reactor().addTimer(ms, callbackArg(args[0], "set_interval"), ms)));
+      }, 2);
+      defineNative("clear_timer", [this](const std::vector<Value> &args) {
+        double id = requireNumberValue(args[0], "reactor.clear_timer id");
+        return Value(reactor().cancelTimer(static_cast<uint64_t>(id)));
+      }, 1);
+      // defer(callback[, arg]): runs on the next turn, before any polling.
+      auto defer = makeRef<NativeFunctionObject>();
+      defer->name = "defer";
+      defer->arity = 1;
+      defer->variadic = true;
+      defer->func = [this, callbackArg](const std::vector<Value> &args) {
+        if (args.empty() || args.size() > 2)
+          throw std::runtime_error("Expected 1 or 2 arguments but got " +
+                                   std::to_string(args.size()) + ".");
+        std::vector<Value> callArgs(args.begin() + 1, args.end());
+        reactor().defer(callbackArg(args[0], "defer"), std::move(callArgs));
+        return Value();
+      };
+      exports->values["defer"] = defer;
+      defineNative("run", [this](const std::vector<Value> &) {
+        runReactor(-1, true);
+        return Value();
+      }, 0);
+      defineNative("run_once", [this](const std::vector<Value> &args) {
+        double ms = isNil(args[0]) ? -1
+                                   : requireNumberValue(args[0], "reactor.run_once timeout");
+        return Value(runReactor(ms, false));
+      }, 1);
+      defineNative("stop", [this](const std::vector<Value> &) {
+        reactor().stop();
+        return Value();
+      }, 0);
+      defineNative("pending", [this](const std::vector<Value> &) {
+        return Value(reactor().pending());
+      }, 0);
+      defineNative("now", [](const std::vector<Value> &) {
+        return Value(Reactor::now());
+      }, 0);
+  } else if (moduleId == "@std.workers") {
+      defineNative("serve", [this](const std::vector<Value> &args) {
+        WorkerPool::Config config;
+        config.executablePath = executablePath_;
+        config.entryFile = entryFilePath_;
+        config.engine = engine_;
+        config.optimize = optimize_;
+        config.handlerModule =
+            requireStringValue(args[1], "workers.serve handler_module");
+        config.handlerName =
+            requireStringValue(args[2], "workers.serve handler_name");
+        config.workers = std::max(1u, std::thread::hardware_concurrency());
+        size_t maxConnections = 0;
+        if (auto options = get_if<MapPtr>(&args[3])) {
+          auto option = [&](const char *key, size_t &out) {
+            auto it = (*options)->values.find(key);
+            if (it != (*options)->values.end() && !isNil(it->second))
+              out = static_cast<size_t>(std::max(
+                  0.0, requireNumberValue(it->second,
+                                          std::string("workers.serve ") + key)));
+          };
+          option("workers", config.workers);
+          option("queue_size", config.queueSize);
+          option("max_connections", maxConnections);
+        } else if (!isNil(args[3])) {
+          throw std::runtime_error("Expected map or nil for workers.serve options.");
+        }
+        const int fd = static_cast<int>(
+            requireNumberValue(args[0], "workers.serve listen_fd"));
+        WorkerPool pool(std::move(config));
+        return Value(static_cast<double>(pool.serve(fd, maxConnections)));
+      }, 4);
+      // @std.socket does not load without lambda support, so handlers get
+      // the blocking primitives they need from here.
+      defineNative("listen", nativeSocketListenTcp, 3);
+      defineNative("send", nativeSocketSend, 2);
+      defineNative("recv", nativeSocketRecv, 2);
+      defineNative("recv_buffer", nativeSocketRecvBuffer, 2);
+      defineNative("writev", nativeSocketWritev, 2);
+      defineNative("sendfile", nativeSocketSendfile, 4);
+      defineNative("close", nativeSocketClose, 1);
+      defineNative("cpu_count", [](const std::vector<Value> &) {
+        return Value(static_cast<double>(
+            std::max(1u, std::thread::hardware_concurrency())));
+      }, 0);
+  } else if (moduleId == "@std.parallel") {
+      auto pool = [this]() -> ParallelPool & {
+        if (!parallel_) {
+          ParallelPool::Config config;
+          config.executablePath = executablePath_;
+          config.entryFile = entryFilePath_;
+          config.engine = engine_;
+          config.optimize = optimize_;
+          config.workers = std::max(1u, std::thread::hardware_concurrency());
+          parallel_ = std::make_unique<ParallelPool>(std::move(config));
+        }
+        return *parallel_;
+      };
+      defineNative("map", [this, pool](const std::vector<Value> &args) {
+        // Workers can only reach the function by name, so it must be an
+        // export of a module this interpreter has loaded.
+        std::string module, name;
+        const bool callable = holds_alternative<FunctionPtr>(args[0]) ||
+                              holds_alternative<NativeFunctionPtr>(args[0]);
+        for (const auto &[id, exports] : moduleCache_) {
+          if (!callable)
+            break;
+          for (const auto &[key, value] : exports->values) {
+            if (valuesEqual(value, args[0])) { // the same function object
+              module = id;
+              name = key;
+              break;
+            }
+          }
+          if (!module.empty())
+            break;
+        }
+        if (module.empty())
+          throw std::runtime_error(
+              "parallel.map needs a function exported by a module (an open "
+              "def loaded with use).");
+        auto list = get_if<ListPtr>(&args[1]);
+        if (!list)
+          throw std::runtime_error("Expected list for parallel.map items.");
+        const auto &elements = (*list)->elements;
+        ParallelPool &workers = pool();
+        size_t chunkSize =
+            isNil(args[2])
+                ? (elements.size() + 4 * workers.size() - 1) /
+                      (4 * workers.size())
+                : requireSizeValue(args[2], "parallel.map chunk_size");
+        std::vector<Transferable> items;
+        items.reserve(elements.size());
+        for (const Value &element : elements)
+          items.push_back(Transferable::from(element));
+        std::vector<Transferable> results =
+            workers.map(module, name, std::move(items), chunkSize);
+        auto out = makeRef<List>();
+        out->elements.reserve(results.size());
+        for (const Transferable &result : results)
+          out->elements.push_back(result.toValue());
+        return Value(out);
+      }, 3);
+      defineNative("workers", [pool](const std::vector<Value> &) {
+        return Value(static_cast<double>(pool().size()));
+      }, 0);
+  } else if (moduleId == "@std.buffer") {
+      defineNative("Buffer", nativeBufferNew, 1);
+      defineNative("create_buffer", nativeBufferNew, 1);
+      defineNative("from_string", nativeBufferNew, 1);
+      defineNative("from_hex", nativeBufferFromHex, 1);
+      defineNative("from_base64", nativeBufferFromBase64, 1);
+      defineNative("concat", nativeBufferConcat, 1);
+      defineNative("compare", nativeBufferCompare, 2);
+      defineNative("equals", nativeBufferEquals, 2);
+  } else if (moduleId == "@std.cache") {
+      // Constructors and factories share one native per policy.
+      defineNative("LRUCache", nativeCacheLru, 1);
+      defineNative("lru", nativeCacheLru, 1);
+      defineNative("LFUCache", nativeCacheLfu, 1);
+      defineNative("lfu", nativeCacheLfu, 1);
+      defineNative("TTLCache", nativeCacheTtl, 2);
+      defineNative("ttl", nativeCacheTtl, 2);
   } else if (moduleId == "@std.socket") {
       defineNative("create", nativeSocketCreate, 2);
       defineNative("bind", nativeSocketBind, 3);
@@ -2743,6 +5130,14 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
       defineNative("connect", nativeSocketConnect, 3);
       defineNative("send", nativeSocketSend, 2);
       defineNative("recv", nativeSocketRecv, 2);
+      defineNative("recv_buffer", nativeSocketRecvBuffer, 2);
+      defineNative("recv_into", nativeSocketRecvInto, 3);
+      defineNative("set_nonblocking", nativeSocketSetNonblocking, 2);
+      defineNative("listen_tcp", nativeSocketListenTcp, 3);
+      defineNative("recvmmsg", nativeSocketRecvMmsg, 3);
+      defineNative("sendmmsg", nativeSocketSendMmsg, 2);
+      defineNative("writev", nativeSocketWritev, 2);
+      defineNative("sendfile", nativeSocketSendfile, 4);
       defineNative("sendto", nativeSocketSendTo, 4);
       defineNative("recvfrom", nativeSocketRecvFrom, 2);
       defineNative("close", nativeSocketClose, 1);
@@ -2755,17 +5150,19 @@ void Interpreter::injectNativeNatives(const std::string &moduleId, MapPtr export
 
 static Value nativeLen(const std::vector<Value> &args) {
   const Value &v = args[0];
-  if (auto l = std::get_if<ListPtr>(&v))
+  if (auto l = get_if<ListPtr>(&v))
     return (double)(*l)->elements.size();
-  if (auto m = std::get_if<MapPtr>(&v))
+  if (auto m = get_if<MapPtr>(&v))
     return (double)(*m)->values.size();
-  if (auto s = std::get_if<std::string>(&v))
+  if (auto s = get_if<std::string>(&v))
     return (double)s->length();
-  throw std::runtime_error("Object has no length (only list, map, string).");
+  if (auto b = get_if<BufferPtr>(&v))
+    return (double)(*b)->bytes.size();
+  throw std::runtime_error("Object has no length (only list, map, string, buffer).");
 }
 
 static Value nativePush(const std::vector<Value> &args) {
-  if (auto l = std::get_if<ListPtr>(&args[0])) {
+  if (auto l = get_if<ListPtr>(&args[0])) {
     (*l)->elements.push_back(args[1]);
     return args[1]; // return pushed value
   }
@@ -2773,7 +5170,7 @@ static Value nativePush(const std::vector<Value> &args) {
 }
 
 static Value nativePop(const std::vector<Value> &args) {
-  if (auto l = std::get_if<ListPtr>(&args[0])) {
+  if (auto l = get_if<ListPtr>(&args[0])) {
     if ((*l)->elements.empty())
       return std::monostate{}; // return nil
     Value v = (*l)->elements.back();
@@ -2784,8 +5181,8 @@ static Value nativePop(const std::vector<Value> &args) {
 }
 
 static Value nativeKeys(const std::vector<Value> &args) {
-  if (auto m = std::get_if<MapPtr>(&args[0])) {
-    auto list = std::make_shared<List>();
+  if (auto m = get_if<MapPtr>(&args[0])) {
+    auto list = makeRef<List>();
     for (const auto &[k, v] : (*m)->values) {
       list->elements.push_back(k);
     }
@@ -2795,8 +5192,8 @@ static Value nativeKeys(const std::vector<Value> &args) {
 }
 
 static Value nativeRemove(const std::vector<Value> &args) {
-  if (auto m = std::get_if<MapPtr>(&args[0])) {
-    if (auto k = std::get_if<std::string>(&args[1])) {
+  if (auto m = get_if<MapPtr>(&args[0])) {
+    if (auto k = get_if<std::string>(&args[1])) {
       if ((*m)->values.count(*k)) {
         Value v = (*m)->values.at(*k);
         (*m)->values.erase(*k);
@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -9,23 +10,97 @@
 #include "environment.hpp"
 #include "value.hpp"
 
+class HttpExchange;
+class ParallelPool;
+class Profiler;
+class Reactor;
+class VM;
+
 class Interpreter {
 public:
+  // Execution engine used for programs, module bodies and function calls.
+  // The tree walker is the reference implementation; the bytecode VM must
+  // produce identical results.
+  enum class Engine { TreeWalker, Bytecode };
+
   Interpreter();
+  ~Interpreter();
+
+  // Resolves `program` (see resolver.hpp) and runs it. The AST must outlive
+  // any functions or classes it defines.
+  void run(std::vector<StmtPtr> &program);
+  // As above, but the interpreter keeps the program for its own lifetime,
+  // as a REPL needs for definitions used by later lines.
+  void run(Program program);
+
+  // A program parsed once and run any number of times (luma_compile).
+  struct Script {
+    Program program;
+    std::shared_ptr<const Chunk> chunk; // compiled by the first VM run
+  };
+  // Optimizes and resolves `program` against the globals defined so far,
+  // and keeps it for the interpreter's lifetime.
+  Script &compile(Program program);
+  void run(Script &script);
+
+  void setEngine(Engine engine);
+  Engine engine() const { return engine_; }
+
+  // Runs the Optimizer (see optimizer.hpp) over programs and modules before
+  // they are resolved. Off by default.
+  void setOptimize(bool enabled) { optimize_ = enabled; }
+  bool optimize() const { return optimize_; }
 
-  void run(const std::vector<StmtPtr> &program);
+  // Starts the call profiler (see profiler.hpp) for everything this
+  // interpreter runs from now on. profiler() is null until then.
+  Profiler &startProfiler();
+  Profiler *profiler() const { return profiler_.get(); }
 
   // Set the entry file path (used to determine project root)
   void setExecutablePath(const std::string &path);
   void setEntryFile(const std::string &path);
 
+  // Loads (or returns the cached exports of) a module such as "@app.util".
+  MapPtr importModule(const std::string &moduleId) {
+    return loadModule(moduleId);
+  }
+  // Calls a Luma function, class or native from C++.
+  Value call(const Value &callee, const std::vector<Value> &args);
+  // The global variable `name`, or null when it is not defined.
+  Value *findGlobal(std::string_view name);
+  // Binds a host function as a global, or when `moduleId` is not empty as an
+  // export of that module next to its built-in natives. A module ID with no
+  // .lu file behind it exports only the natives registered for it.
+  void defineHostNative(const std::string &moduleId, NativeFunctionPtr native);
+
+  // Operator semantics shared by both engines and the optimizer
+  static Value unaryOp(const Token &op, const Value &right);
+  static Value binaryOp(const Token &op, const Value &left, const Value &right);
+
 private:
-  std::shared_ptr<Environment> globals_;
-  std::shared_ptr<Environment> env_;
+  friend class VM;
+
+  Engine engine_ = Engine::TreeWalker;
+  bool optimize_ = false;
+  std::unique_ptr<VM> vm_;
+
+  std::unique_ptr<Reactor> reactor_; // created by the first @std.reactor call
+  std::unique_ptr<Profiler> profiler_;
+  std::unique_ptr<ParallelPool> parallel_; // started by the first parallel.map
+  EnvironmentPool envPool_;
+  // Methods of buffer and list values: natives that take the receiver as
+  // args[0].
+  std::unordered_map<Symbol, NativeFunctionPtr> bufferMethods_;
+  std::unordered_map<Symbol, NativeFunctionPtr> listMethods_;
+  Ref<Environment> globals_;
+  Ref<Environment> env_;
 
   // Module system
   std::unordered_map<std::string, MapPtr> moduleCache_;
-  std::unordered_map<std::string, std::vector<StmtPtr>> moduleAstCache_; // Keep ASTs alive
+  std::unordered_map<std::string, Program> moduleAstCache_; // Keep ASTs alive
+  std::vector<Program> scripts_; // programs handed to run(Program)
+  std::vector<std::unique_ptr<Script>> compiled_;
+  std::unordered_map<std::string, std::vector<NativeFunctionPtr>> hostNatives_;
   std::unordered_set<std::string> modulesLoading_;
   std::string entryFilePath_;
   std::string executablePath_;
@@ -35,23 +110,66 @@ private:
   bool inModuleLoad_ = false;
   MapPtr currentExports_;
 
-  // Return signal used internally
-  struct ReturnSignal {
-    Value value;
-  };
+  // How a statement finished. `return` unwinds by propagating Return up to
+  // callFunction, with the value parked in returnValue_; C++ exceptions are
+  // reserved for runtime errors.
+  enum class Completion { Normal, Return };
+  Value returnValue_;
 
-  void execute(const Stmt &stmt);
+  Completion execute(const Stmt &stmt);
   Value evaluate(const Expr &expr);
 
-  void executeBlock(const BlockStmt &block,
-                    std::shared_ptr<Environment> newEnv);
+  Completion executeBlock(const BlockStmt &block,
+                          Ref<Environment> newEnv);
+  // Runs `block` in a fresh scope taken from (and returned to) the pool.
+  Completion executeScoped(const BlockStmt &block);
 
   // helpers
+  void resolve(std::vector<StmtPtr> &program);
+  // Runs a resolved program, then its event loop. With the VM, `chunk`
+  // (when given) caches the program's bytecode between runs.
+  void runResolved(const std::vector<StmtPtr> &program,
+                   std::shared_ptr<const Chunk> *chunk = nullptr);
   void assignOrDefine(const Token &name, Value value);
+  Value lookUpVariable(const Token &name, const Slot &slot) const;
+  void assignVariable(const Token &name, const Slot &slot, Value value);
+  void defineVariable(const Token &name, const Slot &slot, Value value);
+  void executeSwap(const SwapStmt &stmt);
+  // `name = name + x`, with `left` read from the variable and `right` the
+  // x: appends in place when the variable holds the only other reference to
+  // its string, and otherwise assigns left + right.
+  void appendAssign(const Token &name, const Slot &slot, Value left,
+                    const Value &right);
+  Ref<Environment> callEnvironment(const Function &function,
+                                               const InstancePtr &self,
+                                               const std::vector<Value> &args);
   void visitClassStmt(const ClassStmt &stmt);
 
   Value callFunction(const Value &callee, const std::vector<Value> &args,
                      const Token &callSiteParen);
+  Value invokeFunction(const Function &function, const InstancePtr &self,
+                       const std::vector<Value> &args);
+
+  // Access semantics shared by both engines
+  Value getProperty(const Value &object, const Token &name,
+                    PropertyCache *cache = nullptr);
+  Value setProperty(const Value &object, const Token &name, Value value,
+                    PropertyCache *cache = nullptr);
+  // Callee for `object.name(...)`. A class method (or buffer or list method)
+  // comes back unbound, with `receiver` set to the instance (or buffer or
+  // list); invoke() then calls it without allocating a bound function.
+  Value getMethod(const Value &object, const Token &name, PropertyCache *cache,
+                  Value &receiver);
+  Value invoke(const Value &callee, const Value &receiver,
+               const std::vector<Value> &args, const Token &callSiteParen);
+  // The native method `name` of a buffer or list, or null for other values.
+  NativeFunctionPtr nativeMethod(const Value &object, const Token &name) const;
+  Value callNativeMethod(const NativeFunctionObject &method, const Value &self,
+                         const std::vector<Value> &args);
+  void defineListMethods();
+  Value getIndex(const Value &object, const Value &index);
+  Value setIndex(const Value &object, const Value &index, Value value);
+  int echoCount(const Value &countVal);
 
   // Module system helpers
   MapPtr loadModule(const std::string &moduleId);
@@ -59,4 +177,13 @@ private:
   std::string moduleIdToString(const std::vector<Token> &parts);
   void initializeRoots();
   void injectNativeNatives(const std::string &moduleId, MapPtr exports);
+
+  // Event loop (@std.reactor)
+  Reactor &reactor();
+  // One turn waiting at most `timeoutMs`, or every turn until idle or
+  // stopped. Returns whether work is still pending.
+  bool runReactor(double timeoutMs, bool untilIdle);
+  // Runs an HTTP exchange on the reactor and passes its response (a map, as
+  // http.request returns) to `callback`.
+  void httpAsync(std::shared_ptr<HttpExchange> exchange, Value callback);
 };
@@ -0,0 +1,523 @@
+#include "json.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Deep enough for any real document, shallow enough for the C++ stack.
+constexpr int kMaxDepth = 1000;
+
+// First byte in [p, end) that ends a run of plain string content: a quote or
+// backslash, and with `controls` also any byte below 0x20.
+const char *findSpecial(const char *p, const char *end, bool controls) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x1f);
+  for (; end - p >= 16; p += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                _mm_cmpeq_epi8(chunk, backslash));
+    if (controls) // chunk <= 0x1f, unsigned
+      hits = _mm_or_si128(
+          hits, _mm_cmpeq_epi8(_mm_max_epu8(chunk, space), space));
+    if (const int mask = _mm_movemask_epi8(hits))
+      return p + __builtin_ctz(static_cast<unsigned>(mask));
+  }
+#endif
+  for (; p < end; ++p) {
+    const auto c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\' || (controls && c < 0x20))
+      return p;
+  }
+  return end;
+}
+
+void appendUtf8(std::string &out, uint32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xc0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xe0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  } else {
+    out += static_cast<char>(0xf0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+class Parser {
+public:
+  Parser(std::string_view text, size_t pos) : text_(text), pos_(pos) {}
+
+  size_t position() const { return pos_; }
+
+  void skipWhitespace() {
+    while (pos_ < text_.size()) {
+      const char c = text_[pos_];
+      if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+        break;
+      ++pos_;
+    }
+  }
+
+  bool atEnd() const { return pos_ >= text_.size(); }
+  char peek() const { return atEnd() ? '\0' : text_[pos_]; }
+
+  void expect(char c) {
+    if (peek() != c)
+      fail(std::string("expected '") + c + "'");
+    ++pos_;
+  }
+
+  Value value() {
+    skipWhitespace();
+    switch (peek()) {
+    case '{':
+      return object();
+    case '[':
+      return array();
+    case '"': {
+      std::string_view s = string();
+      return std::string(s);
+    }
+    case 't':
+      return literal("true", true);
+    case 'f':
+      return literal("false", false);
+    case 'n':
+      return literal("null", std::monostate{});
+    default:
+      if (peek() == '-' || (peek() >= '0' && peek() <= '9'))
+        return number();
+      fail(atEnd() ? "unexpected end of input" : "unexpected character");
+    }
+  }
+
+  [[noreturn]] void fail(const std::string &message) const {
+    size_t line = 1, column = 1;
+    for (size_t i = 0; i < pos_ && i < text_.size(); ++i) {
+      if (text_[i] == '\n') {
+        ++line;
+        column = 1;
+      } else {
+        ++column;
+      }
+    }
+    throw std::runtime_error("JSON parse error at line " +
+                             std::to_string(line) + ", column " +
+                             std::to_string(column) + ": " + message + ".");
+  }
+
+private:
+  std::string_view text_;
+  size_t pos_;
+  int depth_ = 0;
+  std::string scratch_; // decoded text of the last escaped string
+  // Size of the last object parsed. Arrays of records tend to repeat one
+  // layout, so it makes a good capacity hint for the next object.
+  size_t lastObjectSize_ = 0;
+
+  void enter() {
+    if (++depth_ > kMaxDepth)
+      fail("nesting deeper than " + std::to_string(kMaxDepth) + " levels");
+  }
+
+  Value object() {
+    enter();
+    ++pos_; // '{'
+    auto map = makeRef<LumaMap>(lastObjectSize_);
+    skipWhitespace();
+    if (peek() == '}') {
+      ++pos_;
+    } else {
+      while (true) {
+        skipWhitespace();
+        if (peek() != '"')
+          fail("expected a string key");
+        // The view is into the input or scratch_, which the value below may
+        // overwrite, so the key is copied into the map first.
+        Value &slot = map->values[string()];
+        skipWhitespace();
+        expect(':');
+        slot = value();
+        skipWhitespace();
+        if (peek() == '}') {
+          ++pos_;
+          break;
+        }
+        expect(',');
+      }
+    }
+    lastObjectSize_ = map->values.size();
+    --depth_;
+    return map;
+  }
+
+  Value array() {
+    enter();
+    ++pos_; // '['
+    auto list = makeRef<List>();
+    skipWhitespace();
+    if (peek() == ']') {
+      ++pos_;
+    } else {
+      while (true) {
+        list->elements.push_back(value());
+        skipWhitespace();
+        if (peek() == ']') {
+          ++pos_;
+          break;
+        }
+        expect(',');
+      }
+    }
+    --depth_;
+    return list;
+  }
+
+  // The contents of the string at pos_: a view of the input when it has no
+  // escapes, else of scratch_. Raw control characters are let through.
+  std::string_view string() {
+    ++pos_; // '"'
+    const char *begin = text_.data() + pos_;
+    const char *end = text_.data() + text_.size();
+    const char *p = findSpecial(begin, end, false);
+    if (p < end && *p == '"') {
+      pos_ = static_cast<size_t>(p + 1 - text_.data());
+      return {begin, static_cast<size_t>(p - begin)};
+    }
+
+    scratch_.assign(begin, p);
+    while (true) {
+      if (p == end) {
+        pos_ = text_.size();
+        fail("unterminated string");
+      }
+      if (*p == '"')
+        break;
+      // *p == '\\'
+      pos_ = static_cast<size_t>(p - text_.data());
+      if (end - p < 2)
+        fail("unterminated string");
+      const char escape = p[1];
+      p += 2;
+      switch (escape) {
+      case '"': scratch_ += '"'; break;
+      case '\\': scratch_ += '\\'; break;
+      case '/': scratch_ += '/'; break;
+      case 'b': scratch_ += '\b'; break;
+      case 'f': scratch_ += '\f'; break;
+      case 'n': scratch_ += '\n'; break;
+      case 'r': scratch_ += '\r'; break;
+      case 't': scratch_ += '\t'; break;
+      case 'u': {
+        uint32_t cp = hex4(p, end);
+        p += 4;
+        if (cp >= 0xd800 && cp < 0xdc00) {
+          // A high surrogate needs the low half that follows it.
+          if (end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            pos_ = static_cast<size_t>(p - text_.data());
+            const uint32_t low = hex4(p + 2, end);
+            if (low >= 0xdc00 && low < 0xe000) {
+              cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+              p += 6;
+            } else {
+              cp = 0xfffd;
+            }
+          } else {
+            cp = 0xfffd;
+          }
+        } else if (cp >= 0xdc00 && cp < 0xe000) {
+          cp = 0xfffd; // a low surrogate on its own
+        }
+        appendUtf8(scratch_, cp);
+        break;
+      }
+      default:
+        fail("invalid escape sequence");
+      }
+      const char *run = findSpecial(p, end, false);
+      scratch_.append(p, run);
+      p = run;
+    }
+    pos_ = static_cast<size_t>(p + 1 - text_.data());
+    return scratch_;
+  }
+
+  // The four hex digits at p, the 'u' of a \u escape being just before.
+  uint32_t hex4(const char *p, const char *end) {
+    if (end - p < 4)
+      fail("truncated \\u escape");
+    uint32_t cp = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = p[i];
+      cp <<= 4;
+      if (c >= '0' && c <= '9')
+        cp |= static_cast<uint32_t>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        cp |= static_cast<uint32_t>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        cp |= static_cast<uint32_t>(c - 'A' + 10);
+      else
+        fail("invalid \\u escape");
+    }
+    return cp;
+  }
+
+  Value number() {
+    const size_t start = pos_;
+    auto digits = [&] {
+      const size_t from = pos_;
+      while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9')
+        ++pos_;
+      return pos_ > from;
+    };
+    if (peek() == '-')
+      ++pos_;
+    const bool leadingZero = peek() == '0';
+    if (!digits())
+      fail("expected a digit");
+    if (leadingZero && pos_ - start > 1 + (text_[start] == '-'))
+      fail("leading zeros are not allowed");
+    if (peek() == '.') {
+      ++pos_;
+      if (!digits())
+        fail("expected a digit after '.'");
+    }
+    if (peek() == 'e' || peek() == 'E') {
+      ++pos_;
+      if (peek() == '+' || peek() == '-')
+        ++pos_;
+      if (!digits())
+        fail("expected an exponent");
+    }
+    double result = 0;
+    const char *first = text_.data() + start;
+    const auto [end, ec] = std::from_chars(first, text_.data() + pos_, result);
+    if (ec == std::errc::result_out_of_range) {
+      // Either overflow or underflow; strtod tells them apart, giving
+      // +-HUGE_VAL for the first and zero or a denormal for the second.
+      const std::string copy(first, pos_ - start);
+      return std::strtod(copy.c_str(), nullptr);
+    }
+    (void)end; // the grammar above already delimited the number
+    return result;
+  }
+
+  Value literal(std::string_view word, Value result) {
+    if (text_.substr(pos_, word.size()) != word)
+      fail("unexpected character");
+    pos_ += word.size();
+    return result;
+  }
+};
+
+class Writer {
+public:
+  explicit Writer(std::string &out) : out_(out) {}
+
+  void value(const Value &v) {
+    if (isNil(v)) {
+      out_ += "null";
+    } else if (auto d = get_if<double>(&v)) {
+      number(*d);
+    } else if (auto s = get_if<std::string>(&v)) {
+      string(*s);
+    } else if (auto b = get_if<bool>(&v)) {
+      out_ += *b ? "true" : "false";
+    } else if (auto l = get_if<ListPtr>(&v)) {
+      enter();
+      out_ += '[';
+      bool first = true;
+      for (const Value &element : (*l)->elements) {
+        if (!first)
+          out_ += ',';
+        first = false;
+        value(element);
+      }
+      out_ += ']';
+      --depth_;
+    } else if (auto m = get_if<MapPtr>(&v)) {
+      enter();
+      out_ += '{';
+      bool first = true;
+      for (const auto &[key, val] : (*m)->values) {
+        if (!first)
+          out_ += ',';
+        first = false;
+        string(key);
+        out_ += ':';
+        value(val);
+      }
+      out_ += '}';
+      --depth_;
+    } else {
+      out_ += "\"<unsupported>\"";
+    }
+  }
+
+private:
+  std::string &out_;
+  int depth_ = 0;
+
+  void enter() {
+    if (++depth_ > kMaxDepth)
+      throw std::runtime_error(
+          "json.stringify: value nested deeper than " +
+          std::to_string(kMaxDepth) + " levels (does it contain itself?).");
+  }
+
+  void number(double d) {
+    if (!std::isfinite(d)) {
+      out_ += "null";
+      return;
+    }
+    char buffer[32];
+    std::to_chars_result r;
+    // Integral values print as integers while they are exact.
+    if (std::trunc(d) == d && std::fabs(d) < 9007199254740992.0)
+      r = std::to_chars(buffer, buffer + sizeof(buffer),
+                        static_cast<long long>(d));
+    else
+      r = std::to_chars(buffer, buffer + sizeof(buffer), d);
+    out_.append(buffer, r.ptr);
+  }
+
+  void string(std::string_view s) {
+    out_ += '"';
+    const char *p = s.data();
+    const char *end = p + s.size();
+    while (true) {
+      const char *run = findSpecial(p, end, true);
+      out_.append(p, run);
+      if (run == end)
+        break;
+      const char c = *run;
+      switch (c) {
+      case '"': out_ += "\\\""; break;
+      case '\\': out_ += "\\\\"; break;
+      case '\b': out_ += "\\b"; break;
+      case '\f': out_ += "\\f"; break;
+      case '\n': out_ += "\\n"; break;
+      case '\r': out_ += "\\r"; break;
+      case '\t': out_ += "\\t"; break;
+      default: {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\u%04x",
+                      static_cast<unsigned char>(c));
+        out_ += escape;
+      }
+      }
+      p = run + 1;
+    }
+    out_ += '"';
+  }
+};
+
+} // namespace
+
+Value jsonParse(std::string_view text) {
+  Parser parser(text, 0);
+  Value result = parser.value();
+  parser.skipWhitespace();
+  if (!parser.atEnd())
+    parser.fail("unexpected characters after the document");
+  return result;
+}
+
+void jsonStringify(const Value &value, std::string &out) {
+  Writer(out).value(value);
+}
+
+std::string jsonStringify(const Value &value) {
+  std::string out;
+  out.reserve(64);
+  jsonStringify(value, out);
+  return out;
+}
+
+// -------------------- JsonReader --------------------
+
+JsonReader::JsonReader(Value source, Mode mode)
+    : source_(std::move(source)), mode_(mode) {
+  if (!get_if<std::string>(&source_) && !get_if<BufferPtr>(&source_))
+    throw std::runtime_error("JSON reader source must be a string or buffer.");
+}
+
+// Taken afresh on each call: a buffer's storage may move between calls.
+std::string_view JsonReader::text() const {
+  if (auto s = get_if<std::string>(&source_))
+    return *s;
+  const auto &bytes = get<BufferPtr>(source_)->bytes;
+  return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+}
+
+void JsonReader::start(std::string_view text) {
+  started_ = true;
+  Parser parser(text, pos_);
+  parser.skipWhitespace();
+  parser.expect('[');
+  parser.skipWhitespace();
+  pos_ = parser.position();
+  if (parser.peek() == ']') {
+    ++pos_;
+    finish(text);
+  }
+}
+
+// After the closing ']': only whitespace may follow.
+void JsonReader::finish(std::string_view text) {
+  closed_ = true;
+  Parser parser(text, pos_);
+  parser.skipWhitespace();
+  if (!parser.atEnd())
+    parser.fail("unexpected characters after the array");
+  pos_ = parser.position();
+}
+
+bool JsonReader::done() {
+  const std::string_view view = text();
+  if (mode_ == Mode::ArrayElements) {
+    if (!started_)
+      start(view);
+    return closed_;
+  }
+  Parser parser(view, pos_);
+  parser.skipWhitespace();
+  pos_ = parser.position();
+  return parser.atEnd();
+}
+
+Value JsonReader::next() {
+  if (done())
+    return std::monostate{};
+  const std::string_view view = text();
+  Parser parser(view, pos_);
+  Value result = parser.value();
+  if (mode_ == Mode::ArrayElements) {
+    parser.skipWhitespace();
+    if (parser.peek() == ']') {
+      pos_ = parser.position() + 1;
+      finish(view);
+      return result;
+    }
+    parser.expect(',');
+  }
+  pos_ = parser.position();
+  return result;
+}
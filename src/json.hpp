@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "value.hpp"
+
+// Native JSON behind @std.json.
+//
+// The parser reads a string_view in a single pass: nothing is copied up
+// front, string bodies are scanned 16 bytes at a time for the next quote or
+// backslash (SSE2 where available), unescaped keys are looked up straight
+// from the input, and numbers are converted in place. Errors throw
+// std::runtime_error with the line and column of the offending character.
+//
+// The serializer appends to one output string, copying runs of characters
+// that need no escaping in bulk.
+
+// Parses exactly one JSON document (surrounding whitespace allowed).
+Value jsonParse(std::string_view text);
+
+// Appends the JSON text of `value` to `out`. Numbers are written in their
+// shortest round-trip form; NaN and infinities become null. Functions,
+// classes, instances and buffers become "<unsupported>". Throws if the value
+// nests too deeply, which is what a list or map containing itself does.
+void jsonStringify(const Value &value, std::string &out);
+std::string jsonStringify(const Value &value);
+
+// Incremental parsing of a string or buffer that stays referenced (not
+// copied) for the reader's lifetime. Only one value is materialized per
+// next() call:
+//  - Documents: a sequence of whitespace-separated documents, e.g. NDJSON;
+//  - ArrayElements: the elements of a top-level array, one at a time.
+class JsonReader {
+public:
+  enum class Mode { Documents, ArrayElements };
+
+  JsonReader(Value source, Mode mode); // throws unless string or buffer
+
+  bool done();  // true once every value has been returned
+  Value next(); // the next value, or nil when done
+
+private:
+  Value source_;
+  Mode mode_;
+  size_t pos_ = 0;
+  bool started_ = false; // ArrayElements: '[' consumed
+  bool closed_ = false;  // ArrayElements: ']' consumed
+
+  std::string_view text() const;
+  void start(std::string_view text);
+  void finish(std::string_view text);
+};
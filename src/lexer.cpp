@@ -1,8 +1,9 @@
 #include "lexer.hpp"
 #include <stdexcept>
+#include <string_view>
 #include <unordered_map>
 
-static const std::unordered_map<std::string, TokenType> kKeywords = {
+static const std::unordered_map<std::string_view, TokenType> kKeywords = {
     {"def", TokenType::Def},     {"return", TokenType::Return},
     {"if", TokenType::If},       {"else", TokenType::Else},
     {"while", TokenType::While}, {"true", TokenType::True},
@@ -20,15 +21,18 @@ static const std::unordered_map<std::string, TokenType> kKeywords = {
     {"not", TokenType::Not},
 };
 
-Lexer::Lexer(std::string source) : source_(std::move(source)) {}
+Lexer::Lexer(std::string_view source) : source_(source) {}
 
-std::vector<Token> Lexer::scanTokens() {
+Token Lexer::nextToken() {
   while (!isAtEnd()) {
     start_ = current_;
     scanToken();
+    if (hasToken_) {
+      hasToken_ = false;
+      return token_;
+    }
   }
-  tokens_.push_back({TokenType::Eof, "", line_});
-  return tokens_;
+  return {TokenType::Eof, "", line_};
 }
 
 bool Lexer::isAtEnd() const { return current_ >= source_.size(); }
@@ -57,7 +61,8 @@ bool Lexer::match(char expected) {
 }
 
 void Lexer::addToken(TokenType type) {
-  tokens_.push_back({type, source_.substr(start_, current_ - start_), line_});
+  token_ = {type, source_.substr(start_, current_ - start_), line_};
+  hasToken_ = true;
 }
 
 bool Lexer::isAlpha(char c) {
@@ -215,11 +220,10 @@ void Lexer::identifierOrKeyword() {
   while (isAlphaNumeric(peek()))
     advance();
 
-  std::string text = source_.substr(start_, current_ - start_);
+  const std::string_view text = source_.substr(start_, current_ - start_);
   auto it = kKeywords.find(text);
-  if (it != kKeywords.end()) {
-    tokens_.push_back({it->second, text, line_});
-  } else {
-    tokens_.push_back({TokenType::Identifier, text, line_});
-  }
+  const TokenType type =
+      it != kKeywords.end() ? it->second : TokenType::Identifier;
+  token_ = {type, text, line_, intern(text)};
+  hasToken_ = true;
 }
@@ -1,16 +1,19 @@
 #pragma once
 #include "token.hpp"
-#include <string>
-#include <vector>
+#include <string_view>
 
+// Scans tokens on demand. Lexemes are views into the source, which must
+// outlive them (see SourceBuffer).
 class Lexer {
 public:
-  explicit Lexer(std::string source);
-  std::vector<Token> scanTokens();
+  explicit Lexer(std::string_view source);
+  // The next token; Eof once the source is exhausted, and on every call after.
+  Token nextToken();
 
 private:
-  std::string source_;
-  std::vector<Token> tokens_;
+  std::string_view source_;
+  Token token_{TokenType::Eof, "", 0};
+  bool hasToken_ = false; // scanToken() produced token_
   size_t start_ = 0;
   size_t current_ = 0;
   int line_ = 1;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 // This header provides a C-compatible interface for the Luma interpreter.
 
 #ifdef __cplusplus
@@ -9,6 +11,14 @@ extern "C" {
 // Opaque pointer to the C++ Interpreter object to hide implementation details.
 typedef struct LumaInterpreter LumaInterpreter;
 
+// Execution engines. The AST interpreter is the reference implementation;
+// the bytecode VM compiles each program and function body once and runs it
+// on a stack machine.
+typedef enum LumaEngine {
+    LUMA_ENGINE_AST = 0,
+    LUMA_ENGINE_VM = 1
+} LumaEngine;
+
 // Creates a new Luma interpreter instance.
 // Must be freed with luma_destroy().
 LumaInterpreter* luma_create();
@@ -22,6 +32,26 @@ void luma_set_executable_path(LumaInterpreter* interp, const char* path);
 // Sets the path of the entry script. Used to resolve module paths.
 void luma_set_entry_file(LumaInterpreter* interp, const char* path);
 
+// Selects the engine used by subsequent luma_run_string/luma_run_file calls
+// (and by modules they load). Defaults to LUMA_ENGINE_AST.
+void luma_set_engine(LumaInterpreter* interp, LumaEngine engine);
+
+// Enables (non-zero) or disables the optimization pass for programs and
+// modules loaded afterwards: constant folding, dead-branch elimination and
+// inlining of constant functions. Disabled by default.
+void luma_set_optimize(LumaInterpreter* interp, int enabled);
+
+// Profiles every call made from now on (see src/profiler.hpp): call counts,
+// inclusive and exclusive time per function and call site, and sampled
+// call stacks.
+void luma_profile_start(LumaInterpreter* interp);
+
+// Stops profiling and prints the top-N report to stderr. If `folded_path`
+// is not NULL the sampled stacks are also written there in the collapsed
+// format of flamegraph.pl. Returns 0 on success, 1 if profiling was never
+// started or the file could not be written.
+int luma_profile_finish(LumaInterpreter* interp, const char* folded_path);
+
 // Executes a string of Luma source code.
 // Returns 0 on success, 1 on failure.
 // In REPL mode, errors are printed to stderr but do not terminate.
@@ -31,6 +61,97 @@ int luma_run_string(LumaInterpreter* interp, const char* source, int is_repl);
 // Returns 0 on success, 1 on failure.
 int luma_run_file(LumaInterpreter* interp, const char* path);
 
+// Parses a source file and writes its pre-parsed module cache, so the first
+// import does not have to (see src/ast_cache.hpp). Nothing is executed.
+// Returns 0 on success, 1 on a read or parse error, 2 if the cache could not
+// be written (for example a read-only directory or LUMA_NO_CACHE set).
+int luma_compile_file(const char* path);
+
+// ---------- Compiled scripts ----------
+
+// A program parsed once and run any number of times. Owned by the
+// interpreter that compiled it and freed with it.
+typedef struct LumaScript LumaScript;
+
+// Parses, optimizes (see luma_set_optimize) and resolves `source` without
+// running it. Names are resolved against the globals defined so far.
+// Returns NULL on a parse error, which is printed to stderr.
+LumaScript* luma_compile(LumaInterpreter* interp, const char* source);
+
+// Runs a compiled script in the interpreter's globals. With the VM the
+// bytecode is compiled by the first run and reused after that.
+// Returns 0 on success, 1 on failure.
+int luma_script_run(LumaInterpreter* interp, LumaScript* script);
+
+// ---------- Values ----------
+
+// A handle to one Luma value. Handles returned by the functions below are
+// owned by the caller and freed with luma_value_free(); NULL stands for nil
+// wherever a handle is accepted.
+typedef struct LumaValue LumaValue;
+
+typedef enum LumaType {
+    LUMA_TYPE_NIL = 0,
+    LUMA_TYPE_NUMBER,
+    LUMA_TYPE_BOOL,
+    LUMA_TYPE_STRING,
+    LUMA_TYPE_BUFFER,
+    LUMA_TYPE_OTHER // lists, maps, functions, classes and instances
+} LumaType;
+
+LumaValue* luma_number(double value);
+LumaValue* luma_bool(int value);
+// Copies `size` bytes, which may include NULs.
+LumaValue* luma_string(const char* data, size_t size);
+// A zero-filled buffer of `size` bytes. Fill it in place through
+// luma_value_buffer() instead of building a copy first.
+LumaValue* luma_buffer(size_t size);
+// Another handle to the same value (strings and buffers are not copied).
+LumaValue* luma_value_copy(const LumaValue* value);
+void luma_value_free(LumaValue* value);
+
+LumaType luma_value_type(const LumaValue* value);
+// 0 unless the value is a number.
+double luma_value_number(const LumaValue* value);
+// The value's truthiness, as `if` sees it.
+int luma_value_truthy(const LumaValue* value);
+// The bytes of a string, not copied and not NUL-terminated, valid while a
+// handle to the string exists. NULL for other values. `size` may be NULL.
+const char* luma_value_string(const LumaValue* value, size_t* size);
+// The bytes of a buffer, writable and shared with Luma, valid until the
+// buffer is resized or the last handle to it goes. NULL for other values.
+unsigned char* luma_value_buffer(LumaValue* value, size_t* size);
+
+// ---------- Calls ----------
+
+// Calls the global function (or class or native) `name` with `argc`
+// arguments, which are only borrowed. On success stores a new handle to the
+// result in `*result` when `result` is not NULL and returns 0; on failure
+// prints the error to stderr and returns 1.
+int luma_call(LumaInterpreter* interp, const char* name,
+              LumaValue* const* args, int argc, LumaValue** result);
+
+// A host function. `args` are borrowed for the duration of the call and
+// must not be freed. The returned handle (NULL for nil) is taken over by
+// the interpreter; to return an argument, return luma_value_copy(args[i])
+// (returning args[i] itself is also accepted, and copied). To raise a Luma
+// error, call luma_native_error() and return NULL.
+typedef LumaValue* (*LumaNativeFn)(LumaInterpreter* interp,
+                                   LumaValue* const* args, int argc,
+                                   void* userdata);
+
+// Registers `fn` as `name`, taking exactly `arity` arguments (any number
+// when negative). With `module_id` NULL it is a global; otherwise it is an
+// export of that module (for example "@app.host"), visible to `use` from
+// then on. A module ID with no .lu file behind it exports only the natives
+// registered for it. Returns 0 on success, 1 on an invalid module ID.
+int luma_register_native(LumaInterpreter* interp, const char* module_id,
+                         const char* name, int arity, LumaNativeFn fn,
+                         void* userdata);
+
+// Makes the running native raise `message` as a Luma error once it returns.
+void luma_native_error(LumaInterpreter* interp, const char* message);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -1,23 +1,48 @@
 #include "luma.h"
 
 // Include the C++ headers for the Luma implementation
+#include "ast_cache.hpp"
 #include "interpreter.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <memory>
 #include <string>
+#include <vector>
 
-// This is a C++ helper function and should not have C linkage.
-static std::string read_file_content(const std::string& path) {
-    std::ifstream in(path, std::ios::in | std::ios::binary);
-    if (!in) {
-        throw std::runtime_error("Could not open file: " + path);
+// These are C++ helper functions and should not have C linkage.
+static void parse_program(Program& program) {
+    Lexer lexer(program.source.text());
+    Parser parser(lexer, program.arena);
+    program.statements = parser.parse();
+}
+
+// Parses the program's source and hands it to the interpreter, which keeps
+// it so REPL definitions outlive the line that made them.
+static int run_program(Interpreter& interp, Program program) {
+    try {
+        parse_program(program);
+        interp.run(std::move(program));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1; // Indicate failure
     }
-    std::ostringstream ss;
-    ss << in.rdbuf();
-    return ss.str();
+    return 0; // Indicate success
+}
+
+// A LumaValue is a heap-allocated Value; a LumaScript is an
+// Interpreter::Script.
+static Value* as_value(LumaValue* value) {
+    return reinterpret_cast<Value*>(value);
+}
+
+static const Value* as_value(const LumaValue* value) {
+    return reinterpret_cast<const Value*>(value);
+}
+
+static LumaValue* new_handle(Value value) {
+    return reinterpret_cast<LumaValue*>(new Value(std::move(value)));
 }
 
 // The extern "C" block ensures that the C++ compiler does not mangle the
@@ -47,31 +72,244 @@ void luma_set_entry_file(LumaInterpreter* interp, const char* path) {
     as_cpp(interp)->setEntryFile(path);
 }
 
-int luma_run_string(LumaInterpreter* interp, const char* source, int is_repl) {
+void luma_set_engine(LumaInterpreter* interp, LumaEngine engine) {
+    as_cpp(interp)->setEngine(engine == LUMA_ENGINE_VM
+                                  ? Interpreter::Engine::Bytecode
+                                  : Interpreter::Engine::TreeWalker);
+}
+
+void luma_set_optimize(LumaInterpreter* interp, int enabled) {
+    as_cpp(interp)->setOptimize(enabled != 0);
+}
+
+void luma_profile_start(LumaInterpreter* interp) {
     try {
-        Lexer lexer(source);
-        auto tokens = lexer.scanTokens();
-        Parser parser(tokens);
-        auto program = parser.parse();
-        as_cpp(interp)->run(program);
+        as_cpp(interp)->startProfiler();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
-        return 1; // Indicate failure
     }
-    return 0; // Indicate success
+}
+
+int luma_profile_finish(LumaInterpreter* interp, const char* folded_path) {
+    Profiler* profiler = as_cpp(interp)->profiler();
+    if (!profiler) {
+        return 1;
+    }
+    profiler->stop();
+    profiler->report(std::cerr);
+    if (folded_path && !profiler->writeCollapsed(folded_path)) {
+        std::cerr << "Error: could not write " << folded_path << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int luma_run_string(LumaInterpreter* interp, const char* source, int is_repl) {
+    Program program;
+    program.source = SourceBuffer(source);
+    return run_program(*as_cpp(interp), std::move(program));
 }
 
 int luma_run_file(LumaInterpreter* interp, const char* path) {
+    luma_set_entry_file(interp, path);
+    Program program;
+    if (!program.source.openFile(path)) {
+        std::cerr << "Error: Could not open file: " << path << "\n";
+        return 1;
+    }
+    return run_program(*as_cpp(interp), std::move(program));
+}
+
+LumaScript* luma_compile(LumaInterpreter* interp, const char* source) {
+    Program program;
+    program.source = SourceBuffer(source);
     try {
-        luma_set_entry_file(interp, path);
-        std::string source = read_file_content(path);
-        // is_repl is 0 (false) because we are running a file.
-        return luma_run_string(interp, source.c_str(), 0);
+        parse_program(program);
+        return reinterpret_cast<LumaScript*>(
+            &as_cpp(interp)->compile(std::move(program)));
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
-        return 1; // Indicate failure
+        return nullptr;
     }
-    return 0; // Indicate success
+}
+
+int luma_script_run(LumaInterpreter* interp, LumaScript* script) {
+    try {
+        as_cpp(interp)->run(*reinterpret_cast<Interpreter::Script*>(script));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+LumaValue* luma_number(double value) { return new_handle(value); }
+
+LumaValue* luma_bool(int value) { return new_handle(value != 0); }
+
+LumaValue* luma_string(const char* data, size_t size) {
+    return new_handle(std::string(data, size));
+}
+
+LumaValue* luma_buffer(size_t size) {
+    return new_handle(makeRef<ByteBuffer>(std::vector<uint8_t>(size)));
+}
+
+LumaValue* luma_value_copy(const LumaValue* value) {
+    return new_handle(value ? *as_value(value) : Value());
+}
+
+void luma_value_free(LumaValue* value) {
+    delete as_value(value);
+}
+
+LumaType luma_value_type(const LumaValue* value) {
+    if (!value) {
+        return LUMA_TYPE_NIL;
+    }
+    switch (as_value(value)->type()) {
+    case Value::Type::Nil:
+        return LUMA_TYPE_NIL;
+    case Value::Type::Number:
+        return LUMA_TYPE_NUMBER;
+    case Value::Type::Bool:
+        return LUMA_TYPE_BOOL;
+    case Value::Type::String:
+        return LUMA_TYPE_STRING;
+    case Value::Type::Buffer:
+        return LUMA_TYPE_BUFFER;
+    default:
+        return LUMA_TYPE_OTHER;
+    }
+}
+
+double luma_value_number(const LumaValue* value) {
+    const double* number = value ? get_if<double>(as_value(value)) : nullptr;
+    return number ? *number : 0;
+}
+
+int luma_value_truthy(const LumaValue* value) {
+    return value && isTruthy(*as_value(value)) ? 1 : 0;
+}
+
+const char* luma_value_string(const LumaValue* value, size_t* size) {
+    const std::string* str =
+        value ? get_if<std::string>(as_value(value)) : nullptr;
+    if (size) {
+        *size = str ? str->size() : 0;
+    }
+    return str ? str->data() : nullptr;
+}
+
+unsigned char* luma_value_buffer(LumaValue* value, size_t* size) {
+    BufferPtr* buffer = value ? get_if<BufferPtr>(as_value(value)) : nullptr;
+    if (size) {
+        *size = buffer ? (*buffer)->bytes.size() : 0;
+    }
+    return buffer ? (*buffer)->bytes.data() : nullptr;
+}
+
+int luma_call(LumaInterpreter* interp, const char* name,
+              LumaValue* const* args, int argc, LumaValue** result) {
+    try {
+        Value* callee = as_cpp(interp)->findGlobal(name);
+        if (!callee) {
+            throw std::runtime_error(std::string("Undefined variable '") +
+                                     name + "'.");
+        }
+        std::vector<Value> values;
+        values.reserve(argc);
+        for (int i = 0; i < argc; ++i) {
+            values.push_back(args[i] ? *as_value(args[i]) : Value());
+        }
+        // Copied first: the call may rebind the global.
+        Value value = as_cpp(interp)->call(Value(*callee), values);
+        if (result) {
+            *result = new_handle(std::move(value));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Set by luma_native_error() and raised when the native returns. Natives
+// run on the thread of the interpreter that calls them.
+static thread_local bool native_failed = false;
+static thread_local std::string native_error;
+
+int luma_register_native(LumaInterpreter* interp, const char* module_id,
+                         const char* name, int arity, LumaNativeFn fn,
+                         void* userdata) {
+    auto native = makeRef<NativeFunctionObject>();
+    native->name = name;
+    native->arity = arity < 0 ? 0 : static_cast<size_t>(arity);
+    native->variadic = arity < 0;
+    native->func = [interp, fn, userdata](const std::vector<Value>& args) {
+        // Handles to the arguments themselves, so nothing is copied.
+        LumaValue* small[8];
+        std::vector<LumaValue*> large;
+        LumaValue** argv = small;
+        if (args.size() > 8) {
+            large.resize(args.size());
+            argv = large.data();
+        }
+        for (size_t i = 0; i < args.size(); ++i) {
+            argv[i] = reinterpret_cast<LumaValue*>(const_cast<Value*>(&args[i]));
+        }
+        native_failed = false;
+        LumaValue* returned =
+            fn(interp, argv, static_cast<int>(args.size()), userdata);
+        // A native that hands back one of its borrowed arguments gets a
+        // copy of it; that handle belongs to `args`, not to us.
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (returned == argv[i]) {
+                returned = luma_value_copy(returned);
+                break;
+            }
+        }
+        std::unique_ptr<Value> out(as_value(returned));
+        if (native_failed) {
+            native_failed = false;
+            throw std::runtime_error(native_error);
+        }
+        return out ? std::move(*out) : Value();
+    };
+    try {
+        as_cpp(interp)->defineHostNative(module_id ? module_id : "", native);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+void luma_native_error(LumaInterpreter* interp, const char* message) {
+    (void)interp;
+    native_failed = true;
+    native_error = message;
+}
+
+int luma_compile_file(const char* path) {
+    Program program;
+    SourceStamp stamp;
+    if (!stampSource(path, stamp) || !program.source.openFile(path)) {
+        std::cerr << "Error: " << path << ": Could not open file\n";
+        return 1;
+    }
+    try {
+        Lexer lexer(program.source.text());
+        Parser parser(lexer, program.arena);
+        program.statements = parser.parse();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << path << ": " << e.what() << "\n";
+        return 1;
+    }
+    return storeCachedProgram(path, stamp, program.source.text(),
+                              program.statements)
+               ? 0
+               : 2;
 }
 
 } // extern "C"
\ No newline at end of file
@@ -25,6 +25,12 @@ static void usage() {
     fprintf(stderr, "Usage: luma [options] [file.lu]\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -i         Run file and then enter interactive mode (REPL).\n");
+    fprintf(stderr, "  --vm       Execute with the bytecode VM instead of the AST interpreter.\n");
+    fprintf(stderr, "  -O         Fold constants and drop dead branches before running.\n");
+    fprintf(stderr, "  --profile[=FILE]\n");
+    fprintf(stderr, "             Print a call profile at exit and write sampled stacks for\n");
+    fprintf(stderr, "             flamegraph.pl to FILE (default luma-profile.folded).\n");
+    fprintf(stderr, "  --compile  Pre-parse the given files into the module cache and exit.\n");
     fprintf(stderr, "  --help     Show this help message.\n\n");
     fprintf(stderr, "If no file is provided, luma starts in REPL mode.\n");
 }
@@ -45,6 +51,48 @@ int main(int argc, char** argv) {
     }
 #endif
 
+    // Parse options before creating the interpreter
+    int interactive = 0;
+    int use_vm = 0;
+    int optimize = 0;
+    const char* profile_path = NULL;
+    const char* file = NULL;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--help") == 0) {
+            usage();
+            return 0;
+        } else if (strcmp(arg, "--compile") == 0) {
+            // luma --compile a.lu b.lu ...: every remaining argument is a file
+            int status = 0;
+            for (int j = i + 1; j < argc; j++) {
+                int rc = luma_compile_file(argv[j]);
+                if (rc == 2) {
+                    fprintf(stderr, "Warning: could not write module cache for %s\n", argv[j]);
+                }
+                if (rc > status) {
+                    status = rc;
+                }
+            }
+            return status == 1 ? 1 : 0;
+        } else if (strcmp(arg, "-i") == 0) {
+            interactive = 1;
+        } else if (strcmp(arg, "--vm") == 0) {
+            use_vm = 1;
+        } else if (strcmp(arg, "-O") == 0) {
+            optimize = 1;
+        } else if (strcmp(arg, "--profile") == 0) {
+            profile_path = "luma-profile.folded";
+        } else if (strncmp(arg, "--profile=", 10) == 0) {
+            profile_path = arg + 10;
+        } else if (arg[0] == '-' || file != NULL) {
+            usage();
+            return 2;
+        } else {
+            file = arg;
+        }
+    }
+
     LumaInterpreter* interp = luma_create();
     if (!interp) {
         fprintf(stderr, "Fatal: Could not create Luma interpreter.\n");
@@ -54,36 +102,27 @@ int main(int argc, char** argv) {
     char exe_path[PATH_MAX];
     get_executable_path(exe_path, sizeof(exe_path));
     luma_set_executable_path(interp, exe_path);
+    if (use_vm) {
+        luma_set_engine(interp, LUMA_ENGINE_VM);
+    }
+    if (optimize) {
+        luma_set_optimize(interp, 1);
+    }
+    if (profile_path) {
+        luma_profile_start(interp);
+    }
 
     int exit_code = 0;
 
-    if (argc == 1) {
+    if (file == NULL) {
         run_repl(interp);
-    } else if (argc == 2) {
-        const char* arg = argv[1];
-        if (strcmp(arg, "--help") == 0) {
-            usage();
-        } else {
-            if (luma_run_file(interp, arg) != 0) {
-                exit_code = 1; // File execution failed
-            }
-        }
-    } else if (argc == 3) {
-        const char* flag = argv[1];
-        const char* file = argv[2];
-        if (strcmp(flag, "-i") == 0) {
-            if (luma_run_file(interp, file) == 0) {
-                run_repl(interp);
-            } else {
-                exit_code = 1; // File execution failed
-            }
-        } else {
-            usage();
-            exit_code = 2;
-        }
-    } else {
-        usage();
-        exit_code = 2;
+    } else if (luma_run_file(interp, file) != 0) {
+        exit_code = 1; // File execution failed
+    } else if (interactive) {
+        run_repl(interp);
+    }
+    if (profile_path) {
+        luma_profile_finish(interp, profile_path);
     }
 
     linenoiseHistoryFree();
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov's design).
+// Every cell carries a sequence number that says whose turn it is: a
+// producer may fill cell `pos` when its sequence equals `pos`, a consumer
+// may drain it when the sequence equals `pos + 1`. Producers and consumers
+// only contend on their own position counter.
+template <class T> class MpmcQueue {
+public:
+  // `capacity` is rounded up to a power of two.
+  explicit MpmcQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    mask_ = size - 1;
+    cells_ = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i < size; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  MpmcQueue(const MpmcQueue &) = delete;
+  MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+  // Returns false instead of waiting when the queue is full.
+  bool tryPush(T value) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      const size_t seq = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Returns false instead of waiting when the queue is empty.
+  bool tryPop(T &out) {
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      const size_t seq = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          out = std::move(cell.value);
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // A snapshot: another thread may push or pop right after it is taken.
+  bool empty() const {
+    const size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    return cells_[pos & mask_].sequence.load(std::memory_order_acquire) !=
+           pos + 1;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+  static constexpr size_t kCacheLine = 64;
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  alignas(kCacheLine) std::atomic<size_t> enqueuePos_{0};
+  alignas(kCacheLine) std::atomic<size_t> dequeuePos_{0};
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+// Base for heap objects referenced from Values. The count is deliberately
+// not atomic: values never cross threads (every thread runs its own
+// Interpreter), so sharing an object costs a plain increment.
+struct RefCounted {
+  uint32_t refCount = 0;
+
+  RefCounted() = default;
+  // A copy is a new object with no owners yet.
+  RefCounted(const RefCounted &) {}
+  RefCounted &operator=(const RefCounted &) { return *this; }
+};
+
+// Intrusive owning pointer to a RefCounted object, one pointer wide.
+template <class T> class Ref {
+public:
+  Ref() = default;
+  Ref(std::nullptr_t) {}
+  explicit Ref(T *p) : p_(p) { retain(); }
+  Ref(const Ref &other) : p_(other.p_) { retain(); }
+  Ref(Ref &&other) noexcept : p_(other.p_) { other.p_ = nullptr; }
+  ~Ref() { release(); }
+
+  Ref &operator=(Ref other) noexcept {
+    std::swap(p_, other.p_);
+    return *this;
+  }
+
+  T *get() const { return p_; }
+  T *operator->() const { return p_; }
+  T &operator*() const { return *p_; }
+  explicit operator bool() const { return p_ != nullptr; }
+  uint32_t use_count() const { return p_ ? p_->refCount : 0; }
+  void reset() {
+    release();
+    p_ = nullptr;
+  }
+
+  friend bool operator==(const Ref &a, const Ref &b) { return a.p_ == b.p_; }
+  friend bool operator!=(const Ref &a, const Ref &b) { return a.p_ != b.p_; }
+  friend bool operator==(const Ref &a, std::nullptr_t) { return !a.p_; }
+  friend bool operator!=(const Ref &a, std::nullptr_t) { return a.p_; }
+
+private:
+  T *p_ = nullptr;
+
+  void retain() {
+    if (p_)
+      ++p_->refCount;
+  }
+  void release() {
+    if (p_ && --p_->refCount == 0)
+      delete p_;
+  }
+};
+
+// ---------- cycle collection ----------
+
+// Reference counting frees everything except cycles: a closure stored in
+// the scope it captured, an instance holding one of its bound methods, a
+// list that contains itself. Objects that can hold Values are GcObjects.
+// Each thread keeps its live ones in an intrusive list, and the collector
+// in gc.hpp looks for groups of them that are only referenced by each
+// other. Strings, buffers and natives cannot close a cycle the collector
+// can see, so they are not tracked.
+struct GcObject;
+using GcVisitor = void (*)(GcObject *child, void *context);
+
+struct GcHeap {
+  static constexpr size_t kMinThreshold = 10000;
+
+  GcObject *head = nullptr;
+  size_t live = 0;
+  size_t allocated = 0; // since the last collection
+  size_t threshold = kMinThreshold; // allocations between collections
+  size_t collections = 0;
+  size_t freed = 0; // by all collections so far
+  bool collecting = false;
+};
+
+// Trivially destructible, so objects that outlive their thread's other
+// thread_locals can still unlink themselves.
+inline thread_local GcHeap gcHeap;
+
+struct GcObject : RefCounted {
+  GcObject() noexcept { link(); }
+  GcObject(const GcObject &other) noexcept : RefCounted(other) { link(); }
+  GcObject &operator=(const GcObject &) { return *this; }
+  virtual ~GcObject() {
+    GcHeap &heap = gcHeap;
+    if (gcPrev)
+      gcPrev->gcNext = gcNext;
+    else
+      heap.head = gcNext;
+    if (gcNext)
+      gcNext->gcPrev = gcPrev;
+    --heap.live;
+  }
+
+  // Calls `visit` once for each reference this object holds to another
+  // GcObject.
+  virtual void traceRefs(GcVisitor visit, void *context) const = 0;
+  // Drops the references traceRefs reports, to break a garbage cycle.
+  virtual void clearRefs() = 0;
+
+  GcObject *gcPrev = nullptr;
+  GcObject *gcNext = nullptr;
+  int32_t gcRefs = 0;       // collector scratch
+  bool gcReachable = false; // collector scratch
+
+private:
+  void link() noexcept {
+    GcHeap &heap = gcHeap;
+    gcNext = heap.head;
+    if (gcNext)
+      gcNext->gcPrev = this;
+    heap.head = this;
+    ++heap.live;
+    ++heap.allocated;
+  }
+};
+
+template <class T, class... Args> Ref<T> makeRef(Args &&...args) {
+  return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+// Immutable string payload of a Value. Copying a string Value shares it.
+struct StringObject : RefCounted {
+  std::string value;
+  explicit StringObject(std::string v) : value(std::move(v)) {}
+};
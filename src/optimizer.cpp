@@ -0,0 +1,320 @@
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "interpreter.hpp"
+
+static Value literalValue(const LiteralExpr &literal) {
+  switch (literal.kind) {
+  case LiteralExpr::Kind::Number:
+    return literal.numberValue;
+  case LiteralExpr::Kind::String:
+    return literal.stringValue;
+  case LiteralExpr::Kind::Bool:
+    return literal.boolValue;
+  case LiteralExpr::Kind::Nil:
+    break;
+  }
+  return std::monostate{};
+}
+
+// Null for values no literal can spell (never produced by folding today).
+static ExprPtr makeLiteral(AstArena &arena, const Value &value) {
+  if (auto n = get_if<double>(&value))
+    return LiteralExpr::number(arena, *n);
+  if (auto s = get_if<std::string>(&value))
+    return LiteralExpr::str(arena, *s);
+  if (auto b = get_if<bool>(&value))
+    return LiteralExpr::boolean(arena, *b);
+  if (isNil(value))
+    return LiteralExpr::nil(arena);
+  return nullptr;
+}
+
+static const LiteralExpr *asLiteral(const ExprPtr &expr) {
+  return dynamic_cast<const LiteralExpr *>(expr.get());
+}
+
+// The literal a `def NAME() { return <literal> }` always returns.
+static const LiteralExpr *constantBody(const FuncDefStmt &fn) {
+  if (!fn.params.empty() || fn.body->statements.size() != 1)
+    return nullptr;
+  auto *ret = dynamic_cast<const ReturnStmt *>(fn.body->statements[0].get());
+  return ret && ret->value ? asLiteral(ret->value) : nullptr;
+}
+
+void Optimizer::optimize(std::vector<StmtPtr> &program) {
+  for (const auto &stmt : program)
+    countBindings(*stmt);
+
+  // In source order, so a constant function is only inlined after its
+  // definition: every later statement runs (or defines code that runs)
+  // once the definition has executed.
+  for (auto &stmt : program) {
+    stmt = statement(std::move(stmt));
+    if (auto *f = dynamic_cast<const FuncDefStmt *>(stmt.get())) {
+      const LiteralExpr *value = constantBody(*f);
+      if (value && bindings_[f->name.symbol] == 1)
+        constants_[f->name.symbol] = value;
+    }
+  }
+  program.erase(std::remove(program.begin(), program.end(), nullptr),
+                program.end());
+}
+
+// -------------------- bindings --------------------
+
+void Optimizer::countBindings(const Stmt &stmt) {
+  auto blockBindings = [&](const BlockStmt *block) {
+    if (block) {
+      for (const auto &s : block->statements)
+        countBindings(*s);
+    }
+  };
+  auto functionBindings = [&](const FuncDefStmt &fn) {
+    for (const Token &param : fn.params)
+      ++bindings_[param.symbol];
+    blockBindings(fn.body.get());
+  };
+
+  if (auto *a = dynamic_cast<const VarAssignStmt *>(&stmt)) {
+    ++bindings_[a->name.symbol];
+  } else if (auto *f = dynamic_cast<const FuncDefStmt *>(&stmt)) {
+    ++bindings_[f->name.symbol];
+    functionBindings(*f);
+  } else if (auto *c = dynamic_cast<const ClassStmt *>(&stmt)) {
+    ++bindings_[c->name.symbol];
+    for (const auto &m : c->methods)
+      functionBindings(*m);
+  } else if (auto *sw = dynamic_cast<const SwapStmt *>(&stmt)) {
+    ++bindings_[sw->left.symbol];
+    ++bindings_[sw->right.symbol];
+  } else if (auto *u = dynamic_cast<const UseStmt *>(&stmt)) {
+    ++bindings_[u->alias.symbol];
+  } else if (auto *b = dynamic_cast<const BlockStmt *>(&stmt)) {
+    blockBindings(b);
+  } else if (auto *i = dynamic_cast<const IfStmt *>(&stmt)) {
+    blockBindings(i->thenBranch.get());
+    if (i->elseBranch)
+      countBindings(*i->elseBranch);
+  } else if (auto *w = dynamic_cast<const WhileStmt *>(&stmt)) {
+    blockBindings(w->body.get());
+  } else if (auto *un = dynamic_cast<const UntilStmt *>(&stmt)) {
+    blockBindings(un->body.get());
+  } else if (auto *e = dynamic_cast<const EchoStmt *>(&stmt)) {
+    blockBindings(e->body.get());
+  } else if (auto *m = dynamic_cast<const MaybeStmt *>(&stmt)) {
+    blockBindings(m->tryBlock.get());
+    blockBindings(m->otherwiseBlock.get());
+  }
+}
+
+// -------------------- statements --------------------
+
+void Optimizer::statements(std::vector<StmtPtr> &list) {
+  for (auto &stmt : list)
+    stmt = statement(std::move(stmt));
+  list.erase(std::remove(list.begin(), list.end(), nullptr), list.end());
+}
+
+void Optimizer::block(BlockStmt &block) { statements(block.statements); }
+
+StmtPtr Optimizer::statement(StmtPtr stmt) {
+  Stmt *s = stmt.get();
+
+  if (auto *e = dynamic_cast<ExprStmt *>(s)) {
+    e->expr = expression(std::move(e->expr));
+    return stmt;
+  }
+  if (auto *p = dynamic_cast<PrintStmt *>(s)) {
+    p->expr = expression(std::move(p->expr));
+    return stmt;
+  }
+  if (auto *a = dynamic_cast<VarAssignStmt *>(s)) {
+    a->value = expression(std::move(a->value));
+    return stmt;
+  }
+  if (auto *b = dynamic_cast<BlockStmt *>(s)) {
+    block(*b);
+    return stmt;
+  }
+
+  if (auto *i = dynamic_cast<IfStmt *>(s)) {
+    i->condition = expression(std::move(i->condition));
+    block(*i->thenBranch);
+    if (i->elseBranch)
+      i->elseBranch = statement(std::move(i->elseBranch));
+    if (const LiteralExpr *cond = asLiteral(i->condition)) {
+      // Both branches run as scoped blocks, so the taken one can stand in
+      // for the whole statement.
+      if (isTruthy(literalValue(*cond)))
+        return std::move(i->thenBranch);
+      return std::move(i->elseBranch); // may be null: nothing runs
+    }
+    return stmt;
+  }
+
+  if (auto *w = dynamic_cast<WhileStmt *>(s)) {
+    w->condition = expression(std::move(w->condition));
+    block(*w->body);
+    const LiteralExpr *cond = asLiteral(w->condition);
+    if (cond && !isTruthy(literalValue(*cond)))
+      return nullptr;
+    return stmt;
+  }
+
+  if (auto *u = dynamic_cast<UntilStmt *>(s)) {
+    u->condition = expression(std::move(u->condition));
+    block(*u->body);
+    const LiteralExpr *cond = asLiteral(u->condition);
+    if (cond && isTruthy(literalValue(*cond)))
+      return nullptr;
+    return stmt;
+  }
+
+  if (auto *r = dynamic_cast<ReturnStmt *>(s)) {
+    if (r->value)
+      r->value = expression(std::move(r->value));
+    return stmt;
+  }
+
+  if (auto *f = dynamic_cast<FuncDefStmt *>(s)) {
+    block(*f->body);
+    return stmt;
+  }
+
+  if (auto *c = dynamic_cast<ClassStmt *>(s)) {
+    for (auto &m : c->methods)
+      block(*m->body);
+    return stmt;
+  }
+
+  if (auto *e = dynamic_cast<EchoStmt *>(s)) {
+    e->count = expression(std::move(e->count));
+    block(*e->body);
+    // echoCount() truncates, so anything in (-1, 1) repeats zero times;
+    // other counts (and non-numbers) keep their runtime behaviour.
+    const LiteralExpr *count = asLiteral(e->count);
+    if (count && count->kind == LiteralExpr::Kind::Number &&
+        count->numberValue > -1 && count->numberValue < 1)
+      return nullptr;
+    return stmt;
+  }
+
+  if (auto *m = dynamic_cast<MaybeStmt *>(s)) {
+    block(*m->tryBlock);
+    if (m->otherwiseBlock)
+      block(*m->otherwiseBlock);
+    return stmt;
+  }
+
+  return stmt; // swap, module and use statements have nothing to fold
+}
+
+// -------------------- expressions --------------------
+
+void Optimizer::expressions(std::vector<ExprPtr> &list) {
+  for (auto &e : list)
+    e = expression(std::move(e));
+}
+
+ExprPtr Optimizer::expression(ExprPtr expr) {
+  Expr *e = expr.get();
+
+  if (auto *g = dynamic_cast<GroupingExpr *>(e)) {
+    g->expr = expression(std::move(g->expr));
+    if (asLiteral(g->expr))
+      return std::move(g->expr);
+    return expr;
+  }
+
+  if (auto *u = dynamic_cast<UnaryExpr *>(e)) {
+    u->right = expression(std::move(u->right));
+    if (const LiteralExpr *right = asLiteral(u->right)) {
+      try {
+        if (ExprPtr folded =
+                makeLiteral(arena_, Interpreter::unaryOp(u->op,
+                                                         literalValue(*right))))
+          return folded;
+      } catch (const std::exception &) {
+        // e.g. -"text": leave it to raise at runtime
+      }
+    }
+    return expr;
+  }
+
+  if (auto *b = dynamic_cast<BinaryExpr *>(e)) {
+    b->left = expression(std::move(b->left));
+    b->right = expression(std::move(b->right));
+    const LiteralExpr *left = asLiteral(b->left);
+    if (left && (b->op.type == TokenType::And || b->op.type == TokenType::Or)) {
+      // Short-circuit: the result is one operand, unevaluated if not taken.
+      const bool truthy = isTruthy(literalValue(*left));
+      const bool takeLeft = b->op.type == TokenType::Or ? truthy : !truthy;
+      return takeLeft ? std::move(b->left) : std::move(b->right);
+    }
+    const LiteralExpr *right = asLiteral(b->right);
+    if (left && right) {
+      try {
+        if (ExprPtr folded = makeLiteral(
+                arena_, Interpreter::binaryOp(b->op, literalValue(*left),
+                                              literalValue(*right))))
+          return folded;
+      } catch (const std::exception &) {
+        // e.g. 1 / 0 or 1 + "a": leave it to raise at runtime
+      }
+    }
+    return expr;
+  }
+
+  if (auto *c = dynamic_cast<CallExpr *>(e)) {
+    if (auto *v = dynamic_cast<const VariableExpr *>(c->callee.get())) {
+      auto it = constants_.find(v->name.symbol);
+      if (it != constants_.end() && c->args.empty()) {
+        const LiteralExpr &value = *it->second;
+        auto copy = arena_.make<LiteralExpr>();
+        copy->kind = value.kind;
+        copy->numberValue = value.numberValue;
+        copy->stringValue = value.stringValue; // shared, like any literal
+        copy->boolValue = value.boolValue;
+        return copy;
+      }
+    }
+    c->callee = expression(std::move(c->callee));
+    expressions(c->args);
+    return expr;
+  }
+
+  if (auto *l = dynamic_cast<ListExpr *>(e)) {
+    expressions(l->elements);
+    return expr;
+  }
+  if (auto *g = dynamic_cast<GetExpr *>(e)) {
+    g->object = expression(std::move(g->object));
+    return expr;
+  }
+  if (auto *i = dynamic_cast<IndexExpr *>(e)) {
+    i->object = expression(std::move(i->object));
+    i->index = expression(std::move(i->index));
+    return expr;
+  }
+  if (auto *i = dynamic_cast<IndexSetExpr *>(e)) {
+    i->object = expression(std::move(i->object));
+    i->index = expression(std::move(i->index));
+    i->value = expression(std::move(i->value));
+    return expr;
+  }
+  if (auto *st = dynamic_cast<SetExpr *>(e)) {
+    st->object = expression(std::move(st->object));
+    st->value = expression(std::move(st->value));
+    return expr;
+  }
+  if (auto *m = dynamic_cast<MapExpr *>(e)) {
+    expressions(m->keys);
+    expressions(m->values);
+    return expr;
+  }
+
+  return expr; // literals, variables and `this`
+}
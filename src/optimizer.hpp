@@ -0,0 +1,44 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+// Optional pass (`luma -O`) between the parser and the resolver that
+// rewrites a program into a cheaper one with the same behaviour:
+//
+//  - unary and binary operators over literals are folded, with the
+//    interpreter's own operator semantics (an operation that would raise,
+//    such as `1 / 0`, is left for runtime so the error still happens);
+//  - `and` / `or` with a literal left operand are short-circuited;
+//  - `if`, `while` and `echo` whose outcome is known statically lose their
+//    dead branches and bodies;
+//  - calls to a top-level zero-parameter function whose body is just
+//    `return <literal>` (e.g. `def PENDING() { return 0 }`) are replaced by
+//    that literal, when the function's name is bound nowhere else in the
+//    program and the call comes after the definition in the source.
+//
+// Replacement nodes are allocated in the program's arena. The module cache
+// stores trees before this pass, so cached modules are optimized on load.
+class Optimizer {
+public:
+  explicit Optimizer(AstArena &arena) : arena_(arena) {}
+
+  void optimize(std::vector<StmtPtr> &program);
+
+private:
+  AstArena &arena_;
+  std::unordered_map<Symbol, int> bindings_; // name -> times it is bound
+  // Constant functions defined so far, by name, with their return value.
+  std::unordered_map<Symbol, const LiteralExpr *> constants_;
+
+  void countBindings(const Stmt &stmt);
+
+  // Each returns the replacement for its node: the node itself, another
+  // node, or null when a statement can be dropped.
+  StmtPtr statement(StmtPtr stmt);
+  ExprPtr expression(ExprPtr expr);
+  void statements(std::vector<StmtPtr> &list);
+  void block(BlockStmt &block);
+  void expressions(std::vector<ExprPtr> &list);
+};
@@ -0,0 +1,216 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// String-keyed hash map that iterates in insertion order. Entries live in a
+// dense vector (so iteration is a linear scan and each entry costs no node
+// allocation); an open-addressing index of entry positions, probed linearly,
+// finds them by key. Erased entries leave a hole that is skipped during
+// iteration and squeezed out on the next rehash.
+//
+// The interface is the subset of std::map that the interpreter uses. Elements
+// are std::pair<key, value> so `it->second` and structured bindings keep
+// working; callers must not change a key through an iterator.
+template <class V> class OrderedMap {
+public:
+  using value_type = std::pair<std::string, V>;
+
+  template <bool Const> class Iter {
+  public:
+    using Map = std::conditional_t<Const, const OrderedMap, OrderedMap>;
+    using Ref = std::conditional_t<Const, const value_type &, value_type &>;
+    using Ptr = std::conditional_t<Const, const value_type *, value_type *>;
+
+    Iter(Map *map, size_t pos) : map_(map), pos_(pos) { skipHoles(); }
+    operator Iter<true>() const { return Iter<true>(map_, pos_); }
+
+    Ref operator*() const { return map_->entries_[pos_]; }
+    Ptr operator->() const { return &map_->entries_[pos_]; }
+    Iter &operator++() {
+      ++pos_;
+      skipHoles();
+      return *this;
+    }
+    bool operator==(const Iter &other) const { return pos_ == other.pos_; }
+    bool operator!=(const Iter &other) const { return pos_ != other.pos_; }
+
+  private:
+    friend class OrderedMap;
+    Map *map_;
+    size_t pos_;
+
+    void skipHoles() {
+      while (pos_ < map_->entries_.size() && map_->hashes_[pos_] == kHole)
+        ++pos_;
+    }
+  };
+
+  using iterator = Iter<false>;
+  using const_iterator = Iter<true>;
+
+  OrderedMap() = default;
+
+  // Room for `n` keys without rehashing.
+  void reserve(size_t n) {
+    if (n == 0)
+      return;
+    entries_.reserve(n);
+    hashes_.reserve(n);
+    if (indexCapacityFor(n) > index_.size())
+      rebuildIndex(indexCapacityFor(n));
+  }
+
+  size_t size() const { return live_; }
+  bool empty() const { return live_ == 0; }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, entries_.size()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, entries_.size()); }
+
+  iterator find(std::string_view key) {
+    int32_t pos = lookup(key, hashOf(key));
+    return pos < 0 ? end() : iterator(this, static_cast<size_t>(pos));
+  }
+  const_iterator find(std::string_view key) const {
+    int32_t pos = lookup(key, hashOf(key));
+    return pos < 0 ? end() : const_iterator(this, static_cast<size_t>(pos));
+  }
+
+  size_t count(std::string_view key) const {
+    return lookup(key, hashOf(key)) < 0 ? 0 : 1;
+  }
+
+  V &at(std::string_view key) {
+    int32_t pos = lookup(key, hashOf(key));
+    if (pos < 0)
+      throw std::out_of_range("OrderedMap::at");
+    return entries_[pos].second;
+  }
+  const V &at(std::string_view key) const {
+    return const_cast<OrderedMap *>(this)->at(key);
+  }
+
+  // Inserts a default value for a new key, appending it to the order.
+  V &operator[](std::string_view key) {
+    const uint64_t hash = hashOf(key);
+    int32_t pos = lookup(key, hash);
+    if (pos >= 0)
+      return entries_[pos].second;
+    return entries_[append(std::string(key), hash)].second;
+  }
+
+  size_t erase(std::string_view key) {
+    const uint64_t hash = hashOf(key);
+    size_t slot = 0;
+    int32_t pos = lookup(key, hash, &slot);
+    if (pos < 0)
+      return 0;
+    index_[slot] = kErased;
+    hashes_[pos] = kHole;
+    entries_[pos] = value_type(); // release the value now
+    --live_;
+    return 1;
+  }
+
+  void clear() {
+    entries_.clear();
+    hashes_.clear();
+    index_.clear();
+    live_ = 0;
+  }
+
+private:
+  static constexpr uint64_t kHole = 0; // hashes_ marker for erased entries
+  static constexpr int32_t kEmpty = -1;
+  static constexpr int32_t kErased = -2;
+
+  std::vector<value_type> entries_; // insertion order, with holes
+  std::vector<uint64_t> hashes_;    // per entry; kHole for erased ones
+  std::vector<int32_t> index_;      // power-of-two sized; entry positions
+  size_t live_ = 0;
+
+  static uint64_t hashOf(std::string_view key) {
+    // Never kHole, so a stored hash always marks a live entry.
+    return static_cast<uint64_t>(std::hash<std::string_view>()(key)) | 1;
+  }
+
+  // Index size that keeps the load factor (counting holes) under 3/4.
+  static size_t indexCapacityFor(size_t entries) {
+    size_t capacity = 8;
+    while (capacity * 3 < entries * 4 + 4)
+      capacity *= 2;
+    return capacity;
+  }
+
+  int32_t lookup(std::string_view key, uint64_t hash,
+                 size_t *slotOut = nullptr) const {
+    if (index_.empty())
+      return -1;
+    const size_t mask = index_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      int32_t pos = index_[slot];
+      if (pos == kEmpty)
+        return -1;
+      if (pos != kErased && hashes_[pos] == hash &&
+          entries_[pos].first == key) {
+        if (slotOut)
+          *slotOut = slot;
+        return pos;
+      }
+    }
+  }
+
+  size_t append(std::string key, uint64_t hash) {
+    if ((entries_.size() + 1) * 4 > index_.size() * 3)
+      grow();
+    const size_t pos = entries_.size();
+    entries_.emplace_back(std::move(key), V());
+    hashes_.push_back(hash);
+    insertIndex(hash, static_cast<int32_t>(pos));
+    ++live_;
+    return pos;
+  }
+
+  void insertIndex(uint64_t hash, int32_t pos) {
+    const size_t mask = index_.size() - 1;
+    size_t slot = hash & mask;
+    while (index_[slot] >= 0)
+      slot = (slot + 1) & mask;
+    index_[slot] = pos;
+  }
+
+  // Drops holes from the entry vector, then sizes the index for what is left
+  // plus room to grow.
+  void grow() {
+    if (live_ != entries_.size()) {
+      size_t out = 0;
+      for (size_t in = 0; in < entries_.size(); ++in) {
+        if (hashes_[in] == kHole)
+          continue;
+        if (out != in) {
+          entries_[out] = std::move(entries_[in]);
+          hashes_[out] = hashes_[in];
+        }
+        ++out;
+      }
+      entries_.resize(out);
+      hashes_.resize(out);
+    }
+    rebuildIndex(indexCapacityFor((live_ + 1) * 2));
+  }
+
+  void rebuildIndex(size_t capacity) {
+    index_.assign(capacity, kEmpty);
+    for (size_t pos = 0; pos < entries_.size(); ++pos) {
+      if (hashes_[pos] != kHole)
+        insertIndex(hashes_[pos], static_cast<int32_t>(pos));
+    }
+  }
+};
@@ -0,0 +1,249 @@
+#include "parallel.hpp"
+#include "gc.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+// -------------------- Transferable --------------------
+
+namespace {
+
+Transferable copyValue(const Value &value,
+                       std::unordered_set<const void *> &open) {
+  Transferable out;
+  switch (value.type()) {
+  case Value::Type::Nil:
+    break;
+  case Value::Type::Number:
+    out.kind = Transferable::Kind::Number;
+    out.number = get<double>(value);
+    break;
+  case Value::Type::Bool:
+    out.kind = Transferable::Kind::Bool;
+    out.boolean = get<bool>(value);
+    break;
+  case Value::Type::String:
+    out.kind = Transferable::Kind::String;
+    out.bytes = get<std::string>(value);
+    break;
+  case Value::Type::Buffer: {
+    const auto &bytes = get<BufferPtr>(value)->bytes;
+    out.kind = Transferable::Kind::Buffer;
+    out.bytes.assign(bytes.begin(), bytes.end());
+    break;
+  }
+  case Value::Type::List: {
+    const List &list = *get<ListPtr>(value);
+    if (!open.insert(&list).second)
+      throw std::runtime_error("Cannot copy a list that contains itself.");
+    out.kind = Transferable::Kind::List;
+    out.elements.reserve(list.elements.size());
+    for (const Value &element : list.elements)
+      out.elements.push_back(copyValue(element, open));
+    open.erase(&list);
+    break;
+  }
+  case Value::Type::Map: {
+    const LumaMap &map = *get<MapPtr>(value);
+    if (!open.insert(&map).second)
+      throw std::runtime_error("Cannot copy a map that contains itself.");
+    out.kind = Transferable::Kind::Map;
+    out.keys.reserve(map.values.size());
+    out.elements.reserve(map.values.size());
+    for (const auto &entry : map.values) {
+      out.keys.push_back(entry.first);
+      out.elements.push_back(copyValue(entry.second, open));
+    }
+    open.erase(&map);
+    break;
+  }
+  default:
+    throw std::runtime_error(
+        "Only nil, numbers, bools, strings, buffers, lists and maps can "
+        "cross threads, not " + valueToString(value) + ".");
+  }
+  return out;
+}
+
+} // namespace
+
+Transferable Transferable::from(const Value &value) {
+  std::unordered_set<const void *> open;
+  return copyValue(value, open);
+}
+
+Value Transferable::toValue() const {
+  switch (kind) {
+  case Kind::Nil:
+    return Value();
+  case Kind::Number:
+    return number;
+  case Kind::Bool:
+    return boolean;
+  case Kind::String:
+    return bytes;
+  case Kind::Buffer:
+    return makeRef<ByteBuffer>(std::vector<uint8_t>(bytes.begin(), bytes.end()));
+  case Kind::List: {
+    auto list = makeRef<List>();
+    list->elements.reserve(elements.size());
+    for (const Transferable &element : elements)
+      list->elements.push_back(element.toValue());
+    return list;
+  }
+  case Kind::Map: {
+    auto map = makeRef<LumaMap>(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+      map->values[keys[i]] = elements[i].toValue();
+    return map;
+  }
+  }
+  return Value();
+}
+
+// -------------------- pool --------------------
+
+ParallelPool::ParallelPool(Config config) : config_(std::move(config)) {
+  const size_t count = config_.workers ? config_.workers : 1;
+  workers_.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    workers_.push_back(std::make_unique<Worker>());
+  for (size_t i = 0; i < count; ++i)
+    workers_[i]->thread = std::thread([this, i] { workerMain(i); });
+}
+
+ParallelPool::~ParallelPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker->thread.joinable())
+      worker->thread.join();
+  }
+}
+
+std::vector<Transferable> ParallelPool::map(const std::string &moduleId,
+                                            const std::string &function,
+                                            std::vector<Transferable> items,
+                                            size_t chunkSize) {
+  if (items.empty())
+    return {};
+  if (chunkSize == 0)
+    chunkSize = 1;
+
+  Job job;
+  job.moduleId = moduleId;
+  job.function = function;
+  job.items = std::move(items);
+  job.results.resize(job.items.size());
+  const size_t chunks = (job.items.size() + chunkSize - 1) / chunkSize;
+  job.remaining.store(chunks);
+
+  for (size_t c = 0; c < chunks; ++c) {
+    Worker &worker = *workers_[c % workers_.size()];
+    const size_t begin = c * chunkSize;
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(
+        {&job, begin, std::min(begin + chunkSize, job.items.size())});
+  }
+  // Counted only once queued, so a woken worker always finds a task.
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    queued_.fetch_add(chunks);
+  }
+  wake_.notify_all();
+
+  std::unique_lock<std::mutex> lock(job.mutex);
+  job.done.wait(lock, [&] { return job.remaining.load() == 0; });
+  if (job.failed.load())
+    throw std::runtime_error(job.error);
+  return std::move(job.results);
+}
+
+bool ParallelPool::take(size_t index, Task &out) {
+  const size_t count = workers_.size();
+  for (;;) {
+    // Own deque from the front, then the others' from the back.
+    for (size_t k = 0; k < count; ++k) {
+      Worker &worker = *workers_[(index + k) % count];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.tasks.empty())
+        continue;
+      if (k == 0) {
+        out = worker.tasks.front();
+        worker.tasks.pop_front();
+      } else {
+        out = worker.tasks.back();
+        worker.tasks.pop_back();
+      }
+      queued_.fetch_sub(1);
+      return true;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    wake_.wait(lock, [&] { return stopping_ || queued_.load() > 0; });
+    if (stopping_ && queued_.load() == 0)
+      return false;
+  }
+}
+
+void ParallelPool::finish(Job &job, const std::string *error) {
+  // The caller may destroy the job once it sees the last chunk done, so
+  // nothing touches it after this lock is released.
+  std::lock_guard<std::mutex> lock(job.mutex);
+  if (error && !job.failed.exchange(true))
+    job.error = *error;
+  if (job.remaining.fetch_sub(1) == 1)
+    job.done.notify_all();
+}
+
+void ParallelPool::workerMain(size_t index) {
+  {
+    Interpreter interp;
+    interp.setEngine(config_.engine);
+    interp.setOptimize(config_.optimize);
+    if (!config_.executablePath.empty())
+      interp.setExecutablePath(config_.executablePath);
+    if (!config_.entryFile.empty())
+      interp.setEntryFile(config_.entryFile);
+
+    // Declared after interp so they are released first.
+    std::unordered_map<std::string, Value> functions; // "module\nname"
+    std::vector<Value> args(1);
+
+    Task task;
+    while (take(index, task)) {
+      Job &job = *task.job;
+      std::string error;
+      if (!job.failed.load()) {
+        try {
+          Value &function = functions[job.moduleId + '\n' + job.function];
+          if (isNil(function)) {
+            MapPtr exports = interp.importModule(job.moduleId);
+            auto it = exports->values.find(job.function);
+            if (it == exports->values.end())
+              throw std::runtime_error("Module " + job.moduleId +
+                                       " has no export '" + job.function + "'");
+            function = it->second;
+          }
+          for (size_t i = task.begin; i < task.end && !job.failed.load(); ++i) {
+            args[0] = job.items[i].toValue();
+            job.results[i] = Transferable::from(interp.call(function, args));
+          }
+        } catch (const std::exception &e) {
+          error = e.what();
+        }
+      }
+      args[0] = Value();
+      gcMaybeCollect();
+      finish(job, error.empty() ? nullptr : &error);
+    }
+  }
+  // The interpreter's destructor collects its own cycles; this catches
+  // anything the worker's calls left on the thread's heap besides, which
+  // would otherwise be lost when the thread exits.
+  gcCollect();
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "interpreter.hpp"
+
+// A deep copy of a Luma value that owns no reference-counted objects, so it
+// can move between threads: nil, numbers, bools, strings, buffers, and
+// lists and maps of those. Functions, classes and instances belong to the
+// interpreter that made them and cannot be copied.
+struct Transferable {
+  enum class Kind : uint8_t { Nil, Number, Bool, String, Buffer, List, Map };
+
+  Kind kind = Kind::Nil;
+  double number = 0;
+  bool boolean = false;
+  std::string bytes;                  // String, Buffer
+  std::vector<Transferable> elements; // List elements, Map values
+  std::vector<std::string> keys;      // Map keys, in insertion order
+
+  // Throws std::runtime_error for values that cannot be copied, and for
+  // lists and maps that contain themselves.
+  static Transferable from(const Value &value);
+  Value toValue() const;
+};
+
+// Runs exported Luma functions over lists on a pool of threads
+// (@std.parallel).
+//
+// As in WorkerPool, every worker owns an Interpreter and nothing Luma-level
+// is shared: a function is named by module ID and export name, each worker
+// imports that module itself (once), and items and results cross threads as
+// Transferables. A map is split into chunks dealt round-robin onto the
+// workers' deques; a worker takes from the front of its own deque and, when
+// that is empty, steals from the back of the others', so uneven chunks
+// still keep every core busy.
+class ParallelPool {
+public:
+  struct Config {
+    // Copied from the calling interpreter so modules resolve the same way.
+    std::string executablePath;
+    std::string entryFile;
+    Interpreter::Engine engine = Interpreter::Engine::TreeWalker;
+    bool optimize = false;
+    size_t workers = 1;
+  };
+
+  explicit ParallelPool(Config config);
+  ~ParallelPool(); // joins the workers
+  ParallelPool(const ParallelPool &) = delete;
+  ParallelPool &operator=(const ParallelPool &) = delete;
+
+  size_t size() const { return workers_.size(); }
+
+  // Calls moduleId's export `function` on each item, `chunkSize` items per
+  // task, and returns the results in order. Blocks until every chunk is
+  // done; throws std::runtime_error with the first error a call raised.
+  std::vector<Transferable> map(const std::string &moduleId,
+                                const std::string &function,
+                                std::vector<Transferable> items,
+                                size_t chunkSize);
+
+private:
+  struct Job {
+    std::string moduleId;
+    std::string function;
+    std::vector<Transferable> items;
+    std::vector<Transferable> results;
+    std::atomic<size_t> remaining{0}; // chunks not yet finished
+    std::atomic<bool> failed{false};  // later chunks are skipped
+    std::mutex mutex;
+    std::condition_variable done;
+    std::string error;
+  };
+
+  struct Task {
+    Job *job = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  Config config_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Idle workers sleep here until tasks are queued or the pool stops.
+  std::mutex sleepMutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> queued_{0};
+  bool stopping_ = false;
+
+  void workerMain(size_t index);
+  bool take(size_t index, Task &out);
+  void finish(Job &job, const std::string *error);
+};
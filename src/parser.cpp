@@ -1,7 +1,9 @@
 #include "parser.hpp"
 #include <sstream>
 
-Parser::Parser(std::vector<Token> tokens) : tokens_(std::move(tokens)) {}
+Parser::Parser(Lexer &lexer, AstArena &arena)
+    : lexer_(lexer), arena_(arena), current_(lexer.nextToken()),
+      previous_(current_) {}
 
 std::vector<StmtPtr> Parser::parse() {
   std::vector<StmtPtr> stmts;
@@ -90,7 +92,7 @@ StmtPtr Parser::moduleDeclaration() {
   consume(TokenType::At, "Expected '@' after 'module'.");
   auto parts = parseModuleId();
   match({TokenType::Semicolon}); // optional semicolon
-  return std::make_unique<ModuleStmt>(std::move(parts));
+  return arena_.make<ModuleStmt>(std::move(parts));
 }
 
 StmtPtr Parser::useStatement() {
@@ -100,7 +102,7 @@ StmtPtr Parser::useStatement() {
   consume(TokenType::As, "Expected 'as' after module ID in use statement.");
   Token alias = consume(TokenType::Identifier, "Expected alias name after 'as'.");
   match({TokenType::Semicolon}); // optional semicolon
-  return std::make_unique<UseStmt>(std::move(parts), std::move(alias));
+  return arena_.make<UseStmt>(std::move(parts), std::move(alias));
 }
 
 // ... (skipping some methods) ...
@@ -110,7 +112,7 @@ StmtPtr Parser::untilStatement() {
   auto cond = expression();
   consume(TokenType::RightParen, "Expected ')' after until condition.");
   auto body = block();
-  return std::make_unique<UntilStmt>(std::move(cond), std::move(body));
+  return arena_.make<UntilStmt>(std::move(cond), std::move(body));
 }
 
 // ... (skipping to call()) ...
@@ -128,17 +130,17 @@ ExprPtr Parser::call() {
         } while (match({TokenType::Comma}));
       }
       consume(TokenType::RightParen, "Expected ')' after arguments.");
-      expr = std::make_unique<CallExpr>(std::move(expr), std::move(paren),
+      expr = arena_.make<CallExpr>(std::move(expr), std::move(paren),
                                         std::move(args));
     } else if (match({TokenType::Dot})) {
       Token name =
           consume(TokenType::Identifier, "Expected property name after '.'.");
-      expr = std::make_unique<GetExpr>(std::move(expr), std::move(name));
+      expr = arena_.make<GetExpr>(std::move(expr), std::move(name));
     } else if (match({TokenType::LeftBracket})) {
       Token bracket = previous();
       auto index = expression();
       consume(TokenType::RightBracket, "Expected ']' after index.");
-      expr = std::make_unique<IndexExpr>(std::move(expr), std::move(bracket),
+      expr = arena_.make<IndexExpr>(std::move(expr), std::move(bracket),
                                          std::move(index));
     } else {
       break;
@@ -148,10 +150,10 @@ ExprPtr Parser::call() {
   return expr;
 }
 
-static std::string unquoteStringLexeme(const std::string &lexeme) {
+static std::string unquoteStringLexeme(std::string_view lexeme) {
   // lexeme includes quotes, e.g. "\"big\""
   if (lexeme.size() >= 2 && lexeme.front() == '"' && lexeme.back() == '"') {
-    std::string inner = lexeme.substr(1, lexeme.size() - 2);
+    std::string_view inner = lexeme.substr(1, lexeme.size() - 2);
     std::string result;
     result.reserve(inner.size());
     for (size_t i = 0; i < inner.size(); ++i) {
@@ -176,7 +178,7 @@ static std::string unquoteStringLexeme(const std::string &lexeme) {
     }
     return result;
   }
-  return lexeme;
+  return std::string(lexeme);
 }
 
 ExprPtr Parser::primary() {
@@ -184,31 +186,31 @@ ExprPtr Parser::primary() {
     const auto &t = previous();
     double v = 0.0;
     try {
-      v = std::stod(t.lexeme);
+      v = std::stod(std::string(t.lexeme));
     } catch (...) {
-      throw error(t, "Invalid number literal: " + t.lexeme);
+      throw error(t, "Invalid number literal: " + std::string(t.lexeme));
     }
-    return LiteralExpr::number(v);
+    return LiteralExpr::number(arena_, v);
   }
 
   if (match({TokenType::String})) {
     const auto &t = previous();
-    return LiteralExpr::str(unquoteStringLexeme(t.lexeme));
+    return LiteralExpr::str(arena_, unquoteStringLexeme(t.lexeme));
   }
 
   if (match({TokenType::True}))
-    return LiteralExpr::boolean(true);
+    return LiteralExpr::boolean(arena_, true);
   if (match({TokenType::False}))
-    return LiteralExpr::boolean(false);
+    return LiteralExpr::boolean(arena_, false);
   if (match({TokenType::Nil}))
-    return LiteralExpr::nil();
+    return LiteralExpr::nil(arena_);
 
   if (match({TokenType::Identifier})) {
-    return std::make_unique<VariableExpr>(previous());
+    return arena_.make<VariableExpr>(previous());
   }
 
   if (match({TokenType::This})) {
-    return std::make_unique<ThisExpr>(previous());
+    return arena_.make<ThisExpr>(previous());
   }
 
   // Bracket for List Literals: [1, 2, 3]
@@ -220,7 +222,7 @@ ExprPtr Parser::primary() {
       } while (match({TokenType::Comma}));
     }
     consume(TokenType::RightBracket, "Expected ']' after list elements.");
-    return std::make_unique<ListExpr>(std::move(elements));
+    return arena_.make<ListExpr>(std::move(elements));
   }
 
   // Brace for Map Literals: { "key": val, ... }
@@ -236,13 +238,13 @@ ExprPtr Parser::primary() {
       } while (match({TokenType::Comma}));
     }
     consume(TokenType::RightBrace, "Expected '}' after map entries.");
-    return std::make_unique<MapExpr>(std::move(keys), std::move(values));
+    return arena_.make<MapExpr>(std::move(keys), std::move(values));
   }
 
   if (match({TokenType::LeftParen})) {
     auto expr = expression();
     consume(TokenType::RightParen, "Expected ')' after expression.");
-    return std::make_unique<GroupingExpr>(std::move(expr));
+    return arena_.make<GroupingExpr>(std::move(expr));
   }
 
   throw error(peek(), "Expected expression.");
@@ -263,7 +265,7 @@ StmtPtr Parser::functionDeclaration(Visibility vis) {
 
   consume(TokenType::RightParen, "Expected ')' after parameters.");
   auto body = block();
-  return std::make_unique<FuncDefStmt>(name, std::move(params),
+  return arena_.make<FuncDefStmt>(name, std::move(params),
                                        std::move(body), vis);
 }
 
@@ -271,18 +273,18 @@ StmtPtr Parser::classDeclaration(Visibility vis) {
   Token name = consume(TokenType::Identifier, "Expected class name.");
   consume(TokenType::LeftBrace, "Expected '{' before class body.");
 
-  std::vector<std::shared_ptr<FuncDefStmt>> methods;
+  std::vector<NodePtr<FuncDefStmt>> methods;
   while (!check(TokenType::RightBrace) && !isAtEnd()) {
     consume(TokenType::Def, "Expected 'def' to define method.");
     auto stmt = functionDeclaration();
-    auto funcStmt = std::unique_ptr<FuncDefStmt>(
+    auto funcStmt = NodePtr<FuncDefStmt>(
         static_cast<FuncDefStmt *>(stmt.release()));
     methods.push_back(std::move(funcStmt));
   }
 
   consume(TokenType::RightBrace, "Expected '}' after class body.");
 
-  return std::make_unique<ClassStmt>(name, methods, vis);
+  return arena_.make<ClassStmt>(name, std::move(methods), vis);
 }
 
 StmtPtr Parser::printStatement() {
@@ -290,7 +292,7 @@ StmtPtr Parser::printStatement() {
   auto value = expression();
   consume(TokenType::RightParen, "Expected ')' after print expression.");
   match({TokenType::Semicolon});
-  return std::make_unique<PrintStmt>(std::move(value));
+  return arena_.make<PrintStmt>(std::move(value));
 }
 
 StmtPtr Parser::ifStatement() {
@@ -311,7 +313,7 @@ StmtPtr Parser::ifStatement() {
     }
   }
 
-  return std::make_unique<IfStmt>(std::move(cond), std::move(thenBlock),
+  return arena_.make<IfStmt>(std::move(cond), std::move(thenBlock),
                                   std::move(elseBranch));
 }
 
@@ -320,7 +322,7 @@ StmtPtr Parser::whileStatement() {
   auto cond = expression();
   consume(TokenType::RightParen, "Expected ')' after while condition.");
   auto body = block();
-  return std::make_unique<WhileStmt>(std::move(cond), std::move(body));
+  return arena_.make<WhileStmt>(std::move(cond), std::move(body));
 }
 
 StmtPtr Parser::returnStatement() {
@@ -333,7 +335,7 @@ StmtPtr Parser::returnStatement() {
     value = expression();
   }
   match({TokenType::Semicolon});
-  return std::make_unique<ReturnStmt>(kw, std::move(value));
+  return arena_.make<ReturnStmt>(kw, std::move(value));
 }
 
 // ========== Luma Unique Statements ==========
@@ -342,19 +344,19 @@ StmtPtr Parser::echoStatement() {
   // echo <count> { ... }
   auto count = expression();
   auto body = block();
-  return std::make_unique<EchoStmt>(std::move(count), std::move(body));
+  return arena_.make<EchoStmt>(std::move(count), std::move(body));
 }
 
 StmtPtr Parser::maybeStatement() {
   // maybe { ... } otherwise { ... }
   auto tryBlock = block();
 
-  std::unique_ptr<BlockStmt> otherwiseBlock = nullptr;
+  NodePtr<BlockStmt> otherwiseBlock = nullptr;
   if (match({TokenType::Otherwise})) {
     otherwiseBlock = block();
   }
 
-  return std::make_unique<MaybeStmt>(std::move(tryBlock),
+  return arena_.make<MaybeStmt>(std::move(tryBlock),
                                      std::move(otherwiseBlock));
 }
 
@@ -366,7 +368,7 @@ StmtPtr Parser::assignmentOrExprStatement() {
       Token right =
           consume(TokenType::Identifier, "Expected identifier after '<->'.");
       match({TokenType::Semicolon});
-      return std::make_unique<SwapStmt>(v->name, right);
+      return arena_.make<SwapStmt>(v->name, right);
     }
     throw error(previous(), "Invalid swap target.");
   }
@@ -376,14 +378,14 @@ StmtPtr Parser::assignmentOrExprStatement() {
     match({TokenType::Semicolon});
 
     if (auto v = dynamic_cast<VariableExpr *>(expr.get())) {
-      return std::make_unique<VarAssignStmt>(v->name, std::move(value));
+      return arena_.make<VarAssignStmt>(v->name, std::move(value));
     }
     if (auto get = dynamic_cast<GetExpr *>(expr.get())) {
-      return std::make_unique<ExprStmt>(std::make_unique<SetExpr>(
+      return arena_.make<ExprStmt>(arena_.make<SetExpr>(
           std::move(get->object), get->name, std::move(value)));
     }
     if (auto idx = dynamic_cast<IndexExpr *>(expr.get())) {
-      return std::make_unique<ExprStmt>(std::make_unique<IndexSetExpr>(
+      return arena_.make<ExprStmt>(arena_.make<IndexSetExpr>(
           std::move(idx->object), idx->bracket, std::move(idx->index),
           std::move(value)));
     }
@@ -391,10 +393,10 @@ StmtPtr Parser::assignmentOrExprStatement() {
   }
 
   match({TokenType::Semicolon});
-  return std::make_unique<ExprStmt>(std::move(expr));
+  return arena_.make<ExprStmt>(std::move(expr));
 }
 
-std::unique_ptr<BlockStmt> Parser::block() {
+NodePtr<BlockStmt> Parser::block() {
   consume(TokenType::LeftBrace, "Expected '{' to start block.");
   std::vector<StmtPtr> stmts;
 
@@ -403,7 +405,7 @@ std::unique_ptr<BlockStmt> Parser::block() {
   }
 
   consume(TokenType::RightBrace, "Expected '}' after block.");
-  return std::make_unique<BlockStmt>(std::move(stmts));
+  return arena_.make<BlockStmt>(std::move(stmts));
 }
 
 // -------------------- expressions --------------------
@@ -415,7 +417,7 @@ ExprPtr Parser::logicalOr() {
   while (match({TokenType::Or})) {
     Token op = previous();
     auto right = logicalAnd();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -425,7 +427,7 @@ ExprPtr Parser::logicalAnd() {
   while (match({TokenType::And})) {
     Token op = previous();
     auto right = equality();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -435,7 +437,7 @@ ExprPtr Parser::equality() {
   while (match({TokenType::BangEqual, TokenType::EqualEqual})) {
     Token op = previous();
     auto right = bitwiseOr();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -445,7 +447,7 @@ ExprPtr Parser::bitwiseOr() {
   while (match({TokenType::Pipe})) {
     Token op = previous();
     auto right = comparison();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -456,7 +458,7 @@ ExprPtr Parser::comparison() {
                 TokenType::LessEqual})) {
     Token op = previous();
     auto right = term();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -466,7 +468,7 @@ ExprPtr Parser::shift() {
   while (match({TokenType::ShiftLeft, TokenType::ShiftRight})) {
     Token op = previous();
     auto right = factor();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -476,7 +478,7 @@ ExprPtr Parser::term() {
   while (match({TokenType::Plus, TokenType::Minus})) {
     Token op = previous();
     auto right = shift();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -486,7 +488,7 @@ ExprPtr Parser::factor() {
   while (match({TokenType::Star, TokenType::Slash, TokenType::Ampersand})) {
     Token op = previous();
     auto right = unary();
-    expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+    expr = arena_.make<BinaryExpr>(std::move(expr), op, std::move(right));
   }
   return expr;
 }
@@ -495,7 +497,7 @@ ExprPtr Parser::unary() {
   if (match({TokenType::Bang, TokenType::Minus, TokenType::Not})) {
     Token op = previous();
     auto right = unary();
-    return std::make_unique<UnaryExpr>(op, std::move(right));
+    return arena_.make<UnaryExpr>(op, std::move(right));
   }
   return call();
 }
@@ -519,16 +521,18 @@ bool Parser::check(TokenType type) const {
 }
 
 const Token &Parser::advance() {
-  if (!isAtEnd())
-    current_++;
+  if (!isAtEnd()) {
+    previous_ = current_;
+    current_ = lexer_.nextToken();
+  }
   return previous();
 }
 
 bool Parser::isAtEnd() const { return peek().type == TokenType::Eof; }
 
-const Token &Parser::peek() const { return tokens_[current_]; }
+const Token &Parser::peek() const { return current_; }
 
-const Token &Parser::previous() const { return tokens_[current_ - 1]; }
+const Token &Parser::previous() const { return previous_; }
 
 const Token &Parser::consume(TokenType type, const std::string &message) {
   if (check(type))
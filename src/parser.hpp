@@ -1,5 +1,6 @@
 #pragma once
 #include "ast.hpp"
+#include "lexer.hpp"
 #include "token.hpp"
 #include <string>
 #include <stdexcept>
@@ -7,7 +8,9 @@
 
 class Parser {
 public:
-  explicit Parser(std::vector<Token> tokens);
+  // Pulls tokens from `lexer` as it goes. Nodes are allocated in `arena`,
+  // which must outlive the returned tree.
+  Parser(Lexer &lexer, AstArena &arena);
   std::vector<StmtPtr> parse();
 
 private:
@@ -15,8 +18,10 @@ private:
     using std::runtime_error::runtime_error;
   };
 
-  std::vector<Token> tokens_;
-  size_t current_ = 0;
+  Lexer &lexer_;
+  AstArena &arena_;
+  Token current_;  // the next token to be consumed
+  Token previous_; // the one consumed last
 
   // statements
   StmtPtr declaration();
@@ -39,7 +44,7 @@ private:
   StmtPtr useStatement();
   std::vector<Token> parseModuleId();
 
-  std::unique_ptr<BlockStmt> block();
+  NodePtr<BlockStmt> block();
 
   // expressions
   ExprPtr expression();
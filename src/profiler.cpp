@@ -0,0 +1,196 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <sys/time.h>
+
+// The profiler whose tree SIGPROF samples; at most one at a time.
+static std::atomic<Profiler *> gSampling{nullptr};
+static struct sigaction gPreviousAction;
+
+static int64_t nanosSince(Profiler::Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Profiler::Clock::now() - start)
+      .count();
+}
+
+Profiler::Profiler(int sampleHz) : sampleHz_(sampleHz) {
+  nodes_.emplace_back(); // <main>: top-level code, outside any call
+  current_.store(&nodes_.front(), std::memory_order_relaxed);
+}
+
+Profiler::~Profiler() { stop(); }
+
+void Profiler::start() {
+  if (running_)
+    return;
+  if (sampleHz_ > 0) {
+    Profiler *expected = nullptr;
+    if (!gSampling.compare_exchange_strong(expected, this))
+      throw std::runtime_error("Another profiler is already sampling.");
+    struct sigaction action {};
+    action.sa_handler = &Profiler::onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &gPreviousAction);
+
+    itimerval timer{};
+    timer.it_interval.tv_usec = 1000000 / sampleHz_;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+  }
+  started_ = Clock::now();
+  running_ = true;
+}
+
+void Profiler::stop() {
+  if (!running_)
+    return;
+  if (gSampling.load() == this) {
+    itimerval off{};
+    setitimer(ITIMER_PROF, &off, nullptr);
+    sigaction(SIGPROF, &gPreviousAction, nullptr);
+    gSampling.store(nullptr);
+  }
+  elapsedNs_ += nanosSince(started_);
+  running_ = false;
+}
+
+void Profiler::onSignal(int) {
+  // Async-signal-safe: two relaxed atomic operations on live memory.
+  if (Profiler *p = gSampling.load(std::memory_order_relaxed))
+    p->current_.load(std::memory_order_relaxed)
+        ->samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+// -------------------- frames --------------------
+
+void Profiler::enter(Scope &scope, uint32_t entry, int callLine) {
+  scope.parent_ = top_;
+  scope.entry_ = entry;
+  scope.callLine_ = callLine;
+  top_ = &scope;
+
+  Entry &e = entries_[entry];
+  ++e.calls;
+  ++e.active;
+
+  Node *node = current_.load(std::memory_order_relaxed);
+  Node *child = nullptr;
+  for (Node *c : node->children) {
+    if (c->entry == entry) {
+      child = c;
+      break;
+    }
+  }
+  if (!child) {
+    child = &nodes_.emplace_back();
+    child->entry = entry;
+    child->parent = node;
+    node->children.push_back(child);
+  }
+  current_.store(child, std::memory_order_relaxed);
+  scope.start_ = Clock::now();
+}
+
+void Profiler::exit(Scope &scope) {
+  const int64_t ns = nanosSince(scope.start_);
+  Entry &e = entries_[scope.entry_];
+  e.exclusiveNs += ns - scope.childNs_;
+  CallSite &site = callSites_[static_cast<uint64_t>(scope.entry_) << 32 |
+                              static_cast<uint32_t>(scope.callLine_)];
+  ++site.calls;
+  if (--e.active == 0) {
+    e.inclusiveNs += ns;
+    site.inclusiveNs += ns;
+  }
+  if (scope.parent_)
+    scope.parent_->childNs_ += ns;
+  top_ = scope.parent_;
+
+  Node *node = current_.load(std::memory_order_relaxed);
+  current_.store(node->parent, std::memory_order_relaxed);
+}
+
+// -------------------- output --------------------
+
+int64_t Profiler::elapsedNs() const {
+  return elapsedNs_ + (running_ ? nanosSince(started_) : 0);
+}
+
+std::string Profiler::frameName(uint32_t entry) const {
+  const Entry &e = entries_[entry];
+  return e.line > 0 ? e.name + ":" + std::to_string(e.line) : e.name;
+}
+
+void Profiler::report(std::ostream &out, size_t top) const {
+  const double totalMs = elapsedNs() / 1e6;
+  uint64_t samples = 0;
+  for (const Node &n : nodes_)
+    samples += n.samples.load(std::memory_order_relaxed);
+
+  char line[256];
+  std::snprintf(line, sizeof(line),
+                "\nProfile: %.1f ms wall, %llu samples at %d Hz\n\n", totalMs,
+                static_cast<unsigned long long>(samples), sampleHz_);
+  out << line;
+
+  std::vector<uint32_t> order(entries_.size());
+  for (uint32_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return entries_[a].exclusiveNs > entries_[b].exclusiveNs;
+  });
+  out << "   self ms   self %   total ms       calls  function\n";
+  for (size_t i = 0; i < order.size() && i < top; ++i) {
+    const Entry &e = entries_[order[i]];
+    std::snprintf(line, sizeof(line), "%10.2f  %6.1f%%  %9.2f  %10llu  %s\n",
+                  e.exclusiveNs / 1e6,
+                  totalMs > 0 ? 100.0 * (e.exclusiveNs / 1e6) / totalMs : 0.0,
+                  e.inclusiveNs / 1e6, static_cast<unsigned long long>(e.calls),
+                  frameName(order[i]).c_str());
+    out << line;
+  }
+
+  std::vector<std::pair<uint64_t, CallSite>> sites(callSites_.begin(),
+                                                   callSites_.end());
+  std::sort(sites.begin(), sites.end(), [](const auto &a, const auto &b) {
+    return a.second.inclusiveNs > b.second.inclusiveNs;
+  });
+  out << "\nHottest call sites:\n"
+      << "      line   total ms       calls  callee\n";
+  for (size_t i = 0; i < sites.size() && i < top; ++i) {
+    const auto callee = static_cast<uint32_t>(sites[i].first >> 32);
+    const auto callLine = static_cast<uint32_t>(sites[i].first);
+    std::snprintf(line, sizeof(line), "%10s  %9.2f  %10llu  %s\n",
+                  callLine ? std::to_string(callLine).c_str() : "-",
+                  sites[i].second.inclusiveNs / 1e6,
+                  static_cast<unsigned long long>(sites[i].second.calls),
+                  frameName(callee).c_str());
+    out << line;
+  }
+}
+
+bool Profiler::writeCollapsed(const std::string &path) const {
+  std::ofstream out(path, std::ios::out | std::ios::trunc);
+  if (!out)
+    return false;
+  std::string stack = "<main>";
+  std::function<void(const Node &)> visit = [&](const Node &node) {
+    if (const uint64_t n = node.samples.load(std::memory_order_relaxed))
+      out << stack << ' ' << n << '\n';
+    for (const Node *child : node.children) {
+      const size_t mark = stack.size();
+      stack += ';';
+      stack += frameName(child->entry);
+      visit(*child);
+      stack.resize(mark);
+    }
+  };
+  visit(nodes_.front());
+  return static_cast<bool>(out.flush());
+}
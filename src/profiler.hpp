@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Call profiler behind `luma --profile`.
+//
+// The interpreter opens a Scope around every call of a Luma function,
+// native or class, and around every module load. The profiler counts calls
+// and measures inclusive and exclusive wall time per callee and per call
+// site, and keeps the calls in a calling-context tree. A SIGPROF timer
+// samples that tree: the handler only bumps a counter on the node the
+// program is currently in, so it is async-signal-safe and costs nothing
+// between samples. Samples are CPU time (ITIMER_PROF), so a program
+// blocked in a sleep or a socket read gathers none.
+//
+// One profiler can sample at a time per process. Only the interpreter that
+// owns it is profiled; @std.workers threads run their own interpreters.
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Profiler(int sampleHz = 1000);
+  ~Profiler(); // stops sampling if still running
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  void start();
+  void stop();
+
+  // Top-N callees by exclusive time, then the hottest call sites.
+  void report(std::ostream &out, size_t top = 20) const;
+  // One line per sampled stack, "<main>;outer;inner <samples>", the input
+  // format of flamegraph.pl and speedscope. Returns false on I/O errors.
+  bool writeCollapsed(const std::string &path) const;
+
+  // One call frame. `key` identifies the callee (a function body, native,
+  // class or module name) and `describe()` is only invoked the first time
+  // a key is seen; it returns its display name and definition line (0 if
+  // none). `callLine` is the line of the call site (0 if none).
+  class Scope {
+  public:
+    template <class Describe>
+    Scope(Profiler *profiler, const void *key, int callLine,
+          Describe &&describe)
+        : profiler_(profiler) {
+      if (!profiler_)
+        return;
+      auto it = profiler_->entryIds_.find(key);
+      if (it == profiler_->entryIds_.end()) {
+        Entry entry;
+        describe(entry.name, entry.line);
+        const auto id = static_cast<uint32_t>(profiler_->entries_.size());
+        it = profiler_->entryIds_.emplace(key, id).first;
+        profiler_->entries_.push_back(std::move(entry));
+      }
+      profiler_->enter(*this, it->second, callLine);
+    }
+    ~Scope() {
+      if (profiler_)
+        profiler_->exit(*this);
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    friend class Profiler;
+    Profiler *profiler_;
+    Scope *parent_ = nullptr;
+    uint32_t entry_ = 0;
+    int callLine_ = 0;
+    Clock::time_point start_;
+    int64_t childNs_ = 0; // inclusive time of calls made from this frame
+  };
+
+private:
+  struct Entry {
+    std::string name;
+    int line = 0;
+    uint64_t calls = 0;
+    int64_t inclusiveNs = 0; // outermost activations only, so recursion
+    int64_t exclusiveNs = 0; // is not counted twice
+    int active = 0;          // activations currently on the stack
+  };
+  struct CallSite {
+    uint64_t calls = 0;
+    int64_t inclusiveNs = 0;
+  };
+  // Calling-context tree. Nodes are never freed while profiling, so the
+  // signal handler may touch whichever one is current.
+  struct Node {
+    uint32_t entry = 0;
+    Node *parent = nullptr;
+    std::vector<Node *> children;
+    std::atomic<uint64_t> samples{0};
+  };
+
+  int sampleHz_;
+  bool running_ = false;
+  Clock::time_point started_;
+  int64_t elapsedNs_ = 0;
+
+  std::unordered_map<const void *, uint32_t> entryIds_;
+  std::vector<Entry> entries_;
+  std::unordered_map<uint64_t, CallSite> callSites_; // entry << 32 | line
+  std::deque<Node> nodes_;                            // nodes_[0]: <main>
+  std::atomic<Node *> current_{nullptr};
+  Scope *top_ = nullptr;
+
+  void enter(Scope &scope, uint32_t entry, int callLine);
+  void exit(Scope &scope);
+  static void onSignal(int);
+  int64_t elapsedNs() const;
+  std::string frameName(uint32_t entry) const;
+};
@@ -0,0 +1,238 @@
+#include "reactor.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define LUMA_REACTOR_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) ||  \
+    defined(__NetBSD__)
+#include <sys/event.h>
+#include <sys/time.h>
+#define LUMA_REACTOR_KQUEUE 1
+#else
+#error "Reactor needs epoll or kqueue"
+#endif
+
+namespace {
+constexpr size_t kMaxEvents = 256;
+
+[[noreturn]] void fail(const char *what) {
+  throw std::runtime_error(std::string("Reactor ") + what + ": " +
+                           std::strerror(errno));
+}
+} // namespace
+
+Reactor::Reactor() {
+#if LUMA_REACTOR_EPOLL
+  pollFd_ = epoll_create1(EPOLL_CLOEXEC);
+#else
+  pollFd_ = kqueue();
+#endif
+  if (pollFd_ < 0)
+    fail("create");
+}
+
+Reactor::~Reactor() {
+  if (pollFd_ >= 0)
+    close(pollFd_);
+}
+
+double Reactor::now() {
+  using namespace std::chrono;
+  return duration<double, std::milli>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// -------------------- fd readiness --------------------
+
+void Reactor::updateInterest(int fd, Watch &watch) {
+  uint32_t wanted = (isNil(watch.onReadable) ? 0u : uint32_t(Readable)) |
+                    (isNil(watch.onWritable) ? 0u : uint32_t(Writable));
+  if (wanted == watch.registered)
+    return;
+#if LUMA_REACTOR_EPOLL
+  epoll_event ev{};
+  ev.events = (wanted & Readable ? uint32_t(EPOLLIN) : 0u) |
+              (wanted & Writable ? uint32_t(EPOLLOUT) : 0u);
+  ev.data.fd = fd;
+  int op = !watch.registered ? EPOLL_CTL_ADD
+                             : (wanted ? EPOLL_CTL_MOD : EPOLL_CTL_DEL);
+  if (epoll_ctl(pollFd_, op, fd, &ev) < 0 && op != EPOLL_CTL_DEL)
+    fail("watch");
+#else
+  struct kevent changes[2];
+  int n = 0;
+  const uint32_t changed = wanted ^ watch.registered;
+  if (changed & Readable)
+    EV_SET(&changes[n++], fd, EVFILT_READ,
+           wanted & Readable ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+  if (changed & Writable)
+    EV_SET(&changes[n++], fd, EVFILT_WRITE,
+           wanted & Writable ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+  if (kevent(pollFd_, changes, n, nullptr, 0, nullptr) < 0 && wanted)
+    fail("watch");
+#endif
+  watch.registered = wanted;
+}
+
+void Reactor::watch(int fd, Event event, Value callback) {
+  auto it = watches_.find(fd);
+  if (it == watches_.end()) {
+    if (isNil(callback))
+      return;
+    it = watches_.emplace(fd, Watch()).first;
+  }
+  Watch &w = it->second;
+  (event == Readable ? w.onReadable : w.onWritable) = std::move(callback);
+  updateInterest(fd, w);
+  if (!w.registered)
+    watches_.erase(it);
+}
+
+void Reactor::unwatch(int fd) {
+  auto it = watches_.find(fd);
+  if (it == watches_.end())
+    return;
+  it->second.onReadable = Value();
+  it->second.onWritable = Value();
+  updateInterest(fd, it->second);
+  watches_.erase(it);
+}
+
+void Reactor::poll(double timeoutMs, const Dispatch &dispatch) {
+  const int timeout =
+      timeoutMs < 0 ? -1 : static_cast<int>(std::ceil(timeoutMs));
+  // Collect first: callbacks may watch or unwatch any fd, so each one is
+  // looked up again right before it runs.
+  std::vector<std::pair<int, uint32_t>> ready;
+#if LUMA_REACTOR_EPOLL
+  epoll_event events[kMaxEvents];
+  int n = epoll_wait(pollFd_, events, kMaxEvents, timeout);
+  if (n < 0) {
+    if (errno == EINTR)
+      return;
+    fail("poll");
+  }
+  for (int i = 0; i < n; ++i) {
+    const int fd = events[i].data.fd;
+    const uint32_t e = events[i].events;
+    // Errors and hangups wake both sides so the next read or write sees them.
+    const bool broken = e & (EPOLLERR | EPOLLHUP);
+    const uint32_t readable = e & EPOLLIN || broken ? uint32_t(Readable) : 0u;
+    const uint32_t writable = e & EPOLLOUT || broken ? uint32_t(Writable) : 0u;
+    ready.push_back({fd, readable | writable});
+  }
+#else
+  struct kevent events[kMaxEvents];
+  timespec ts;
+  timespec *tsp = nullptr;
+  if (timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    tsp = &ts;
+  }
+  int n = kevent(pollFd_, nullptr, 0, events, kMaxEvents, tsp);
+  if (n < 0) {
+    if (errno == EINTR)
+      return;
+    fail("poll");
+  }
+  for (int i = 0; i < n; ++i) {
+    ready.push_back({static_cast<int>(events[i].ident),
+                     events[i].filter == EVFILT_READ ? Readable : Writable});
+  }
+#endif
+  for (const auto &[fd, events] : ready) {
+    const Value arg = static_cast<double>(fd);
+    for (Event event : {Readable, Writable}) {
+      if (!(events & event))
+        continue;
+      auto it = watches_.find(fd);
+      if (it == watches_.end())
+        break;
+      Value callback = event == Readable ? it->second.onReadable
+                                         : it->second.onWritable;
+      if (!isNil(callback))
+        dispatch(callback, {arg});
+    }
+  }
+}
+
+// -------------------- timers and deferred calls --------------------
+
+uint64_t Reactor::addTimer(double delayMs, Value callback, double intervalMs) {
+  const uint64_t id = nextTimerId_++;
+  timers_.emplace(id, Timer{std::move(callback), std::max(0.0, intervalMs)});
+  dueHeap_.push_back({now() + std::max(0.0, delayMs), id});
+  std::push_heap(dueHeap_.begin(), dueHeap_.end(), std::greater<Due>());
+  return id;
+}
+
+bool Reactor::cancelTimer(uint64_t id) { return timers_.erase(id) != 0; }
+
+void Reactor::defer(Value callback, std::vector<Value> args) {
+  deferred_.push_back({std::move(callback), std::move(args)});
+}
+
+void Reactor::fireTimers(const Dispatch &dispatch) {
+  const double t = now();
+  while (!dueHeap_.empty() && dueHeap_.front().at <= t) {
+    std::pop_heap(dueHeap_.begin(), dueHeap_.end(), std::greater<Due>());
+    const Due due = dueHeap_.back();
+    dueHeap_.pop_back();
+    auto it = timers_.find(due.id);
+    if (it == timers_.end())
+      continue; // cancelled
+    Value callback = it->second.callback;
+    if (it->second.intervalMs > 0) {
+      dueHeap_.push_back({due.at + it->second.intervalMs, due.id});
+      std::push_heap(dueHeap_.begin(), dueHeap_.end(), std::greater<Due>());
+    } else {
+      timers_.erase(it);
+    }
+    dispatch(callback, {});
+  }
+}
+
+bool Reactor::runOnce(double timeoutMs, const Dispatch &dispatch) {
+  // Callbacks deferred while these run wait for the next turn.
+  std::vector<Deferred> batch;
+  batch.swap(deferred_);
+  for (const Deferred &d : batch)
+    dispatch(d.callback, d.args);
+
+  if (!pending())
+    return false;
+
+  double wait = timeoutMs;
+  if (!deferred_.empty()) {
+    wait = 0;
+  } else {
+    while (!dueHeap_.empty() && !timers_.count(dueHeap_.front().id)) {
+      std::pop_heap(dueHeap_.begin(), dueHeap_.end(), std::greater<Due>());
+      dueHeap_.pop_back();
+    }
+    if (!dueHeap_.empty()) {
+      double untilTimer = std::max(0.0, dueHeap_.front().at - now());
+      wait = wait < 0 ? untilTimer : std::min(wait, untilTimer);
+    }
+  }
+  poll(wait, dispatch);
+  fireTimers(dispatch);
+  return pending();
+}
+
+void Reactor::run(const Dispatch &dispatch) {
+  stopped_ = false;
+  while (!stopped_ && runOnce(-1, dispatch)) {
+  }
+  stopped_ = false;
+}
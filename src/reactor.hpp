@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "value.hpp"
+
+// Single-threaded event loop behind @std.reactor: fd readiness through epoll
+// (Linux) or kqueue (macOS and the BSDs), timers on a monotonic-clock
+// min-heap, and a queue of deferred callbacks that runs before each poll.
+//
+// The reactor only stores callbacks; running them is left to the Dispatch
+// function so that calls go through the interpreter. Errors raised by a
+// callback propagate out of run()/runOnce().
+class Reactor {
+public:
+  enum Event : uint32_t { Readable = 1, Writable = 2 };
+  using Dispatch =
+      std::function<void(const Value &callback, const std::vector<Value> &args)>;
+
+  Reactor(); // throws std::runtime_error if the poller cannot be created
+  ~Reactor();
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  // Calls `callback(fd)` whenever `fd` is ready for `event`, replacing any
+  // earlier callback for that pair. A nil callback stops watching `event`.
+  void watch(int fd, Event event, Value callback);
+  void unwatch(int fd);
+
+  // Calls `callback()` after `delayMs`, then every `intervalMs` if non-zero.
+  uint64_t addTimer(double delayMs, Value callback, double intervalMs = 0);
+  bool cancelTimer(uint64_t id);
+
+  // Calls `callback(args...)` on the next turn of the loop.
+  void defer(Value callback, std::vector<Value> args = {});
+
+  // One turn: deferred callbacks, then a poll that waits at most
+  // `timeoutMs` (negative: until the next timer or fd event), then due
+  // timers. Returns whether work is still pending.
+  bool runOnce(double timeoutMs, const Dispatch &dispatch);
+  // Turns until nothing is pending or stop() is called.
+  void run(const Dispatch &dispatch);
+  void stop() { stopped_ = true; }
+
+  bool pending() const {
+    return !deferred_.empty() || !timers_.empty() || !watches_.empty();
+  }
+
+  static double now(); // monotonic milliseconds
+
+private:
+  struct Watch {
+    Value onReadable;
+    Value onWritable;
+    uint32_t registered = 0; // events the poller currently reports
+  };
+  struct Timer {
+    Value callback;
+    double intervalMs;
+  };
+  struct Due {
+    double at;
+    uint64_t id;
+    bool operator>(const Due &o) const {
+      return at != o.at ? at > o.at : id > o.id;
+    }
+  };
+  struct Deferred {
+    Value callback;
+    std::vector<Value> args;
+  };
+
+  int pollFd_ = -1;
+  std::unordered_map<int, Watch> watches_;
+  std::unordered_map<uint64_t, Timer> timers_;
+  std::vector<Due> dueHeap_; // min-heap; cancelled ids are skipped lazily
+  std::vector<Deferred> deferred_;
+  uint64_t nextTimerId_ = 1;
+  bool stopped_ = false;
+
+  void updateInterest(int fd, Watch &watch);
+  void poll(double timeoutMs, const Dispatch &dispatch);
+  void fireTimers(const Dispatch &dispatch);
+};
@@ -0,0 +1,254 @@
+#include "resolver.hpp"
+
+Resolver::Resolver(std::unordered_set<Symbol> knownGlobals)
+    : globals_(std::move(knownGlobals)) {}
+
+void Resolver::resolve(std::vector<StmtPtr> &program) {
+  // Names bound at the top level may be reassigned from inside functions and
+  // blocks, so assignments to them must stay name-based everywhere.
+  for (const auto &stmt : program) {
+    if (auto *a = dynamic_cast<VarAssignStmt *>(stmt.get()))
+      globals_.insert(a->name.symbol);
+    else if (auto *f = dynamic_cast<FuncDefStmt *>(stmt.get()))
+      globals_.insert(f->name.symbol);
+    else if (auto *c = dynamic_cast<ClassStmt *>(stmt.get()))
+      globals_.insert(c->name.symbol);
+    else if (auto *u = dynamic_cast<UseStmt *>(stmt.get()))
+      globals_.insert(u->alias.symbol);
+  }
+
+  for (auto &stmt : program)
+    statement(*stmt);
+}
+
+// -------------------- scopes --------------------
+
+Slot Resolver::lookup(Symbol name) const {
+  for (size_t d = 0; d < scopes_.size(); ++d) {
+    const auto &names = scopes_[scopes_.size() - 1 - d]->names;
+    // Scan backwards so a repeated parameter name binds to the last one,
+    // as it did when parameters were defined one after another by name.
+    for (size_t i = names.size(); i-- > 0;) {
+      if (names[i] == name)
+        return {static_cast<int>(d), static_cast<int>(i)};
+    }
+  }
+  return {};
+}
+
+Slot Resolver::declare(Symbol name) {
+  if (scopes_.empty())
+    return {}; // top level: bound by name
+  auto &names = scopes_.back()->names;
+  for (size_t i = names.size(); i-- > 0;) {
+    if (names[i] == name)
+      return {0, static_cast<int>(i)};
+  }
+  names.push_back(name);
+  return {0, static_cast<int>(names.size() - 1)};
+}
+
+Slot Resolver::assignTarget(Symbol name) {
+  Slot slot = lookup(name);
+  if (slot.resolved() || globals_.count(name))
+    return slot;
+  return declare(name);
+}
+
+void Resolver::block(BlockStmt &block) {
+  scopes_.push_back(&block.scope);
+  for (auto &stmt : block.statements)
+    statement(*stmt);
+  scopes_.pop_back();
+}
+
+void Resolver::function(FuncDefStmt &fn, bool method) {
+  ScopeInfo &scope = fn.body->scope;
+  scopes_.push_back(&scope);
+  if (method) {
+    scope.receiver = true;
+    scope.names.push_back(intern("this"));
+  }
+  for (const auto &param : fn.params)
+    scope.names.push_back(param.symbol);
+  // The body runs directly in the call environment, next to the parameters.
+  for (auto &stmt : fn.body->statements)
+    statement(*stmt);
+  scopes_.pop_back();
+}
+
+// -------------------- statements --------------------
+
+void Resolver::statement(Stmt &stmt) {
+  if (auto *x = dynamic_cast<ExprStmt *>(&stmt)) {
+    expression(*x->expr);
+    return;
+  }
+
+  if (auto *p = dynamic_cast<PrintStmt *>(&stmt)) {
+    expression(*p->expr);
+    return;
+  }
+
+  if (auto *a = dynamic_cast<VarAssignStmt *>(&stmt)) {
+    expression(*a->value); // the value is evaluated before the name binds
+    a->slot = assignTarget(a->name.symbol);
+    a->appended = nullptr;
+    auto *sum = dynamic_cast<BinaryExpr *>(a->value.get());
+    if (sum && sum->op.type == TokenType::Plus) {
+      auto *var = dynamic_cast<VariableExpr *>(sum->left.get());
+      if (var && var->name.symbol == a->name.symbol &&
+          var->slot.depth == a->slot.depth && var->slot.index == a->slot.index)
+        a->appended = sum->right.get();
+    }
+    return;
+  }
+
+  if (auto *b = dynamic_cast<BlockStmt *>(&stmt)) {
+    block(*b);
+    return;
+  }
+
+  if (auto *i = dynamic_cast<IfStmt *>(&stmt)) {
+    expression(*i->condition);
+    block(*i->thenBranch);
+    if (i->elseBranch)
+      statement(*i->elseBranch); // a BlockStmt or an else-if IfStmt
+    return;
+  }
+
+  if (auto *w = dynamic_cast<WhileStmt *>(&stmt)) {
+    expression(*w->condition);
+    block(*w->body);
+    return;
+  }
+
+  if (auto *u = dynamic_cast<UntilStmt *>(&stmt)) {
+    expression(*u->condition);
+    block(*u->body);
+    return;
+  }
+
+  if (auto *r = dynamic_cast<ReturnStmt *>(&stmt)) {
+    if (r->value)
+      expression(*r->value);
+    return;
+  }
+
+  if (auto *f = dynamic_cast<FuncDefStmt *>(&stmt)) {
+    // Bind the name first so the body can refer to itself recursively.
+    f->slot = declare(f->name.symbol);
+    function(*f, false);
+    return;
+  }
+
+  if (auto *c = dynamic_cast<ClassStmt *>(&stmt)) {
+    c->slot = declare(c->name.symbol);
+    for (auto &method : c->methods)
+      function(*method, true);
+    return;
+  }
+
+  if (auto *e = dynamic_cast<EchoStmt *>(&stmt)) {
+    expression(*e->count);
+    block(*e->body);
+    return;
+  }
+
+  if (auto *s = dynamic_cast<SwapStmt *>(&stmt)) {
+    s->leftSlot = lookup(s->left.symbol);
+    s->rightSlot = lookup(s->right.symbol);
+    return;
+  }
+
+  if (auto *m = dynamic_cast<MaybeStmt *>(&stmt)) {
+    block(*m->tryBlock);
+    if (m->otherwiseBlock)
+      block(*m->otherwiseBlock);
+    return;
+  }
+
+  if (auto *use = dynamic_cast<UseStmt *>(&stmt)) {
+    use->slot = declare(use->alias.symbol);
+    return;
+  }
+
+  // ModuleStmt has nothing to resolve.
+}
+
+// -------------------- expressions --------------------
+
+void Resolver::expression(Expr &expr) {
+  if (auto *v = dynamic_cast<VariableExpr *>(&expr)) {
+    v->slot = lookup(v->name.symbol);
+    return;
+  }
+
+  if (auto *th = dynamic_cast<ThisExpr *>(&expr)) {
+    th->slot = lookup(th->keyword.symbol);
+    return;
+  }
+
+  if (auto *g = dynamic_cast<GroupingExpr *>(&expr)) {
+    expression(*g->expr);
+    return;
+  }
+
+  if (auto *u = dynamic_cast<UnaryExpr *>(&expr)) {
+    expression(*u->right);
+    return;
+  }
+
+  if (auto *b = dynamic_cast<BinaryExpr *>(&expr)) {
+    expression(*b->left);
+    expression(*b->right);
+    return;
+  }
+
+  if (auto *c = dynamic_cast<CallExpr *>(&expr)) {
+    expression(*c->callee);
+    for (auto &a : c->args)
+      expression(*a);
+    return;
+  }
+
+  if (auto *ix = dynamic_cast<IndexExpr *>(&expr)) {
+    expression(*ix->object);
+    expression(*ix->index);
+    return;
+  }
+
+  if (auto *is = dynamic_cast<IndexSetExpr *>(&expr)) {
+    expression(*is->object);
+    expression(*is->index);
+    expression(*is->value);
+    return;
+  }
+
+  if (auto *list = dynamic_cast<ListExpr *>(&expr)) {
+    for (auto &e : list->elements)
+      expression(*e);
+    return;
+  }
+
+  if (auto *get = dynamic_cast<GetExpr *>(&expr)) {
+    expression(*get->object);
+    return;
+  }
+
+  if (auto *set = dynamic_cast<SetExpr *>(&expr)) {
+    expression(*set->object);
+    expression(*set->value);
+    return;
+  }
+
+  if (auto *mp = dynamic_cast<MapExpr *>(&expr)) {
+    for (size_t i = 0; i < mp->keys.size(); ++i) {
+      expression(*mp->keys[i]);
+      expression(*mp->values[i]);
+    }
+    return;
+  }
+
+  // LiteralExpr has nothing to resolve.
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <unordered_set>
+#include <vector>
+
+#include "ast.hpp"
+
+// Static pass between the parser and the interpreter that assigns every
+// block and function scope a slot layout (BlockStmt::scope) and annotates
+// variable reads and writes with their lexical address (Slot).
+//
+// Luma has no declarations: `x = v` assigns an existing `x` or defines a new
+// local. The resolver mirrors that rule at compile time. An assignment to a
+// name already declared in an enclosing resolved scope targets that slot; an
+// assignment to a name that may live in the dynamic top-level scope (it is
+// assigned at the top level of the program, or already defined in the
+// environment the program runs in) stays name-based; anything else declares
+// a new slot in the innermost scope. Top-level code itself is never
+// slot-resolved, so globals and module exports keep name-based lookup.
+class Resolver {
+public:
+  // `knownGlobals`: names already defined where the program will run.
+  explicit Resolver(std::unordered_set<Symbol> knownGlobals = {});
+
+  void resolve(std::vector<StmtPtr> &program);
+
+private:
+  std::unordered_set<Symbol> globals_;
+  std::vector<ScopeInfo *> scopes_; // innermost last
+
+  void statement(Stmt &stmt);
+  void expression(Expr &expr);
+  void block(BlockStmt &block);
+  void function(FuncDefStmt &fn, bool method);
+
+  Slot lookup(Symbol name) const;
+  Slot declare(Symbol name);
+  Slot assignTarget(Symbol name);
+};
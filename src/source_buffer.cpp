@@ -0,0 +1,83 @@
+#include "source_buffer.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::SourceBuffer(std::string_view text) {
+  if (text.empty())
+    return;
+  owned_.reset(new char[text.size()]);
+  std::memcpy(owned_.get(), text.data(), text.size());
+  data_ = owned_.get();
+  size_ = text.size();
+}
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other) noexcept {
+  if (this != &other) {
+    release();
+    owned_ = std::move(other.owned_);
+    data_ = other.data_;
+    size_ = other.size_;
+    mapped_ = other.mapped_;
+    other.data_ = "";
+    other.size_ = 0;
+    other.mapped_ = false;
+  }
+  return *this;
+}
+
+void SourceBuffer::release() {
+  if (mapped_)
+    munmap(const_cast<char *>(data_), size_);
+  owned_.reset();
+  data_ = "";
+  size_ = 0;
+  mapped_ = false;
+}
+
+bool SourceBuffer::openFile(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  release();
+  const size_t size = static_cast<size_t>(st.st_size);
+
+  if (size >= kMapThreshold) {
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      ::close(fd);
+      data_ = static_cast<const char *>(map);
+      size_ = size;
+      mapped_ = true;
+      return true;
+    }
+  }
+
+  // Small files (and filesystems that can't map) are read in one go.
+  std::unique_ptr<char[]> buffer(new char[size ? size : 1]);
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n = ::read(fd, buffer.get() + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // error, or the file shrank since fstat()
+    done += static_cast<size_t>(n);
+  }
+  ::close(fd);
+  owned_ = std::move(buffer);
+  data_ = owned_.get();
+  size_ = done;
+  return done == size;
+}
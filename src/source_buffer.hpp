@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// The text of one source file or string. Tokens and parse trees point into
+// it, so it lives alongside them (see Program in ast.hpp) and its bytes
+// never move, even when the buffer itself does.
+//
+// Large files are mapped read-only instead of read, so a module's source is
+// never copied at all. A mapped file must not be truncated while the
+// module is loaded.
+class SourceBuffer {
+public:
+  SourceBuffer() = default;
+  explicit SourceBuffer(std::string_view text); // copies `text`
+  ~SourceBuffer();
+  SourceBuffer(SourceBuffer &&other) noexcept { *this = std::move(other); }
+  SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+  // Replaces the contents with the file at `path`; false if it can't be read.
+  bool openFile(const std::string &path);
+
+  std::string_view text() const { return {data_, size_}; }
+  bool mapped() const { return mapped_; }
+
+private:
+  static constexpr size_t kMapThreshold = 64 * 1024;
+
+  std::unique_ptr<char[]> owned_; // when read rather than mapped
+  const char *data_ = "";
+  size_t size_ = 0;
+  bool mapped_ = false;
+
+  void release();
+};
@@ -0,0 +1,191 @@
+#include "string_ops.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#define LUMA_STRING_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define LUMA_STRING_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr size_t kBlock = 16;
+
+inline int lowestBit(uint64_t mask) { return __builtin_ctzll(mask); }
+
+#if LUMA_STRING_SSE2
+
+// Bit i set when byte i of both blocks matches the needle's first and last
+// byte respectively.
+inline uint64_t candidateMask(const char *first, const char *last,
+                              __m128i firstByte, __m128i lastByte) {
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(last));
+  return static_cast<uint32_t>(_mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(a, firstByte), _mm_cmpeq_epi8(b, lastByte))));
+}
+constexpr int kMaskBitsPerByte = 1;
+
+#elif LUMA_STRING_NEON
+
+// NEON has no movemask; narrowing the comparison gives four bits per byte.
+inline uint64_t candidateMask(const char *first, const char *last,
+                              uint8x16_t firstByte, uint8x16_t lastByte) {
+  uint8x16_t a = vld1q_u8(reinterpret_cast<const uint8_t *>(first));
+  uint8x16_t b = vld1q_u8(reinterpret_cast<const uint8_t *>(last));
+  uint8x16_t eq = vandq_u8(vceqq_u8(a, firstByte), vceqq_u8(b, lastByte));
+  return vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+constexpr int kMaskBitsPerByte = 4;
+
+#endif
+
+// Needles of two or more bytes. Compares the needle's first and last bytes
+// against 16 positions at once and checks the middle only where both match,
+// which skips most of the text on real inputs.
+size_t findLong(const char *s, size_t n, const char *needle, size_t k) {
+  size_t i = 0;
+#if LUMA_STRING_SSE2 || LUMA_STRING_NEON
+#if LUMA_STRING_SSE2
+  const __m128i firstByte = _mm_set1_epi8(needle[0]);
+  const __m128i lastByte = _mm_set1_epi8(needle[k - 1]);
+#else
+  const uint8x16_t firstByte = vdupq_n_u8(static_cast<uint8_t>(needle[0]));
+  const uint8x16_t lastByte = vdupq_n_u8(static_cast<uint8_t>(needle[k - 1]));
+#endif
+  for (; i + k - 1 + kBlock <= n; i += kBlock) {
+    uint64_t mask = candidateMask(s + i, s + i + k - 1, firstByte, lastByte);
+    while (mask) {
+      const int bit = lowestBit(mask);
+      const size_t at = i + bit / kMaskBitsPerByte;
+      if (std::memcmp(s + at + 1, needle + 1, k - 2) == 0)
+        return at;
+      // Drop this byte's bits.
+      mask &= ~(((uint64_t(1) << kMaskBitsPerByte) - 1)
+                << (bit & ~(kMaskBitsPerByte - 1)));
+    }
+  }
+#endif
+  size_t at = std::string_view(s + i, n - i).find(std::string_view(needle, k));
+  return at == std::string_view::npos ? at : i + at;
+}
+
+// Adds `delta` to every byte in [lo, hi].
+void shiftRange(std::string &str, char lo, char hi, int delta) {
+  char *s = str.data();
+  const size_t n = str.size();
+  size_t i = 0;
+#if LUMA_STRING_SSE2
+  // Signed bytes: moving lo to -128 turns the range test into one compare.
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(-128 - lo));
+  const __m128i limit = _mm_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1));
+  const __m128i change = _mm_set1_epi8(static_cast<char>(delta));
+  for (; i + kBlock <= n; i += kBlock) {
+    __m128i *p = reinterpret_cast<__m128i *>(s + i);
+    __m128i v = _mm_loadu_si128(p);
+    __m128i inRange = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+    _mm_storeu_si128(p, _mm_add_epi8(v, _mm_and_si128(inRange, change)));
+  }
+#elif LUMA_STRING_NEON
+  const uint8x16_t low = vdupq_n_u8(static_cast<uint8_t>(lo));
+  const uint8x16_t high = vdupq_n_u8(static_cast<uint8_t>(hi));
+  const uint8x16_t change = vdupq_n_u8(static_cast<uint8_t>(delta));
+  for (; i + kBlock <= n; i += kBlock) {
+    uint8_t *p = reinterpret_cast<uint8_t *>(s + i);
+    uint8x16_t v = vld1q_u8(p);
+    uint8x16_t inRange = vandq_u8(vcgeq_u8(v, low), vcleq_u8(v, high));
+    vst1q_u8(p, vaddq_u8(v, vandq_u8(inRange, change)));
+  }
+#endif
+  for (; i < n; ++i) {
+    if (s[i] >= lo && s[i] <= hi)
+      s[i] = static_cast<char>(s[i] + delta);
+  }
+}
+
+bool isSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+} // namespace
+
+size_t findSubstring(std::string_view haystack, std::string_view needle,
+                     size_t from) {
+  if (from > haystack.size())
+    return std::string_view::npos;
+  const char *s = haystack.data() + from;
+  const size_t n = haystack.size() - from;
+  if (needle.empty())
+    return from;
+  if (needle.size() > n)
+    return std::string_view::npos;
+  if (needle.size() == 1) {
+    // memchr is already vectorized by the C library.
+    const void *hit = std::memchr(s, needle[0], n);
+    return hit ? static_cast<const char *>(hit) - haystack.data()
+               : std::string_view::npos;
+  }
+  size_t at = findLong(s, n, needle.data(), needle.size());
+  return at == std::string_view::npos ? at : from + at;
+}
+
+size_t countSubstring(std::string_view haystack, std::string_view needle) {
+  size_t count = 0;
+  for (size_t at = findSubstring(haystack, needle);
+       at != std::string_view::npos;
+       at = findSubstring(haystack, needle, at + needle.size()))
+    ++count;
+  return count;
+}
+
+std::string replaceAll(std::string_view haystack, std::string_view from,
+                       std::string_view to) {
+  std::string out;
+  size_t at = findSubstring(haystack, from);
+  if (at == std::string_view::npos)
+    return std::string(haystack);
+  if (from.size() == to.size()) {
+    out.assign(haystack);
+    for (; at != std::string_view::npos;
+         at = findSubstring(haystack, from, at + from.size()))
+      out.replace(at, to.size(), to);
+    return out;
+  }
+  // Sized once from the first match on; the count needs a second pass only
+  // when the result grows.
+  if (to.size() > from.size())
+    out.reserve(haystack.size() +
+                countSubstring(haystack.substr(at), from) *
+                    (to.size() - from.size()));
+  else
+    out.reserve(haystack.size());
+  size_t start = 0;
+  for (; at != std::string_view::npos;
+       at = findSubstring(haystack, from, start)) {
+    out.append(haystack.data() + start, at - start);
+    out.append(to);
+    start = at + from.size();
+  }
+  out.append(haystack.data() + start, haystack.size() - start);
+  return out;
+}
+
+void asciiUpper(std::string &s) { shiftRange(s, 'a', 'z', 'A' - 'a'); }
+
+void asciiLower(std::string &s) { shiftRange(s, 'A', 'Z', 'a' - 'A'); }
+
+std::string_view trimWhitespace(std::string_view s) {
+  // Only the whitespace itself is read, so there is nothing to vectorize.
+  size_t start = 0;
+  while (start < s.size() && isSpace(s[start]))
+    ++start;
+  size_t end = s.size();
+  while (end > start && isSpace(s[end - 1]))
+    --end;
+  return s.substr(start, end - start);
+}
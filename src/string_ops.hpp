@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Byte-string kernels behind @std.string.
+//
+// Substring search and ASCII case conversion work on 16 bytes at a time
+// with SSE2 on x86 and NEON on ARM, and fall back to portable loops
+// elsewhere. Strings are treated as bytes: case conversion only changes
+// ASCII letters and positions are byte offsets, as len() counts them.
+
+// Position of the first `needle` at or after `from`, or npos. An empty
+// needle is found at `from` (when that is within the string).
+size_t findSubstring(std::string_view haystack, std::string_view needle,
+                     size_t from = 0);
+
+// Non-overlapping occurrences of a non-empty `needle`.
+size_t countSubstring(std::string_view haystack, std::string_view needle);
+
+// `haystack` with every non-overlapping `from` (non-empty) replaced by `to`.
+std::string replaceAll(std::string_view haystack, std::string_view from,
+                       std::string_view to);
+
+void asciiUpper(std::string &s);
+void asciiLower(std::string &s);
+
+// `s` without leading and trailing ASCII whitespace (as isspace() in the C
+// locale: space, \t, \n, \v, \f, \r).
+std::string_view trimWhitespace(std::string_view s);
@@ -1,5 +1,7 @@
 #pragma once
-#include <string>
+#include <string_view>
+
+#include "intern.hpp"
 
 enum class TokenType {
   // Single-character tokens
@@ -192,6 +194,9 @@ inline const char *tokenTypeName(TokenType t) {
 
 struct Token {
   TokenType type;
-  std::string lexeme; // the exact text
+  // The exact text: a view into the program's SourceBuffer, or for trees
+  // read from the module cache, into the symbol table or the AstArena.
+  std::string_view lexeme;
   int line;
+  Symbol symbol = 0; // interned lexeme, for identifiers and keywords
 };
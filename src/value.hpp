@@ -1,110 +1,403 @@
 #pragma once
+#include <atomic>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <iomanip>
-#include <map>
 #include <memory>
+#include <new>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
 #include "ast.hpp"
+#include "object.hpp"
+#include "ordered_map.hpp"
 #include "token.hpp"
 
 class Environment;
 
-struct Function {
-  Token name;
-  std::vector<Token> params;
-  const BlockStmt *body = nullptr;
-  std::shared_ptr<Environment> closure;
-
-  size_t arity() const { return params.size(); }
-};
-
-using FunctionPtr = std::shared_ptr<Function>;
-struct List; // Forward decl
-using ListPtr = std::shared_ptr<List>;
+struct Function;
+using FunctionPtr = Ref<Function>;
+struct List;
+using ListPtr = Ref<List>;
 struct LumaClass;
-using ClassPtr = std::shared_ptr<LumaClass>;
+using ClassPtr = Ref<LumaClass>;
 struct LumaInstance;
-using InstancePtr = std::shared_ptr<LumaInstance>;
+using InstancePtr = Ref<LumaInstance>;
 struct LumaMap;
-using MapPtr = std::shared_ptr<LumaMap>;
-
-// Forward declaration of Value for NativeFunction
-struct ValueWrapper;
-// We need a recursive definition for NativeFunction -> Value -> NativeFunction.
-// But std::variant is fine with incomplete types if we use pointers? No, Value
-// is by value. NativeFunction is std::function. std::function needs complete
-// type for operator(). But we can define NativeFunction as taking
-// vector<variant...>. Wait, Value is defined right here.
-
-// Circular dependency: Value depends on NativeFunction, NativeFunction depends
-// on Value. Solution: Use a struct wrapper or declared type.
-// Actually, std::function<Value(const std::vector<Value>&)> works if Value is
-// forward declared? No, it needs to know size.
-// The standard way is using std::any or void*, or a wrapper struct.
-// Let's forward declare Value, but we can't fully define NativeFunction before
-// Value.
-// HOWEVER, std::function types are erased. We can define NativeFunction with a
-// forward declared Value? No.
-// Let's define Value first, but without NativeFunction, then add it? No.
+using MapPtr = Ref<LumaMap>;
+struct NativeFunctionObject;
+using NativeFunctionPtr = Ref<NativeFunctionObject>;
+struct ByteBuffer;
+using BufferPtr = Ref<ByteBuffer>;
+
+// Every Luma value in 16 bytes: a type tag plus either an unboxed number or
+// bool, or one intrusive reference to a heap object. Strings are immutable
+// StringObjects, so copying a string value never copies its characters.
 //
-// Workaround: Define NativeFunction as a struct that holds the std::function?
-// Or simply use std::shared_ptr<NativeFunctionImpl> where NativeFunctionImpl
-// is defined later?
-// Lox uses a class for NativeFunction. Let's use a shared pointer to a struct.
+// The accessors mirror std::variant (get_if, get, holds_alternative, with
+// std::monostate as nil) so call sites read the same as before; the one
+// difference is that string access is always const.
+class Value {
+public:
+  // Same order as the alternatives of the former std::variant.
+  enum class Type : uint8_t {
+    Nil,
+    Number,
+    String,
+    Bool,
+    Function,
+    List,
+    Class,
+    Instance,
+    Map,
+    Native,
+    Buffer,
+  };
 
-struct NativeFunctionObject;
-using NativeFunctionPtr = std::shared_ptr<NativeFunctionObject>;
+  Value() noexcept : type_(Type::Nil), number_(0) {}
+  Value(std::monostate) noexcept : Value() {}
+  Value(double d) noexcept : type_(Type::Number), number_(d) {}
+  // Only a real bool: pointers and ints must not silently become booleans.
+  template <class B,
+            std::enable_if_t<std::is_same<B, bool>::value, int> = 0>
+  Value(B b) noexcept : type_(Type::Bool), boolean_(b) {}
+  Value(std::string s)
+      : Value(makeRef<StringObject>(std::move(s))) {}
+  Value(const char *s) : Value(std::string(s)) {}
+  Value(Ref<StringObject> s) : type_(Type::String), string_(std::move(s)) {}
+  Value(FunctionPtr f) : type_(Type::Function), function_(std::move(f)) {}
+  Value(ListPtr l) : type_(Type::List), list_(std::move(l)) {}
+  Value(ClassPtr c) : type_(Type::Class), class_(std::move(c)) {}
+  Value(InstancePtr i) : type_(Type::Instance), instance_(std::move(i)) {}
+  Value(MapPtr m) : type_(Type::Map), map_(std::move(m)) {}
+  Value(NativeFunctionPtr n) : type_(Type::Native), native_(std::move(n)) {}
+  Value(BufferPtr b) : type_(Type::Buffer), buffer_(std::move(b)) {}
+
+  Value(const Value &other) : type_(Type::Nil), number_(0) { copyFrom(other); }
+  Value(Value &&other) noexcept : type_(Type::Nil), number_(0) {
+    stealFrom(other);
+  }
+  Value &operator=(const Value &other) {
+    if (this != &other) {
+      Value copy(other);
+      destroy();
+      stealFrom(copy);
+    }
+    return *this;
+  }
+  Value &operator=(Value &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      stealFrom(other);
+    }
+    return *this;
+  }
+  ~Value() { destroy(); }
+
+  Type type() const { return type_; }
+  size_t index() const { return static_cast<size_t>(type_); }
+
+  // The shared string object, for callers that want to keep or compare it.
+  const Ref<StringObject> *stringObject() const {
+    return type_ == Type::String ? &string_ : nullptr;
+  }
+
+private:
+  Type type_;
+  union {
+    double number_;
+    bool boolean_;
+    Ref<StringObject> string_;
+    FunctionPtr function_;
+    ListPtr list_;
+    ClassPtr class_;
+    InstancePtr instance_;
+    MapPtr map_;
+    NativeFunctionPtr native_;
+    BufferPtr buffer_;
+  };
+
+  template <class T> friend struct ValueAccess;
 
-using Value =
-    std::variant<std::monostate, double, std::string, bool, FunctionPtr,
-                 ListPtr, ClassPtr, InstancePtr, MapPtr, NativeFunctionPtr>; // monostate = nil
+  bool holdsObject() const {
+    return type_ != Type::Nil && type_ != Type::Number && type_ != Type::Bool;
+  }
+  inline void copyFrom(const Value &other);
+  inline void destroy() noexcept;
+
+  // Every payload is a number, a bool or a single pointer, so moving a value
+  // is a bitwise copy that leaves the source as nil.
+  void stealFrom(Value &other) noexcept {
+    type_ = other.type_;
+    std::memcpy(static_cast<void *>(&number_),
+                static_cast<const void *>(&other.number_), sizeof(number_));
+    other.type_ = Type::Nil;
+    other.number_ = 0;
+  }
+};
 
-struct NativeFunctionObject {
+static_assert(sizeof(Value) == 16, "Value should stay two words wide");
+
+// Environment is incomplete here, so the members that touch `closure` are
+// defined in environment.cpp.
+struct Function : GcObject {
+  Token name;
+  std::vector<Token> params;
+  const BlockStmt *body = nullptr;
+  Ref<Environment> closure;
+  InstancePtr receiver; // bound 'this' for methods read off an instance
+
+  Function() = default;
+  Function(const Function &other);
+  ~Function() override;
+  void traceRefs(GcVisitor visit, void *context) const override;
+  void clearRefs() override;
+
+  size_t arity() const { return params.size(); }
+};
+
+struct NativeFunctionObject : RefCounted {
     std::function<Value(const std::vector<Value>&)> func;
     std::string name; // for debugging
     size_t arity = 0; // -1 for variadic? Let's generic size_t.
     bool variadic = false;
 };
 
-struct List {
+struct List : GcObject {
   std::vector<Value> elements;
+
+  void traceRefs(GcVisitor visit, void *context) const override;
+  void clearRefs() override;
 };
 
-struct LumaMap {
-  std::map<std::string, Value> values;
+// Mutable, contiguous bytes (@std.buffer, socket payloads): one byte per
+// byte instead of one Value per byte.
+struct ByteBuffer : RefCounted {
+  std::vector<uint8_t> bytes;
+
+  ByteBuffer() = default;
+  explicit ByteBuffer(std::vector<uint8_t> b) : bytes(std::move(b)) {}
+  ByteBuffer(const char *data, size_t size)
+      : bytes(reinterpret_cast<const uint8_t *>(data),
+              reinterpret_cast<const uint8_t *>(data) + size) {}
 };
 
-struct LumaClass {
+// Keys iterate in insertion order, which is also the order maps print in.
+struct LumaMap : GcObject {
+  OrderedMap<Value> values;
+
+  LumaMap() = default;
+  // Pre-sizes the table for `capacity` keys.
+  explicit LumaMap(size_t capacity) { values.reserve(capacity); }
+
+  void traceRefs(GcVisitor visit, void *context) const override;
+  void clearRefs() override;
+};
+
+// Hidden class: the field layout shared by every instance that gained the
+// same fields in the same order. Each class owns a transition tree of shapes
+// rooted at LumaClass::rootShape; ids are unique for the whole process, so
+// inline caches can key on them without worrying about reused addresses.
+struct Shape {
+  uint64_t id = nextId();
+  std::vector<Symbol> fields; // slot index -> field name
+  std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions;
+
+  int slotOf(Symbol name) const {
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (fields[i] == name)
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  // The shape reached by adding `name` after this shape's fields.
+  Shape *withField(Symbol name) {
+    std::unique_ptr<Shape> &next = transitions[name];
+    if (!next) {
+      next = std::make_unique<Shape>();
+      next->fields = fields;
+      next->fields.push_back(name);
+    }
+    return next.get();
+  }
+
+private:
+  static uint64_t nextId() {
+    static std::atomic<uint64_t> counter{1};
+    return counter.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+struct LumaClass : GcObject {
   std::string name;
-  std::map<std::string, FunctionPtr> methods;
+  std::unordered_map<Symbol, FunctionPtr> methods;
+  std::unique_ptr<Shape> rootShape = std::make_unique<Shape>();
+
+  void traceRefs(GcVisitor visit, void *context) const override;
+  void clearRefs() override;
 
-  FunctionPtr findMethod(const std::string &name) {
-    if (methods.count(name))
-      return methods.at(name);
+  FunctionPtr findMethod(Symbol name) const {
+    auto it = methods.find(name);
+    if (it != methods.end())
+      return it->second;
     return nullptr;
   }
 };
 
-struct LumaInstance {
+struct LumaInstance : GcObject {
   ClassPtr klass;
-  std::map<std::string, Value> fields;
+  Shape *shape; // owned by klass
+  std::vector<Value> fields; // laid out by shape
+
+  LumaInstance(ClassPtr k) : klass(k), shape(klass->rootShape.get()) {}
+
+  void traceRefs(GcVisitor visit, void *context) const override;
+  void clearRefs() override;
+
+  const Value *field(Symbol name) const {
+    int slot = shape->slotOf(name);
+    return slot < 0 ? nullptr : &fields[slot];
+  }
 
-  LumaInstance(ClassPtr k) : klass(k) {}
+  void setField(Symbol name, Value value) {
+    int slot = shape->slotOf(name);
+    if (slot >= 0) {
+      fields[slot] = std::move(value);
+      return;
+    }
+    shape = shape->withField(name);
+    fields.push_back(std::move(value));
+  }
+};
+
+#define LUMA_VALUE_OBJECTS(X)                                                  \
+  X(String, string_, Ref<StringObject>)                                        \
+  X(Function, function_, FunctionPtr)                                          \
+  X(List, list_, ListPtr)                                                      \
+  X(Class, class_, ClassPtr)                                                   \
+  X(Instance, instance_, InstancePtr)                                          \
+  X(Map, map_, MapPtr)                                                         \
+  X(Native, native_, NativeFunctionPtr)                                        \
+  X(Buffer, buffer_, BufferPtr)
+
+inline void Value::copyFrom(const Value &other) {
+  switch (other.type_) {
+  case Type::Nil:
+  case Type::Number:
+  case Type::Bool:
+    number_ = other.number_; // copies the bool too
+    break;
+#define LUMA_COPY_OBJECT(TAG, MEMBER, PTR)                                     \
+  case Type::TAG:                                                              \
+    new (&MEMBER) PTR(other.MEMBER);                                           \
+    break;
+    LUMA_VALUE_OBJECTS(LUMA_COPY_OBJECT)
+#undef LUMA_COPY_OBJECT
+  }
+  type_ = other.type_;
+}
+
+inline void Value::destroy() noexcept {
+  if (!holdsObject())
+    return;
+  switch (type_) {
+#define LUMA_DESTROY_OBJECT(TAG, MEMBER, PTR)                                  \
+  case Type::TAG:                                                              \
+    MEMBER.~PTR();                                                             \
+    break;
+    LUMA_VALUE_OBJECTS(LUMA_DESTROY_OBJECT)
+#undef LUMA_DESTROY_OBJECT
+  default:
+    break;
+  }
+  type_ = Type::Nil;
+  number_ = 0;
+}
+
+// ---------- variant-style access ----------
+
+template <class T> struct ValueAccess;
+
+template <> struct ValueAccess<std::monostate> {
+  static constexpr Value::Type type = Value::Type::Nil;
 };
 
+template <> struct ValueAccess<double> {
+  static constexpr Value::Type type = Value::Type::Number;
+  static double *get(Value &v) { return &v.number_; }
+  static const double *get(const Value &v) { return &v.number_; }
+};
+
+template <> struct ValueAccess<bool> {
+  static constexpr Value::Type type = Value::Type::Bool;
+  static bool *get(Value &v) { return &v.boolean_; }
+  static const bool *get(const Value &v) { return &v.boolean_; }
+};
+
+// Strings are immutable: both overloads hand out a const pointer.
+template <> struct ValueAccess<std::string> {
+  static constexpr Value::Type type = Value::Type::String;
+  static const std::string *get(const Value &v) { return &v.string_->value; }
+};
+
+#define LUMA_VALUE_ACCESS(TAG, MEMBER, PTR)                                    \
+  template <> struct ValueAccess<PTR> {                                        \
+    static constexpr Value::Type type = Value::Type::TAG;                      \
+    static PTR *get(Value &v) { return &v.MEMBER; }                            \
+    static const PTR *get(const Value &v) { return &v.MEMBER; }                \
+  };
+LUMA_VALUE_ACCESS(Function, function_, FunctionPtr)
+LUMA_VALUE_ACCESS(List, list_, ListPtr)
+LUMA_VALUE_ACCESS(Class, class_, ClassPtr)
+LUMA_VALUE_ACCESS(Instance, instance_, InstancePtr)
+LUMA_VALUE_ACCESS(Map, map_, MapPtr)
+LUMA_VALUE_ACCESS(Native, native_, NativeFunctionPtr)
+LUMA_VALUE_ACCESS(Buffer, buffer_, BufferPtr)
+#undef LUMA_VALUE_ACCESS
+#undef LUMA_VALUE_OBJECTS
+
+template <class T> bool holds_alternative(const Value &v) {
+  return v.type() == ValueAccess<T>::type;
+}
+
+template <class T> auto get_if(Value *v) -> decltype(ValueAccess<T>::get(*v)) {
+  return v && v->type() == ValueAccess<T>::type ? ValueAccess<T>::get(*v)
+                                                : nullptr;
+}
+
+template <class T>
+auto get_if(const Value *v) -> decltype(ValueAccess<T>::get(*v)) {
+  return v && v->type() == ValueAccess<T>::type ? ValueAccess<T>::get(*v)
+                                                : nullptr;
+}
+
+template <class T> auto get(Value &v) -> decltype(*ValueAccess<T>::get(v)) {
+  if (v.type() != ValueAccess<T>::type)
+    throw std::bad_variant_access();
+  return *ValueAccess<T>::get(v);
+}
+
+template <class T>
+auto get(const Value &v) -> decltype(*ValueAccess<T>::get(v)) {
+  if (v.type() != ValueAccess<T>::type)
+    throw std::bad_variant_access();
+  return *ValueAccess<T>::get(v);
+}
+
 inline bool isNil(const Value &v) {
-  return std::holds_alternative<std::monostate>(v);
+  return holds_alternative<std::monostate>(v);
 }
 
 inline bool isTruthy(const Value &v) {
-  if (std::holds_alternative<std::monostate>(v))
+  if (holds_alternative<std::monostate>(v))
     return false;
-  if (auto b = std::get_if<bool>(&v))
+  if (auto b = get_if<bool>(&v))
     return *b;
   return true; // numbers, strings, functions, lists, classes, instances, maps
                // are truthy
@@ -132,19 +425,19 @@ inline std::string numberToString(double d) {
 }
 
 inline std::string valueToString(const Value &v) {
-  if (std::holds_alternative<std::monostate>(v))
+  if (holds_alternative<std::monostate>(v))
     return "nil";
-  if (auto d = std::get_if<double>(&v))
+  if (auto d = get_if<double>(&v))
     return numberToString(*d);
-  if (auto s = std::get_if<std::string>(&v))
+  if (auto s = get_if<std::string>(&v))
     return *s;
-  if (auto b = std::get_if<bool>(&v))
+  if (auto b = get_if<bool>(&v))
     return *b ? "true" : "false";
-  if (auto f = std::get_if<FunctionPtr>(&v))
-    return "<fn " + (*f)->name.lexeme + ">";
-  if (auto n = std::get_if<NativeFunctionPtr>(&v))
+  if (auto f = get_if<FunctionPtr>(&v))
+    return "<fn " + std::string((*f)->name.lexeme) + ">";
+  if (auto n = get_if<NativeFunctionPtr>(&v))
       return "<native fn " + (*n)->name + ">";
-  if (auto l = std::get_if<ListPtr>(&v)) {
+  if (auto l = get_if<ListPtr>(&v)) {
     std::string s = "[";
     const auto &elems = (*l)->elements;
     for (size_t i = 0; i < elems.size(); i++) {
@@ -155,13 +448,16 @@ inline std::string valueToString(const Value &v) {
     s += "]";
     return s;
   }
-  if (auto c = std::get_if<ClassPtr>(&v)) {
+  if (auto c = get_if<ClassPtr>(&v)) {
     return "<class " + (*c)->name + ">";
   }
-  if (auto i = std::get_if<InstancePtr>(&v)) {
+  if (auto i = get_if<InstancePtr>(&v)) {
     return "<instance " + (*i)->klass->name + ">";
   }
-  if (auto m = std::get_if<MapPtr>(&v)) {
+  if (auto b = get_if<BufferPtr>(&v)) {
+    return "<buffer " + std::to_string((*b)->bytes.size()) + " bytes>";
+  }
+  if (auto m = get_if<MapPtr>(&v)) {
     std::string s = "{";
     const auto &map = (*m)->values;
     int k = 0;
@@ -184,24 +480,94 @@ inline bool valuesEqual(const Value &a, const Value &b) {
   }
   if (isNil(a) && isNil(b))
     return true;
-  if (auto da = std::get_if<double>(&a))
-    return *da == std::get<double>(b);
-  if (auto sa = std::get_if<std::string>(&a))
-    return *sa == std::get<std::string>(b);
-  if (auto ba = std::get_if<bool>(&a))
-    return *ba == std::get<bool>(b);
-  if (auto fa = std::get_if<FunctionPtr>(&a))
-    return fa->get() == std::get<FunctionPtr>(b).get();
-  if (auto la = std::get_if<ListPtr>(&a))
+  if (auto da = get_if<double>(&a))
+    return *da == get<double>(b);
+  if (auto sa = get_if<std::string>(&a))
+    return *sa == get<std::string>(b);
+  if (auto ba = get_if<bool>(&a))
+    return *ba == get<bool>(b);
+  if (auto fa = get_if<FunctionPtr>(&a))
+    return fa->get() == get<FunctionPtr>(b).get();
+  if (auto la = get_if<ListPtr>(&a))
     return la->get() ==
-           std::get<ListPtr>(b).get(); // pointer equality for lists
-  if (auto ca = std::get_if<ClassPtr>(&a))
-    return ca->get() == std::get<ClassPtr>(b).get();
-  if (auto ia = std::get_if<InstancePtr>(&a))
-    return ia->get() == std::get<InstancePtr>(b).get();
-  if (auto ma = std::get_if<MapPtr>(&a))
-    return ma->get() == std::get<MapPtr>(b).get();
-   if (auto na = std::get_if<NativeFunctionPtr>(&a))
-    return na->get() == std::get<NativeFunctionPtr>(b).get(); // pointer equality
+           get<ListPtr>(b).get(); // pointer equality for lists
+  if (auto ca = get_if<ClassPtr>(&a))
+    return ca->get() == get<ClassPtr>(b).get();
+  if (auto ia = get_if<InstancePtr>(&a))
+    return ia->get() == get<InstancePtr>(b).get();
+  if (auto ma = get_if<MapPtr>(&a))
+    return ma->get() == get<MapPtr>(b).get();
+   if (auto na = get_if<NativeFunctionPtr>(&a))
+    return na->get() == get<NativeFunctionPtr>(b).get(); // pointer equality
+  if (auto bu = get_if<BufferPtr>(&a))
+    return bu->get() == get<BufferPtr>(b).get(); // like lists; see equals()
   return false;
 }
+
+// ---------- cycle collection (see GcObject) ----------
+
+inline GcObject *gcObjectOf(const Value &v) {
+  switch (v.type()) {
+  case Value::Type::Function:
+    return get<FunctionPtr>(v).get();
+  case Value::Type::List:
+    return get<ListPtr>(v).get();
+  case Value::Type::Class:
+    return get<ClassPtr>(v).get();
+  case Value::Type::Instance:
+    return get<InstancePtr>(v).get();
+  case Value::Type::Map:
+    return get<MapPtr>(v).get();
+  default:
+    return nullptr;
+  }
+}
+
+inline void gcTrace(const Value &v, GcVisitor visit, void *context) {
+  if (GcObject *object = gcObjectOf(v))
+    visit(object, context);
+}
+
+// The clearRefs() below move the contents out first, so whatever their
+// destructors release never sees a half-cleared container.
+
+inline void List::traceRefs(GcVisitor visit, void *context) const {
+  for (const Value &element : elements)
+    gcTrace(element, visit, context);
+}
+
+inline void List::clearRefs() { std::vector<Value>().swap(elements); }
+
+inline void LumaMap::traceRefs(GcVisitor visit, void *context) const {
+  for (const auto &entry : values)
+    gcTrace(entry.second, visit, context);
+}
+
+inline void LumaMap::clearRefs() {
+  OrderedMap<Value> dropped = std::move(values);
+  values.clear();
+}
+
+inline void LumaClass::traceRefs(GcVisitor visit, void *context) const {
+  for (const auto &entry : methods)
+    if (entry.second)
+      visit(entry.second.get(), context);
+}
+
+inline void LumaClass::clearRefs() {
+  std::unordered_map<Symbol, FunctionPtr>().swap(methods);
+}
+
+// The class stays: the shape belongs to it, and no cycle runs only through
+// instance-to-class edges.
+inline void LumaInstance::traceRefs(GcVisitor visit, void *context) const {
+  if (klass)
+    visit(klass.get(), context);
+  for (const Value &field : fields)
+    gcTrace(field, visit, context);
+}
+
+inline void LumaInstance::clearRefs() {
+  shape = klass->rootShape.get();
+  std::vector<Value>().swap(fields);
+}
@@ -0,0 +1,334 @@
+#include "vm.hpp"
+#include "compiler.hpp"
+#include "gc.hpp"
+#include "interpreter.hpp"
+#include <iostream>
+#include <stdexcept>
+
+VM::VM(Interpreter &interp) : interp_(interp) { stack_.reserve(256); }
+
+const Chunk &VM::chunkFor(const BlockStmt &body) {
+  if (!body.compiled) {
+    body.compiled = Compiler().compileFunction(body);
+  }
+  return *body.compiled;
+}
+
+Value VM::run(const Chunk &chunk, Ref<Environment> env) {
+  Ref<Environment> previous = std::move(interp_.env_);
+  interp_.env_ = std::move(env);
+  const size_t base = stack_.size();
+  std::vector<Handler> handlers;
+  uint32_t ip = 0;
+
+  for (;;) {
+    try {
+      Value result = execute(chunk, ip, handlers);
+      stack_.resize(base);
+      interp_.env_ = std::move(previous);
+      return result;
+    } catch (const std::runtime_error &) {
+      if (handlers.empty()) {
+        stack_.resize(base);
+        interp_.env_ = std::move(previous);
+        throw;
+      }
+      // Innermost maybe block: unwind to where it started and run its
+      // otherwise branch.
+      Handler h = std::move(handlers.back());
+      handlers.pop_back();
+      stack_.resize(h.stackDepth);
+      interp_.env_ = std::move(h.env);
+      ip = h.target;
+    } catch (...) {
+      stack_.resize(base);
+      interp_.env_ = std::move(previous);
+      throw;
+    }
+  }
+}
+
+// Arithmetic and comparison with an inline fast path for two numbers; every
+// other operand combination (and every error) goes through the interpreter's
+// shared semantics.
+#define NUMERIC_BINARY(OP, RESULT)                                             \
+  {                                                                            \
+    Value right = pop();                                                       \
+    Value &left = stack_.back();                                               \
+    double *x = get_if<double>(&left);                                    \
+    double *y = get_if<double>(&right);                                   \
+    if (x && y) {                                                              \
+      left = RESULT(*x OP * y);                                                \
+    } else {                                                                   \
+      left = interp_.binaryOp(chunk.tokens[in.a], left, right);                \
+    }                                                                          \
+    break;                                                                     \
+  }
+
+#define SLOW_BINARY()                                                          \
+  {                                                                            \
+    Value right = pop();                                                       \
+    Value &left = stack_.back();                                               \
+    left = interp_.binaryOp(chunk.tokens[in.a], left, right);                  \
+    break;                                                                     \
+  }
+
+Value VM::execute(const Chunk &chunk, uint32_t ip,
+                  std::vector<Handler> &handlers) {
+  const Instruction *code = chunk.code.data();
+
+  for (;;) {
+    const Instruction &in = code[ip++];
+    switch (in.op) {
+    case OpCode::Constant:
+      push(chunk.constants[in.a]);
+      break;
+    case OpCode::Nil:
+      push(std::monostate{});
+      break;
+    case OpCode::True:
+      push(true);
+      break;
+    case OpCode::False:
+      push(false);
+      break;
+    case OpCode::Pop:
+      stack_.pop_back();
+      break;
+
+    case OpCode::GetLocal:
+      push(interp_.env_->ancestor(in.a)->slot(in.b));
+      break;
+    case OpCode::SetLocal:
+      interp_.env_->ancestor(in.a)->setSlot(in.b, pop());
+      break;
+    case OpCode::GetVar:
+      push(interp_.env_->get(chunk.tokens[in.a]));
+      break;
+    case OpCode::SetVar:
+      interp_.assignOrDefine(chunk.tokens[in.a], pop());
+      break;
+    case OpCode::Swap:
+      interp_.executeSwap(static_cast<const SwapStmt &>(*chunk.stmts[in.a]));
+      break;
+    case OpCode::Append: {
+      const auto &assign =
+          static_cast<const VarAssignStmt &>(*chunk.stmts[in.a]);
+      Value right = pop();
+      Value left = pop();
+      interp_.appendAssign(assign.name, assign.slot, std::move(left), right);
+      break;
+    }
+
+    case OpCode::Negate: {
+      Value &top = stack_.back();
+      if (double *d = get_if<double>(&top))
+        *d = -*d;
+      else
+        top = interp_.unaryOp(chunk.tokens[in.a], top);
+      break;
+    }
+    case OpCode::Not: {
+      Value &top = stack_.back();
+      top = !isTruthy(top);
+      break;
+    }
+    case OpCode::Add:
+      NUMERIC_BINARY(+, double)
+    case OpCode::Subtract:
+      NUMERIC_BINARY(-, double)
+    case OpCode::Multiply:
+      NUMERIC_BINARY(*, double)
+    case OpCode::Divide: {
+      Value right = pop();
+      Value &left = stack_.back();
+      double *x = get_if<double>(&left);
+      double *y = get_if<double>(&right);
+      if (x && y && *y != 0.0)
+        left = *x / *y;
+      else
+        left = interp_.binaryOp(chunk.tokens[in.a], left, right);
+      break;
+    }
+    case OpCode::Greater:
+      NUMERIC_BINARY(>, bool)
+    case OpCode::GreaterEqual:
+      NUMERIC_BINARY(>=, bool)
+    case OpCode::Less:
+      NUMERIC_BINARY(<, bool)
+    case OpCode::LessEqual:
+      NUMERIC_BINARY(<=, bool)
+    case OpCode::BitAnd:
+    case OpCode::BitOr:
+    case OpCode::ShiftLeft:
+    case OpCode::ShiftRight:
+      SLOW_BINARY()
+    case OpCode::Equal: {
+      Value right = pop();
+      Value &left = stack_.back();
+      left = valuesEqual(left, right);
+      break;
+    }
+    case OpCode::NotEqual: {
+      Value right = pop();
+      Value &left = stack_.back();
+      left = !valuesEqual(left, right);
+      break;
+    }
+
+    case OpCode::Jump:
+      if (in.a < ip) // loop back-edge
+        gcMaybeCollect();
+      ip = in.a;
+      break;
+    case OpCode::JumpIfFalse:
+      if (!isTruthy(pop()))
+        ip = in.a;
+      break;
+    case OpCode::JumpIfTrue:
+      if (isTruthy(pop()))
+        ip = in.a;
+      break;
+    case OpCode::JumpIfFalseKeep:
+      if (!isTruthy(stack_.back()))
+        ip = in.a;
+      break;
+    case OpCode::JumpIfTrueKeep:
+      if (isTruthy(stack_.back()))
+        ip = in.a;
+      break;
+
+    case OpCode::Call: {
+      const size_t calleeAt = stack_.size() - in.a - 1;
+      std::vector<Value> args(std::make_move_iterator(stack_.begin() + calleeAt + 1),
+                              std::make_move_iterator(stack_.end()));
+      Value callee = std::move(stack_[calleeAt]);
+      stack_.resize(calleeAt);
+      if (!holds_alternative<FunctionPtr>(callee) &&
+          !holds_alternative<ClassPtr>(callee) &&
+          !holds_alternative<NativeFunctionPtr>(callee)) {
+        throw std::runtime_error("Can only call functions and classes.");
+      }
+      push(interp_.callFunction(callee, args, chunk.tokens[in.b]));
+      break;
+    }
+    case OpCode::GetMethod: {
+      const auto &get = static_cast<const GetExpr &>(*chunk.exprs[in.a]);
+      Value object = pop();
+      Value receiver;
+      push(interp_.getMethod(object, get.name, &get.cache, receiver));
+      push(std::move(receiver));
+      break;
+    }
+    case OpCode::Invoke: {
+      const size_t calleeAt = stack_.size() - in.a - 2;
+      std::vector<Value> args(std::make_move_iterator(stack_.begin() + calleeAt + 2),
+                              std::make_move_iterator(stack_.end()));
+      Value callee = std::move(stack_[calleeAt]);
+      Value receiver = std::move(stack_[calleeAt + 1]);
+      stack_.resize(calleeAt);
+      push(interp_.invoke(callee, receiver, args, chunk.tokens[in.b]));
+      break;
+    }
+    case OpCode::BuildList: {
+      auto list = makeRef<List>();
+      const size_t first = stack_.size() - in.a;
+      list->elements.assign(std::make_move_iterator(stack_.begin() + first),
+                            std::make_move_iterator(stack_.end()));
+      stack_.resize(first);
+      push(std::move(list));
+      break;
+    }
+    case OpCode::BuildMap: {
+      auto map = makeRef<LumaMap>(static_cast<size_t>(in.a));
+      const size_t first = stack_.size() - 2 * static_cast<size_t>(in.a);
+      for (size_t i = first; i < stack_.size(); i += 2) {
+        auto s = get_if<std::string>(&stack_[i]);
+        if (!s)
+          throw std::runtime_error("Map keys must be strings.");
+        map->values[*s] = std::move(stack_[i + 1]);
+      }
+      stack_.resize(first);
+      push(std::move(map));
+      break;
+    }
+    case OpCode::GetProperty: {
+      const auto &get = static_cast<const GetExpr &>(*chunk.exprs[in.a]);
+      Value object = pop();
+      push(interp_.getProperty(object, get.name, &get.cache));
+      break;
+    }
+    case OpCode::SetProperty: {
+      const auto &set = static_cast<const SetExpr &>(*chunk.exprs[in.a]);
+      Value value = pop();
+      Value object = pop();
+      push(interp_.setProperty(object, set.name, std::move(value), &set.cache));
+      break;
+    }
+    case OpCode::GetIndex: {
+      Value index = pop();
+      Value object = pop();
+      push(interp_.getIndex(object, index));
+      break;
+    }
+    case OpCode::SetIndex: {
+      Value value = pop();
+      Value index = pop();
+      Value object = pop();
+      push(interp_.setIndex(object, index, std::move(value)));
+      break;
+    }
+
+    case OpCode::Print:
+      std::cout << valueToString(pop()) << "\n";
+      break;
+    case OpCode::PushScope:
+      interp_.env_ = interp_.envPool_.acquire(interp_.env_, chunk.scopes[in.a]);
+      break;
+    case OpCode::PopScope: {
+      Ref<Environment> enclosing = interp_.env_->enclosing();
+      interp_.envPool_.release(interp_.env_);
+      interp_.env_ = std::move(enclosing);
+      break;
+    }
+    case OpCode::EchoInit: {
+      Value count = pop();
+      push(static_cast<double>(interp_.echoCount(count)));
+      break;
+    }
+    case OpCode::EchoNext: {
+      double &remaining = get<double>(stack_.back());
+      if (remaining <= 0) {
+        stack_.pop_back();
+        ip = in.a;
+      } else {
+        remaining -= 1;
+      }
+      break;
+    }
+    case OpCode::MaybeBegin:
+      handlers.push_back({in.a, stack_.size(), interp_.env_});
+      break;
+    case OpCode::MaybeEnd:
+      handlers.pop_back();
+      break;
+    case OpCode::Exec:
+      (void)interp_.execute(*chunk.stmts[in.a]);
+      break;
+    case OpCode::Export: {
+      const Token &name = chunk.tokens[in.a];
+      interp_.currentExports_->values[name.lexeme] = interp_.env_->get(name);
+      break;
+    }
+    case OpCode::Return:
+      return pop();
+    case OpCode::ReturnOutside:
+      // Not a runtime_error: a stray return must not be swallowed by an
+      // enclosing maybe block.
+      throw std::logic_error("Return used outside of a function.");
+    }
+  }
+}
+
+#undef NUMERIC_BINARY
+#undef SLOW_BINARY
@@ -0,0 +1,45 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "bytecode.hpp"
+#include "environment.hpp"
+#include "value.hpp"
+
+class Interpreter;
+
+// Stack machine that executes compiled chunks. It shares the interpreter's
+// runtime (environments, module system, natives, call semantics), so code
+// running on the VM and on the tree walker can call into each other freely.
+class VM {
+public:
+  explicit VM(Interpreter &interp);
+
+  // Runs `chunk` with `env` as the current environment and returns the value
+  // of its Return instruction. The interpreter's environment is restored on
+  // every exit, including exceptions.
+  Value run(const Chunk &chunk, Ref<Environment> env);
+
+  // Bytecode for a function body, compiled on first use.
+  const Chunk &chunkFor(const BlockStmt &body);
+
+private:
+  struct Handler {
+    uint32_t target;
+    size_t stackDepth;
+    Ref<Environment> env;
+  };
+
+  Interpreter &interp_;
+  std::vector<Value> stack_;
+
+  Value execute(const Chunk &chunk, uint32_t ip,
+                std::vector<Handler> &handlers);
+
+  void push(Value v) { stack_.push_back(std::move(v)); }
+  Value pop() {
+    Value v = std::move(stack_.back());
+    stack_.pop_back();
+    return v;
+  }
+};
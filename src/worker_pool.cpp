@@ -0,0 +1,168 @@
+#include "worker_pool.hpp"
+#include "gc.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WorkerPool::WorkerPool(Config config)
+    : config_(std::move(config)), queue_(config_.queueSize) {
+  const size_t count = config_.workers ? config_.workers : 1;
+  threads_.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    threads_.emplace_back([this] { workerMain(); });
+
+  std::unique_lock<std::mutex> lock(startMutex_);
+  started_.wait(lock, [&] { return ready_ == count; });
+  if (!startError_.empty()) {
+    const std::string error = startError_;
+    lock.unlock();
+    shutdown();
+    throw std::runtime_error(error);
+  }
+}
+
+WorkerPool::~WorkerPool() { shutdown(); }
+
+void WorkerPool::shutdown() {
+  stopping_.store(true);
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    wake_.notify_all();
+  }
+  for (std::thread &t : threads_) {
+    if (t.joinable())
+      t.join();
+  }
+}
+
+// -------------------- workers --------------------
+
+void WorkerPool::workerMain() {
+  serve();
+  // The interpreter collected its own cycles when serve() destroyed it;
+  // this catches anything the handler's calls left on the thread's heap
+  // besides, which would otherwise be lost when the thread exits.
+  gcCollect();
+}
+
+void WorkerPool::serve() {
+  Interpreter interp;
+  Value handler; // declared after interp so it is released first
+  std::string error;
+  try {
+    interp.setEngine(config_.engine);
+    interp.setOptimize(config_.optimize);
+    if (!config_.executablePath.empty())
+      interp.setExecutablePath(config_.executablePath);
+    if (!config_.entryFile.empty())
+      interp.setEntryFile(config_.entryFile);
+    MapPtr exports = interp.importModule(config_.handlerModule);
+    auto it = exports->values.find(config_.handlerName);
+    if (it == exports->values.end())
+      throw std::runtime_error("Module " + config_.handlerModule +
+                               " has no export '" + config_.handlerName + "'");
+    handler = it->second;
+  } catch (const std::exception &e) {
+    error = e.what();
+  }
+  {
+    std::lock_guard<std::mutex> lock(startMutex_);
+    if (!error.empty() && startError_.empty())
+      startError_ = "Worker failed to load handler: " + error;
+    ++ready_;
+    started_.notify_one();
+  }
+  if (!error.empty())
+    return;
+
+  Connection connection;
+  while (next(connection)) {
+    auto conn = makeRef<LumaMap>(3);
+    conn->values["fd"] = static_cast<double>(connection.fd);
+    conn->values["address"] = connection.address;
+    conn->values["port"] = static_cast<double>(connection.port);
+    try {
+      (void)interp.call(handler, {Value(conn)});
+    } catch (const std::exception &e) {
+      // One write per line so reports from different workers don't mix.
+      std::cerr << ("Worker error: " + std::string(e.what()) + "\n");
+    }
+    // The pool owns the socket: a handler closing it could close a
+    // descriptor another worker has been handed in the meantime.
+    close(connection.fd);
+    gcMaybeCollect();
+    handled_.fetch_add(1);
+    std::lock_guard<std::mutex> lock(doneMutex_);
+    done_.notify_all();
+  }
+}
+
+bool WorkerPool::next(Connection &out) {
+  for (;;) {
+    if (queue_.tryPop(out))
+      return true;
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    sleepers_.fetch_add(1);
+    // Pairs with the fence in submit(): either the producer sees this
+    // sleeper and notifies, or this check sees its connection.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake_.wait(lock, [&] { return stopping_.load() || !queue_.empty(); });
+    sleepers_.fetch_sub(1);
+    if (stopping_.load() && queue_.empty())
+      return false;
+  }
+}
+
+void WorkerPool::submit(Connection connection) {
+  while (!queue_.tryPush(connection))
+    std::this_thread::yield(); // every worker is busy; apply backpressure
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers_.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    wake_.notify_one();
+  }
+}
+
+// -------------------- acceptor --------------------
+
+size_t WorkerPool::serve(int listenFd, size_t maxConnections) {
+  const size_t base = handled_.load();
+  size_t accepted = 0;
+  while (maxConnections == 0 || accepted < maxConnections) {
+    sockaddr_in peer;
+    socklen_t length = sizeof(peer);
+    const int fd = accept(listenFd, reinterpret_cast<sockaddr *>(&peer),
+                          &length);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // A listener left non-blocking for @std.reactor: wait for a peer.
+        pollfd p{listenFd, POLLIN, 0};
+        (void)::poll(&p, 1, -1);
+        continue;
+      }
+      throw std::runtime_error(std::string("workers.serve accept: ") +
+                               std::strerror(errno));
+    }
+    Connection connection;
+    connection.fd = fd;
+    char address[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &peer.sin_addr, address, sizeof(address));
+    connection.address = address;
+    connection.port = ntohs(peer.sin_port);
+    submit(std::move(connection));
+    ++accepted;
+  }
+
+  std::unique_lock<std::mutex> lock(doneMutex_);
+  done_.wait(lock, [&] { return handled_.load() - base >= accepted; });
+  return accepted;
+}
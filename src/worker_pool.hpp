@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "mpmc_queue.hpp"
+
+// Serves accepted TCP connections from a pool of threads (@std.workers).
+//
+// Values are not thread-safe (reference counts are plain integers), so
+// nothing Luma-level is shared: every worker owns an Interpreter with its
+// own globals and module cache, loads the handler module itself and calls
+// the exported handler with each connection it takes. Only file descriptors
+// and peer addresses cross threads, through a lock-free queue.
+class WorkerPool {
+public:
+  struct Config {
+    // Copied from the spawning interpreter so modules resolve the same way.
+    std::string executablePath;
+    std::string entryFile;
+    Interpreter::Engine engine = Interpreter::Engine::TreeWalker;
+    bool optimize = false;
+
+    std::string handlerModule; // module ID, e.g. "@app.handlers"
+    std::string handlerName;   // exported function called as handler(conn)
+    size_t workers = 1;
+    size_t queueSize = 1024;
+  };
+
+  // Starts the workers and waits until each one has loaded the handler.
+  // Throws std::runtime_error with the first worker's load error, if any.
+  explicit WorkerPool(Config config);
+  ~WorkerPool(); // drains queued connections, then joins the workers
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Accepts connections on `listenFd` and hands them to the workers until
+  // `maxConnections` have been accepted (0: forever). A full queue blocks
+  // the acceptor rather than dropping connections. Returns once every
+  // accepted connection has been handled; the count is returned.
+  size_t serve(int listenFd, size_t maxConnections);
+
+private:
+  struct Connection {
+    int fd = -1;
+    std::string address;
+    int port = 0;
+  };
+
+  Config config_;
+  MpmcQueue<Connection> queue_;
+  std::vector<std::thread> threads_;
+
+  // Idle workers sleep here; producers only take the lock when one is.
+  std::mutex sleepMutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> sleepers_{0};
+  std::atomic<bool> stopping_{false};
+
+  // Startup handshake
+  std::mutex startMutex_;
+  std::condition_variable started_;
+  size_t ready_ = 0;
+  std::string startError_;
+
+  std::atomic<size_t> handled_{0};
+  std::mutex doneMutex_;
+  std::condition_variable done_;
+
+  void workerMain();
+  void serve(); // loads the handler and runs connections until shutdown
+  bool next(Connection &out);
+  void submit(Connection connection);
+  void shutdown();
+};
@@ -0,0 +1,147 @@
+// Checks the embedding API in src/luma.h from plain C: compiled scripts,
+// luma_call, host natives and value handles. Run by ctest; exits non-zero
+// on the first failed check.
+
+#include "luma.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,         \
+                    __LINE__, #cond);                                      \
+            ++failures;                                                    \
+        }                                                                  \
+    } while (0)
+
+// Returns its argument handle itself, which the interpreter must copy
+// rather than free.
+static LumaValue* ident(LumaInterpreter* interp, LumaValue* const* args,
+                        int argc, void* userdata) {
+    (void)interp;
+    (void)argc;
+    (void)userdata;
+    return args[0];
+}
+
+static LumaValue* ident_copy(LumaInterpreter* interp, LumaValue* const* args,
+                             int argc, void* userdata) {
+    (void)interp;
+    (void)argc;
+    (void)userdata;
+    return luma_value_copy(args[0]);
+}
+
+static LumaValue* sum(LumaInterpreter* interp, LumaValue* const* args,
+                      int argc, void* userdata) {
+    (void)interp;
+    (void)userdata;
+    double total = 0;
+    for (int i = 0; i < argc; ++i) {
+        total += luma_value_number(args[i]);
+    }
+    return luma_number(total);
+}
+
+static LumaValue* fail(LumaInterpreter* interp, LumaValue* const* args,
+                       int argc, void* userdata) {
+    (void)args;
+    (void)argc;
+    luma_native_error(interp, (const char*)userdata);
+    return NULL;
+}
+
+static int string_is(const LumaValue* value, const char* expected) {
+    size_t size;
+    const char* data = luma_value_string(value, &size);
+    return data && size == strlen(expected) &&
+           memcmp(data, expected, size) == 0;
+}
+
+static void run_checks(LumaEngine engine) {
+    LumaInterpreter* interp = luma_create();
+    luma_set_engine(interp, engine);
+
+    CHECK(luma_register_native(interp, NULL, "ident", 1, ident, NULL) == 0);
+    CHECK(luma_register_native(interp, NULL, "ident_copy", 1, ident_copy,
+                               NULL) == 0);
+    CHECK(luma_register_native(interp, "@app.host", "sum", -1, sum, NULL) ==
+          0);
+    CHECK(luma_register_native(interp, NULL, "fail", 0, fail,
+                               "host failure") == 0);
+    CHECK(luma_register_native(interp, "no_at", "f", 0, sum, NULL) == 1);
+
+    // Natives returning a borrowed argument, directly and copied.
+    CHECK(luma_run_string(interp,
+                          "a = ident(\"hello\")\n"
+                          "b = ident_copy([1, 2])\n"
+                          "def same(x) { return ident(x) }\n",
+                          0) == 0);
+
+    LumaValue* result = NULL;
+    LumaValue* arg = luma_string("borrowed", 8);
+    CHECK(luma_call(interp, "same", &arg, 1, &result) == 0);
+    CHECK(string_is(result, "borrowed"));
+    CHECK(string_is(arg, "borrowed"));
+    luma_value_free(result);
+    luma_value_free(arg);
+
+    // A compiled script runs repeatedly against the same globals.
+    CHECK(luma_run_string(interp, "count = 0\n", 0) == 0);
+    LumaScript* script = luma_compile(
+        interp,
+        "use @app.host as host\n"
+        "count = count + host.sum(1, 2, 3)\n"
+        "def rule(n, buf) {\n"
+        "  buf[0] = 65\n"
+        "  return n * 2\n"
+        "}\n");
+    CHECK(script != NULL);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(luma_script_run(interp, script) == 0);
+    }
+    CHECK(luma_call(interp, "ident", NULL, 0, NULL) == 1); // wrong arity
+    LumaValue* count_args[1] = {NULL};
+    CHECK(luma_call(interp, "ident", count_args, 1, &result) == 0);
+    CHECK(luma_value_type(result) == LUMA_TYPE_NIL);
+    luma_value_free(result);
+
+    // Buffers are shared with Luma, so the rule's write is visible here.
+    LumaValue* rule_args[2] = {luma_number(21), luma_buffer(4)};
+    CHECK(luma_call(interp, "rule", rule_args, 2, &result) == 0);
+    CHECK(luma_value_type(result) == LUMA_TYPE_NUMBER);
+    CHECK(luma_value_number(result) == 42);
+    size_t size = 0;
+    unsigned char* bytes = luma_value_buffer(rule_args[1], &size);
+    CHECK(bytes && size == 4 && bytes[0] == 65);
+    luma_value_free(result);
+    luma_value_free(rule_args[0]);
+    luma_value_free(rule_args[1]);
+
+    LumaValue* total = NULL;
+    CHECK(luma_run_string(interp, "def total() { return count }\n", 0) == 0);
+    CHECK(luma_call(interp, "total", NULL, 0, &total) == 0);
+    CHECK(luma_value_number(total) == 18);
+    luma_value_free(total);
+
+    // Errors: a native raising one, and a missing function.
+    CHECK(luma_call(interp, "fail", NULL, 0, NULL) == 1);
+    CHECK(luma_call(interp, "missing", NULL, 0, NULL) == 1);
+
+    luma_destroy(interp);
+}
+
+int main(void) {
+    run_checks(LUMA_ENGINE_AST);
+    run_checks(LUMA_ENGINE_VM);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("embed checks passed\n");
+    return 0;
+}